@@ -0,0 +1,180 @@
+// Scheduler overhead of the job system: empty jobs, nested spawning, dependency chains, main thread jobs and
+// parallelFor at several batch sizes against a plain loop.
+//   job_bench [--workers 1,2,4,8] [--jobs 1000000] [--runs 3] [--pin]
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "job_system.h"
+
+struct BenchOptions {
+    std::vector<uint32_t> workers{};
+    uint32_t jobs = {1'000'000u};
+    uint32_t runs = {3u};
+    bool pin = {false};
+};
+
+BenchOptions parseOptions(int argc, char **argv) {
+    BenchOptions options{};
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--workers" && i + 1 < argc) {
+            std::stringstream list(argv[++i]);
+            for (std::string count; std::getline(list, count, ',');) {
+                options.workers.push_back(std::max(1u, static_cast<uint32_t>(std::stoul(count))));
+            }
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            options.jobs = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+        } else if (arg == "--runs" && i + 1 < argc) {
+            options.runs = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+        } else if (arg == "--pin") {
+            options.pin = true;
+        } else {
+            throw std::runtime_error(std::format("Unknown option {}\nusage: job_bench [--workers 1,2,4,8] [--jobs 1000000] [--runs 3] [--pin]", arg));
+        }
+    }
+    if (options.workers.empty()) {
+        uint32_t maxWorkers = std::max(std::thread::hardware_concurrency(), 2u) - 1u;
+        for (uint32_t count = 1u; count < maxWorkers; count *= 2u) {
+            options.workers.push_back(count);
+        }
+        options.workers.push_back(maxWorkers);
+    }
+    return options;
+}
+
+double bestMs(uint32_t runs, const std::function<void()> &run) {
+    double best = std::numeric_limits<double>::max();
+    for (uint32_t i = 0u; i < runs; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+void report(const std::string &name, double ms, uint64_t jobs) {
+    std::cout << std::format("[JobBench]   {:<28} {:>10.2f} ms {:>9.1f} ns/job {:>8.2f} Mjobs/s", name, ms, ms * 1e6 / jobs,
+                             jobs / ms / 1e3) << std::endl;
+}
+
+// payload small enough that the result is dominated by the scheduler
+void spin(std::atomic<uint64_t> &sink, uint64_t value) {
+    sink.fetch_add(value, std::memory_order_relaxed);
+}
+
+// every job spawns two children until depth is reached, all spawning happens on workers and spreads by stealing
+void spawnTree(JobSystem &system, JobCounter &counter, std::atomic<uint64_t> &sink, uint32_t depth) {
+    spin(sink, depth);
+    if (depth == 0u) {
+        return;
+    }
+    for (uint32_t child = 0u; child < 2u; ++child) {
+        runJob(system, [&system, &counter, &sink, depth] { spawnTree(system, counter, sink, depth - 1u); }, &counter);
+    }
+}
+
+void benchmarkWorkers(const BenchOptions &options, uint32_t workers) {
+    JobSystem system{};
+    startJobSystem(system, {.workers = workers, .pinWorkers = options.pin});
+    std::atomic<uint64_t> sink{0u};
+    std::cout << std::format("[JobBench] {} workers{}", workers, options.pin ? ", pinned" : "") << std::endl;
+
+    double ms = bestMs(options.runs, [&] {
+        for (uint32_t i = 0u; i < options.jobs; ++i) {
+            std::function<void()> job = [&sink, i] { spin(sink, i); };
+            job();
+        }
+    });
+    report("direct calls (baseline)", ms, options.jobs);
+
+    ms = bestMs(options.runs, [&] {
+        JobCounter counter{};
+        for (uint32_t i = 0u; i < options.jobs; ++i) {
+            runJob(system, [&sink, i] { spin(sink, i); }, &counter);
+        }
+        waitJobs(system, counter);
+    });
+    report("spawn from main + wait", ms, options.jobs);
+
+    auto depth = uint32_t(std::bit_width(options.jobs) - 1u);
+    uint64_t treeJobs = (2ull << depth) - 1u;
+    ms = bestMs(options.runs, [&] {
+        JobCounter counter{};
+        runJob(system, [&] { spawnTree(system, counter, sink, depth); }, &counter);
+        waitJobs(system, counter);
+    });
+    report("nested binary tree", ms, treeJobs);
+
+    // each link waits for the previous one, measures wake up latency rather than throughput
+    uint32_t chainLength = std::min(options.jobs, 10'000u);
+    ms = bestMs(options.runs, [&] {
+        std::vector<JobCounter> links(chainLength);
+        runJob(system, [&sink] { spin(sink, 1u); }, &links[0]);
+        for (uint32_t i = 1u; i < chainLength; ++i) {
+            runJobAfter(system, links[i - 1u], [&sink] { spin(sink, 1u); }, &links[i]);
+        }
+        for (auto &link : links) {
+            waitJobs(system, link);
+        }
+    });
+    report("dependency chain", ms, chainLength);
+
+    ms = bestMs(options.runs, [&] {
+        JobCounter counter{};
+        for (uint32_t i = 0u; i < options.jobs; ++i) {
+            runJob(system, [&system, &sink, &counter, i] { runMainThreadJob(system, [&sink, i] { spin(sink, i); }, &counter); },
+                   &counter);
+        }
+        waitJobs(system, counter);
+    });
+    report("worker to main thread", ms, options.jobs * 2ull);
+
+    // parallelFor over a float array, batch size decides whether the scheduler or the memory bus is the limit
+    std::vector<float> values(size_t(options.jobs) * 16u, 1.0f);
+    double serialMs = bestMs(options.runs, [&] {
+        for (auto &value : values) {
+            value = value * 1.0001f + 0.5f;
+        }
+    });
+    report("parallelFor serial loop", serialMs, values.size());
+    for (uint64_t batch : {1'024ull, 16'384ull, 262'144ull}) {
+        ms = bestMs(options.runs, [&] {
+            parallelFor(system, values.size(), batch, [&values](uint64_t begin, uint64_t end) {
+                for (uint64_t i = begin; i < end; ++i) {
+                    values[i] = values[i] * 1.0001f + 0.5f;
+                }
+            });
+        });
+        report(std::format("parallelFor batch {} ({:.2f}x)", batch, serialMs / ms), ms, (values.size() + batch - 1u) / batch);
+    }
+
+    std::cout << std::format("[JobBench]   {} jobs executed, {} stolen", system.executed.load(), system.steals.load()) << std::endl;
+    stopJobSystem(system);
+}
+
+int main(int argc, char **argv) {
+    try {
+        BenchOptions options = parseOptions(argc, argv);
+        for (uint32_t workers : options.workers) {
+            benchmarkWorkers(options, workers);
+        }
+    } catch (std::exception &e) {
+        std::cout << e.what() << std::endl;
+        return -3;
+    }
+    return 0;
+}
@@ -0,0 +1,306 @@
+// Times the CPU stages of model import one by one on synthetic grids and real OBJ files, no GPU needed.
+//   mesh_bench [file.obj...] [--sizes 10000,100000,1000000,10000000] [--threads 1,2,4,8] [--runs 3] [--keep]
+// Synthetic meshes are written to the temp directory first, --sizes goes up to 50000000 if the disk and RAM allow.
+// Stages: parse (loadObj), vertex expansion (corners to positions), streamed decode (parse + expansion + buffer fill
+// in one pass, what the renderer does), staging copy and position welding.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "obj_loader.h"
+
+struct BenchOptions {
+    std::vector<std::string> files{};
+    std::vector<uint64_t> sizes{}; // synthetic triangle counts
+    std::vector<uint32_t> threads{};
+    uint32_t runs = {3u};
+    bool keep = {false}; // leave the synthetic OBJ files in the temp directory
+};
+
+struct BenchMesh {
+    std::string name{};
+    std::string path{};
+    bool synthetic = {false};
+};
+
+constexpr const char *USAGE = "usage: mesh_bench [file.obj...] [--sizes 10000,100000,1000000,10000000] [--threads 1,2,4,8] "
+                              "[--runs 3] [--keep]";
+
+template <typename T>
+std::vector<T> parseList(const std::string &list) {
+    std::vector<T> values{};
+    std::stringstream stream(list);
+    for (std::string value; std::getline(stream, value, ',');) {
+        values.push_back(static_cast<T>(std::stoull(value)));
+    }
+    return values;
+}
+
+BenchOptions parseOptions(int argc, char **argv) {
+    BenchOptions options{};
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--sizes" && i + 1 < argc) {
+            options.sizes = parseList<uint64_t>(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.threads = parseList<uint32_t>(argv[++i]);
+            if (std::find(options.threads.begin(), options.threads.end(), 0u) != options.threads.end()) {
+                throw std::runtime_error(std::format("--threads needs at least one thread per run\n{}", USAGE));
+            }
+        } else if (arg == "--runs" && i + 1 < argc) {
+            options.runs = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+        } else if (arg == "--keep") {
+            options.keep = true;
+        } else if (!arg.starts_with("--")) {
+            options.files.push_back(arg);
+        } else {
+            throw std::runtime_error(std::format("Unknown option {}\n{}", arg, USAGE));
+        }
+    }
+    if (options.sizes.empty() && options.files.empty()) {
+        options.sizes = {10'000u, 100'000u, 1'000'000u, 10'000'000u};
+    }
+    if (options.threads.empty()) {
+        for (uint32_t count = 1u; count < std::thread::hardware_concurrency(); count *= 2u) {
+            options.threads.push_back(count);
+        }
+        options.threads.push_back(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    return options;
+}
+
+// VmHWM of this process, reset before each stage so every stage reports its own peak
+void resetPeakRss() {
+    std::ofstream("/proc/self/clear_refs") << "5";
+}
+
+double peakRssMiB() {
+    std::ifstream status("/proc/self/status");
+    for (std::string line; std::getline(status, line);) {
+        if (line.starts_with("VmHWM:")) {
+            return std::stod(line.substr(6u)) / 1024.0;
+        }
+    }
+    return 0.0;
+}
+
+// square grid in the xy plane with two triangles per cell, at least triangles triangles
+std::string writeGridObj(uint64_t triangles) {
+    auto cells = uint64_t(std::ceil(std::sqrt(double(std::max<uint64_t>(triangles, 2u)) / 2.0)));
+    std::string path = (std::filesystem::temp_directory_path() / std::format("mesh_bench_{}.obj", triangles)).string();
+    std::ofstream file(path, std::ios::binary);
+    std::string chunk{};
+    auto flush = [&](bool force) {
+        if (force || chunk.size() > (8u << 20)) {
+            file.write(chunk.data(), std::streamsize(chunk.size()));
+            chunk.clear();
+        }
+    };
+    for (uint64_t y = 0u; y <= cells; ++y) {
+        for (uint64_t x = 0u; x <= cells; ++x) {
+            chunk += std::format("v {:.6f} {:.6f} 0.0\n", double(x) / cells, double(y) / cells);
+            flush(false);
+        }
+    }
+    uint64_t written = 0u;
+    for (uint64_t y = 0u; y < cells && written < triangles; ++y) {
+        for (uint64_t x = 0u; x < cells && written < triangles; ++x) {
+            uint64_t v = y * (cells + 1u) + x + 1u; // 1-based
+            chunk += std::format("f {} {} {}\n", v, v + 1u, v + cells + 2u);
+            if (++written < triangles) {
+                chunk += std::format("f {} {} {}\n", v, v + cells + 2u, v + cells + 1u);
+                ++written;
+            }
+            flush(false);
+        }
+    }
+    flush(true);
+    if (!file) {
+        throw std::runtime_error(std::format("Failed to write {}", path));
+    }
+    return path;
+}
+
+// best of runs, first run also pays for the page cache
+double bestMs(uint32_t runs, const std::function<void()> &run) {
+    double best = std::numeric_limits<double>::max();
+    for (uint32_t i = 0u; i < runs; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+void report(const std::string &stage, uint32_t threads, double ms, uint64_t bytes, uint64_t triangles) {
+    double seconds = ms / 1000.0;
+    std::cout << std::format("[MeshBench]   {:<16} {:>3} threads {:>10.1f} ms {:>9.1f} MB/s {:>9.2f} Mtris/s  peak RSS {:>8.1f} MiB",
+                             stage, threads, ms, bytes / seconds / 1e6, triangles / seconds / 1e6, peakRssMiB()) << std::endl;
+}
+
+// splits [0, count) into one contiguous range per thread
+void parallelFor(uint32_t threads, uint64_t count, const std::function<void(uint64_t begin, uint64_t end)> &body) {
+    std::vector<std::thread> workers{};
+    uint64_t step = (count + threads - 1u) / threads;
+    for (uint64_t begin = 0u; begin < count; begin += step) {
+        workers.emplace_back(body, begin, std::min(count, begin + step));
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+// every corner becomes its own vertex, like decodeObjModel
+void expandVertices(const ObjMesh &mesh, std::vector<float> &positions, uint32_t threads) {
+    positions.resize(mesh.corners.size() * 3u);
+    parallelFor(threads, mesh.corners.size(), [&](uint64_t begin, uint64_t end) {
+        auto &source = mesh.attributes.positions;
+        for (uint64_t i = begin; i < end; ++i) {
+            int32_t p = mesh.corners[i].position;
+            positions[i * 3u + 0u] = source[p * 3 + 0];
+            positions[i * 3u + 1u] = -source[p * 3 + 1];
+            positions[i * 3u + 2u] = source[p * 3 + 2];
+        }
+    });
+}
+
+struct PositionKey {
+    float x, y, z;
+    bool operator==(const PositionKey &) const = default;
+};
+
+struct PositionKeyHash {
+    size_t operator()(const PositionKey &key) const {
+        uint32_t x, y, z;
+        memcpy(&x, &key.x, 4u);
+        memcpy(&y, &key.y, 4u);
+        memcpy(&z, &key.z, 4u);
+        return size_t(x) * 73856093u ^ size_t(y) * 19349663u ^ size_t(z) * 83492791u;
+    }
+};
+
+// merges bit identical positions back into an indexed mesh, returns the unique vertex count
+uint64_t weldPositions(const std::vector<float> &positions, std::vector<uint32_t> &indices) {
+    std::unordered_map<PositionKey, uint32_t, PositionKeyHash> unique{};
+    unique.reserve(positions.size() / 9u);
+    indices.resize(positions.size() / 3u);
+    for (size_t i = 0u; i < indices.size(); ++i) {
+        PositionKey key{positions[i * 3u], positions[i * 3u + 1u], positions[i * 3u + 2u]};
+        indices[i] = unique.try_emplace(key, uint32_t(unique.size())).first->second;
+    }
+    return unique.size();
+}
+
+void benchmarkMesh(const BenchOptions &options, const BenchMesh &mesh) {
+    uint64_t fileBytes = std::filesystem::file_size(mesh.path);
+    ObjMesh parsed = loadObj(mesh.path);
+    uint64_t triangles = parsed.corners.size() / 3u;
+    uint64_t expandedBytes = parsed.corners.size() * 3u * sizeof(float);
+    std::cout << std::format("[MeshBench] {}: {} triangles, {} positions, {:.1f} MB OBJ", mesh.name, triangles,
+                             parsed.attributes.positions.size() / 3u, fileBytes / 1e6) << std::endl;
+
+    for (uint32_t threads : options.threads) {
+        parsed = {};
+        resetPeakRss();
+        double ms = bestMs(options.runs, [&] { parsed = loadObj(mesh.path, {.threads = threads}); });
+        report("parse", threads, ms, fileBytes, triangles);
+
+        std::vector<float> positions{};
+        resetPeakRss();
+        ms = bestMs(options.runs, [&] { expandVertices(parsed, positions, threads); });
+        report("expand", threads, ms, expandedBytes, triangles);
+
+        // the corner list never exists as a whole, batches are expanded straight into the upload blob
+        parsed = {};
+        positions = {};
+        std::vector<float> blob{};
+        resetPeakRss();
+        ms = bestMs(options.runs, [&] {
+            const ObjAttributes *attributes = nullptr;
+            ObjSink sink {
+                .begin = [&](const ObjAttributes &objAttributes, const ObjScene &scene) {
+                    attributes = &objAttributes;
+                    blob.assign(scene.triangleCount * 9u, 0.0f);
+                },
+                .faces = [&](const ObjFaceBatch &batch) {
+                    float *dst = blob.data() + batch.firstTriangle * 9u;
+                    for (auto &corner : batch.corners) {
+                        *dst++ = attributes->positions[corner.position * 3 + 0];
+                        *dst++ = -attributes->positions[corner.position * 3 + 1];
+                        *dst++ = attributes->positions[corner.position * 3 + 2];
+                    }
+                }
+            };
+            streamObj(mesh.path, sink, {.threads = threads});
+        });
+        report("streamed decode", threads, ms, fileBytes, triangles);
+        parsed = loadObj(mesh.path, {.threads = threads});
+    }
+
+    // single threaded stages, the renderer runs them on one streaming worker
+    std::vector<float> positions{};
+    expandVertices(parsed, positions, 1u);
+    parsed = {};
+
+    // staging writes are chunked like the per-frame upload budget
+    constexpr size_t STAGING_CHUNK = {8u << 20};
+    std::vector<std::byte> staging(STAGING_CHUNK);
+    resetPeakRss();
+    double ms = bestMs(options.runs, [&] {
+        auto *src = reinterpret_cast<const std::byte*>(positions.data());
+        for (size_t offset = 0u; offset < expandedBytes; offset += STAGING_CHUNK) {
+            memcpy(staging.data(), src + offset, std::min(STAGING_CHUNK, size_t(expandedBytes - offset)));
+        }
+    });
+    report("staging copy", 1u, ms, expandedBytes, triangles);
+
+    std::vector<uint32_t> indices{};
+    uint64_t uniqueVertices = 0u;
+    resetPeakRss();
+    ms = bestMs(options.runs, [&] { uniqueVertices = weldPositions(positions, indices); });
+    report("weld", 1u, ms, expandedBytes, triangles);
+    std::cout << std::format("[MeshBench]   weld: {} corners to {} vertices", indices.size(), uniqueVertices) << std::endl;
+}
+
+int main(int argc, char **argv) {
+    try {
+        BenchOptions options = parseOptions(argc, argv);
+        std::vector<BenchMesh> meshes{};
+        for (uint64_t size : options.sizes) {
+            auto start = std::chrono::steady_clock::now();
+            std::string path = writeGridObj(size);
+            std::cout << std::format("[MeshBench] wrote {} in {:.1f} s", path,
+                                     std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()) << std::endl;
+            meshes.push_back({std::format("grid {}", size), path, true});
+        }
+        for (auto &file : options.files) {
+            meshes.push_back({file, file, false});
+        }
+        for (auto &mesh : meshes) {
+            benchmarkMesh(options, mesh);
+            if (mesh.synthetic && !options.keep) {
+                std::filesystem::remove(mesh.path);
+            }
+        }
+    } catch (std::exception &e) {
+        std::cout << e.what() << std::endl;
+        return -3;
+    }
+    return 0;
+}
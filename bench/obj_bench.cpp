@@ -0,0 +1,133 @@
+// Compares the parallel OBJ front end with tinyobj on the same files.
+//   obj_bench <file.obj>... [--threads 1,2,4,8] [--runs 3]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+#include "obj_loader.h"
+
+struct BenchOptions {
+    std::vector<std::string> files{};
+    std::vector<uint32_t> threads{};
+    uint32_t runs = {3u};
+};
+
+BenchOptions parseOptions(int argc, char **argv) {
+    BenchOptions options{};
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            std::stringstream list(argv[++i]);
+            for (std::string count; std::getline(list, count, ',');) {
+                options.threads.push_back(static_cast<uint32_t>(std::stoul(count)));
+            }
+        } else if (arg == "--runs" && i + 1 < argc) {
+            options.runs = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+        } else if (!arg.starts_with("--")) {
+            options.files.push_back(arg);
+        } else {
+            throw std::runtime_error(std::format("Unknown option {}\nusage: obj_bench <file.obj>... [--threads 1,2,4,8] [--runs 3]", arg));
+        }
+    }
+    if (options.files.empty()) {
+        throw std::runtime_error("usage: obj_bench <file.obj>... [--threads 1,2,4,8] [--runs 3]");
+    }
+    if (options.threads.empty()) {
+        for (uint32_t count = 1u; count < std::thread::hardware_concurrency(); count *= 2u) {
+            options.threads.push_back(count);
+        }
+        options.threads.push_back(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    return options;
+}
+
+// best of runs, first run also pays for the page cache
+double bestMs(uint32_t runs, const std::function<void()> &run) {
+    double best = std::numeric_limits<double>::max();
+    for (uint32_t i = 0u; i < runs; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+void report(const std::string &name, double ms, uint64_t bytes, uint64_t triangles) {
+    double seconds = ms / 1000.0;
+    std::cout << std::format("[ObjBench] {:<24} {:>10.1f} ms {:>9.1f} MB/s {:>9.2f} Mtris/s", name, ms,
+                             bytes / seconds / 1e6, triangles / seconds / 1e6) << std::endl;
+}
+
+int main(int argc, char **argv) {
+    try {
+        BenchOptions options = parseOptions(argc, argv);
+        for (auto &file : options.files) {
+            uint64_t bytes = std::filesystem::file_size(file);
+            std::cout << std::format("[ObjBench] {} ({:.1f} MB)", file, bytes / 1e6) << std::endl;
+
+            uint64_t tinyTriangles = 0u;
+            double tinyMs = bestMs(options.runs, [&] {
+                tinyobj::attrib_t attrib;
+                std::vector<tinyobj::shape_t> shapes;
+                std::vector<tinyobj::material_t> materials;
+                std::string warn, err;
+                if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, file.c_str(), nullptr, true)) {
+                    throw std::runtime_error(std::format("tinyobj failed on {}: {}", file, err));
+                }
+                tinyTriangles = 0u;
+                for (auto &shape : shapes) {
+                    tinyTriangles += shape.mesh.indices.size() / 3u;
+                }
+            });
+            report("tinyobj", tinyMs, bytes, tinyTriangles);
+
+            double bestLoadMs = std::numeric_limits<double>::max();
+            for (uint32_t threads : options.threads) {
+                uint64_t triangles = 0u;
+                double ms = bestMs(options.runs, [&] {
+                    triangles = loadObj(file, {.threads = threads}).corners.size() / 3u;
+                });
+                bestLoadMs = std::min(bestLoadMs, ms);
+                report(std::format("loadObj {} threads", threads), ms, bytes, triangles);
+                if (triangles != tinyTriangles) {
+                    std::cout << std::format("[ObjBench] triangle count mismatch: {} vs tinyobj {}", triangles, tinyTriangles) << std::endl;
+                }
+
+                // streaming keeps only one batch per worker, the sink just touches the corners
+                std::atomic<uint64_t> checksum{0u};
+                ObjSink sink {
+                    .faces = [&checksum](const ObjFaceBatch &batch) {
+                        uint64_t sum = 0u;
+                        for (auto &corner : batch.corners) {
+                            sum += static_cast<uint32_t>(corner.position);
+                        }
+                        checksum += sum;
+                    }
+                };
+                ms = bestMs(options.runs, [&] { triangles = streamObj(file, sink, {.threads = threads}).triangleCount; });
+                report(std::format("streamObj {} threads", threads), ms, bytes, triangles);
+            }
+            std::cout << std::format("[ObjBench] loadObj speedup over tinyobj: {:.1f}x", tinyMs / bestLoadMs) << std::endl;
+        }
+    } catch (std::exception &e) {
+        std::cout << e.what() << std::endl;
+        return -3;
+    }
+    return 0;
+}
@@ -0,0 +1,552 @@
+// Correctness and throughput of the GPU primitives in gpu_primitives.h: prefix sum, stream compaction and radix sort of
+// 32 and 64 bit keys with values, each checked against a CPU implementation and timed with GPU timestamps next to it.
+// Runs the subgroup kernels and the shared memory fallback on any Vulkan 1.4 device, CPU drivers like lavapipe included.
+//   primitives_bench [--sizes 1000,1000000,16000000] [--runs 10] [--device <name substring>] [--no-subgroups] [--shaders shader]
+// Exits with 1 when a GPU result differs from the CPU one.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "gpu_primitives.h"
+
+#define RT_THROW(msg) throw std::runtime_error(msg);
+
+#define VK_CHECK(x, msg)                                                       \
+  do {                                                                         \
+    if ((x) != VK_SUCCESS) {                                                   \
+      RT_THROW(msg)                                                            \
+    }                                                                          \
+  } while (0)
+
+constexpr uint32_t MAX_SIZE = {1u << 26}; // 256 MiB per buffer
+
+struct BenchOptions {
+    std::vector<uint32_t> sizes{};
+    uint32_t runs = {10u};
+    std::string device{}; // first device whose name contains it, empty picks the first one
+    bool subgroups = {true};
+    std::string shaderDir{"shader"};
+};
+
+struct BenchContext {
+    VkInstance instance = {VK_NULL_HANDLE};
+    VkPhysicalDevice physicalDevice = {VK_NULL_HANDLE};
+    VkPhysicalDeviceProperties properties{};
+    VkPhysicalDeviceMemoryProperties memoryProperties{};
+    VkDevice device = {VK_NULL_HANDLE};
+    uint32_t queueFamily = {0u};
+    VkQueue queue = {VK_NULL_HANDLE};
+    VkCommandPool commandPool = {VK_NULL_HANDLE};
+    VkCommandBuffer cmd = {VK_NULL_HANDLE};
+    VkFence fence = {VK_NULL_HANDLE};
+    VkQueryPool timestamps = {VK_NULL_HANDLE}; // null when the queue has no timestamps
+};
+
+struct BenchBuffer {
+    VkBuffer buffer = {VK_NULL_HANDLE};
+    VkDeviceMemory memory = {VK_NULL_HANDLE};
+    VkDeviceSize size = {0u};
+    void *mapped = {nullptr}; // host visible buffers only
+};
+
+BenchOptions parseOptions(int argc, char **argv) {
+    constexpr const char *usage =
+        "usage: primitives_bench [--sizes 1000,1000000,16000000] [--runs 10] [--device <name>] [--no-subgroups] [--shaders shader]";
+    BenchOptions options{};
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--sizes" && i + 1 < argc) {
+            std::stringstream list(argv[++i]);
+            for (std::string size; std::getline(list, size, ',');) {
+                options.sizes.push_back(std::clamp(static_cast<uint32_t>(std::stoul(size)), 1u, MAX_SIZE));
+            }
+        } else if (arg == "--runs" && i + 1 < argc) {
+            options.runs = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+        } else if (arg == "--device" && i + 1 < argc) {
+            options.device = argv[++i];
+        } else if (arg == "--no-subgroups") {
+            options.subgroups = false;
+        } else if (arg == "--shaders" && i + 1 < argc) {
+            options.shaderDir = argv[++i];
+        } else {
+            throw std::runtime_error(std::format("Unknown option {}\n{}", arg, usage));
+        }
+    }
+    if (options.sizes.empty()) {
+        options.sizes = {1000u, 1'000'000u, 16'000'000u};
+    }
+    return options;
+}
+
+BenchContext createBenchContext(const BenchOptions &options) {
+    BenchContext ctx{};
+    VkApplicationInfo appInfo {
+        .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+        .pApplicationName = "primitives_bench",
+        .apiVersion = VK_API_VERSION_1_4
+    };
+    VkInstanceCreateInfo instanceCI {.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO, .pApplicationInfo = &appInfo};
+    VK_CHECK(vkCreateInstance(&instanceCI, nullptr, &ctx.instance), "Failed to create instance");
+
+    // push descriptors are core in 1.4
+    uint32_t deviceCount = {0u};
+    vkEnumeratePhysicalDevices(ctx.instance, &deviceCount, nullptr);
+    std::vector<VkPhysicalDevice> devices(deviceCount);
+    vkEnumeratePhysicalDevices(ctx.instance, &deviceCount, devices.data());
+    for (VkPhysicalDevice device : devices) {
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(device, &properties);
+        if (properties.apiVersion >= VK_API_VERSION_1_4 && std::string_view(properties.deviceName).contains(options.device)) {
+            ctx.physicalDevice = device;
+            ctx.properties = properties;
+            break;
+        }
+    }
+    if (ctx.physicalDevice == VK_NULL_HANDLE) {
+        RT_THROW(std::format("No Vulkan 1.4 device matching \"{}\"", options.device));
+    }
+    vkGetPhysicalDeviceMemoryProperties(ctx.physicalDevice, &ctx.memoryProperties);
+
+    uint32_t familyCount = {0u};
+    vkGetPhysicalDeviceQueueFamilyProperties(ctx.physicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(ctx.physicalDevice, &familyCount, families.data());
+    auto compute = std::find_if(families.begin(), families.end(),
+                                [](const VkQueueFamilyProperties &family) { return family.queueFlags & VK_QUEUE_COMPUTE_BIT; });
+    if (compute == families.end()) {
+        RT_THROW("No compute queue");
+    }
+    ctx.queueFamily = static_cast<uint32_t>(compute - families.begin());
+
+    // full subgroups when the device has them, createGpuPrimitives falls back to shared memory scans otherwise
+    VkPhysicalDeviceVulkan13Features supported13 {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES};
+    VkPhysicalDeviceFeatures2 supported {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &supported13};
+    vkGetPhysicalDeviceFeatures2(ctx.physicalDevice, &supported);
+    float priority = {1.0f};
+    VkDeviceQueueCreateInfo queueCI {
+        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+        .queueFamilyIndex = ctx.queueFamily,
+        .queueCount = 1u,
+        .pQueuePriorities = &priority
+    };
+    VkPhysicalDeviceVulkan13Features features13 {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+        .computeFullSubgroups = supported13.computeFullSubgroups,
+        .synchronization2 = VK_TRUE
+    };
+    VkDeviceCreateInfo deviceCI {
+        .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        .pNext = &features13,
+        .queueCreateInfoCount = 1u,
+        .pQueueCreateInfos = &queueCI
+    };
+    VK_CHECK(vkCreateDevice(ctx.physicalDevice, &deviceCI, nullptr, &ctx.device), "Failed to create device");
+    vkGetDeviceQueue(ctx.device, ctx.queueFamily, 0u, &ctx.queue);
+
+    VkCommandPoolCreateInfo poolCI {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = ctx.queueFamily
+    };
+    VK_CHECK(vkCreateCommandPool(ctx.device, &poolCI, nullptr, &ctx.commandPool), "Failed to create command pool");
+    VkCommandBufferAllocateInfo cmdAI {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = ctx.commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1u
+    };
+    VK_CHECK(vkAllocateCommandBuffers(ctx.device, &cmdAI, &ctx.cmd), "Failed to allocate command buffer");
+    VkFenceCreateInfo fenceCI {.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+    VK_CHECK(vkCreateFence(ctx.device, &fenceCI, nullptr, &ctx.fence), "Failed to create fence");
+
+    if (compute->timestampValidBits > 0u) {
+        VkQueryPoolCreateInfo queryCI {.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO, .queryType = VK_QUERY_TYPE_TIMESTAMP, .queryCount = 2u};
+        VK_CHECK(vkCreateQueryPool(ctx.device, &queryCI, nullptr, &ctx.timestamps), "Failed to create query pool");
+    }
+    std::cout << std::format("[PrimitivesBench] device {}{}", ctx.properties.deviceName,
+                             ctx.timestamps != VK_NULL_HANDLE ? "" : ", no timestamps, GPU times include submit and wait") << std::endl;
+    return ctx;
+}
+
+void destroyBenchContext(BenchContext &ctx) {
+    if (ctx.timestamps != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(ctx.device, ctx.timestamps, nullptr);
+    }
+    vkDestroyFence(ctx.device, ctx.fence, nullptr);
+    vkDestroyCommandPool(ctx.device, ctx.commandPool, nullptr);
+    vkDestroyDevice(ctx.device, nullptr);
+    vkDestroyInstance(ctx.instance, nullptr);
+    ctx = {};
+}
+
+uint32_t findMemoryType(const BenchContext &ctx, uint32_t typeBits, VkMemoryPropertyFlags properties) {
+    for (uint32_t i = 0u; i < ctx.memoryProperties.memoryTypeCount; ++i) {
+        if ((typeBits & (1u << i)) && (ctx.memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+    RT_THROW("No suitable memory type");
+}
+
+BenchBuffer createBuffer(const BenchContext &ctx, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) {
+    BenchBuffer buffer{.size = size};
+    VkBufferCreateInfo buffCI {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = std::max(size, VkDeviceSize(4u)), .usage = usage};
+    VK_CHECK(vkCreateBuffer(ctx.device, &buffCI, nullptr, &buffer.buffer), "Failed to create buffer");
+    VkMemoryRequirements requirements{};
+    vkGetBufferMemoryRequirements(ctx.device, buffer.buffer, &requirements);
+    VkMemoryAllocateInfo memoryAI {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = requirements.size,
+        .memoryTypeIndex = findMemoryType(ctx, requirements.memoryTypeBits, properties)
+    };
+    VK_CHECK(vkAllocateMemory(ctx.device, &memoryAI, nullptr, &buffer.memory), "Failed to allocate memory");
+    VK_CHECK(vkBindBufferMemory(ctx.device, buffer.buffer, buffer.memory, 0u), "Failed to bind buffer memory");
+    if (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        VK_CHECK(vkMapMemory(ctx.device, buffer.memory, 0u, VK_WHOLE_SIZE, 0u, &buffer.mapped), "Failed to map buffer");
+    }
+    return buffer;
+}
+
+// storage buffer the primitives read and write, filled and read back through staging copies
+BenchBuffer createDeviceBuffer(const BenchContext &ctx, VkDeviceSize size) {
+    return createBuffer(ctx, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+void destroyBuffer(const BenchContext &ctx, BenchBuffer &buffer) {
+    vkDestroyBuffer(ctx.device, buffer.buffer, nullptr);
+    vkFreeMemory(ctx.device, buffer.memory, nullptr);
+    buffer = {};
+}
+
+VkDescriptorBufferInfo bufferInfo(const BenchBuffer &buffer) {
+    return {buffer.buffer, 0u, VK_WHOLE_SIZE};
+}
+
+void beginCommands(const BenchContext &ctx) {
+    VK_CHECK(vkResetCommandBuffer(ctx.cmd, 0u), "Failed to reset command buffer");
+    VkCommandBufferBeginInfo beginInfo {.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
+    VK_CHECK(vkBeginCommandBuffer(ctx.cmd, &beginInfo), "Failed to begin command buffer");
+}
+
+void submitAndWait(const BenchContext &ctx) {
+    VK_CHECK(vkEndCommandBuffer(ctx.cmd), "Failed to end command buffer");
+    VkCommandBufferSubmitInfo cmdSubmitInfo {.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO, .commandBuffer = ctx.cmd};
+    VkSubmitInfo2 submitInfo {.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2, .commandBufferInfoCount = 1u, .pCommandBufferInfos = &cmdSubmitInfo};
+    VK_CHECK(vkQueueSubmit2(ctx.queue, 1u, &submitInfo, ctx.fence), "Failed to submit");
+    VK_CHECK(vkWaitForFences(ctx.device, 1u, &ctx.fence, VK_TRUE, std::numeric_limits<uint64_t>::max()), "Failed to wait for fence");
+    VK_CHECK(vkResetFences(ctx.device, 1u, &ctx.fence), "Failed to reset fence");
+}
+
+// everything recorded before, copies and primitives alike, is done and visible to everything after
+void fullBarrier(VkCommandBuffer cmd) {
+    VkMemoryBarrier2 barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+        .srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+        .srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT,
+        .dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+        .dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT
+    };
+    VkDependencyInfo depsInfo {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .memoryBarrierCount = 1u, .pMemoryBarriers = &barrier};
+    vkCmdPipelineBarrier2(cmd, &depsInfo);
+}
+
+void upload(const BenchContext &ctx, const BenchBuffer &staging, const BenchBuffer &buffer, std::span<const uint32_t> data) {
+    memcpy(staging.mapped, data.data(), data.size_bytes());
+    beginCommands(ctx);
+    fullBarrier(ctx.cmd);
+    VkBufferCopy region {.srcOffset = 0u, .dstOffset = 0u, .size = data.size_bytes()};
+    vkCmdCopyBuffer(ctx.cmd, staging.buffer, buffer.buffer, 1u, &region);
+    submitAndWait(ctx);
+}
+
+std::vector<uint32_t> download(const BenchContext &ctx, const BenchBuffer &staging, const BenchBuffer &buffer, size_t count) {
+    beginCommands(ctx);
+    fullBarrier(ctx.cmd);
+    VkBufferCopy region {.srcOffset = 0u, .dstOffset = 0u, .size = count * sizeof(uint32_t)};
+    vkCmdCopyBuffer(ctx.cmd, buffer.buffer, staging.buffer, 1u, &region);
+    VkMemoryBarrier2 barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+        .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+        .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        .dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
+        .dstAccessMask = VK_ACCESS_2_HOST_READ_BIT
+    };
+    VkDependencyInfo depsInfo {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .memoryBarrierCount = 1u, .pMemoryBarriers = &barrier};
+    vkCmdPipelineBarrier2(ctx.cmd, &depsInfo);
+    submitAndWait(ctx);
+    auto *words = static_cast<const uint32_t *>(staging.mapped);
+    return {words, words + count};
+}
+
+// best of the runs. prepare restores the inputs a primitive overwrites and stays outside the timestamps
+double bestGpuMs(const BenchContext &ctx, uint32_t runs, const std::function<void(VkCommandBuffer)> &prepare,
+                 const std::function<void(VkCommandBuffer)> &work) {
+    double best = std::numeric_limits<double>::max();
+    for (uint32_t run = 0u; run < runs; ++run) {
+        beginCommands(ctx);
+        fullBarrier(ctx.cmd);
+        if (prepare) {
+            prepare(ctx.cmd);
+            fullBarrier(ctx.cmd);
+        }
+        if (ctx.timestamps != VK_NULL_HANDLE) {
+            vkCmdResetQueryPool(ctx.cmd, ctx.timestamps, 0u, 2u);
+            vkCmdWriteTimestamp2(ctx.cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, ctx.timestamps, 0u);
+        }
+        work(ctx.cmd);
+        if (ctx.timestamps != VK_NULL_HANDLE) {
+            vkCmdWriteTimestamp2(ctx.cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, ctx.timestamps, 1u);
+        }
+        auto start = std::chrono::steady_clock::now();
+        submitAndWait(ctx);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (ctx.timestamps != VK_NULL_HANDLE) {
+            std::array<uint64_t, 2> ticks{};
+            VK_CHECK(vkGetQueryPoolResults(ctx.device, ctx.timestamps, 0u, 2u, sizeof(ticks), ticks.data(), sizeof(uint64_t),
+                                           VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT), "Failed to read timestamps");
+            ms = (ticks[1] - ticks[0]) * ctx.properties.limits.timestampPeriod / 1e6;
+        }
+        best = std::min(best, ms);
+    }
+    return best;
+}
+
+double bestCpuMs(uint32_t runs, const std::function<void()> &run) {
+    double best = std::numeric_limits<double>::max();
+    for (uint32_t i = 0u; i < runs; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+// empty when they match
+std::string compareResults(std::span<const uint32_t> gpu, std::span<const uint32_t> cpu) {
+    if (gpu.size() != cpu.size()) {
+        return std::format("{} elements instead of {}", gpu.size(), cpu.size());
+    }
+    auto mismatch = std::mismatch(gpu.begin(), gpu.end(), cpu.begin());
+    if (mismatch.first == gpu.end()) {
+        return {};
+    }
+    return std::format("element {} is {} instead of {}", mismatch.first - gpu.begin(), *mismatch.first, *mismatch.second);
+}
+
+struct PrimitiveResult {
+    const char *name = {""};
+    uint32_t count = {0u};
+    double gpuMs = {0.0};
+    double cpuMs = {0.0};
+    std::string mismatch{}; // empty when the GPU matched the CPU
+};
+
+void report(const PrimitiveResult &result) {
+    std::cout << std::format("[PrimitivesBench]   {:<14} {:>9} gpu {:>9.3f} ms {:>7.3f} Gelem/s  cpu {:>9.3f} ms {:>7.3f} Gelem/s  {}",
+                             result.name, result.count, result.gpuMs, result.count / result.gpuMs / 1e6, result.cpuMs,
+                             result.count / result.cpuMs / 1e6, result.mismatch.empty() ? "ok" : "MISMATCH " + result.mismatch)
+              << std::endl;
+}
+
+// buffers for one size, large enough for 64 bit keys
+struct BenchBuffers {
+    BenchBuffer staging{};
+    BenchBuffer source{};       // pristine keys, restored before every sort
+    BenchBuffer sourceValues{};
+    BenchBuffer a{};            // input, keys
+    BenchBuffer b{};            // output, key temps
+    BenchBuffer values{};       // flags, values
+    BenchBuffer valuesTemp{};
+    BenchBuffer outputCount{};
+    BenchBuffer scratch{};
+};
+
+BenchBuffers createBenchBuffers(const BenchContext &ctx, const GpuPrimitives &primitives, uint32_t count) {
+    VkDeviceSize keyBytes = 2u * VkDeviceSize(count) * sizeof(uint32_t);
+    VkDeviceSize valueBytes = VkDeviceSize(count) * sizeof(uint32_t);
+    return {
+        .staging = createBuffer(ctx, keyBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT),
+        .source = createDeviceBuffer(ctx, keyBytes),
+        .sourceValues = createDeviceBuffer(ctx, valueBytes),
+        .a = createDeviceBuffer(ctx, keyBytes),
+        .b = createDeviceBuffer(ctx, keyBytes),
+        .values = createDeviceBuffer(ctx, valueBytes),
+        .valuesTemp = createDeviceBuffer(ctx, valueBytes),
+        .outputCount = createDeviceBuffer(ctx, sizeof(uint32_t)),
+        .scratch = createDeviceBuffer(ctx, std::max(prefixSumScratchSize(count), radixSortScratchSize(primitives, count)))
+    };
+}
+
+void destroyBenchBuffers(const BenchContext &ctx, BenchBuffers &buffers) {
+    for (BenchBuffer *buffer : {&buffers.staging, &buffers.source, &buffers.sourceValues, &buffers.a, &buffers.b, &buffers.values,
+                                &buffers.valuesTemp, &buffers.outputCount, &buffers.scratch}) {
+        destroyBuffer(ctx, *buffer);
+    }
+}
+
+PrimitiveResult benchPrefixSum(const BenchContext &ctx, const GpuPrimitives &primitives, const BenchOptions &options, BenchBuffers &buffers,
+                               uint32_t count, std::mt19937 &random) {
+    std::vector<uint32_t> input(count);
+    std::uniform_int_distribution<uint32_t> value(0u, 15u);
+    std::generate(input.begin(), input.end(), [&] { return value(random); });
+    std::vector<uint32_t> expected(count);
+    PrimitiveResult result{.name = "prefix sum", .count = count};
+    result.cpuMs = bestCpuMs(options.runs, [&] { std::exclusive_scan(input.begin(), input.end(), expected.begin(), 0u); });
+
+    upload(ctx, buffers.staging, buffers.a, input);
+    result.gpuMs = bestGpuMs(ctx, options.runs, {}, [&](VkCommandBuffer cmd) {
+        recordPrefixSum(primitives, cmd, count, bufferInfo(buffers.a), bufferInfo(buffers.b), bufferInfo(buffers.scratch));
+    });
+    result.mismatch = compareResults(download(ctx, buffers.staging, buffers.b, count), expected);
+    return result;
+}
+
+PrimitiveResult benchCompact(const BenchContext &ctx, const GpuPrimitives &primitives, const BenchOptions &options, BenchBuffers &buffers,
+                             uint32_t count, std::mt19937 &random) {
+    std::vector<uint32_t> input(count);
+    std::iota(input.begin(), input.end(), 0u);
+    std::vector<uint32_t> flags(count);
+    std::bernoulli_distribution keep(0.5);
+    std::generate(flags.begin(), flags.end(), [&] { return keep(random) ? 1u : 0u; });
+    std::vector<uint32_t> expected;
+    PrimitiveResult result{.name = "compact", .count = count};
+    result.cpuMs = bestCpuMs(options.runs, [&] {
+        expected.clear();
+        for (uint32_t i = 0u; i < count; ++i) {
+            if (flags[i] != 0u) {
+                expected.push_back(input[i]);
+            }
+        }
+    });
+
+    upload(ctx, buffers.staging, buffers.a, input);
+    upload(ctx, buffers.staging, buffers.values, flags);
+    result.gpuMs = bestGpuMs(ctx, options.runs, {}, [&](VkCommandBuffer cmd) {
+        recordCompact(primitives, cmd, count, bufferInfo(buffers.a), bufferInfo(buffers.values), bufferInfo(buffers.b),
+                      bufferInfo(buffers.outputCount), bufferInfo(buffers.scratch));
+    });
+    uint32_t kept = download(ctx, buffers.staging, buffers.outputCount, 1u)[0];
+    if (kept != expected.size()) {
+        result.mismatch = std::format("kept {} instead of {}", kept, expected.size());
+    } else {
+        result.mismatch = compareResults(download(ctx, buffers.staging, buffers.b, kept), expected);
+    }
+    return result;
+}
+
+// random keys with their original index as value, equal keys keep the order of their values when the sort is stable
+PrimitiveResult benchRadixSort(const BenchContext &ctx, const GpuPrimitives &primitives, const BenchOptions &options, BenchBuffers &buffers,
+                               uint32_t count, uint32_t keyBits, std::mt19937 &random) {
+    std::vector<uint64_t> keys(count);
+    std::uniform_int_distribution<uint64_t> key(0u, keyBits == 64u ? std::numeric_limits<uint64_t>::max() : std::numeric_limits<uint32_t>::max());
+    for (uint32_t i = 0u; i < count; ++i) {
+        keys[i] = i % 4u == 3u ? keys[i / 2u] : key(random); // every fourth key repeats an earlier one
+    }
+    std::vector<uint32_t> order(count);
+    PrimitiveResult result{.name = keyBits == 64u ? "radix sort 64" : "radix sort 32", .count = count};
+    result.cpuMs = bestCpuMs(options.runs, [&] {
+        std::iota(order.begin(), order.end(), 0u);
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+    });
+
+    uint32_t keyWords = keyBits / 32u;
+    std::vector<uint32_t> words(size_t(count) * keyWords);
+    std::vector<uint32_t> expectedWords(words.size());
+    for (uint32_t i = 0u; i < count; ++i) {
+        for (uint32_t word = 0u; word < keyWords; ++word) {
+            words[i * keyWords + word] = uint32_t(keys[i] >> (32u * word));
+            expectedWords[i * keyWords + word] = uint32_t(keys[order[i]] >> (32u * word));
+        }
+    }
+    std::vector<uint32_t> values(count);
+    std::iota(values.begin(), values.end(), 0u);
+    upload(ctx, buffers.staging, buffers.source, words);
+    upload(ctx, buffers.staging, buffers.sourceValues, values);
+
+    VkDeviceSize keyBytes = words.size() * sizeof(uint32_t);
+    VkDeviceSize valueBytes = values.size() * sizeof(uint32_t);
+    RadixSortBuffers sortBuffers {
+        .keys = bufferInfo(buffers.a),
+        .keysTemp = bufferInfo(buffers.b),
+        .values = bufferInfo(buffers.values),
+        .valuesTemp = bufferInfo(buffers.valuesTemp),
+        .scratch = bufferInfo(buffers.scratch)
+    };
+    auto restore = [&](VkCommandBuffer cmd) {
+        VkBufferCopy keyRegion {.size = keyBytes};
+        vkCmdCopyBuffer(cmd, buffers.source.buffer, buffers.a.buffer, 1u, &keyRegion);
+        VkBufferCopy valueRegion {.size = valueBytes};
+        vkCmdCopyBuffer(cmd, buffers.sourceValues.buffer, buffers.values.buffer, 1u, &valueRegion);
+    };
+    result.gpuMs = bestGpuMs(ctx, options.runs, restore, [&](VkCommandBuffer cmd) {
+        recordRadixSort(primitives, cmd, count, keyBits, sortBuffers);
+    });
+    result.mismatch = compareResults(download(ctx, buffers.staging, buffers.a, words.size()), expectedWords);
+    if (result.mismatch.empty()) {
+        result.mismatch = compareResults(download(ctx, buffers.staging, buffers.values, count), order);
+        if (!result.mismatch.empty()) {
+            result.mismatch = "values, " + result.mismatch;
+        }
+    }
+    return result;
+}
+
+int main(int argc, char **argv) {
+    try {
+        BenchOptions options = parseOptions(argc, argv);
+        BenchContext ctx = createBenchContext(options);
+        bool mismatch = {false};
+
+        // the subgroup kernels first, then the shared memory fallback every device runs
+        std::vector<bool> paths = options.subgroups ? std::vector<bool>{true, false} : std::vector<bool>{false};
+        for (bool subgroups : paths) {
+            GpuPrimitives primitives{};
+            createGpuPrimitives(primitives, ctx.physicalDevice, ctx.device, {.shaderDir = options.shaderDir, .subgroupOps = subgroups});
+            if (subgroups && !primitives.subgroupOps) {
+                std::cout << "[PrimitivesBench] no full subgroups with arithmetic in compute shaders, subgroup kernels skipped" << std::endl;
+                destroyGpuPrimitives(primitives);
+                continue;
+            }
+            std::cout << std::format("[PrimitivesBench] {} kernels, best of {} runs", subgroups ? "subgroup" : "shared memory", options.runs)
+                      << std::endl;
+            std::mt19937 random(1234u);
+            for (uint32_t count : options.sizes) {
+                BenchBuffers buffers = createBenchBuffers(ctx, primitives, count);
+                for (const PrimitiveResult &result : {benchPrefixSum(ctx, primitives, options, buffers, count, random),
+                                                      benchCompact(ctx, primitives, options, buffers, count, random),
+                                                      benchRadixSort(ctx, primitives, options, buffers, count, 32u, random),
+                                                      benchRadixSort(ctx, primitives, options, buffers, count, 64u, random)}) {
+                    report(result);
+                    mismatch = mismatch || !result.mismatch.empty();
+                }
+                destroyBenchBuffers(ctx, buffers);
+            }
+            destroyGpuPrimitives(primitives);
+        }
+        destroyBenchContext(ctx);
+        return mismatch ? 1 : 0;
+    } catch (std::exception &e) {
+        std::cout << e.what() << std::endl;
+        return -3;
+    }
+}
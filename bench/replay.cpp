@@ -0,0 +1,831 @@
+// Replays frames written by vulkan14 --capture offscreen, no window or swapchain, and reports CPU and GPU frame times.
+//   vulkan14_replay <capture.vcap> [--iterations 100] [--warmup 10] [--device <name substring>]
+// Every captured pipeline is created as a monolithic pipeline, whatever mode the capturing run used.
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "capture_format.h"
+
+#define RT_THROW(msg) throw std::runtime_error(msg);
+
+#define VK_CHECK(x, msg)                                                       \
+  do {                                                                         \
+    if ((x) != VK_SUCCESS) {                                                   \
+      RT_THROW(msg)                                                            \
+    }                                                                          \
+  } while (0)
+
+struct ReplayOptions {
+    std::string capturePath{};
+    uint32_t iterations = {100u};
+    uint32_t warmup = {10u};
+    std::string device{}; // first device whose name contains it, empty picks the first one
+};
+
+struct ReplayContext {
+    VkInstance instance = {VK_NULL_HANDLE};
+    VkPhysicalDevice physicalDevice = {VK_NULL_HANDLE};
+    VkPhysicalDeviceProperties properties{};
+    VkPhysicalDeviceMemoryProperties memoryProperties{};
+    VkDevice device = {VK_NULL_HANDLE};
+    uint32_t queueFamily = {0u};
+    VkQueue queue = {VK_NULL_HANDLE};
+    VkCommandPool commandPool = {VK_NULL_HANDLE};
+    VkCommandBuffer cmd = {VK_NULL_HANDLE};
+    VkFence fence = {VK_NULL_HANDLE};
+    VkQueryPool timestamps = {VK_NULL_HANDLE}; // null when the queue has no timestamps
+};
+
+struct ReplayBuffer {
+    VkBuffer buffer = {VK_NULL_HANDLE};
+    VkDeviceMemory memory = {VK_NULL_HANDLE};
+    VkDeviceSize size = {0u};
+};
+
+struct ReplayShader {
+    VkShaderModule module = {VK_NULL_HANDLE};
+    std::string vertexEntry{};
+    std::string fragmentEntry{};
+    std::vector<VkSpecializationMapEntry> specializationEntries{};
+    std::vector<uint32_t> specializationData{};
+    std::vector<VkDescriptorSetLayout> setLayouts{};
+    VkPipelineLayout layout = {VK_NULL_HANDLE};
+};
+
+struct ReplayImage {
+    VkImage image = {VK_NULL_HANDLE};
+    VkDeviceMemory memory = {VK_NULL_HANDLE};
+    VkImageView view = {VK_NULL_HANDLE};
+};
+
+// frame commands with their ids resolved at load
+struct ReplayCommand {
+    CaptureOp op = {CaptureOp::End};
+    VkPipeline pipeline = {VK_NULL_HANDLE};
+    VkBuffer buffer = {VK_NULL_HANDLE};
+    VkDescriptorSet descriptorSet = {VK_NULL_HANDLE};
+    VkPipelineLayout layout = {VK_NULL_HANDLE};
+    uint32_t set = {0u};
+    VkDeviceSize offset = {0u};
+    CaptureDrawIndexed draw{};
+    std::vector<uint32_t> constants{};
+};
+
+struct ReplayCapture {
+    std::unordered_map<uint32_t, ReplayBuffer> buffers{};
+    std::unordered_map<uint32_t, ReplayShader> shaders{};
+    std::unordered_map<uint32_t, VkPipeline> pipelines{};
+    std::unordered_map<uint32_t, VkDescriptorSet> descriptorSets{};
+    std::vector<VkDescriptorPool> descriptorPools{};
+    std::vector<std::vector<ReplayCommand>> frames{};
+    CaptureRendering rendering{};
+};
+
+ReplayOptions parseOptions(int argc, char **argv) {
+    constexpr const char *usage = "usage: vulkan14_replay <capture.vcap> [--iterations 100] [--warmup 10] [--device <name>]";
+    ReplayOptions options{};
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--iterations" && i + 1 < argc) {
+            options.iterations = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+        } else if (arg == "--warmup" && i + 1 < argc) {
+            options.warmup = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--device" && i + 1 < argc) {
+            options.device = argv[++i];
+        } else if (!arg.starts_with("--") && options.capturePath.empty()) {
+            options.capturePath = arg;
+        } else {
+            throw std::runtime_error(std::format("Unknown option {}\n{}", arg, usage));
+        }
+    }
+    if (options.capturePath.empty()) {
+        throw std::runtime_error(usage);
+    }
+    return options;
+}
+
+std::vector<std::byte> readCapture(const std::string &path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        RT_THROW(std::format("Failed to open capture {}", path));
+    }
+    std::vector<std::byte> data(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(data.data()), std::streamsize(data.size()));
+    return data;
+}
+
+ReplayContext createReplayContext(const ReplayOptions &options) {
+    ReplayContext ctx{};
+    VkApplicationInfo appInfo {
+        .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+        .pApplicationName = "vulkan14_replay",
+        .apiVersion = VK_API_VERSION_1_3
+    };
+    VkInstanceCreateInfo instanceCI {.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO, .pApplicationInfo = &appInfo};
+    VK_CHECK(vkCreateInstance(&instanceCI, nullptr, &ctx.instance), "Failed to create instance");
+
+    uint32_t deviceCount = {0u};
+    vkEnumeratePhysicalDevices(ctx.instance, &deviceCount, nullptr);
+    std::vector<VkPhysicalDevice> devices(deviceCount);
+    vkEnumeratePhysicalDevices(ctx.instance, &deviceCount, devices.data());
+    for (VkPhysicalDevice device : devices) {
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(device, &properties);
+        if (properties.apiVersion >= VK_API_VERSION_1_3 && std::string_view(properties.deviceName).contains(options.device)) {
+            ctx.physicalDevice = device;
+            ctx.properties = properties;
+            break;
+        }
+    }
+    if (ctx.physicalDevice == VK_NULL_HANDLE) {
+        RT_THROW(std::format("No Vulkan 1.3 device matching \"{}\"", options.device));
+    }
+    vkGetPhysicalDeviceMemoryProperties(ctx.physicalDevice, &ctx.memoryProperties);
+
+    uint32_t familyCount = {0u};
+    vkGetPhysicalDeviceQueueFamilyProperties(ctx.physicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(ctx.physicalDevice, &familyCount, families.data());
+    auto graphics = std::find_if(families.begin(), families.end(),
+                                 [](const VkQueueFamilyProperties &family) { return family.queueFlags & VK_QUEUE_GRAPHICS_BIT; });
+    if (graphics == families.end()) {
+        RT_THROW("No graphics queue");
+    }
+    ctx.queueFamily = static_cast<uint32_t>(graphics - families.begin());
+
+    float priority = {1.0f};
+    VkDeviceQueueCreateInfo queueCI {
+        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+        .queueFamilyIndex = ctx.queueFamily,
+        .queueCount = 1u,
+        .pQueuePriorities = &priority
+    };
+    VkPhysicalDeviceVulkan13Features features13 {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+        .synchronization2 = VK_TRUE,
+        .dynamicRendering = VK_TRUE
+    };
+    VkDeviceCreateInfo deviceCI {
+        .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        .pNext = &features13,
+        .queueCreateInfoCount = 1u,
+        .pQueueCreateInfos = &queueCI
+    };
+    VK_CHECK(vkCreateDevice(ctx.physicalDevice, &deviceCI, nullptr, &ctx.device), "Failed to create device");
+    vkGetDeviceQueue(ctx.device, ctx.queueFamily, 0u, &ctx.queue);
+
+    VkCommandPoolCreateInfo poolCI {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = ctx.queueFamily
+    };
+    VK_CHECK(vkCreateCommandPool(ctx.device, &poolCI, nullptr, &ctx.commandPool), "Failed to create command pool");
+    VkCommandBufferAllocateInfo cmdAI {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = ctx.commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1u
+    };
+    VK_CHECK(vkAllocateCommandBuffers(ctx.device, &cmdAI, &ctx.cmd), "Failed to allocate command buffer");
+    VkFenceCreateInfo fenceCI {.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+    VK_CHECK(vkCreateFence(ctx.device, &fenceCI, nullptr, &ctx.fence), "Failed to create fence");
+
+    if (graphics->timestampValidBits > 0u) {
+        VkQueryPoolCreateInfo queryCI {.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO, .queryType = VK_QUERY_TYPE_TIMESTAMP, .queryCount = 2u};
+        VK_CHECK(vkCreateQueryPool(ctx.device, &queryCI, nullptr, &ctx.timestamps), "Failed to create query pool");
+    }
+    std::cout << std::format("[Replay] device {}", ctx.properties.deviceName) << std::endl;
+    return ctx;
+}
+
+uint32_t findMemoryType(const ReplayContext &ctx, uint32_t typeBits, VkMemoryPropertyFlags properties) {
+    for (uint32_t i = 0u; i < ctx.memoryProperties.memoryTypeCount; ++i) {
+        if ((typeBits & (1u << i)) && (ctx.memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+    RT_THROW("No suitable memory type");
+}
+
+VkDeviceMemory allocateMemory(const ReplayContext &ctx, const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties) {
+    VkMemoryAllocateInfo memoryAI {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = requirements.size,
+        .memoryTypeIndex = findMemoryType(ctx, requirements.memoryTypeBits, properties)
+    };
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VK_CHECK(vkAllocateMemory(ctx.device, &memoryAI, nullptr, &memory), "Failed to allocate memory");
+    return memory;
+}
+
+ReplayBuffer createBuffer(const ReplayContext &ctx, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) {
+    ReplayBuffer buffer{.size = size};
+    VkBufferCreateInfo buffCI {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = std::max(size, VkDeviceSize(4u)), .usage = usage};
+    VK_CHECK(vkCreateBuffer(ctx.device, &buffCI, nullptr, &buffer.buffer), "Failed to create buffer");
+    VkMemoryRequirements requirements{};
+    vkGetBufferMemoryRequirements(ctx.device, buffer.buffer, &requirements);
+    buffer.memory = allocateMemory(ctx, requirements, properties);
+    VK_CHECK(vkBindBufferMemory(ctx.device, buffer.buffer, buffer.memory, 0u), "Failed to bind buffer memory");
+    return buffer;
+}
+
+void submitAndWait(const ReplayContext &ctx) {
+    VkCommandBufferSubmitInfo cmdSubmitInfo {.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO, .commandBuffer = ctx.cmd};
+    VkSubmitInfo2 submitInfo {.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2, .commandBufferInfoCount = 1u, .pCommandBufferInfos = &cmdSubmitInfo};
+    VK_CHECK(vkQueueSubmit2(ctx.queue, 1u, &submitInfo, ctx.fence), "Failed to submit");
+    VK_CHECK(vkWaitForFences(ctx.device, 1u, &ctx.fence, VK_TRUE, std::numeric_limits<uint64_t>::max()), "Failed to wait for fence");
+    VK_CHECK(vkResetFences(ctx.device, 1u, &ctx.fence), "Failed to reset fence");
+}
+
+void beginCommands(const ReplayContext &ctx) {
+    VK_CHECK(vkResetCommandBuffer(ctx.cmd, 0u), "Failed to reset command buffer");
+    VkCommandBufferBeginInfo beginInfo {.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
+    VK_CHECK(vkBeginCommandBuffer(ctx.cmd, &beginInfo), "Failed to begin command buffer");
+}
+
+void uploadBuffer(const ReplayContext &ctx, const ReplayBuffer &buffer, VkDeviceSize offset, std::span<const std::byte> data) {
+    if (offset + data.size() > buffer.size) {
+        RT_THROW("Capture uploads past the end of a buffer");
+    }
+    ReplayBuffer staging = createBuffer(ctx, data.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    void *mapped = nullptr;
+    VK_CHECK(vkMapMemory(ctx.device, staging.memory, 0u, VK_WHOLE_SIZE, 0u, &mapped), "Failed to map staging buffer");
+    memcpy(mapped, data.data(), data.size());
+    vkUnmapMemory(ctx.device, staging.memory);
+
+    beginCommands(ctx);
+    VkBufferCopy region {.srcOffset = 0u, .dstOffset = offset, .size = data.size()};
+    vkCmdCopyBuffer(ctx.cmd, staging.buffer, buffer.buffer, 1u, &region);
+    VkMemoryBarrier2 barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+        .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+        .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        .dstStageMask = VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+        .dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT
+    };
+    VkDependencyInfo depsInfo {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .memoryBarrierCount = 1u, .pMemoryBarriers = &barrier};
+    vkCmdPipelineBarrier2(ctx.cmd, &depsInfo);
+    VK_CHECK(vkEndCommandBuffer(ctx.cmd), "Failed to end command buffer");
+    submitAndWait(ctx);
+
+    vkDestroyBuffer(ctx.device, staging.buffer, nullptr);
+    vkFreeMemory(ctx.device, staging.memory, nullptr);
+}
+
+void loadShader(const ReplayContext &ctx, ReplayCapture &capture, CaptureReader &reader) {
+    auto id = captureGet<uint32_t>(reader);
+    ReplayShader shader{};
+    std::vector<uint32_t> spirv = captureGetArray<uint32_t>(reader);
+    shader.vertexEntry = captureGetString(reader);
+    shader.fragmentEntry = captureGetString(reader);
+    shader.specializationEntries = captureGetArray<VkSpecializationMapEntry>(reader);
+    shader.specializationData = captureGetArray<uint32_t>(reader);
+    auto pushConstantSize = captureGet<uint32_t>(reader);
+
+    // same layout createPipelineLayout() builds, sets without bindings get an empty layout
+    auto setCount = captureGet<uint32_t>(reader);
+    std::vector<std::pair<uint32_t, std::vector<VkDescriptorSetLayoutBinding>>> sets{};
+    for (uint32_t i = 0u; i < setCount; ++i) {
+        auto set = captureGet<uint32_t>(reader);
+        std::vector<VkDescriptorSetLayoutBinding> bindings{};
+        for (auto &binding : captureGetArray<CaptureSetLayoutBinding>(reader)) {
+            bindings.push_back({binding.binding, binding.type, binding.count, binding.stages, nullptr});
+        }
+        sets.emplace_back(set, std::move(bindings));
+    }
+    uint32_t layoutCount = {0u};
+    for (auto &set : sets) {
+        layoutCount = std::max(layoutCount, set.first + 1u);
+    }
+    shader.setLayouts.assign(layoutCount, VK_NULL_HANDLE);
+    for (uint32_t set = 0u; set < layoutCount; ++set) {
+        auto it = std::find_if(sets.begin(), sets.end(), [set](const auto &desc) { return desc.first == set; });
+        VkDescriptorSetLayoutCreateInfo setLayoutCI {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .bindingCount = it != sets.end() ? static_cast<uint32_t>(it->second.size()) : 0u,
+            .pBindings = it != sets.end() ? it->second.data() : nullptr
+        };
+        VK_CHECK(vkCreateDescriptorSetLayout(ctx.device, &setLayoutCI, nullptr, &shader.setLayouts[set]),
+                 "Failed to create descriptorSetLayout");
+    }
+    VkPushConstantRange pushConstants {VK_SHADER_STAGE_ALL_GRAPHICS, 0u, pushConstantSize};
+    VkPipelineLayoutCreateInfo pipLayoutCI {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = layoutCount,
+        .pSetLayouts = shader.setLayouts.data(),
+        .pushConstantRangeCount = pushConstantSize > 0u ? 1u : 0u,
+        .pPushConstantRanges = &pushConstants
+    };
+    VK_CHECK(vkCreatePipelineLayout(ctx.device, &pipLayoutCI, nullptr, &shader.layout), "Failed to create pipeline layout");
+
+    VkShaderModuleCreateInfo moduleCI {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = spirv.size() * sizeof(uint32_t),
+        .pCode = spirv.data()
+    };
+    VK_CHECK(vkCreateShaderModule(ctx.device, &moduleCI, nullptr, &shader.module), "Failed to create shader module");
+    capture.shaders[id] = std::move(shader);
+}
+
+// the capturing device may have supported more samples than this one, fail up front instead of creating invalid images
+void checkSampleCount(const ReplayContext &ctx, VkSampleCountFlagBits samples) {
+    VkSampleCountFlags supported = ctx.properties.limits.framebufferColorSampleCounts & ctx.properties.limits.framebufferDepthSampleCounts;
+    if (!std::has_single_bit(uint32_t(samples)) || !(supported & samples)) {
+        RT_THROW(std::format("Capture renders with {} samples, {} supports color and depth attachments with sample count mask {:#x}",
+                             uint32_t(samples), ctx.properties.deviceName, supported));
+    }
+}
+
+void loadPipeline(const ReplayContext &ctx, ReplayCapture &capture, CaptureReader &reader) {
+    auto id = captureGet<uint32_t>(reader);
+    const ReplayShader &shader = capture.shaders.at(captureGet<uint32_t>(reader));
+    auto state = captureGet<CapturePipelineState>(reader);
+    if (state.vertexAttributeCount > CapturePipelineState::MAX_VERTEX_ATTRIBUTES ||
+        state.colorAttachmentCount > CapturePipelineState::MAX_COLOR_ATTACHMENTS) {
+        RT_THROW("Capture has an invalid pipeline state");
+    }
+    checkSampleCount(ctx, state.samples);
+
+    std::array<VkDynamicState, 2> dynamicStates {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamicStateCI {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .dynamicStateCount = static_cast<uint32_t>(dynamicStates.size()),
+        .pDynamicStates = dynamicStates.data()
+    };
+    VkVertexInputBindingDescription binding {.binding = 0u, .stride = state.vertexStride, .inputRate = VK_VERTEX_INPUT_RATE_VERTEX};
+    VkPipelineVertexInputStateCreateInfo vertexInputCI {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .vertexBindingDescriptionCount = state.vertexStride > 0u ? 1u : 0u,
+        .pVertexBindingDescriptions = &binding,
+        .vertexAttributeDescriptionCount = state.vertexAttributeCount,
+        .pVertexAttributeDescriptions = state.vertexAttributes.data()
+    };
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyCI {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .topology = state.topology
+    };
+    VkPipelineViewportStateCreateInfo viewportCI {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .viewportCount = 1u,
+        .scissorCount = 1u
+    };
+    VkPipelineRasterizationStateCreateInfo rasterizationCI {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .polygonMode = state.polygonMode,
+        .cullMode = state.cullMode,
+        .frontFace = state.frontFace,
+        .lineWidth = 1.0f
+    };
+    VkPipelineMultisampleStateCreateInfo multisampleCI {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .rasterizationSamples = state.samples
+    };
+    VkPipelineDepthStencilStateCreateInfo depthStencilCI {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+        .depthTestEnable = state.depthTestEnable,
+        .depthWriteEnable = state.depthWriteEnable,
+        .depthCompareOp = state.depthCompareOp
+    };
+    std::array<VkPipelineColorBlendAttachmentState, CapturePipelineState::MAX_COLOR_ATTACHMENTS> blendStates{};
+    blendStates.fill(state.blend);
+    VkPipelineColorBlendStateCreateInfo colorBlendCI {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .attachmentCount = state.colorAttachmentCount,
+        .pAttachments = blendStates.data()
+    };
+
+    VkSpecializationInfo specializationInfo {
+        .mapEntryCount = static_cast<uint32_t>(shader.specializationEntries.size()),
+        .pMapEntries = shader.specializationEntries.data(),
+        .dataSize = shader.specializationData.size() * sizeof(uint32_t),
+        .pData = shader.specializationData.data()
+    };
+    std::array<VkPipelineShaderStageCreateInfo, 2> stages {
+        VkPipelineShaderStageCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_VERTEX_BIT,
+            .module = shader.module,
+            .pName = shader.vertexEntry.c_str(),
+            .pSpecializationInfo = &specializationInfo
+        },
+        VkPipelineShaderStageCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .module = shader.module,
+            .pName = shader.fragmentEntry.c_str(),
+            .pSpecializationInfo = &specializationInfo
+        }
+    };
+    VkPipelineRenderingCreateInfo renderingCI {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+        .colorAttachmentCount = state.colorAttachmentCount,
+        .pColorAttachmentFormats = state.colorFormats.data(),
+        .depthAttachmentFormat = state.depthFormat,
+        .stencilAttachmentFormat = state.stencilFormat
+    };
+    VkGraphicsPipelineCreateInfo pipelineCI {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext = &renderingCI,
+        .stageCount = state.depthOnly ? 1u : static_cast<uint32_t>(stages.size()),
+        .pStages = stages.data(),
+        .pVertexInputState = &vertexInputCI,
+        .pInputAssemblyState = &inputAssemblyCI,
+        .pViewportState = &viewportCI,
+        .pRasterizationState = &rasterizationCI,
+        .pMultisampleState = &multisampleCI,
+        .pDepthStencilState = &depthStencilCI,
+        .pColorBlendState = &colorBlendCI,
+        .pDynamicState = &dynamicStateCI,
+        .layout = shader.layout
+    };
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateGraphicsPipelines(ctx.device, VK_NULL_HANDLE, 1u, &pipelineCI, nullptr, &pipeline), "Failed to create pipeline");
+    capture.pipelines[id] = pipeline;
+}
+
+void loadDescriptorSet(const ReplayContext &ctx, ReplayCapture &capture, CaptureReader &reader) {
+    auto id = captureGet<uint32_t>(reader);
+    const ReplayShader &shader = capture.shaders.at(captureGet<uint32_t>(reader));
+    auto set = captureGet<uint32_t>(reader);
+    std::vector<CaptureDescriptorWrite> writes = captureGetArray<CaptureDescriptorWrite>(reader);
+    if (set >= shader.setLayouts.size()) {
+        RT_THROW("Capture writes a descriptor set the shader doesn't have");
+    }
+
+    // one small pool per set, captures hold a handful of them
+    std::vector<VkDescriptorPoolSize> poolSizes{};
+    for (auto &write : writes) {
+        poolSizes.push_back({write.type, 1u});
+    }
+    VkDescriptorPoolCreateInfo poolCI {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = 1u,
+        .poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
+        .pPoolSizes = poolSizes.data()
+    };
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateDescriptorPool(ctx.device, &poolCI, nullptr, &pool), "Failed to create descriptor pool");
+    capture.descriptorPools.push_back(pool);
+    VkDescriptorSetAllocateInfo setAI {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = pool,
+        .descriptorSetCount = 1u,
+        .pSetLayouts = &shader.setLayouts[set]
+    };
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    VK_CHECK(vkAllocateDescriptorSets(ctx.device, &setAI, &descriptorSet), "Failed to allocate descriptor set");
+
+    std::vector<VkDescriptorBufferInfo> bufferInfos(writes.size());
+    std::vector<VkWriteDescriptorSet> descriptorWrites(writes.size());
+    for (size_t i = 0u; i < writes.size(); ++i) {
+        bufferInfos[i] = {capture.buffers.at(writes[i].buffer).buffer, writes[i].offset, writes[i].range};
+        descriptorWrites[i] = {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptorSet,
+            .dstBinding = writes[i].binding,
+            .descriptorCount = 1u,
+            .descriptorType = writes[i].type,
+            .pBufferInfo = &bufferInfos[i]
+        };
+    }
+    vkUpdateDescriptorSets(ctx.device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0u, nullptr);
+    capture.descriptorSets[id] = descriptorSet;
+}
+
+// creates every resource right away and keeps the frame commands, creation records may sit between frame commands
+ReplayCapture loadCapture(const ReplayContext &ctx, std::span<const std::byte> data) {
+    CaptureReader reader{.data = data};
+    auto header = captureGet<CaptureHeader>(reader);
+    if (header.magic != CAPTURE_MAGIC || header.version != CAPTURE_VERSION) {
+        RT_THROW(std::format("Not a version {} capture", CAPTURE_VERSION));
+    }
+
+    ReplayCapture capture{};
+    std::vector<ReplayCommand> *frame = nullptr;
+    for (auto op = captureGet<CaptureOp>(reader); op != CaptureOp::End; op = captureGet<CaptureOp>(reader)) {
+        ReplayCommand command{.op = op};
+        switch (op) {
+        case CaptureOp::CreateBuffer: {
+            auto id = captureGet<uint32_t>(reader);
+            auto size = captureGet<VkDeviceSize>(reader);
+            auto usage = captureGet<VkBufferUsageFlags>(reader);
+            capture.buffers[id] = createBuffer(ctx, size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            continue;
+        }
+        case CaptureOp::UploadBuffer: {
+            const ReplayBuffer &buffer = capture.buffers.at(captureGet<uint32_t>(reader));
+            auto offset = captureGet<VkDeviceSize>(reader);
+            std::vector<std::byte> bytes = captureGetArray<std::byte>(reader);
+            uploadBuffer(ctx, buffer, offset, bytes);
+            continue;
+        }
+        case CaptureOp::CreateShader:
+            loadShader(ctx, capture, reader);
+            continue;
+        case CaptureOp::CreatePipeline:
+            loadPipeline(ctx, capture, reader);
+            continue;
+        case CaptureOp::CreateDescriptorSet:
+            loadDescriptorSet(ctx, capture, reader);
+            continue;
+        case CaptureOp::BeginFrame:
+            captureGet<uint32_t>(reader);
+            frame = &capture.frames.emplace_back();
+            continue;
+        case CaptureOp::BeginRendering: {
+            auto rendering = captureGet<CaptureRendering>(reader);
+            checkSampleCount(ctx, rendering.samples);
+            if (capture.frames.size() == 1u) {
+                capture.rendering = rendering;
+            } else if (rendering.extent.width != capture.rendering.extent.width ||
+                       rendering.extent.height != capture.rendering.extent.height) {
+                RT_THROW("Captured frames differ in extent");
+            }
+            break;
+        }
+        case CaptureOp::BindPipeline:
+            command.pipeline = capture.pipelines.at(captureGet<uint32_t>(reader));
+            break;
+        case CaptureOp::BindVertexBuffer:
+        case CaptureOp::BindIndexBuffer:
+            command.buffer = capture.buffers.at(captureGet<uint32_t>(reader)).buffer;
+            command.offset = captureGet<VkDeviceSize>(reader);
+            break;
+        case CaptureOp::BindDescriptorSet:
+            command.layout = capture.shaders.at(captureGet<uint32_t>(reader)).layout;
+            command.set = captureGet<uint32_t>(reader);
+            command.descriptorSet = capture.descriptorSets.at(captureGet<uint32_t>(reader));
+            break;
+        case CaptureOp::PushConstants:
+            command.layout = capture.shaders.at(captureGet<uint32_t>(reader)).layout;
+            command.constants = captureGetArray<uint32_t>(reader);
+            break;
+        case CaptureOp::DrawIndexed:
+            command.draw = captureGet<CaptureDrawIndexed>(reader);
+            break;
+        case CaptureOp::EndRendering:
+        case CaptureOp::EndFrame:
+            break;
+        default:
+            RT_THROW(std::format("Unknown capture op {}", static_cast<uint32_t>(op)));
+        }
+        if (frame == nullptr) {
+            RT_THROW("Capture has frame commands outside of a frame");
+        }
+        frame->push_back(std::move(command));
+    }
+    if (capture.frames.size() != header.frameCount) {
+        RT_THROW(std::format("Capture has {} frames, header says {}", capture.frames.size(), header.frameCount));
+    }
+    return capture;
+}
+
+ReplayImage createAttachment(const ReplayContext &ctx, VkExtent2D extent, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect,
+                             VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT) {
+    ReplayImage image{};
+    VkImageCreateInfo imageCI {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = format,
+        .extent = {extent.width, extent.height, 1u},
+        .mipLevels = 1u,
+        .arrayLayers = 1u,
+        .samples = samples,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = usage,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+    };
+    VK_CHECK(vkCreateImage(ctx.device, &imageCI, nullptr, &image.image), "Failed to create attachment");
+    VkMemoryRequirements requirements{};
+    vkGetImageMemoryRequirements(ctx.device, image.image, &requirements);
+    image.memory = allocateMemory(ctx, requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    VK_CHECK(vkBindImageMemory(ctx.device, image.image, image.memory, 0u), "Failed to bind attachment memory");
+    VkImageViewCreateInfo viewCI {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = image.image,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = format,
+        .subresourceRange = {aspect, 0u, 1u, 0u, 1u}
+    };
+    VK_CHECK(vkCreateImageView(ctx.device, &viewCI, nullptr, &image.view), "Failed to create attachment view");
+    return image;
+}
+
+bool hasStencil(VkFormat format) {
+    return format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+// one captured frame into the offscreen attachments, the previous contents are discarded like a new swapchain image.
+// Multisampled color is resolved into resolve at the end of the pass, its image is null otherwise
+void recordFrame(const ReplayContext &ctx, const ReplayCapture &capture, const std::vector<ReplayCommand> &frame,
+                 const ReplayImage &color, const ReplayImage &depth, const ReplayImage &resolve) {
+    const CaptureRendering &rendering = capture.rendering;
+    VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT | (hasStencil(rendering.depthFormat) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0u);
+    beginCommands(ctx);
+    if (ctx.timestamps != VK_NULL_HANDLE) {
+        vkCmdResetQueryPool(ctx.cmd, ctx.timestamps, 0u, 2u);
+        vkCmdWriteTimestamp2(ctx.cmd, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, ctx.timestamps, 0u);
+    }
+    std::vector<VkImageMemoryBarrier2> imgBarriers {
+        VkImageMemoryBarrier2{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .srcAccessMask = 0u,
+            .dstStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            .image = color.image,
+            .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u}
+        },
+        VkImageMemoryBarrier2{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+            .srcAccessMask = 0u,
+            .dstStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+            .dstAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            .image = depth.image,
+            .subresourceRange = {depthAspect, 0u, 1u, 0u, 1u}
+        }
+    };
+    if (resolve.image != VK_NULL_HANDLE) {
+        VkImageMemoryBarrier2 resolveBarrier = imgBarriers[0];
+        resolveBarrier.dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+        resolveBarrier.image = resolve.image;
+        imgBarriers.push_back(resolveBarrier);
+    }
+    VkDependencyInfo depsInfo {
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .imageMemoryBarrierCount = static_cast<uint32_t>(imgBarriers.size()),
+        .pImageMemoryBarriers = imgBarriers.data()
+    };
+    vkCmdPipelineBarrier2(ctx.cmd, &depsInfo);
+
+    VkRenderingAttachmentInfo colorAttachInfo {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+        .imageView = color.view,
+        .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        .resolveMode = resolve.image != VK_NULL_HANDLE ? VK_RESOLVE_MODE_AVERAGE_BIT : VK_RESOLVE_MODE_NONE,
+        .resolveImageView = resolve.view,
+        .resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = resolve.image != VK_NULL_HANDLE ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE
+    };
+    std::copy(rendering.clearColor.begin(), rendering.clearColor.end(), colorAttachInfo.clearValue.color.float32);
+    VkRenderingAttachmentInfo depthAttachInfo {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+        .imageView = depth.view,
+        .imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        .clearValue = {.depthStencil = {rendering.clearDepth, 0u}}
+    };
+    VkRenderingInfo renderingInfo {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+        .renderArea = {{0, 0}, rendering.extent},
+        .layerCount = 1u,
+        .colorAttachmentCount = 1u,
+        .pColorAttachments = &colorAttachInfo,
+        .pDepthAttachment = &depthAttachInfo
+    };
+    VkViewport viewport{0.0f, 0.0f, (float) rendering.extent.width, (float) rendering.extent.height, 0.0f, 1.0f};
+    VkRect2D scissor{{0, 0}, rendering.extent};
+
+    for (auto &command : frame) {
+        switch (command.op) {
+        case CaptureOp::BeginRendering:
+            vkCmdBeginRendering(ctx.cmd, &renderingInfo);
+            vkCmdSetViewport(ctx.cmd, 0u, 1u, &viewport);
+            vkCmdSetScissor(ctx.cmd, 0u, 1u, &scissor);
+            break;
+        case CaptureOp::BindPipeline:
+            vkCmdBindPipeline(ctx.cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, command.pipeline);
+            break;
+        case CaptureOp::BindVertexBuffer:
+            vkCmdBindVertexBuffers(ctx.cmd, 0u, 1u, &command.buffer, &command.offset);
+            break;
+        case CaptureOp::BindIndexBuffer:
+            vkCmdBindIndexBuffer(ctx.cmd, command.buffer, command.offset, VK_INDEX_TYPE_UINT32);
+            break;
+        case CaptureOp::BindDescriptorSet:
+            vkCmdBindDescriptorSets(ctx.cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, command.layout, command.set, 1u, &command.descriptorSet, 0u, nullptr);
+            break;
+        case CaptureOp::PushConstants:
+            vkCmdPushConstants(ctx.cmd, command.layout, VK_SHADER_STAGE_ALL_GRAPHICS, 0u,
+                               static_cast<uint32_t>(command.constants.size() * sizeof(uint32_t)), command.constants.data());
+            break;
+        case CaptureOp::DrawIndexed:
+            vkCmdDrawIndexed(ctx.cmd, command.draw.indexCount, command.draw.instanceCount, command.draw.firstIndex,
+                             command.draw.vertexOffset, command.draw.firstInstance);
+            break;
+        case CaptureOp::EndRendering:
+            vkCmdEndRendering(ctx.cmd);
+            break;
+        default:
+            break;
+        }
+    }
+    if (ctx.timestamps != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp2(ctx.cmd, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, ctx.timestamps, 1u);
+    }
+    VK_CHECK(vkEndCommandBuffer(ctx.cmd), "Failed to end command buffer");
+}
+
+struct FrameTimes {
+    std::vector<double> cpuMs{};
+    std::vector<double> gpuMs{};
+};
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1u, static_cast<size_t>(p * (values.size() - 1u) + 0.5))];
+}
+
+void report(const std::string &label, const std::vector<double> &ms) {
+    if (ms.empty()) {
+        return;
+    }
+    std::cout << std::format("[Replay] {} ms: min {:.3f} median {:.3f} p95 {:.3f} p99 {:.3f} max {:.3f}", label,
+                             percentile(ms, 0.0), percentile(ms, 0.5), percentile(ms, 0.95), percentile(ms, 0.99),
+                             percentile(ms, 1.0)) << std::endl;
+}
+
+int main(int argc, char **argv) {
+    try {
+        ReplayOptions options = parseOptions(argc, argv);
+        std::vector<std::byte> data = readCapture(options.capturePath);
+        ReplayContext ctx = createReplayContext(options);
+        ReplayCapture capture = loadCapture(ctx, data);
+        if (capture.frames.empty()) {
+            RT_THROW("Capture has no frames");
+        }
+        size_t draws = std::count_if(capture.frames[0].begin(), capture.frames[0].end(),
+                                     [](const ReplayCommand &command) { return command.op == CaptureOp::DrawIndexed; });
+        std::cout << std::format("[Replay] {}: {} frames at {}x{}, {} draws per frame, {} pipelines", options.capturePath,
+                                 capture.frames.size(), capture.rendering.extent.width, capture.rendering.extent.height, draws,
+                                 capture.pipelines.size()) << std::endl;
+
+        VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT | (hasStencil(capture.rendering.depthFormat) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0u);
+        VkSampleCountFlagBits samples = capture.rendering.samples;
+        ReplayImage color = createAttachment(ctx, capture.rendering.extent, capture.rendering.colorFormat,
+                                             VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT, samples);
+        ReplayImage depth = createAttachment(ctx, capture.rendering.extent, capture.rendering.depthFormat,
+                                             VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, depthAspect, samples);
+        ReplayImage resolve{};
+        if (samples != VK_SAMPLE_COUNT_1_BIT) {
+            resolve = createAttachment(ctx, capture.rendering.extent, capture.rendering.colorFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+                                       VK_IMAGE_ASPECT_COLOR_BIT);
+        }
+
+        // each iteration replays all captured frames in order, one submit and fence wait per frame
+        FrameTimes times{};
+        for (uint32_t iteration = 0u; iteration < options.warmup + options.iterations; ++iteration) {
+            for (auto &frame : capture.frames) {
+                auto start = std::chrono::steady_clock::now();
+                recordFrame(ctx, capture, frame, color, depth, resolve);
+                submitAndWait(ctx);
+                double cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                if (iteration < options.warmup) {
+                    continue;
+                }
+                times.cpuMs.push_back(cpuMs);
+                if (ctx.timestamps != VK_NULL_HANDLE) {
+                    std::array<uint64_t, 2> ticks{};
+                    VK_CHECK(vkGetQueryPoolResults(ctx.device, ctx.timestamps, 0u, 2u, sizeof(ticks), ticks.data(), sizeof(uint64_t),
+                                                   VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT), "Failed to read timestamps");
+                    times.gpuMs.push_back((ticks[1] - ticks[0]) * ctx.properties.limits.timestampPeriod / 1e6);
+                }
+            }
+        }
+        report("cpu frame (record, submit, wait)", times.cpuMs);
+        report("gpu frame", times.gpuMs);
+    } catch (std::exception &e) {
+        std::cout << e.what() << std::endl;
+        return -3;
+    }
+    return 0;
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// Command stream of captured frames, written by vulkan14 --capture and executed by vulkan14_replay.
+// A record is a CaptureOp byte followed by its POD fields. Resources are referred to by ids assigned in creation
+// order, so a capture doesn't depend on the handles or the device of the process that wrote it.
+
+constexpr uint32_t CAPTURE_MAGIC = {0x50414356u}; // "VCAP"
+constexpr uint32_t CAPTURE_VERSION = {3u};
+
+enum class CaptureOp : uint8_t {
+    CreateBuffer = 1u,   // id, size, usage
+    UploadBuffer,        // id, offset, bytes
+    CreateShader,        // id, spirv, entry points, specialization, push constant size, set layouts
+    CreatePipeline,      // id, shader id, CapturePipelineState
+    CreateDescriptorSet, // id, shader id, set, CaptureDescriptorWrite list
+    BeginFrame,          // frame index
+    BeginRendering,      // CaptureRendering
+    BindPipeline,        // pipeline id
+    BindVertexBuffer,    // buffer id, offset
+    BindIndexBuffer,     // buffer id, offset
+    BindDescriptorSet,   // shader id of the layout, set, descriptor set id
+    PushConstants,       // shader id of the layout, bytes
+    DrawIndexed,         // CaptureDrawIndexed
+    EndRendering,
+    EndFrame,
+    End
+};
+
+struct CaptureHeader {
+    uint32_t magic = {CAPTURE_MAGIC};
+    uint32_t version = {CAPTURE_VERSION};
+    uint32_t frameCount = {0u};
+    uint32_t reserved = {0u};
+};
+
+// fixed function state of one pipeline, the same fields PipelineStateKey has
+struct CapturePipelineState {
+    static constexpr uint32_t MAX_VERTEX_ATTRIBUTES = {8u};
+    static constexpr uint32_t MAX_COLOR_ATTACHMENTS = {4u};
+
+    uint32_t vertexStride = {0u};
+    uint32_t vertexAttributeCount = {0u};
+    std::array<VkVertexInputAttributeDescription, MAX_VERTEX_ATTRIBUTES> vertexAttributes{};
+    uint32_t colorAttachmentCount = {0u};
+    std::array<VkFormat, MAX_COLOR_ATTACHMENTS> colorFormats{};
+    VkFormat depthFormat = {VK_FORMAT_UNDEFINED};
+    VkFormat stencilFormat = {VK_FORMAT_UNDEFINED};
+    VkSampleCountFlagBits samples = {VK_SAMPLE_COUNT_1_BIT};
+    VkPrimitiveTopology topology = {VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST};
+    VkPolygonMode polygonMode = {VK_POLYGON_MODE_FILL};
+    VkCullModeFlags cullMode = {VK_CULL_MODE_NONE};
+    VkFrontFace frontFace = {VK_FRONT_FACE_COUNTER_CLOCKWISE};
+    VkBool32 depthTestEnable = {VK_TRUE};
+    VkBool32 depthWriteEnable = {VK_TRUE};
+    VkCompareOp depthCompareOp = {VK_COMPARE_OP_LESS_OR_EQUAL};
+    VkBool32 depthOnly = {VK_FALSE}; // vertex stage only, the depth pre-pass
+    VkPipelineColorBlendAttachmentState blend{};
+};
+
+struct CaptureDescriptorWrite {
+    uint32_t binding = {0u};
+    VkDescriptorType type = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER};
+    uint32_t buffer = {0u};
+    VkDeviceSize offset = {0u};
+    VkDeviceSize range = {VK_WHOLE_SIZE};
+};
+
+struct CaptureSetLayoutBinding {
+    uint32_t binding = {0u};
+    VkDescriptorType type = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER};
+    uint32_t count = {1u};
+    VkShaderStageFlags stages = {0u};
+};
+
+// single color and depth attachment of the scene pass
+struct CaptureRendering {
+    VkExtent2D extent{};
+    VkFormat colorFormat = {VK_FORMAT_UNDEFINED};
+    VkFormat depthFormat = {VK_FORMAT_UNDEFINED};
+    std::array<float, 4> clearColor{};
+    float clearDepth = {1.0f};
+    VkSampleCountFlagBits samples = {VK_SAMPLE_COUNT_1_BIT}; // of both attachments, color is resolved when above 1
+};
+
+struct CaptureDrawIndexed {
+    uint32_t indexCount = {0u};
+    uint32_t instanceCount = {1u};
+    uint32_t firstIndex = {0u};
+    int32_t vertexOffset = {0};
+    uint32_t firstInstance = {0u};
+};
+
+template <typename T>
+void capturePut(std::vector<std::byte> &stream, const T &value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    auto bytes = std::as_bytes(std::span(&value, 1u));
+    stream.insert(stream.end(), bytes.begin(), bytes.end());
+}
+
+template <typename T>
+void capturePutArray(std::vector<std::byte> &stream, std::span<const T> values) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    capturePut(stream, uint64_t(values.size()));
+    auto bytes = std::as_bytes(values);
+    stream.insert(stream.end(), bytes.begin(), bytes.end());
+}
+
+inline void capturePutString(std::vector<std::byte> &stream, std::string_view value) {
+    capturePutArray(stream, std::span(value.data(), value.size()));
+}
+
+struct CaptureReader {
+    std::span<const std::byte> data{};
+    size_t offset = {0u};
+};
+
+inline std::span<const std::byte> captureGetBytes(CaptureReader &reader, size_t size) {
+    if (size > reader.data.size() - reader.offset) {
+        throw std::runtime_error("Capture is truncated");
+    }
+    auto bytes = reader.data.subspan(reader.offset, size);
+    reader.offset += size;
+    return bytes;
+}
+
+template <typename T>
+T captureGet(CaptureReader &reader) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    T value{};
+    memcpy(&value, captureGetBytes(reader, sizeof(T)).data(), sizeof(T));
+    return value;
+}
+
+template <typename T>
+std::vector<T> captureGetArray(CaptureReader &reader) {
+    auto count = captureGet<uint64_t>(reader);
+    if (count > (reader.data.size() - reader.offset) / sizeof(T)) {
+        throw std::runtime_error("Capture is truncated");
+    }
+    std::vector<T> values(count);
+    memcpy(values.data(), captureGetBytes(reader, count * sizeof(T)).data(), count * sizeof(T));
+    return values;
+}
+
+inline std::string captureGetString(CaptureReader &reader) {
+    std::vector<char> chars = captureGetArray<char>(reader);
+    return {chars.begin(), chars.end()};
+}
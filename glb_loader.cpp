@@ -0,0 +1,545 @@
+#include "glb_loader.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint32_t GLB_MAGIC = 0x46546C67u;      // "glTF"
+constexpr uint32_t GLB_CHUNK_JSON = 0x4E4F534Au; // "JSON"
+constexpr uint32_t GLB_CHUNK_BIN = 0x004E4942u;  // "BIN\0"
+constexpr uint32_t GLB_TRIANGLES = 4u;
+constexpr int JSON_MAX_DEPTH = 128;
+
+// just enough JSON for the glTF chunk, numbers as double, objects keep their order
+struct JsonValue {
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type type = {Type::Null};
+    bool boolean = {false};
+    double number = {0.0};
+    std::string string{};
+    std::vector<JsonValue> array{};
+    std::vector<std::pair<std::string, JsonValue>> object{};
+
+    const JsonValue *find(std::string_view key) const {
+        for (auto &[name, value] : object) {
+            if (name == key) {
+                return &value;
+            }
+        }
+        return nullptr;
+    }
+};
+
+struct JsonParser {
+    const char *begin = nullptr;
+    const char *p = nullptr;
+    const char *end = nullptr;
+
+    [[noreturn]] void fail(std::string_view what) const {
+        throw std::runtime_error(std::format("Invalid glTF JSON at offset {}: {}", p - begin, what));
+    }
+
+    void skipSpace() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+            ++p;
+        }
+    }
+
+    bool consume(char c) {
+        skipSpace();
+        if (p < end && *p == c) {
+            ++p;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c) {
+        if (!consume(c)) {
+            fail(std::format("expected '{}'", c));
+        }
+    }
+
+    static void appendUtf8(std::string &out, uint32_t code) {
+        if (code < 0x80u) {
+            out += char(code);
+        } else if (code < 0x800u) {
+            out += char(0xC0u | (code >> 6));
+            out += char(0x80u | (code & 0x3Fu));
+        } else if (code < 0x10000u) {
+            out += char(0xE0u | (code >> 12));
+            out += char(0x80u | ((code >> 6) & 0x3Fu));
+            out += char(0x80u | (code & 0x3Fu));
+        } else {
+            out += char(0xF0u | (code >> 18));
+            out += char(0x80u | ((code >> 12) & 0x3Fu));
+            out += char(0x80u | ((code >> 6) & 0x3Fu));
+            out += char(0x80u | (code & 0x3Fu));
+        }
+    }
+
+    uint32_t parseHex4() {
+        uint32_t code = 0u;
+        if (end - p < 4 || std::from_chars(p, p + 4, code, 16).ptr != p + 4) {
+            fail("bad \\u escape");
+        }
+        p += 4;
+        return code;
+    }
+
+    std::string parseString() {
+        expect('"');
+        std::string out{};
+        while (true) {
+            const char *run = p;
+            while (p < end && *p != '"' && *p != '\\') {
+                ++p;
+            }
+            out.append(run, p);
+            if (p == end) {
+                fail("unterminated string");
+            }
+            if (*p++ == '"') {
+                return out;
+            }
+            if (p == end) {
+                fail("unterminated escape");
+            }
+            switch (char c = *p++) {
+                case '"': case '\\': case '/': out += c; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    uint32_t code = parseHex4();
+                    if (code >= 0xD800u && code < 0xDC00u && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                        p += 2;
+                        code = 0x10000u + ((code - 0xD800u) << 10) + (parseHex4() - 0xDC00u);
+                    }
+                    appendUtf8(out, code);
+                    break;
+                }
+                default: fail("bad escape");
+            }
+        }
+    }
+
+    JsonValue parseValue(int depth) {
+        if (depth > JSON_MAX_DEPTH) {
+            fail("nested too deeply");
+        }
+        skipSpace();
+        if (p == end) {
+            fail("unexpected end");
+        }
+        JsonValue value{};
+        if (*p == '{') {
+            ++p;
+            value.type = JsonValue::Type::Object;
+            if (consume('}')) {
+                return value;
+            }
+            do {
+                skipSpace();
+                std::string key = parseString();
+                expect(':');
+                value.object.emplace_back(std::move(key), parseValue(depth + 1));
+            } while (consume(','));
+            expect('}');
+        } else if (*p == '[') {
+            ++p;
+            value.type = JsonValue::Type::Array;
+            if (consume(']')) {
+                return value;
+            }
+            do {
+                value.array.push_back(parseValue(depth + 1));
+            } while (consume(','));
+            expect(']');
+        } else if (*p == '"') {
+            value.type = JsonValue::Type::String;
+            value.string = parseString();
+        } else if (std::string_view(p, end).starts_with("true")) {
+            value.type = JsonValue::Type::Bool;
+            value.boolean = true;
+            p += 4;
+        } else if (std::string_view(p, end).starts_with("false")) {
+            value.type = JsonValue::Type::Bool;
+            p += 5;
+        } else if (std::string_view(p, end).starts_with("null")) {
+            p += 4;
+        } else {
+            value.type = JsonValue::Type::Number;
+            auto [next, ec] = std::from_chars(p, end, value.number);
+            if (ec != std::errc{}) {
+                fail("bad value");
+            }
+            p = next;
+        }
+        return value;
+    }
+};
+
+const JsonValue &member(const JsonValue &object, std::string_view key) {
+    static const JsonValue null{};
+    const JsonValue *value = object.find(key);
+    return value != nullptr ? *value : null;
+}
+
+double number(const JsonValue &object, std::string_view key, double fallback) {
+    const JsonValue &value = member(object, key);
+    return value.type == JsonValue::Type::Number ? value.number : fallback;
+}
+
+// counts, offsets and indices, negative or fractional numbers are rejected before they reach an integer cast
+uint64_t integer(const JsonValue &value) {
+    if (value.type != JsonValue::Type::Number || !(value.number >= 0.0) || value.number > 9007199254740992.0 ||
+        value.number != std::floor(value.number)) {
+        throw std::runtime_error(std::format("Invalid glTF integer {}", value.number));
+    }
+    return uint64_t(value.number);
+}
+
+uint64_t integer(const JsonValue &object, std::string_view key, uint64_t fallback) {
+    const JsonValue &value = member(object, key);
+    return value.type == JsonValue::Type::Number ? integer(value) : fallback;
+}
+
+int32_t index(const JsonValue &value) {
+    uint64_t i = integer(value);
+    if (i > uint64_t(std::numeric_limits<int32_t>::max())) {
+        throw std::runtime_error(std::format("Invalid glTF index {}", i));
+    }
+    return int32_t(i);
+}
+
+// -1 when missing
+int32_t index(const JsonValue &object, std::string_view key) {
+    const JsonValue &value = member(object, key);
+    return value.type == JsonValue::Type::Null ? -1 : index(value);
+}
+
+std::string string(const JsonValue &object, std::string_view key) {
+    const JsonValue &value = member(object, key);
+    return value.type == JsonValue::Type::String ? value.string : std::string{};
+}
+
+template <size_t N>
+std::array<float, N> floats(const JsonValue &object, std::string_view key, std::array<float, N> fallback) {
+    const JsonValue &value = member(object, key);
+    if (value.array.size() == N) {
+        for (size_t i = 0u; i < N; ++i) {
+            fallback[i] = float(value.array[i].number);
+        }
+    }
+    return fallback;
+}
+
+uint32_t componentCount(const std::string &type) {
+    if (type == "SCALAR") return 1u;
+    if (type == "VEC2") return 2u;
+    if (type == "VEC3") return 3u;
+    if (type == "VEC4" || type == "MAT2") return 4u;
+    if (type == "MAT3") return 9u;
+    if (type == "MAT4") return 16u;
+    throw std::runtime_error(std::format("Unknown glTF accessor type {}", type));
+}
+
+uint32_t readU32(const char *p) {
+    uint32_t value = 0u;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+using Mat4 = std::array<float, 16>; // column-major
+
+Mat4 multiply(const Mat4 &a, const Mat4 &b) {
+    Mat4 result{};
+    for (int col = 0; col < 4; ++col) {
+        for (int row = 0; row < 4; ++row) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; ++k) {
+                sum += a[k * 4 + row] * b[col * 4 + k];
+            }
+            result[col * 4 + row] = sum;
+        }
+    }
+    return result;
+}
+
+// matrix or translation * rotation * scale
+Mat4 localTransform(const JsonValue &node) {
+    if (node.find("matrix") != nullptr) {
+        return floats<16>(node, "matrix", GlbInstance{}.transform);
+    }
+    auto t = floats<3>(node, "translation", {0.0f, 0.0f, 0.0f});
+    auto r = floats<4>(node, "rotation", {0.0f, 0.0f, 0.0f, 1.0f});
+    auto s = floats<3>(node, "scale", {1.0f, 1.0f, 1.0f});
+    float x = r[0], y = r[1], z = r[2], w = r[3];
+    return {
+        (1.0f - 2.0f * (y * y + z * z)) * s[0], (2.0f * (x * y + z * w)) * s[0], (2.0f * (x * z - y * w)) * s[0], 0.0f,
+        (2.0f * (x * y - z * w)) * s[1], (1.0f - 2.0f * (x * x + z * z)) * s[1], (2.0f * (y * z + x * w)) * s[1], 0.0f,
+        (2.0f * (x * z + y * w)) * s[2], (2.0f * (y * z - x * w)) * s[2], (1.0f - 2.0f * (x * x + y * y)) * s[2], 0.0f,
+        t[0], t[1], t[2], 1.0f
+    };
+}
+
+// nodes form disjoint trees, a node reached twice is a cycle or a shared child and would expand without bound
+void collectInstances(const JsonValue &nodes, int32_t node, const Mat4 &parent, int depth, std::vector<bool> &visited,
+                      GlbFile &file) {
+    if (node < 0 || size_t(node) >= nodes.array.size() || depth > JSON_MAX_DEPTH || visited[node]) {
+        throw std::runtime_error(std::format("Invalid glTF node hierarchy at node {}", node));
+    }
+    visited[node] = true;
+    const JsonValue &desc = nodes.array[node];
+    Mat4 world = multiply(parent, localTransform(desc));
+    if (int32_t mesh = index(desc, "mesh"); mesh >= 0) {
+        if (size_t(mesh) >= file.meshes.size()) {
+            throw std::runtime_error(std::format("glTF node {} references missing mesh {}", node, mesh));
+        }
+        file.instances.push_back({uint32_t(mesh), world});
+    }
+    for (auto &child : member(desc, "children").array) {
+        collectInstances(nodes, index(child), world, depth + 1, visited, file);
+    }
+}
+
+}
+
+std::span<const std::byte> GlbFile::data(const GlbAccessor &accessor) const {
+    if (accessor.count == 0u) {
+        return {};
+    }
+    uint64_t size = (accessor.count - 1u) * accessor.byteStride + glbComponentSize(accessor.componentType) * accessor.components;
+    return bin.subspan(accessor.byteOffset, size);
+}
+
+uint32_t glbComponentSize(uint32_t componentType) {
+    switch (componentType) {
+        case GLB_BYTE: case GLB_UNSIGNED_BYTE: return 1u;
+        case GLB_SHORT: case GLB_UNSIGNED_SHORT: return 2u;
+        case GLB_UNSIGNED_INT: case GLB_FLOAT: return 4u;
+        default: throw std::runtime_error(std::format("Unknown glTF component type {}", componentType));
+    }
+}
+
+int32_t glbAttribute(const GlbPrimitive &primitive, std::string_view semantic) {
+    for (auto &[name, accessor] : primitive.attributes) {
+        if (name == semantic) {
+            return accessor;
+        }
+    }
+    return -1;
+}
+
+GlbFile openGlb(const std::string &path) {
+    // accessors are read in mesh order, not front to back
+    auto mapped = std::make_shared<MappedFile>(path, MADV_WILLNEED);
+    const char *data = mapped->data;
+    if (mapped->size < 20u || readU32(data) != GLB_MAGIC || readU32(data + 4) != 2u) {
+        throw std::runtime_error(std::format("{} is not a glTF 2.0 binary", path));
+    }
+    size_t length = std::min<size_t>(readU32(data + 8), mapped->size);
+    uint32_t jsonLength = readU32(data + 12);
+    if (readU32(data + 16) != GLB_CHUNK_JSON || 20u + size_t(jsonLength) > length) {
+        throw std::runtime_error(std::format("{} has no JSON chunk", path));
+    }
+    GlbFile file{};
+    size_t binChunk = 20u + ((size_t(jsonLength) + 3u) & ~size_t(3u)); // chunks are 4 byte aligned
+    if (binChunk + 8u <= length && readU32(data + binChunk + 4) == GLB_CHUNK_BIN) {
+        size_t binLength = std::min<size_t>(readU32(data + binChunk), length - binChunk - 8u);
+        file.bin = {reinterpret_cast<const std::byte*>(data + binChunk + 8u), binLength};
+    }
+
+    JsonParser parser{data + 20, data + 20, data + 20 + jsonLength};
+    JsonValue json = parser.parseValue(0);
+
+    for (auto &extension : member(json, "extensionsRequired").array) {
+        throw std::runtime_error(std::format("{} requires unsupported extension {}", path, extension.string));
+    }
+    auto &buffers = member(json, "buffers").array;
+    if (!buffers.empty() && (buffers.size() > 1u || buffers[0].find("uri") != nullptr)) {
+        throw std::runtime_error(std::format("{} references external buffers, only the embedded BIN chunk is supported", path));
+    }
+
+    auto &views = member(json, "bufferViews").array;
+    for (auto &desc : member(json, "accessors").array) {
+        int32_t view = index(desc, "bufferView");
+        if (view < 0 || size_t(view) >= views.size() || desc.find("sparse") != nullptr) {
+            throw std::runtime_error(std::format("{}: sparse accessors and accessors without buffer view are not supported", path));
+        }
+        if (index(views[view], "buffer") != 0) { // every view is read from the BIN chunk, buffer 0
+            throw std::runtime_error(std::format("{}: buffer view {} is not in the embedded BIN chunk", path, view));
+        }
+        uint64_t byteStride = integer(views[view], "byteStride", 0u);
+        if (byteStride > 252u) { // glTF maximum, keeps the bounds check below from overflowing
+            throw std::runtime_error(std::format("{}: buffer view {} has byte stride {}", path, view, byteStride));
+        }
+        GlbAccessor accessor {
+            .byteOffset = integer(views[view], "byteOffset", 0u) + integer(desc, "byteOffset", 0u),
+            .byteStride = uint32_t(byteStride),
+            .componentType = uint32_t(std::min<uint64_t>(integer(desc, "componentType", 0u), std::numeric_limits<uint32_t>::max())),
+            .components = componentCount(string(desc, "type")),
+            .normalized = member(desc, "normalized").boolean,
+            .count = integer(desc, "count", 0u)
+        };
+        uint32_t elementSize = glbComponentSize(accessor.componentType) * accessor.components;
+        if (accessor.byteStride == 0u) {
+            accessor.byteStride = elementSize;
+        }
+        uint64_t viewEnd = integer(views[view], "byteOffset", 0u) + integer(views[view], "byteLength", 0u);
+        if (accessor.count > 0u && (accessor.count > file.bin.size() || viewEnd > file.bin.size() ||
+                                    accessor.byteOffset + (accessor.count - 1u) * accessor.byteStride + elementSize > viewEnd)) {
+            throw std::runtime_error(std::format("{}: accessor {} is out of bounds", path, file.accessors.size()));
+        }
+        file.accessors.push_back(accessor);
+    }
+
+    for (auto &desc : member(json, "materials").array) {
+        auto &pbr = member(desc, "pbrMetallicRoughness");
+        file.materials.push_back({
+            .name = string(desc, "name"),
+            .baseColor = floats<4>(pbr, "baseColorFactor", {1.0f, 1.0f, 1.0f, 1.0f}),
+            .emissive = floats<3>(desc, "emissiveFactor", {0.0f, 0.0f, 0.0f}),
+            .metallic = float(number(pbr, "metallicFactor", 1.0)),
+            .roughness = float(number(pbr, "roughnessFactor", 1.0)),
+            .blend = string(desc, "alphaMode") == "BLEND"
+        });
+    }
+
+    for (auto &desc : member(json, "meshes").array) {
+        GlbMesh mesh{.name = string(desc, "name")};
+        for (auto &primitiveDesc : member(desc, "primitives").array) {
+            if (number(primitiveDesc, "mode", GLB_TRIANGLES) != GLB_TRIANGLES) {
+                continue;
+            }
+            GlbPrimitive primitive{.indices = index(primitiveDesc, "indices"), .material = index(primitiveDesc, "material")};
+            for (auto &[semantic, accessor] : member(primitiveDesc, "attributes").object) {
+                if (size_t(index(accessor)) >= file.accessors.size()) {
+                    throw std::runtime_error(std::format("{}: mesh {} references missing accessor", path, mesh.name));
+                }
+                primitive.attributes.emplace_back(semantic, index(accessor));
+            }
+            if (glbAttribute(primitive, "POSITION") < 0 || primitive.indices >= int32_t(file.accessors.size()) ||
+                primitive.material >= int32_t(file.materials.size())) {
+                throw std::runtime_error(std::format("{}: invalid primitive in mesh {}", path, mesh.name));
+            }
+            mesh.primitives.push_back(std::move(primitive));
+        }
+        file.meshes.push_back(std::move(mesh));
+    }
+
+    // default scene, or every root node when the file has no scenes
+    auto &nodes = member(json, "nodes");
+    std::vector<int32_t> roots{};
+    auto &scenes = member(json, "scenes").array;
+    if (!scenes.empty()) {
+        int32_t scene = std::clamp(index(json, "scene"), 0, int32_t(scenes.size()) - 1);
+        for (auto &root : member(scenes[scene], "nodes").array) {
+            roots.push_back(index(root));
+        }
+    } else {
+        std::vector<bool> isChild(nodes.array.size(), false);
+        for (auto &node : nodes.array) {
+            for (auto &child : member(node, "children").array) {
+                if (size_t(index(child)) < isChild.size()) {
+                    isChild[index(child)] = true;
+                }
+            }
+        }
+        for (size_t node = 0u; node < isChild.size(); ++node) {
+            if (!isChild[node]) {
+                roots.push_back(int32_t(node));
+            }
+        }
+    }
+    std::vector<bool> visited(nodes.array.size(), false);
+    for (int32_t root : roots) {
+        collectInstances(nodes, root, GlbInstance{}.transform, 0, visited, file);
+    }
+
+    file.mapping = std::shared_ptr<const void>(mapped, mapped->data);
+    return file;
+}
+
+void readGlbFloats(const GlbFile &file, const GlbAccessor &accessor, uint32_t components, std::byte *dst, size_t dstStride) {
+    auto src = file.data(accessor);
+    uint32_t componentSize = glbComponentSize(accessor.componentType);
+    uint32_t copied = std::min(components, accessor.components);
+    for (uint64_t i = 0u; i < accessor.count; ++i) {
+        const std::byte *element = src.data() + i * accessor.byteStride;
+        std::array<float, 16> values{};
+        for (uint32_t c = 0u; c < copied; ++c) {
+            const std::byte *component = element + c * componentSize;
+            switch (accessor.componentType) {
+                case GLB_FLOAT: memcpy(&values[c], component, sizeof(float)); break;
+                case GLB_UNSIGNED_BYTE: {
+                    auto v = std::to_integer<uint8_t>(*component);
+                    values[c] = accessor.normalized ? v / 255.0f : float(v);
+                    break;
+                }
+                case GLB_BYTE: {
+                    auto v = int8_t(std::to_integer<uint8_t>(*component));
+                    values[c] = accessor.normalized ? std::max(v / 127.0f, -1.0f) : float(v);
+                    break;
+                }
+                case GLB_UNSIGNED_SHORT: {
+                    uint16_t v = 0u;
+                    memcpy(&v, component, sizeof(v));
+                    values[c] = accessor.normalized ? v / 65535.0f : float(v);
+                    break;
+                }
+                case GLB_SHORT: {
+                    int16_t v = 0;
+                    memcpy(&v, component, sizeof(v));
+                    values[c] = accessor.normalized ? std::max(v / 32767.0f, -1.0f) : float(v);
+                    break;
+                }
+                case GLB_UNSIGNED_INT: {
+                    uint32_t v = 0u;
+                    memcpy(&v, component, sizeof(v));
+                    values[c] = float(v);
+                    break;
+                }
+            }
+        }
+        memcpy(dst + i * dstStride, values.data(), components * sizeof(float));
+    }
+}
+
+uint64_t readGlbIndices(const GlbFile &file, const GlbAccessor &accessor, uint64_t vertexCount, uint32_t *dst) {
+    auto src = file.data(accessor);
+    uint64_t directBytes = 0u;
+    if (accessor.componentType == GLB_UNSIGNED_INT && accessor.byteStride == sizeof(uint32_t)) {
+        memcpy(dst, src.data(), src.size());
+        directBytes = src.size();
+    }
+    for (uint64_t i = directBytes > 0u ? accessor.count : 0u; i < accessor.count; ++i) {
+        const std::byte *element = src.data() + i * accessor.byteStride;
+        switch (accessor.componentType) {
+            case GLB_UNSIGNED_BYTE: dst[i] = std::to_integer<uint8_t>(*element); break;
+            case GLB_UNSIGNED_SHORT: {
+                uint16_t v = 0u;
+                memcpy(&v, element, sizeof(v));
+                dst[i] = v;
+                break;
+            }
+            case GLB_UNSIGNED_INT: memcpy(&dst[i], element, sizeof(uint32_t)); break;
+            default: throw std::runtime_error(std::format("Invalid glTF index component type {}", accessor.componentType));
+        }
+    }
+    if (std::any_of(dst, dst + accessor.count, [vertexCount](uint32_t i) { return i >= vertexCount; })) {
+        throw std::runtime_error(std::format("glTF indices reference vertices past the {} of their primitive", vertexCount));
+    }
+    return directBytes;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Binary glTF front end. The file stays mapped for the lifetime of GlbFile, accessors point into its BIN chunk
+// so the caller copies vertex and index data straight from the mapping and converts only what doesn't fit.
+
+constexpr uint32_t GLB_BYTE = 5120u;
+constexpr uint32_t GLB_UNSIGNED_BYTE = 5121u;
+constexpr uint32_t GLB_SHORT = 5122u;
+constexpr uint32_t GLB_UNSIGNED_SHORT = 5123u;
+constexpr uint32_t GLB_UNSIGNED_INT = 5125u;
+constexpr uint32_t GLB_FLOAT = 5126u;
+
+struct GlbAccessor {
+    uint64_t byteOffset = {0u};    // into the BIN chunk, view offset included
+    uint32_t byteStride = {0u};    // of the buffer view, element size when tightly packed
+    uint32_t componentType = {GLB_FLOAT};
+    uint32_t components = {1u};    // SCALAR 1 ... VEC4 4, MAT4 16
+    bool normalized = {false};
+    uint64_t count = {0u};
+};
+
+struct GlbPrimitive {
+    std::vector<std::pair<std::string, int32_t>> attributes{}; // semantic, accessor
+    int32_t indices = {-1};  // accessor, -1 for non-indexed primitives
+    int32_t material = {-1};
+};
+
+struct GlbMesh {
+    std::string name{};
+    std::vector<GlbPrimitive> primitives{}; // triangle lists only, other modes are skipped
+};
+
+struct GlbMaterial {
+    std::string name{};
+    std::array<float, 4> baseColor{1.0f, 1.0f, 1.0f, 1.0f};
+    std::array<float, 3> emissive{0.0f, 0.0f, 0.0f};
+    float metallic = {1.0f};
+    float roughness = {1.0f};
+    bool blend = {false}; // alphaMode BLEND
+};
+
+// node of the default scene referencing a mesh, world transform is column-major
+struct GlbInstance {
+    uint32_t mesh = {0u};
+    std::array<float, 16> transform{1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+                                    0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+};
+
+struct GlbFile {
+    std::vector<GlbAccessor> accessors{};
+    std::vector<GlbMesh> meshes{};
+    std::vector<GlbMaterial> materials{};
+    std::vector<GlbInstance> instances{}; // in scene traversal order
+    std::span<const std::byte> bin{};     // BIN chunk inside the mapping
+    std::shared_ptr<const void> mapping{};
+
+    std::span<const std::byte> data(const GlbAccessor &accessor) const; // count elements at byteStride
+};
+
+// throws std::runtime_error on I/O errors, malformed files and required extensions
+GlbFile openGlb(const std::string &path);
+
+uint32_t glbComponentSize(uint32_t componentType);
+
+// accessor of a primitive attribute, -1 when the primitive doesn't have it
+int32_t glbAttribute(const GlbPrimitive &primitive, std::string_view semantic);
+
+// count elements as floats, normalized integers are scaled and missing components are zero
+void readGlbFloats(const GlbFile &file, const GlbAccessor &accessor, uint32_t components, std::byte *dst, size_t dstStride);
+
+// count indices as 32 bit, throws when one reaches past vertexCount. Returns the bytes copied without conversion
+uint64_t readGlbIndices(const GlbFile &file, const GlbAccessor &accessor, uint64_t vertexCount, uint32_t *dst);
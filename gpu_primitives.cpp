@@ -0,0 +1,283 @@
+#include "gpu_primitives.h"
+
+#include <algorithm>
+#include <array>
+#include <format>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <slang.h>
+#include <slang-com-ptr.h>
+
+namespace {
+
+constexpr uint32_t GROUP_SIZE = {256u}; // GROUP_SIZE in primitives_common.slang
+constexpr uint32_t BINDING_COUNT = {5u};
+
+void check(VkResult result, const char *what) {
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error(std::format("{} failed: {}", what, int(result)));
+    }
+}
+
+uint32_t tileCount(uint32_t count) {
+    return (count + PRIMITIVES_TILE_SIZE - 1u) / PRIMITIVES_TILE_SIZE;
+}
+
+VkDeviceSize alignUp(VkDeviceSize size, VkDeviceSize alignment) {
+    return (size + alignment - 1u) / alignment * alignment;
+}
+
+std::string diagnosticText(slang::IBlob *diagnostics) {
+    return diagnostics != nullptr ? std::string(static_cast<const char *>(diagnostics->getBufferPointer())) : std::string{};
+}
+
+// one entry point of a module linked against the module exporting kSubgroupOps
+std::vector<uint32_t> compileKernel(slang::ISession *session, slang::IModule *constants, const char *moduleName, const char *entryPoint) {
+    Slang::ComPtr<slang::IBlob> diagnostics;
+    slang::IModule *module = session->loadModule(moduleName, diagnostics.writeRef());
+    if (module == nullptr) {
+        throw std::runtime_error(std::format("{}.slang: {}", moduleName, diagnosticText(diagnostics)));
+    }
+    Slang::ComPtr<slang::IEntryPoint> entry;
+    if (SLANG_FAILED(module->findEntryPointByName(entryPoint, entry.writeRef()))) {
+        throw std::runtime_error(std::format("{}.slang has no entry point {}", moduleName, entryPoint));
+    }
+    std::array<slang::IComponentType *, 3> components{module, entry.get(), constants};
+    Slang::ComPtr<slang::IComponentType> program;
+    Slang::ComPtr<slang::IComponentType> linked;
+    Slang::ComPtr<slang::IBlob> spirv;
+    if (SLANG_FAILED(session->createCompositeComponentType(components.data(), SlangInt(components.size()), program.writeRef(),
+                                                           diagnostics.writeRef())) ||
+        SLANG_FAILED(program->link(linked.writeRef(), diagnostics.writeRef())) ||
+        SLANG_FAILED(linked->getEntryPointCode(0, 0, spirv.writeRef(), diagnostics.writeRef()))) {
+        throw std::runtime_error(std::format("{}: {}", entryPoint, diagnosticText(diagnostics)));
+    }
+    auto *words = static_cast<const uint32_t *>(spirv->getBufferPointer());
+    return {words, words + spirv->getBufferSize() / sizeof(uint32_t)};
+}
+
+void dispatchTiles(const GpuPrimitives &primitives, VkCommandBuffer cmd, VkPipeline pipeline, const PrimitiveConstants &constants,
+                   const std::array<VkDescriptorBufferInfo, BINDING_COUNT> &buffers) {
+    std::array<VkWriteDescriptorSet, BINDING_COUNT> writes{};
+    for (uint32_t binding = 0u; binding < BINDING_COUNT; ++binding) {
+        writes[binding] = {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstBinding = binding,
+            .descriptorCount = 1u,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo = &buffers[binding]
+        };
+    }
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdPushDescriptorSet(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, primitives.layout, 0u, BINDING_COUNT, writes.data());
+    vkCmdPushConstants(cmd, primitives.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0u, sizeof(constants), &constants);
+    // rows of 65535 groups, see groupIndex()
+    vkCmdDispatch(cmd, std::min(constants.tileCount, 65535u), (constants.tileCount + 65534u) / 65535u, 1u);
+}
+
+// between the dispatches and scratch clears of one primitive
+void primitivesBarrier(VkCommandBuffer cmd) {
+    VkMemoryBarrier2 barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+        .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_CLEAR_BIT,
+        .srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_CLEAR_BIT,
+        .dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT
+    };
+    VkDependencyInfo depsInfo {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .memoryBarrierCount = 1u, .pMemoryBarriers = &barrier};
+    vkCmdPipelineBarrier2(cmd, &depsInfo);
+}
+
+// tile counter and tile states start at zero
+void clearTileStates(VkCommandBuffer cmd, uint32_t count, const VkDescriptorBufferInfo &scratch) {
+    vkCmdFillBuffer(cmd, scratch.buffer, scratch.offset, prefixSumScratchSize(count), 0u);
+    primitivesBarrier(cmd);
+}
+
+} // namespace
+
+void createGpuPrimitives(GpuPrimitives &primitives, VkPhysicalDevice physicalDevice, VkDevice device, const GpuPrimitivesOptions &options,
+                         VkPipelineCache pipelineCache) {
+    primitives.device = device;
+
+    // the subgroup path needs arithmetic in compute shaders and full subgroups laid out in thread order
+    VkPhysicalDeviceVulkan11Properties properties11 {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_PROPERTIES};
+    VkPhysicalDeviceProperties2 properties2 {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &properties11};
+    vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+    VkPhysicalDeviceVulkan13Features features13 {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES};
+    VkPhysicalDeviceFeatures2 features2 {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &features13};
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+    VkSubgroupFeatureFlags subgroupOps = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+    primitives.subgroupOps = options.subgroupOps && (properties11.subgroupSupportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+                             (properties11.subgroupSupportedOperations & subgroupOps) == subgroupOps &&
+                             properties11.subgroupSize <= GROUP_SIZE && features13.computeFullSubgroups;
+    primitives.offsetAlignment = std::max<VkDeviceSize>(properties2.properties.limits.minStorageBufferOffsetAlignment, 4u);
+
+    std::array<VkDescriptorSetLayoutBinding, BINDING_COUNT> bindings{};
+    for (uint32_t binding = 0u; binding < BINDING_COUNT; ++binding) {
+        bindings[binding] = {binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1u, VK_SHADER_STAGE_COMPUTE_BIT, nullptr};
+    }
+    VkDescriptorSetLayoutCreateInfo setLayoutCI {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT,
+        .bindingCount = BINDING_COUNT,
+        .pBindings = bindings.data()
+    };
+    check(vkCreateDescriptorSetLayout(device, &setLayoutCI, nullptr, &primitives.setLayout), "vkCreateDescriptorSetLayout");
+    VkPushConstantRange pushConstants {VK_SHADER_STAGE_COMPUTE_BIT, 0u, sizeof(PrimitiveConstants)};
+    VkPipelineLayoutCreateInfo layoutCI {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1u,
+        .pSetLayouts = &primitives.setLayout,
+        .pushConstantRangeCount = 1u,
+        .pPushConstantRanges = &pushConstants
+    };
+    check(vkCreatePipelineLayout(device, &layoutCI, nullptr, &primitives.layout), "vkCreatePipelineLayout");
+
+    Slang::ComPtr<slang::IGlobalSession> globalSession;
+    slang::createGlobalSession(globalSession.writeRef());
+    slang::TargetDesc target {.format = SLANG_SPIRV, .profile = globalSession->findProfile("spirv_1_4")};
+    auto compilerOptions = std::to_array<slang::CompilerOptionEntry>({
+        {slang::CompilerOptionName::EmitSpirvDirectly, {slang::CompilerOptionValueKind::Int, 1}},
+        {slang::CompilerOptionName::VulkanUseEntryPointName, {slang::CompilerOptionValueKind::Int, 1}}
+    });
+    const char *searchPath = options.shaderDir.c_str();
+    slang::SessionDesc sessionDesc {
+        .targets = &target,
+        .targetCount = 1,
+        .searchPaths = &searchPath,
+        .searchPathCount = 1,
+        .compilerOptionEntries = compilerOptions.data(),
+        .compilerOptionEntryCount = uint32_t(compilerOptions.size())
+    };
+    Slang::ComPtr<slang::ISession> session;
+    if (SLANG_FAILED(globalSession->createSession(sessionDesc, session.writeRef()))) {
+        throw std::runtime_error("Failed to create slang session");
+    }
+    std::string constantsSource = std::format("export static const bool kSubgroupOps = {};\n", primitives.subgroupOps);
+    Slang::ComPtr<slang::IBlob> diagnostics;
+    Slang::ComPtr<slang::IModule> constants;
+    constants = session->loadModuleFromSourceString("primitive_constants", "primitive_constants.slang", constantsSource.c_str(),
+                                                    diagnostics.writeRef());
+    if (constants == nullptr) {
+        throw std::runtime_error(std::format("primitive constants: {}", diagnosticText(diagnostics)));
+    }
+
+    struct Kernel {
+        const char *module;
+        const char *entryPoint;
+        VkPipeline *pipeline;
+    };
+    for (const Kernel &kernel : {Kernel{"scan", "prefixSum", &primitives.prefixSum}, Kernel{"scan", "compact", &primitives.compact},
+                                 Kernel{"radix_sort", "radixHistogram", &primitives.radixHistogram},
+                                 Kernel{"radix_sort", "radixScatter", &primitives.radixScatter}}) {
+        std::vector<uint32_t> spirv = compileKernel(session.get(), constants.get(), kernel.module, kernel.entryPoint);
+        VkShaderModuleCreateInfo moduleCI {.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO, .codeSize = spirv.size() * sizeof(uint32_t),
+                                           .pCode = spirv.data()};
+        VkShaderModule module = VK_NULL_HANDLE;
+        check(vkCreateShaderModule(device, &moduleCI, nullptr, &module), "vkCreateShaderModule");
+        VkComputePipelineCreateInfo pipelineCI {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .stage = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .flags = primitives.subgroupOps ? VkPipelineShaderStageCreateFlags(VK_PIPELINE_SHADER_STAGE_CREATE_REQUIRE_FULL_SUBGROUPS_BIT) : 0u,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = module,
+                .pName = kernel.entryPoint
+            },
+            .layout = primitives.layout
+        };
+        VkResult result = vkCreateComputePipelines(device, pipelineCache, 1u, &pipelineCI, nullptr, kernel.pipeline);
+        vkDestroyShaderModule(device, module, nullptr);
+        check(result, kernel.entryPoint);
+    }
+}
+
+void destroyGpuPrimitives(GpuPrimitives &primitives) {
+    for (VkPipeline pipeline : {primitives.prefixSum, primitives.compact, primitives.radixHistogram, primitives.radixScatter}) {
+        vkDestroyPipeline(primitives.device, pipeline, nullptr);
+    }
+    vkDestroyPipelineLayout(primitives.device, primitives.layout, nullptr);
+    vkDestroyDescriptorSetLayout(primitives.device, primitives.setLayout, nullptr);
+    primitives = {};
+}
+
+// tile counter, then the state of every tile
+VkDeviceSize prefixSumScratchSize(uint32_t count) {
+    return (VkDeviceSize(tileCount(count)) * PRIMITIVES_TILE_STATE_WORDS + 1u) * sizeof(uint32_t);
+}
+
+// digit counts per tile, their prefix sum and the scratch of that prefix sum
+VkDeviceSize radixSortScratchSize(const GpuPrimitives &primitives, uint32_t count) {
+    uint32_t countsSize = PRIMITIVES_RADIX * tileCount(count);
+    return 2u * alignUp(countsSize * sizeof(uint32_t), primitives.offsetAlignment) + prefixSumScratchSize(countsSize);
+}
+
+void recordPrefixSum(const GpuPrimitives &primitives, VkCommandBuffer cmd, uint32_t count, const VkDescriptorBufferInfo &input,
+                     const VkDescriptorBufferInfo &output, const VkDescriptorBufferInfo &scratch) {
+    if (count == 0u) {
+        return;
+    }
+    clearTileStates(cmd, count, scratch);
+    PrimitiveConstants constants {.count = count, .tileCount = tileCount(count)};
+    // compaction bindings are unused, any valid buffer does
+    dispatchTiles(primitives, cmd, primitives.prefixSum, constants, {input, output, scratch, input, output});
+}
+
+void recordCompact(const GpuPrimitives &primitives, VkCommandBuffer cmd, uint32_t count, const VkDescriptorBufferInfo &input,
+                   const VkDescriptorBufferInfo &flags, const VkDescriptorBufferInfo &output, const VkDescriptorBufferInfo &outputCount,
+                   const VkDescriptorBufferInfo &scratch) {
+    if (count == 0u) {
+        vkCmdFillBuffer(cmd, outputCount.buffer, outputCount.offset, sizeof(uint32_t), 0u);
+        return;
+    }
+    clearTileStates(cmd, count, scratch);
+    PrimitiveConstants constants {.count = count, .tileCount = tileCount(count)};
+    dispatchTiles(primitives, cmd, primitives.compact, constants, {input, output, scratch, flags, outputCount});
+}
+
+// one pass per 8 key bits, keys and values go back and forth between the buffers and their temps. The pass count is
+// even, so they end up where they started
+void recordRadixSort(const GpuPrimitives &primitives, VkCommandBuffer cmd, uint32_t count, uint32_t keyBits, const RadixSortBuffers &buffers) {
+    if (keyBits != 32u && keyBits != 64u) {
+        throw std::runtime_error(std::format("Radix sort of {} bit keys, only 32 and 64 are supported", keyBits));
+    }
+    if (count == 0u) {
+        return;
+    }
+    uint32_t tiles = tileCount(count);
+    uint32_t countsSize = PRIMITIVES_RADIX * tiles;
+    VkDeviceSize countsBytes = VkDeviceSize(countsSize) * sizeof(uint32_t);
+    VkDeviceSize countsStride = alignUp(countsBytes, primitives.offsetAlignment);
+    const VkDescriptorBufferInfo &scratch = buffers.scratch;
+    VkDescriptorBufferInfo digitCounts {scratch.buffer, scratch.offset, countsBytes};
+    VkDescriptorBufferInfo digitSlots {scratch.buffer, scratch.offset + countsStride, countsBytes};
+    VkDescriptorBufferInfo scanScratch {scratch.buffer, scratch.offset + 2u * countsStride, prefixSumScratchSize(countsSize)};
+
+    // without values the value bindings alias the keys, the kernels don't touch them
+    bool hasValues = buffers.values.buffer != VK_NULL_HANDLE;
+    std::array<VkDescriptorBufferInfo, 2> keys{buffers.keys, buffers.keysTemp};
+    std::array<VkDescriptorBufferInfo, 2> values{hasValues ? buffers.values : buffers.keys, hasValues ? buffers.valuesTemp : buffers.keysTemp};
+    for (uint32_t pass = 0u; pass < keyBits / 8u; ++pass) {
+        uint32_t source = pass & 1u;
+        PrimitiveConstants constants {
+            .count = count,
+            .tileCount = tiles,
+            .shift = pass * 8u,
+            .keyWords = keyBits / 32u,
+            .hasValues = hasValues ? 1u : 0u
+        };
+        if (pass > 0u) {
+            primitivesBarrier(cmd);
+        }
+        dispatchTiles(primitives, cmd, primitives.radixHistogram, constants,
+                      {keys[source], keys[source ^ 1u], digitCounts, values[source], values[source ^ 1u]});
+        primitivesBarrier(cmd);
+        recordPrefixSum(primitives, cmd, countsSize, digitCounts, digitSlots, scanScratch);
+        primitivesBarrier(cmd);
+        dispatchTiles(primitives, cmd, primitives.radixScatter, constants,
+                      {keys[source], keys[source ^ 1u], digitSlots, values[source], values[source ^ 1u]});
+    }
+}
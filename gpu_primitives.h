@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vulkan/vulkan.h>
+
+// Parallel primitives for GPU driven work, kernels in shader/scan.slang and shader/radix_sort.slang:
+//   - exclusive prefix sum of uint32, single pass with decoupled look-back, sums wrap at 2^32 like uint32 arithmetic
+//   - stream compaction of uint32 by a flag per element, keeps the order and writes the kept count
+//   - LSD radix sort of 32 or 64 bit keys, optionally moving a uint32 value with every key
+// The record functions record dispatches and the barriers between them into the caller's command buffer, ordering
+// against the caller's work before and after is up to the caller. Buffers are bound with push descriptors, their
+// offsets must respect minStorageBufferOffsetAlignment and they need storage buffer usage, scratch buffers transfer dst
+// usage as well. The subgroup path needs computeFullSubgroups enabled on the device. Errors throw std::runtime_error.
+
+constexpr uint32_t PRIMITIVES_TILE_SIZE = {1024u}; // elements per workgroup, TILE_SIZE in primitives_common.slang
+constexpr uint32_t PRIMITIVES_RADIX = {256u};
+constexpr uint32_t PRIMITIVES_TILE_STATE_WORDS = {3u}; // flag, aggregate, inclusive prefix, STATE_WORDS in scan.slang
+
+struct GpuPrimitivesOptions {
+    std::string shaderDir{"shader"};
+    bool subgroupOps = {true}; // subgroup arithmetic where compute shaders support it, shared memory scans otherwise
+};
+
+struct GpuPrimitives {
+    VkDevice device = {VK_NULL_HANDLE};
+    bool subgroupOps = {false};            // what the kernels were compiled with
+    VkDeviceSize offsetAlignment = {256u}; // of the ranges within scratch buffers
+    VkDescriptorSetLayout setLayout = {VK_NULL_HANDLE}; // five storage buffers, pushed
+    VkPipelineLayout layout = {VK_NULL_HANDLE};
+    VkPipeline prefixSum = {VK_NULL_HANDLE};
+    VkPipeline compact = {VK_NULL_HANDLE};
+    VkPipeline radixHistogram = {VK_NULL_HANDLE};
+    VkPipeline radixScatter = {VK_NULL_HANDLE};
+};
+
+// matches PrimitiveConstants in shader/primitives_common.slang
+struct PrimitiveConstants {
+    uint32_t count = {0u};
+    uint32_t tileCount = {0u};
+    uint32_t shift = {0u};
+    uint32_t keyWords = {1u};
+    uint32_t hasValues = {0u};
+};
+
+struct RadixSortBuffers {
+    VkDescriptorBufferInfo keys{};       // sorted in place, 64 bit keys are two words with the low word first
+    VkDescriptorBufferInfo keysTemp{};   // as large as keys
+    VkDescriptorBufferInfo values{};     // optional, null buffer without values
+    VkDescriptorBufferInfo valuesTemp{}; // as large as values
+    VkDescriptorBufferInfo scratch{};    // radixSortScratchSize bytes
+};
+
+// compiles the kernels, pipelines go into pipelineCache when it isn't null
+void createGpuPrimitives(GpuPrimitives &primitives, VkPhysicalDevice physicalDevice, VkDevice device,
+                         const GpuPrimitivesOptions &options = {}, VkPipelineCache pipelineCache = VK_NULL_HANDLE);
+void destroyGpuPrimitives(GpuPrimitives &primitives);
+
+VkDeviceSize prefixSumScratchSize(uint32_t count);
+VkDeviceSize radixSortScratchSize(const GpuPrimitives &primitives, uint32_t count);
+
+void recordPrefixSum(const GpuPrimitives &primitives, VkCommandBuffer cmd, uint32_t count, const VkDescriptorBufferInfo &input,
+                     const VkDescriptorBufferInfo &output, const VkDescriptorBufferInfo &scratch);
+// outputCount receives one uint32, the number of kept elements, and needs transfer dst usage for empty inputs
+void recordCompact(const GpuPrimitives &primitives, VkCommandBuffer cmd, uint32_t count, const VkDescriptorBufferInfo &input,
+                   const VkDescriptorBufferInfo &flags, const VkDescriptorBufferInfo &output, const VkDescriptorBufferInfo &outputCount,
+                   const VkDescriptorBufferInfo &scratch);
+// keyBits is 32 or 64
+void recordRadixSort(const GpuPrimitives &primitives, VkCommandBuffer cmd, uint32_t count, uint32_t keyBits, const RadixSortBuffers &buffers);
@@ -0,0 +1,216 @@
+#include "job_system.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <pthread.h>
+#include <sched.h>
+
+namespace {
+
+// worker identity of the current thread, jobs spawned from a worker go to its own deque
+thread_local JobSystem *currentSystem = nullptr;
+thread_local uint32_t currentWorker = {0u};
+
+// workers keep queuing on their own deque until stopJobSystem joins them, other threads need the workers running.
+// Checked before a job is counted, so a job that can't be queued doesn't leave its counter pending
+void requireRunning(const JobSystem &system) {
+    if (currentSystem != &system && (system.stopping.load() || system.workers.empty())) {
+        throw std::runtime_error("Job queued on a job system that isn't running");
+    }
+}
+
+void pushJob(JobSystem &system, Job job) {
+    requireRunning(system);
+    uint32_t index = currentSystem == &system ? currentWorker
+                                              : system.nextWorker.fetch_add(1u, std::memory_order_relaxed) % uint32_t(system.workers.size());
+    {
+        auto &worker = *system.workers[index];
+        std::lock_guard lock(worker.mutex);
+        worker.jobs.push_back(std::move(job));
+    }
+    // pairs with the sleeping increment in workerLoop, one of the two sides always sees the other
+    system.queued.fetch_add(1);
+    if (system.sleeping.load() > 0u) {
+        { std::lock_guard lock(system.sleepMutex); }
+        system.jobAvailable.notify_one();
+    }
+}
+
+bool popJob(JobSystem &system, Job &job) {
+    auto workerCount = uint32_t(system.workers.size());
+    bool isWorker = currentSystem == &system;
+    uint32_t first = isWorker ? currentWorker : system.nextWorker.load(std::memory_order_relaxed) % workerCount;
+    for (uint32_t i = 0u; i < workerCount; ++i) {
+        auto &worker = *system.workers[(first + i) % workerCount];
+        std::lock_guard lock(worker.mutex);
+        if (worker.jobs.empty()) {
+            continue;
+        }
+        // own work newest first while it's still in cache, stolen work oldest first since it's usually the largest
+        if (isWorker && i == 0u) {
+            job = std::move(worker.jobs.back());
+            worker.jobs.pop_back();
+        } else {
+            job = std::move(worker.jobs.front());
+            worker.jobs.pop_front();
+            system.steals.fetch_add(1u, std::memory_order_relaxed);
+        }
+        system.queued.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+void finishJob(JobSystem &system, JobCounter &counter) {
+    std::vector<Job> ready{};
+    {
+        // under the lock so a waiter can't destroy the counter before this returns, see waitJobs
+        std::lock_guard lock(counter.mutex);
+        if (counter.pending.fetch_sub(1u, std::memory_order_acq_rel) == 1u) {
+            ready.swap(counter.continuations);
+        }
+    }
+    for (auto &job : ready) {
+        pushJob(system, std::move(job));
+    }
+}
+
+void executeJob(JobSystem &system, Job &job) {
+    job.function();
+    system.executed.fetch_add(1u, std::memory_order_relaxed);
+    if (job.counter != nullptr) {
+        finishJob(system, *job.counter);
+    }
+}
+
+void workerLoop(JobSystem &system, uint32_t index) {
+    currentSystem = &system;
+    currentWorker = index;
+    while (true) {
+        Job job{};
+        if (popJob(system, job)) {
+            executeJob(system, job);
+            continue;
+        }
+        if (system.stopping.load()) {
+            return;
+        }
+        std::unique_lock lock(system.sleepMutex);
+        system.sleeping.fetch_add(1u);
+        system.jobAvailable.wait(lock, [&system] { return system.stopping.load() || system.queued.load() > 0; });
+        system.sleeping.fetch_sub(1u);
+    }
+}
+
+void pinThread(std::thread &thread, uint32_t core) {
+    cpu_set_t cpus{};
+    CPU_ZERO(&cpus);
+    CPU_SET(core, &cpus);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus);
+}
+
+} // namespace
+
+void startJobSystem(JobSystem &system, const JobSystemOptions &options) {
+    uint32_t cores = std::max(std::thread::hardware_concurrency(), 2u);
+    uint32_t workerCount = options.workers != 0u ? options.workers : cores - 1u;
+    system.mainThread = std::this_thread::get_id();
+    system.stopping = false;
+    for (uint32_t i = 0u; i < workerCount; ++i) {
+        system.workers.push_back(std::make_unique<JobWorker>());
+    }
+    // deques exist before any worker can steal from them
+    for (uint32_t i = 0u; i < workerCount; ++i) {
+        auto &worker = *system.workers[i];
+        worker.thread = std::thread(workerLoop, std::ref(system), i);
+        if (options.pinWorkers) {
+            pinThread(worker.thread, (i + 1u) % cores);
+        }
+    }
+}
+
+void stopJobSystem(JobSystem &system) {
+    {
+        std::lock_guard lock(system.sleepMutex);
+        system.stopping = true;
+    }
+    system.jobAvailable.notify_all();
+    for (auto &worker : system.workers) {
+        worker->thread.join();
+    }
+    system.workers.clear();
+}
+
+void bindJobMainThread(JobSystem &system) {
+    system.mainThread = std::this_thread::get_id();
+}
+
+void runJob(JobSystem &system, std::function<void()> function, JobCounter *counter) {
+    requireRunning(system);
+    if (counter != nullptr) {
+        counter->pending.fetch_add(1u, std::memory_order_relaxed);
+    }
+    pushJob(system, {std::move(function), counter});
+}
+
+void runJobAfter(JobSystem &system, JobCounter &dependency, std::function<void()> function, JobCounter *counter) {
+    requireRunning(system);
+    if (counter != nullptr) {
+        counter->pending.fetch_add(1u, std::memory_order_relaxed);
+    }
+    {
+        std::lock_guard lock(dependency.mutex);
+        if (dependency.pending.load(std::memory_order_acquire) != 0u) {
+            dependency.continuations.push_back({std::move(function), counter});
+            return;
+        }
+    }
+    pushJob(system, {std::move(function), counter});
+}
+
+void runMainThreadJob(JobSystem &system, std::function<void()> function, JobCounter *counter) {
+    if (counter != nullptr) {
+        counter->pending.fetch_add(1u, std::memory_order_relaxed);
+    }
+    std::lock_guard lock(system.mainThreadMutex);
+    system.mainThreadJobs.push_back({std::move(function), counter});
+}
+
+uint32_t runMainThreadJobs(JobSystem &system) {
+    std::deque<Job> jobs{};
+    {
+        std::lock_guard lock(system.mainThreadMutex);
+        jobs.swap(system.mainThreadJobs);
+    }
+    for (auto &job : jobs) {
+        executeJob(system, job);
+    }
+    return uint32_t(jobs.size());
+}
+
+void waitJobs(JobSystem &system, JobCounter &counter) {
+    bool mainThread = std::this_thread::get_id() == system.mainThread;
+    while (counter.pending.load(std::memory_order_acquire) != 0u) {
+        if (mainThread && runMainThreadJobs(system) > 0u) {
+            continue;
+        }
+        Job job{};
+        if (popJob(system, job)) {
+            executeJob(system, job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    // the last finishJob may still hold the lock
+    std::lock_guard lock(counter.mutex);
+}
+
+void parallelFor(JobSystem &system, uint64_t count, uint64_t batch, const std::function<void(uint64_t begin, uint64_t end)> &body) {
+    JobCounter counter{};
+    batch = std::max<uint64_t>(batch, 1u);
+    for (uint64_t begin = 0u; begin < count; begin += batch) {
+        runJob(system, [&body, begin, end = std::min(count, begin + batch)] { body(begin, end); }, &counter);
+    }
+    waitJobs(system, counter);
+}
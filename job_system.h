@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing scheduler. Every worker owns a deque, runs its newest job first and steals the oldest job of another
+// worker when it runs dry. Jobs report to a JobCounter, callers wait on counters and dependencies are continuations of
+// a counter. Main thread jobs never run on a worker, only when the bound main thread drains or waits.
+// Jobs must not throw.
+
+struct JobCounter;
+
+struct Job {
+    std::function<void()> function{};
+    JobCounter *counter = {nullptr}; // decremented after function returned
+};
+
+// may only be reused or destroyed once waited for
+struct JobCounter {
+    std::atomic<uint32_t> pending{0u};
+    std::mutex mutex;
+    std::vector<Job> continuations{}; // queued when pending drops to zero
+};
+
+struct JobWorker {
+    std::mutex mutex;
+    std::deque<Job> jobs{}; // owner pushes and pops at the back, thieves take the front
+    std::thread thread{};
+};
+
+struct JobSystemOptions {
+    uint32_t workers = {0u};    // 0 = hardware concurrency - 1, the main thread helps while it waits
+    bool pinWorkers = {false};  // worker i runs on core (i + 1) % cores only, the main thread isn't pinned
+};
+
+struct JobSystem {
+    std::vector<std::unique_ptr<JobWorker>> workers{};
+    std::atomic<uint32_t> nextWorker{0u}; // round robin deque for jobs from threads that aren't workers
+    std::atomic<int64_t> queued{0u};      // jobs in all worker deques
+    std::atomic<uint32_t> sleeping{0u};
+    std::mutex sleepMutex;
+    std::condition_variable jobAvailable;
+    std::atomic<bool> stopping{false};
+
+    std::mutex mainThreadMutex;
+    std::deque<Job> mainThreadJobs{};
+    std::thread::id mainThread{};
+
+    std::atomic<uint64_t> executed{0u};
+    std::atomic<uint64_t> steals{0u};
+};
+
+// the calling thread becomes the main thread
+void startJobSystem(JobSystem &system, const JobSystemOptions &options = {});
+
+// finishes queued jobs before returning, main thread jobs are left alone
+void stopJobSystem(JobSystem &system);
+
+// moves main thread affinity to the calling thread, e.g. a render thread
+void bindJobMainThread(JobSystem &system);
+
+// throws when called from a thread other than a worker before startJobSystem or once stopJobSystem began
+void runJob(JobSystem &system, std::function<void()> function, JobCounter *counter = nullptr);
+
+// queued once dependency is zero, right away if it already is; counter covers the job from this call on
+void runJobAfter(JobSystem &system, JobCounter &dependency, std::function<void()> function, JobCounter *counter = nullptr);
+
+// queued for the main thread, runs in its next runMainThreadJobs or waitJobs
+void runMainThreadJob(JobSystem &system, std::function<void()> function, JobCounter *counter = nullptr);
+
+// main thread only, returns the number of jobs run
+uint32_t runMainThreadJobs(JobSystem &system);
+
+// runs other jobs until counter is zero, main thread jobs as well when called on the main thread
+void waitJobs(JobSystem &system, JobCounter &counter);
+
+// body runs on [begin, end) ranges of at most batch elements, returns once all are done
+void parallelFor(JobSystem &system, uint64_t count, uint64_t batch, const std::function<void(uint64_t begin, uint64_t end)> &body);
@@ -1,14 +1,44 @@
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <deque>
 #include <exception>
+#include <filesystem>
 #include <format>
+#include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <iterator>
 #include <limits>
+#include <memory>
+#include <mutex>
+#include <numeric>
 #include <optional>
-#include <set>
+#include <shared_mutex>
+#include <span>
+#include <sstream>
 #include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <variant>
 #include <vector>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/resource.h>
+#include <unistd.h>
 #include <vulkan/vulkan.h>
 #include <vulkan/vulkan_core.h>
 #define GLFW_INCLUDE_VULKAN
@@ -23,11 +53,19 @@
 #include <slang-rhi.h>
 #include <slang-rhi/shader-cursor.h>
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader.h>
+#include "capture_format.h"
+#include "glb_loader.h"
+#include "job_system.h"
+#include "obj_loader.h"
+#include "offset_allocator.h"
+#include "spsc_queue.h"
 
 #define RT_THROW(msg) throw std::runtime_error(msg);
 
+#define LOAD_DEVICE_PROC(vkCtx, name)                                          \
+  (vkCtx).ext.name = reinterpret_cast<PFN_##name>(                             \
+      vkGetDeviceProcAddr((vkCtx).device, #name))
+
 #define VK_CHECK(x, msg)                                                       \
   do {                                                                         \
     if ((x) != VK_SUCCESS) {                                                   \
@@ -35,6 +73,13 @@
     }                                                                          \
   } while (0)
 
+// vulkan14_bench is this file built with VULKAN14_BENCH, it runs a measured benchmark instead of the interactive loop
+#ifdef VULKAN14_BENCH
+constexpr bool BENCH_BUILD = {true};
+#else
+constexpr bool BENCH_BUILD = {false};
+#endif
+
 struct Vertex {
     glm::vec3 position = {0.0f, 0.0f, 0.0f};
     glm::vec3 color = {0.125f, 0.125f, 0.125f};
@@ -64,15 +109,84 @@ struct Vertex {
     }
 };
 
+// matches Material in tris.slang, std430
+struct GPUMaterial {
+    glm::vec4 diffuse = {0.0f, 1.0f, 0.0f, 1.0f}; // rgb, opacity
+    glm::vec4 specular = {0.0f, 0.0f, 0.0f, 0.0f}; // rgb, shininess
+    glm::vec4 emission = {0.0f, 0.0f, 0.0f, 0.0f};
+};
+
+// matches InstanceTransform in tris.slang, rows of the affine world transform
+struct GPUInstance {
+    std::array<glm::vec4, 3> rows{glm::vec4{1.0f, 0.0f, 0.0f, 0.0f}, glm::vec4{0.0f, 1.0f, 0.0f, 0.0f}, glm::vec4{0.0f, 0.0f, 1.0f, 0.0f}};
+};
+
+// one draw per submesh range, sorted by pipeline state then material so each is bound only once. Blended draws come
+// last and back to front instead, see sortBlendedDraws
+struct SceneDraw {
+    uint32_t state = {0u};    // index into ModelContext::drawStates, transparent materials use 1
+    uint32_t material = {0u}; // index into the material buffer, passed as push constant
+    uint32_t firstIndex = {0u};
+    uint32_t indexCount = {0u};
+    int32_t vertexOffset = {0};      // indices are local to their mesh
+    uint32_t firstInstance = {0u};   // into the instance buffer, every node using the mesh is one instance
+    uint32_t instanceCount = {1u};
+    glm::vec4 bounds = {0.0f, 0.0f, 0.0f, std::numeric_limits<float>::infinity()}; // mesh space sphere, never culled until computed
+};
+
+struct AppOptions {
+    bool shaderObjects = {false};       // --shader-objects, VK_EXT_shader_object instead of pipelines
+    uint32_t benchStateChanges = {0u};  // --bench-state-changes <draws>, compare state change cost and exit
+    uint32_t streamBudgetMiB = {8u};    // --stream-budget <MiB>, asset bytes copied to the GPU per frame
+    std::string modelPath{"assets/monkey.obj"}; // --model <file.obj|file.glb>
+    uint32_t memoryLogSeconds = {10u};  // --memory-log <seconds>, per heap budget report, 0 disables
+    uint32_t defragBudgetMiB = {16u};   // --defrag-budget <MiB>, bytes copied per defragmentation pass and so per frame, 0 disables.
+                                        // Stands in for a time budget, a pass's GPU time grows with the bytes it copies
+    std::string capturePath{};          // --capture <file>, command stream for vulkan14_replay, exits when written
+    uint32_t captureFrames = {1u};      // --capture-frames <n>
+    uint32_t jobWorkers = {0u};         // --job-workers <n>, 0 = one per core besides the main thread
+    bool pinJobWorkers = {false};       // --pin-job-workers, one core per job worker
+    std::array<float, 3> queuePriorities{1.0f, 0.5f, 0.5f}; // --queue-priorities <graphics>,<compute>,<transfer>
+    bool occlusionCulling = {true};     // --no-occlusion-culling, draw every instance without the two phase Hi-Z test
+    bool depthPrepass = {false};        // --depth-prepass, opaque draws lay down depth first and shade with EQUAL
+    float gpuBudgetMs = {0.0f};         // --dynamic-resolution <ms>, GPU frame time the render scale follows, 0 renders at native size
+    std::array<float, 2> renderScale{0.5f, 1.0f}; // --render-scale <min>,<max>, per axis, within 0.25 and 1
+    uint32_t msaaSamples = {1u};        // --msaa <samples>, the highest count the device supports up to it, 1 disables
+
+    // scene and presentation, fixed per benchmark run
+    bool headless = {false};            // --headless, offscreen images instead of a window and swapchain
+    uint32_t width = {1920u};           // --resolution <width>x<height>
+    uint32_t height = {1080u};
+    uint32_t framesInFlight = {2u};     // --frames-in-flight <1..3>
+    VkPresentModeKHR presentMode = {VK_PRESENT_MODE_MAILBOX_KHR}; // --present-mode fifo|mailbox|immediate, FIFO if unsupported
+    uint32_t instanceCount = {1u};      // --instances <n>, the model is repeated n times on a grid
+    uint32_t benchFrames = {BENCH_BUILD ? 1000u : 0u}; // --bench-frames <n>, measured frames once the model is resident
+    uint32_t benchWarmup = {100u};      // --bench-warmup <n>
+    std::string benchOutput{};          // --bench-output <file.json>, stdout when empty
+};
+
+// input from the GLFW callbacks on the main thread, drained by the render thread once per frame
+struct WindowEvent {
+    enum class Type : uint8_t { Key } type = {Type::Key};
+    int32_t key = {0};
+    int32_t action = {0};
+};
+
 struct WindowContext {
     GLFWwindow *window = nullptr;
 
     uint32_t width = 1920u;
     uint32_t height = 1080u;
+
+    SpscQueue<WindowEvent, 256u> events{}; // main thread produces, render thread consumes
+    bool memoryStatsRequested = {false}; // F12, VMA JSON dump at the next frame boundary
+    std::atomic<bool> closeRequested{false}; // set by either thread, the render thread stops at its next frame
 };
 
 struct Queue {
-    std::optional<uint32_t> idx;
+    std::optional<uint32_t> idx;     // family
+    uint32_t queueIndex = {0u};      // within the family, roles beyond the family's queue count share its last queue
+    float priority = {1.0f};
     VkQueue queueHandle = VK_NULL_HANDLE;
 };
 
@@ -80,8 +194,16 @@ struct DepthBuffer {
     VkImage image = {VK_NULL_HANDLE};
     VkImageView imageView = {VK_NULL_HANDLE};
     VmaAllocation depthAlloc = {VK_NULL_HANDLE};
+    VkFormat format = {VK_FORMAT_UNDEFINED}; // float depth preferred, cleared to 0 for reversed-Z
+    bool sampled = {false}; // read by the depth pyramid pass, the format supports sampling
 };
 
+// layout transitions of combined formats have to include the stencil aspect
+inline VkImageAspectFlags depthAspects(VkFormat format) {
+    bool stencil = format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D16_UNORM_S8_UINT;
+    return VK_IMAGE_ASPECT_DEPTH_BIT | (stencil ? VK_IMAGE_ASPECT_STENCIL_BIT : 0u);
+}
+
 struct SwapChain {
     VkSwapchainKHR swapchainHandle = VK_NULL_HANDLE;
     VkSwapchainKHR oldSwapchainHandle = VK_NULL_HANDLE;
@@ -94,11 +216,60 @@ struct SwapChain {
 
     std::vector<VkImage> images{};
     std::vector<VkImageView> imageViews{};
+    std::vector<VmaAllocation> imageAllocations{}; // headless only, offscreen images are owned
+    VkImageUsageFlags imageUsage = {0u}; // transfer dst when the surface allows it, the dynamic resolution blit needs it
 
-    static constexpr int32_t MAX_SWAPCHAIN_FRAMES = {2};
+    // upper bound of frames in flight, deferred destruction always waits this many frames
+    static constexpr int32_t MAX_SWAPCHAIN_FRAMES = {3};
+    uint32_t framesInFlight = {2u};
     uint32_t currentFrame = {0u};
 };
 
+// device level entry points of enabled extensions
+struct ExtensionFunctions {
+    PFN_vkCreateShadersEXT vkCreateShadersEXT = {nullptr};
+    PFN_vkDestroyShaderEXT vkDestroyShaderEXT = {nullptr};
+    PFN_vkCmdBindShadersEXT vkCmdBindShadersEXT = {nullptr};
+    PFN_vkCmdSetVertexInputEXT vkCmdSetVertexInputEXT = {nullptr};
+    PFN_vkCmdSetPolygonModeEXT vkCmdSetPolygonModeEXT = {nullptr};
+    PFN_vkCmdSetRasterizationSamplesEXT vkCmdSetRasterizationSamplesEXT = {nullptr};
+    PFN_vkCmdSetSampleMaskEXT vkCmdSetSampleMaskEXT = {nullptr};
+    PFN_vkCmdSetAlphaToCoverageEnableEXT vkCmdSetAlphaToCoverageEnableEXT = {nullptr};
+    PFN_vkCmdSetColorBlendEnableEXT vkCmdSetColorBlendEnableEXT = {nullptr};
+    PFN_vkCmdSetColorBlendEquationEXT vkCmdSetColorBlendEquationEXT = {nullptr};
+    PFN_vkCmdSetColorWriteMaskEXT vkCmdSetColorWriteMaskEXT = {nullptr};
+};
+
+// materials and instances of one model, also a copy source so defragmentation can move it
+constexpr VkBufferUsageFlags MODEL_BUFFER_USAGE = {VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                                   VK_BUFFER_USAGE_TRANSFER_SRC_BIT};
+
+// buffer sub-allocation classes: per-frame transient data in a linear pool used as a ring, small long-lived buffers
+// in a block pool, dedicated memory only above DEDICATED_THRESHOLD, so steady state frames never call vkAllocateMemory
+struct TransientBuffer {
+    VkBuffer buffer = {VK_NULL_HANDLE};
+    VmaAllocation allocation = {VK_NULL_HANDLE};
+    std::byte *mapped = nullptr;
+    uint64_t frame = {0u}; // freed once this frame is done, always in allocation order
+};
+
+struct MemoryPools {
+    static constexpr VkDeviceSize TRANSIENT_POOL_SIZE = {64ull << 20};
+    static constexpr VkDeviceSize SMALL_BLOCK_SIZE = {16ull << 20};
+    static constexpr VkDeviceSize SMALL_BUFFER_LIMIT = {1ull << 20};    // smaller buffers go to the block pool
+    static constexpr VkDeviceSize DEDICATED_THRESHOLD = {64ull << 20};  // larger resources get their own memory
+
+    VmaPool transient = {VK_NULL_HANDLE};
+    VmaPool small = {VK_NULL_HANDLE};
+    std::deque<TransientBuffer> transientBuffers{};
+
+    // from VMA's device memory callbacks
+    std::atomic<uint64_t> deviceAllocations{0u};
+    std::atomic<uint64_t> deviceFrees{0u};
+    std::atomic<uint64_t> deviceBytes{0u};
+    uint64_t lastLoggedAllocations = {0u};
+};
+
 struct VulkanContext {
     VkInstance instance = VK_NULL_HANDLE;
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
@@ -108,12 +279,21 @@ struct VulkanContext {
 
     Queue graphicsQueue = {};
     Queue presentQueue = {};
-    Queue computeQueue = {};
+    Queue computeQueue = {};  // async compute family when there is one
+    Queue transferQueue = {}; // streaming uploads, dedicated transfer family when there is one
+    std::array<uint32_t, 2> uploadFamilies{}; // graphics and transfer, for buffers shared concurrently between them
 
     VkPhysicalDeviceProperties properties;
+    VkPhysicalDeviceFeatures features{}; // core features enabled on the device
     VkPhysicalDeviceVulkan12Features vulkan12Features{};
     VkPhysicalDeviceVulkan13Features vulkan13Features{};
     VkPhysicalDeviceVulkan14Features vulkan14Features{};
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphicsPipelineLibraryFeatures{};
+    bool graphicsPipelineLibrary = {false}; // VK_EXT_graphics_pipeline_library enabled
+    VkPhysicalDeviceShaderObjectFeaturesEXT shaderObjectFeatures{};
+    bool shaderObject = {false}; // VK_EXT_shader_object enabled
+    bool memoryBudget = {false}; // VK_EXT_memory_budget enabled, VMA estimates budgets without it
+    ExtensionFunctions ext{};
 
     std::vector<VkSemaphore> presentSemaphores{};
     std::vector<VkSemaphore> renderCompleteSemaphores{};
@@ -122,36 +302,527 @@ struct VulkanContext {
     VkCommandPool commandPool;
     std::array<VkCommandBuffer, SwapChain::MAX_SWAPCHAIN_FRAMES> commandBuffers{};
 
+    // only with a transfer queue apart from the graphics queue, the frame's graphics submit waits for its uploads
+    VkCommandPool transferCommandPool = {VK_NULL_HANDLE};
+    std::array<VkCommandBuffer, SwapChain::MAX_SWAPCHAIN_FRAMES> transferCommandBuffers{};
+    std::vector<VkSemaphore> uploadSemaphores{};
+
     VmaAllocator allocator = {VK_NULL_HANDLE};
+    MemoryPools pools{};
+
+    std::atomic<uint64_t> frameCounter{0u}; // total frames submitted, used to retire objects safely
 };
 
 struct GPUBuffer {
     VmaAllocation bufferAllocation = {VK_NULL_HANDLE};
     VkBuffer buffer = {VK_NULL_HANDLE};
     VkDeviceSize size = {0u};
-    VkDeviceSize vertexBufferSize {0u};
-    VkDeviceSize indexBufferSize {0u};
-    uint32_t indexCount {0};
 
     void *mapped = nullptr;
 };
 
+// vertices and indices of every model live in two buffers bound once per frame, ranges come from O(1) offset allocators
+struct GeometryArena {
+    static constexpr uint32_t VERTEX_BYTES = {256u << 20};
+    static constexpr uint32_t INDEX_COUNT = {32u << 20}; // 128 MiB of 32 bit indices
+
+    GPUBuffer vertices{};
+    GPUBuffer indices{};
+    OffsetAllocator vertexAllocator{}; // in bytes
+    OffsetAllocator indexAllocator{};  // in indices
+};
+
+// mesh handle, where a model's vertices and indices are in the arena. Its draws are rebased onto it
+struct ModelGeometry {
+    OffsetAllocation vertices{};
+    OffsetAllocation indices{};
+    GPUBuffer dedicatedVertices{}; // instead of the arena ranges when the arenas can't hold the model
+    GPUBuffer dedicatedIndices{};
+    VkDeviceSize vertexByteOffset = {0u}; // vertex stride aligned
+    int32_t vertexOffset = {0};
+    uint32_t firstIndex = {0u};
+};
+
+struct RetiredPipeline {
+    VkPipeline pipeline = {VK_NULL_HANDLE};
+    uint64_t retireFrame = {0u}; // frame in which pipeline was replaced
+};
+
+// shader variant the scene stopped using, its module, layouts and pipelines go once no frame uses them
+struct RetiredShaderVariant {
+    uint64_t shaderVariant = {0u};
+    uint64_t retireFrame = {0u};
+};
+
+inline uint64_t hashCombine(uint64_t seed, uint64_t value) {
+    return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 12u) + (seed >> 4u));
+}
+
+struct VertexAttributeKey {
+    uint32_t location = {0u};
+    VkFormat format = {VK_FORMAT_UNDEFINED};
+    uint32_t offset = {0u};
+
+    bool operator==(const VertexAttributeKey &) const = default;
+};
+
+// uploaded vertex stream, holds only the Vertex attributes the shader reads, packed in location order
+struct VertexLayout {
+    uint32_t stride = {0u};
+    std::vector<VertexAttributeKey> attributes{}; // offsets into the packed stream
+    std::vector<uint32_t> sourceOffsets{};        // offsets into Vertex
+
+    bool operator==(const VertexLayout &) const = default;
+};
+
+// everything a graphics pipeline is built from, compare and hash only canonicalized keys
+struct PipelineStateKey {
+    static constexpr uint32_t MAX_VERTEX_ATTRIBUTES = {8u};
+    static constexpr uint32_t MAX_COLOR_ATTACHMENTS = {4u};
+
+    uint64_t shaderVariant = {0u}; // see registerShader()
+    VkGraphicsPipelineLibraryFlagsEXT libraryParts = {0u}; // non zero for graphics pipeline library parts
+
+    // vertex layout, one interleaved binding
+    uint32_t vertexStride = {0u};
+    uint32_t vertexAttributeCount = {0u};
+    std::array<VertexAttributeKey, MAX_VERTEX_ATTRIBUTES> vertexAttributes{};
+
+    // attachments
+    uint32_t colorAttachmentCount = {0u};
+    std::array<VkFormat, MAX_COLOR_ATTACHMENTS> colorFormats{};
+    VkFormat depthFormat = {VK_FORMAT_UNDEFINED};
+    VkFormat stencilFormat = {VK_FORMAT_UNDEFINED};
+    VkSampleCountFlagBits samples = {VK_SAMPLE_COUNT_1_BIT};
+
+    // fixed function
+    VkPrimitiveTopology topology = {VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST};
+    VkPolygonMode polygonMode = {VK_POLYGON_MODE_FILL};
+    VkCullModeFlags cullMode = {VK_CULL_MODE_NONE};
+    VkFrontFace frontFace = {VK_FRONT_FACE_COUNTER_CLOCKWISE};
+    VkBool32 depthTestEnable = {VK_TRUE};
+    VkBool32 depthWriteEnable = {VK_TRUE};
+    VkCompareOp depthCompareOp = {VK_COMPARE_OP_GREATER_OR_EQUAL}; // reversed-Z, near is 1
+    VkBool32 depthOnly = {VK_FALSE}; // vertex stage only, no fragment shader runs - see makePrepassState
+    VkBool32 blendEnable = {VK_FALSE};
+    VkBlendFactor srcColorBlendFactor = {VK_BLEND_FACTOR_ONE};
+    VkBlendFactor dstColorBlendFactor = {VK_BLEND_FACTOR_ZERO};
+    VkBlendOp colorBlendOp = {VK_BLEND_OP_ADD};
+    VkBlendFactor srcAlphaBlendFactor = {VK_BLEND_FACTOR_ONE};
+    VkBlendFactor dstAlphaBlendFactor = {VK_BLEND_FACTOR_ZERO};
+    VkBlendOp alphaBlendOp = {VK_BLEND_OP_ADD};
+    VkColorComponentFlags colorWriteMask = {0xf};
+
+    bool operator==(const PipelineStateKey &) const = default;
+};
+
+// hashes fields one by one, padding bytes are never read
+inline uint64_t hashPipelineState(const PipelineStateKey &key) {
+    uint64_t h = hashCombine(key.shaderVariant, key.libraryParts);
+    h = hashCombine(h, key.vertexStride);
+    h = hashCombine(h, key.vertexAttributeCount);
+    for (uint32_t i = 0u; i < key.vertexAttributeCount; ++i) {
+        h = hashCombine(h, key.vertexAttributes[i].location);
+        h = hashCombine(h, key.vertexAttributes[i].format);
+        h = hashCombine(h, key.vertexAttributes[i].offset);
+    }
+    h = hashCombine(h, key.colorAttachmentCount);
+    for (uint32_t i = 0u; i < key.colorAttachmentCount; ++i) {
+        h = hashCombine(h, key.colorFormats[i]);
+    }
+    for (uint64_t value : {uint64_t(key.depthFormat), uint64_t(key.stencilFormat), uint64_t(key.samples),
+                           uint64_t(key.topology), uint64_t(key.polygonMode), uint64_t(key.cullMode),
+                           uint64_t(key.frontFace), uint64_t(key.depthTestEnable), uint64_t(key.depthWriteEnable),
+                           uint64_t(key.depthCompareOp), uint64_t(key.depthOnly), uint64_t(key.blendEnable),
+                           uint64_t(key.srcColorBlendFactor), uint64_t(key.dstColorBlendFactor), uint64_t(key.colorBlendOp),
+                           uint64_t(key.srcAlphaBlendFactor), uint64_t(key.dstAlphaBlendFactor), uint64_t(key.alphaBlendOp),
+                           uint64_t(key.colorWriteMask)}) {
+        h = hashCombine(h, value);
+    }
+    return h;
+}
+
+struct PipelineStateKeyHash {
+    size_t operator()(const PipelineStateKey &key) const { return hashPipelineState(key); }
+};
+
+struct LinkTimeConstant {
+    std::string type{};  // slang type, e.g. bool
+    std::string name{};  // declared as "extern static const" in the module
+    std::string value{};
+};
+
+// typed like the shader declares the constant, e.g. 1.5f for a float one
+using SpecializationValue = std::variant<uint32_t, int32_t, float>;
+
+// 32 bit pattern handed to VkSpecializationInfo
+inline uint32_t specializationBits(const SpecializationValue &value) {
+    return std::visit([](auto v) { return std::bit_cast<uint32_t>(v); }, value);
+}
+
+// identifies a shader variant, features are compiled out by slang instead of branched at runtime
+struct ShaderVariantKey {
+    std::string modulePath{};
+    std::vector<LinkTimeConstant> linkTimeConstants{};
+    std::vector<std::string> genericArgs{}; // types for the generic parameters of the entry points, in order
+    std::vector<std::pair<uint32_t, SpecializationValue>> specializationConstants{}; // vk::constant_id -> value
+};
+
+struct VertexInput {
+    uint32_t location = {0u};
+    VkFormat format = {VK_FORMAT_UNDEFINED};
+};
+
+struct DescriptorSetDesc {
+    uint32_t set = {0u};
+    std::vector<VkDescriptorSetLayoutBinding> bindings{};
+};
+
+// resource interface of a linked program, read from slang reflection
+struct ShaderReflection {
+    std::vector<VertexInput> vertexInputs{}; // only inputs the vertex entry point reads, sorted by location
+    std::vector<DescriptorSetDesc> descriptorSets{};
+    uint32_t pushConstantSize = {0u};
+};
+
+// SPIR-V of all entry points of one variant plus what Vulkan needs to use it
+struct CompiledShader {
+    std::vector<uint32_t> spirv{};
+    ShaderReflection reflection{};
+    std::string vertexEntry{"main"};
+    std::string fragmentEntry{"main"};
+    std::vector<VkSpecializationMapEntry> specializationEntries{};
+    std::vector<uint32_t> specializationData{};
+};
+
+struct ShaderVariant {
+    VkShaderModule module = {VK_NULL_HANDLE};
+    std::array<VkShaderEXT, 2> shaderObjects{}; // vertex, fragment - only with shader objects enabled
+    std::string vertexEntry{"main"};
+    std::string fragmentEntry{"main"};
+    std::vector<VkSpecializationMapEntry> specializationEntries{};
+    std::vector<uint32_t> specializationData{};
+    VertexLayout vertexLayout{};
+    std::vector<VkDescriptorSetLayout> setLayouts{};
+    VkPipelineLayout layout = {VK_NULL_HANDLE};
+    uint32_t pushConstantSize = {0u};
+    std::shared_ptr<const CompiledShader> compiled{}; // SPIR-V and reflection, written to command captures
+
+    VkSpecializationInfo specializationInfo() const {
+        return {static_cast<uint32_t>(specializationEntries.size()), specializationEntries.data(),
+                specializationData.size() * sizeof(uint32_t), specializationData.data()};
+    }
+};
+
+// pipeline permutations created on first use, sharded to keep lookups from different threads apart
+struct PipelineStateCache {
+    static constexpr uint32_t SHARD_COUNT = {16u};
+
+    struct Shard {
+        std::shared_mutex mutex;
+        std::unordered_map<PipelineStateKey, std::shared_future<VkPipeline>, PipelineStateKeyHash> pipelines{};
+    };
+    std::array<Shard, SHARD_COUNT> shards{};
+
+    std::mutex shaderMutex;
+    std::unordered_map<uint64_t, ShaderVariant> shaders{};
+
+    std::atomic<uint64_t> replacements{0u}; // optimized pipelines swapped in, bumped so the scene resolves again
+
+    // counters to find hitches
+    std::atomic<uint64_t> hits{0u};
+    std::atomic<uint64_t> misses{0u};
+    std::atomic<uint64_t> compileTimeNs{0u};
+    std::atomic<uint64_t> maxCompileTimeNs{0u};
+};
+
+// decoded model as one blob: vertices | indices | materials | instances, uploaded into a single buffer
+struct ModelData {
+    std::string path{};
+    VertexLayout vertexLayout{}; // vertices are packed for it
+    std::vector<std::byte> data{};
+    VkDeviceSize indexOffset = {0u};
+    VkDeviceSize materialOffset = {0u}; // storage buffer offset aligned
+    VkDeviceSize instanceOffset = {0u}; // storage buffer offset aligned
+    uint32_t indexCount = {0u};
+    std::vector<SceneDraw> draws{};
+};
+
+struct RetiredModel {
+    GPUBuffer buffer{};
+    ModelGeometry geometry{};
+    VkDescriptorSet descriptorSet = {VK_NULL_HANDLE};
+    uint64_t retireFrame = {0u}; // frame in which the model was replaced
+};
+
+// streamed model kept on the GPU after it stopped being drawn, evicted least recently used first
+struct ResidentModel {
+    ModelData model{}; // data blob already released
+    GPUBuffer buffer{};
+    ModelGeometry geometry{};
+    uint64_t lastUsedFrame = {0u};
+};
+
 struct ModelContext {
     VkPipelineCache pipelineCache = {VK_NULL_HANDLE};
-    VkPipeline pipline = {VK_NULL_HANDLE};
-    VkPipelineLayout piplineLayout = {VK_NULL_HANDLE};
-
-    VkDescriptorSetLayout descriptorSetLayout = {VK_NULL_HANDLE};
-    std::vector<VkDescriptorSet> descriptorSets{};
+    VkPipelineLayout piplineLayout = {VK_NULL_HANDLE}; // layout of the current shader variant
+    uint32_t pushConstantSize = {0u};                  // of the current shader variant
+
+    ShaderVariantKey shaderKey{}; // set once in initResouces, hot-reload recompiles it
+    PipelineStateKey pipelineState{}; // scene state, drawStates are derived from it
+    std::vector<PipelineStateKey> drawStates{};
+    std::vector<VkPipeline> drawPipelines{}; // resolved from pipelineStates at frame boundary
+    bool pipelinesDirty = {true};            // drawStates changed since drawPipelines were resolved
+    uint64_t resolvedReplacements = {0u};    // PipelineStateCache::replacements seen by the last resolve
+    PipelineStateKey prepassState{}; // depth only twin of the opaque state, --depth-prepass
+    VkPipeline prepassPipeline = {VK_NULL_HANDLE};
+    std::array<VkShaderEXT, 2> shaderObjects{}; // resolved at frame boundary when shader objects are used
+    PipelineStateCache pipelineStates{};
+    std::atomic<uint64_t> pendingShaderVariant{0u}; // set by hot-reload once its pipeline is in the cache
+
+    std::mutex retireMutex;
+    std::vector<RetiredPipeline> retiredPipelines{}; // destroyed once their last frame is done
+    std::vector<RetiredShaderVariant> retiredShaderVariants{};
+
+    VkDescriptorSet descriptorSet = {VK_NULL_HANDLE}; // materials of the drawn model
     VkDescriptorPool descriptorPool = {VK_NULL_HANDLE};
 
-    GPUBuffer gpuBuffer{}; // vertex + index buffer in one buffer
+    std::string assetPath{}; // streamed in, a placeholder is drawn until it is resident
+    ModelData drawn{};     // the model being drawn, its data blob is released after upload
+    GPUBuffer gpuBuffer{}; // materials | instances
+    uint64_t drawnRevision = {0u}; // bumped whenever drawn or gpuBuffer change, state derived from them is rebuilt
+    std::atomic<bool> drawnHasBlended{false}; // copy of drawn's draws for hot-reload, which must not read them
+    ModelGeometry geometry{};
+    GeometryArena arena{}; // render thread only
+    uint64_t waitingShaderVariant = {0u}; // hot-reloaded variant reading other attributes, applied with the restreamed model
+    std::vector<RetiredModel> retiredModels{}; // render thread only
+    std::vector<ResidentModel> residentModels{}; // render thread only, republished without streaming
+};
+
+struct SlangModule {
+    Slang::ComPtr<slang::ISession> session;
+    Slang::ComPtr<slang::IModule> module;
+};
+
+// one slang session per module, all variants and entry points of a module are compiled in it
+struct ShaderCompiler {
+    std::mutex mutex; // slang sessions must not be used from several threads at once
+    Slang::ComPtr<slang::IGlobalSession> globalSession;
+    std::unordered_map<std::string, SlangModule> modules{}; // by module path
+    std::unordered_map<std::string, uint64_t> variants{};   // canonical variant key -> shader variant id
+};
+
+// watches shader directory and rebuilds pipeline on a background thread
+struct ShaderHotReload {
+    std::string shaderDir{"shader"};
+
+    int inotifyFd = {-1};
+    std::thread worker{};
+    std::atomic<bool> running{false};
+};
+
+// thread pool creating pipelines concurrently against the shared pipeline cache
+struct PipelineCompiler {
+    std::vector<std::thread> workers{};
+    std::deque<std::packaged_task<VkPipeline()>> jobs{};
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    bool stopping = {false};
+    std::vector<std::future<VkPipeline>> backgroundLinks{}; // optimized links nobody waits for, under mutex
+};
+
+struct StreamRequest {
+    std::string path{};
+    float priority = {0.0f}; // lower streams first, e.g. distance to the camera
+    VertexLayout vertexLayout{};
+    std::chrono::steady_clock::time_point requested{};
+};
+
+struct StreamUpload {
+    ModelData model{};
+    float priority = {0.0f};
+    std::chrono::steady_clock::time_point requested{};
+    GPUBuffer target{};             // device local, filled front to back together with the geometry
+    ModelGeometry geometry{};
+    VkDeviceSize uploaded = {0u};
+    uint64_t lastCopyFrame = {0u};  // resident once this frame is done
+};
+
+// jobs decode assets without touching Vulkan and hand them to the render thread as main thread jobs, which copies
+// them to the GPU a budgeted slice per frame
+struct AssetStreamer {
+    std::mutex mutex;
+    bool stopping = {false};
+    std::vector<StreamRequest> requests{}; // taken by priority
+    JobCounter decodes{};                  // one job per request
+
+    // render thread only
+    std::vector<StreamUpload> uploads{};   // being copied, in priority order
+    std::vector<StreamUpload> completed{}; // all bytes copied, published once the last copy frame is done
+    uint64_t bytesUploaded = {0u};
+};
+
+// keeps device local heaps below their VK_EXT_memory_budget budget by evicting resident models
+struct ResidencyManager {
+    static constexpr double EVICTION_THRESHOLD = {0.9}; // of a heap budget
+    std::chrono::steady_clock::time_point lastLog{};
+    uint64_t evictions = {0u};
+    VkDeviceSize evictedBytes = {0u};
+};
+
+// compacts model buffers with VMA's incremental defragmentation, one pass in flight at a time: moves are copied on
+// the GPU in the frame the pass begins, the old memory is released once that frame is done
+struct Defragmenter {
+    static constexpr double FREE_RATIO_THRESHOLD = {0.3};   // of the block bytes unused
+    static constexpr VkDeviceSize MIN_FREE_BYTES = {16ull << 20};
+    static constexpr uint32_t MAX_MOVES_PER_PASS = {64u};
+    static constexpr std::chrono::seconds CHECK_INTERVAL{5};
+
+    VmaDefragmentationContext context = {VK_NULL_HANDLE};
+    VmaPool pool = {VK_NULL_HANDLE}; // being defragmented, null for the default pools
+    VmaDefragmentationPassMoveInfo pass{};
+    bool passOpen = {false};
+    uint64_t passFrame = {0u};
+    std::vector<VkBuffer> movedBuffers{}; // still bound to the old memory, destroyed when the pass ends
+    std::chrono::steady_clock::time_point lastCheck{};
+    bool checkSmallPool = {false}; // alternates between the pools
+
+    uint64_t runs = {0u};
+    uint64_t moves = {0u};
+    VkDeviceSize bytesMoved = {0u};
+};
+
+// scene commands of the captured frames plus everything they read, see capture_format.h. The scene is frozen while
+// capturing so no frame references a resource the capture doesn't contain
+struct CommandCapture {
+    bool active = {false};
+    uint32_t framesCaptured = {0u};
+    std::vector<std::byte> stream{};
+    uint32_t nextId = {1u};
+    std::unordered_map<VkBuffer, uint32_t> buffers{};
+    std::unordered_map<uint64_t, uint32_t> shaders{}; // by shader variant
+    std::unordered_map<PipelineStateKey, uint32_t, PipelineStateKeyHash> pipelines{};
+    std::unordered_map<VkDescriptorSet, uint32_t> descriptorSets{};
+};
+
+// frame and startup timings reported by --bench-frames, GPU time comes from timestamps around each frame's commands
+// and around its scene passes
+struct FrameProfiler {
+    static constexpr uint32_t FRAME_QUERIES = {4u}; // frame start and end, scene passes start and end
+    VkQueryPool queryPool = {VK_NULL_HANDLE}; // FRAME_QUERIES timestamps per frame in flight, null when the queue has none
+    std::array<bool, SwapChain::MAX_SWAPCHAIN_FRAMES> pending{};  // timestamps written, read after the frame's fence
+    std::array<bool, SwapChain::MAX_SWAPCHAIN_FRAMES> measured{}; // the frame counts towards gpuFrameMs
+    bool measuring = {false};
+    double fenceWaitMs = {0.0}; // of the last frame
+    std::vector<double> cpuFrameMs{}; // whole draw() calls
+    std::vector<double> cpuWorkMs{};  // draw() without the fence wait
+    std::vector<double> gpuFrameMs{};
+    std::vector<double> scenePassMs{}; // scene rendering including MSAA resolves, and the phase 1 cull between the passes
+    std::vector<double> renderScale{}; // of every measured frame, 1 without dynamic resolution
+    std::chrono::steady_clock::time_point lastMark{std::chrono::steady_clock::now()};
+    std::vector<std::pair<std::string, double>> startupMs{};
+};
+
+// compute pipeline of a module with a single entry point, its set 0 is pushed with vkCmdPushDescriptorSet
+struct ComputeKernel {
+    VkDescriptorSetLayout setLayout = {VK_NULL_HANDLE};
+    VkPipelineLayout layout = {VK_NULL_HANDLE};
+    VkPipeline pipeline = {VK_NULL_HANDLE};
+    uint32_t pushConstantSize = {0u};
+};
+
+// matches PyramidConstants in depth_pyramid.slang
+struct PyramidConstants {
+    glm::uvec2 sourceSize{};
+    glm::uvec2 targetSize{};
+    uint32_t sourceIsDepth = {0u};
+};
+
+// matches CullConstants in cull.slang
+struct CullConstants {
+    uint32_t recordCount = {0u};
+    uint32_t drawCount = {0u};
+    uint32_t phase = {0u};
+    uint32_t pyramidLevels = {0u};
+    glm::vec2 pyramidSize{};
+};
+
+// two phase occlusion culling against a min/max depth pyramid, see shader/cull.slang. The per model buffers are rebuilt
+// whenever the drawn model buffer changes, on publish as well as when defragmentation moves it
+struct OcclusionCulling {
+    bool enabled = {false}; // --no-occlusion-culling and device support, captured frames are drawn without it
+    ComputeKernel pyramidKernel{};
+    ComputeKernel cullKernel{};
+
+    VkImage pyramid = {VK_NULL_HANDLE}; // R32G32 min, max depth, level 0 is the depth buffer rounded down to a power of two
+    VmaAllocation pyramidAlloc = {VK_NULL_HANDLE};
+    VkImageView pyramidView = {VK_NULL_HANDLE};  // all levels, read by the cull pass
+    std::vector<VkImageView> levelViews{};        // one per level, written by the pyramid pass
+    VkExtent2D pyramidExtent{};
+
+    uint64_t modelRevision = {0u}; // ModelContext::drawnRevision the buffers below were built for
+    GPUBuffer drawBounds{};       // vec4 per draw, host written
+    GPUBuffer records{};          // draw, instance per drawn instance, host written
+    GPUBuffer commandTemplate{};  // indirect commands of both phases with no instances, host written
+    GPUBuffer commands{};         // copied from the template every frame, instance counts added by the cull pass
+    GPUBuffer visibility{};       // per record, survives between frames
+    GPUBuffer culledInstances{};  // instance transforms of both phases, compacted per draw
+    VkDescriptorSet culledDescriptorSet = {VK_NULL_HANDLE}; // model descriptor set reading culledInstances
+    uint32_t drawCount = {0u};
+    uint32_t recordCount = {0u};
+    bool resetVisibility = {false}; // everything counts as visible in the first frame of a model
+};
+
+// dynamic resolution scaling. The scene target is allocated at the largest scale and the scene is drawn into its top
+// left corner at the current one, the depth buffer and depth pyramid are shared the same way. That corner is blitted
+// to the swapchain image with linear filtering
+struct DynamicResolution {
+    bool enabled = {false}; // --dynamic-resolution, GPU timestamps and blit support for the color format
+    VkImage image = {VK_NULL_HANDLE};
+    VmaAllocation allocation = {VK_NULL_HANDLE};
+    VkImageView view = {VK_NULL_HANDLE};
+    VkExtent2D maxExtent{};    // swapchain extent at the largest scale
+    VkExtent2D extent{};       // the scene is drawn at, the swapchain extent when disabled
+    float scale = {1.0f};
+    double filteredMs = {0.0}; // smoothed GPU frame time at the current scale, 0 until its first sample
+    uint32_t settleFrames = {0u}; // samples still to come from frames recorded before the last change
+};
+
+// multisampled scene attachments, resolved by the resolve attachments of the last pass that draws into them. Without
+// occlusion culling nothing reads them after the pass, so they are transient and lazily allocated where the device has
+// such memory, a tiler then keeps the samples on chip. Phase 1 of culling loads them again, and the pyramid needs the
+// depth resolved into the depth buffer
+struct Multisampling {
+    VkSampleCountFlagBits samples = {VK_SAMPLE_COUNT_1_BIT}; // --msaa within the color and depth limits of the device
+    VkImage color = {VK_NULL_HANDLE};
+    VmaAllocation colorAlloc = {VK_NULL_HANDLE};
+    VkImageView colorView = {VK_NULL_HANDLE};
+    VkImage depth = {VK_NULL_HANDLE};
+    VmaAllocation depthAlloc = {VK_NULL_HANDLE};
+    VkImageView depthView = {VK_NULL_HANDLE};
+    VkResolveModeFlagBits depthResolve = {VK_RESOLVE_MODE_NONE}; // into the depth buffer for the pyramid, with culling only
+    bool transient = {false};       // samples are not stored past the pass
+    bool lazilyAllocated = {false};
+    VkDeviceSize attachmentBytes = {0u}; // of both targets
 };
 
 struct AppContext {
+    AppOptions options;
     WindowContext windowCtx;
     VulkanContext vkCtx;
     ModelContext modelCtx;
+    ShaderCompiler shaderCompiler;
+    ShaderHotReload hotReload;
+    PipelineCompiler pipelineCompiler;
+    AssetStreamer assetStreamer;
+    ResidencyManager residency;
+    Defragmenter defragmenter;
+    CommandCapture capture;
+    FrameProfiler profiler;
+    JobSystem jobs;
+    OcclusionCulling culling;
+    DynamicResolution resolution;
+    Multisampling msaa;
 };
 
 uint32_t findMemoryType(const VulkanContext &vkCtx, uint32_t type, VkMemoryPropertyFlags props) {
@@ -166,6 +837,72 @@ uint32_t findMemoryType(const VulkanContext &vkCtx, uint32_t type, VkMemoryPrope
     RT_THROW("Failed to find suitable memory type");
 }
 
+void createMemoryPools(VulkanContext &vkCtx) {
+    // one fixed block used front to back and freed in the same order, VMA then treats it as a ring buffer
+    VkBufferCreateInfo transientCI {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = 0x10000u, .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT};
+    VmaAllocationCreateInfo transientAllocCI {.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                                              .usage = VMA_MEMORY_USAGE_AUTO};
+    VmaPoolCreateInfo transientPoolCI {.flags = VMA_POOL_CREATE_LINEAR_ALGORITHM_BIT, .blockSize = MemoryPools::TRANSIENT_POOL_SIZE,
+                                       .minBlockCount = 1u, .maxBlockCount = 1u};
+    VK_CHECK(vmaFindMemoryTypeIndexForBufferInfo(vkCtx.allocator, &transientCI, &transientAllocCI, &transientPoolCI.memoryTypeIndex),
+             "No memory type for transient buffers");
+    VK_CHECK(vmaCreatePool(vkCtx.allocator, &transientPoolCI, &vkCtx.pools.transient), "Failed to create transient pool");
+
+    VkBufferCreateInfo smallCI {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = 0x10000u, .usage = MODEL_BUFFER_USAGE};
+    VmaAllocationCreateInfo smallAllocCI {.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE};
+    VmaPoolCreateInfo smallPoolCI {.blockSize = MemoryPools::SMALL_BLOCK_SIZE, .minBlockCount = 1u};
+    VK_CHECK(vmaFindMemoryTypeIndexForBufferInfo(vkCtx.allocator, &smallCI, &smallAllocCI, &smallPoolCI.memoryTypeIndex),
+             "No memory type for small buffers");
+    VK_CHECK(vmaCreatePool(vkCtx.allocator, &smallPoolCI, &vkCtx.pools.small), "Failed to create small buffer pool");
+}
+
+// device local buffer placement by size, see MemoryPools
+VmaAllocationCreateInfo bufferAllocationInfo(const VulkanContext &vkCtx, VkDeviceSize size) {
+    VmaAllocationCreateInfo allocCI {.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE};
+    if (size < MemoryPools::SMALL_BUFFER_LIMIT) {
+        allocCI.pool = vkCtx.pools.small;
+    } else if (size >= MemoryPools::DEDICATED_THRESHOLD) {
+        allocCI.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+    }
+    return allocCI;
+}
+
+VmaAllocationCreateInfo imageAllocationInfo(const VulkanContext &vkCtx, const VkImageCreateInfo &imageCI) {
+    VkDeviceImageMemoryRequirements requirementsInfo {.sType = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS, .pCreateInfo = &imageCI};
+    VkMemoryRequirements2 requirements {.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2};
+    vkGetDeviceImageMemoryRequirements(vkCtx.device, &requirementsInfo, &requirements);
+    VmaAllocationCreateInfo allocCI {.usage = VMA_MEMORY_USAGE_AUTO};
+    if (requirements.memoryRequirements.size >= MemoryPools::DEDICATED_THRESHOLD) {
+        allocCI.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+    }
+    return allocCI;
+}
+
+// mapped host visible buffer valid for the current frame, nullptr when the ring is full until older frames are done
+TransientBuffer *allocateTransientBuffer(VulkanContext &vkCtx, VkDeviceSize size, VkBufferUsageFlags usage) {
+    VkBufferCreateInfo buffCI {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = size, .usage = usage};
+    VmaAllocationCreateInfo buffAllocCI {.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                                         .usage = VMA_MEMORY_USAGE_AUTO, .pool = vkCtx.pools.transient};
+    TransientBuffer transient {.frame = vkCtx.frameCounter};
+    VmaAllocationInfo allocInfo{};
+    VkResult result = vmaCreateBuffer(vkCtx.allocator, &buffCI, &buffAllocCI, &transient.buffer, &transient.allocation, &allocInfo);
+    if (result == VK_ERROR_OUT_OF_DEVICE_MEMORY) {
+        return nullptr;
+    }
+    VK_CHECK(result, "Failed to create transient buffer");
+    transient.mapped = static_cast<std::byte*>(allocInfo.pMappedData);
+    return &vkCtx.pools.transientBuffers.emplace_back(transient);
+}
+
+// frame boundary, transient buffers are freed in the order they were allocated
+void releaseTransientBuffers(VulkanContext &vkCtx) {
+    auto &buffers = vkCtx.pools.transientBuffers;
+    while (!buffers.empty() && buffers.front().frame + SwapChain::MAX_SWAPCHAIN_FRAMES <= vkCtx.frameCounter) {
+        vmaDestroyBuffer(vkCtx.allocator, buffers.front().buffer, buffers.front().allocation);
+        buffers.pop_front();
+    }
+}
+
 VkCommandBuffer beginSingleTimeCommands(const VulkanContext &vkCtx) {
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -199,16 +936,48 @@ void endSingleTimeCommands(const VulkanContext &vkCtx, VkCommandBuffer commandBu
     vkFreeCommandBuffers(vkCtx.device, vkCtx.commandPool, 1, &commandBuffer);
 }
 
-VkShaderModule loadShader(AppContext &appCtx, const std::string &path) {
-    Slang::ComPtr<slang::IGlobalSession> globalSlangSession;
+// canonical form of the key - constants sorted by name/id, generic args keep their order
+std::string shaderVariantName(ShaderVariantKey key) {
+    std::sort(key.linkTimeConstants.begin(), key.linkTimeConstants.end(),
+              [](const LinkTimeConstant &a, const LinkTimeConstant &b) { return a.name < b.name; });
+    std::sort(key.specializationConstants.begin(), key.specializationConstants.end());
+
+    std::string name = key.modulePath;
+    for (auto &constant : key.linkTimeConstants) {
+        name += std::format("|{} {}={}", constant.type, constant.name, constant.value);
+    }
+    for (auto &arg : key.genericArgs) {
+        name += std::format("|<{}>", arg);
+    }
+    // suffixed with the type, 1u and 1.0f are different constants
+    for (auto &[id, value] : key.specializationConstants) {
+        name += std::visit([id](auto v) {
+            using T = decltype(v);
+            return std::format("|#{}={}{}", id, v, std::is_same_v<T, float> ? "f" : std::is_same_v<T, int32_t> ? "i" : "u");
+        }, value);
+    }
+    return name;
+}
+
+SlangModule *loadSlangModule(ShaderCompiler &compiler, const std::string &path, std::string &diagnostics) {
+    if (auto it = compiler.modules.find(path); it != compiler.modules.end()) {
+        return &it->second;
+    }
+    if (compiler.globalSession == nullptr) {
+        slang::createGlobalSession(compiler.globalSession.writeRef());
+    }
 
-    slang::createGlobalSession(globalSlangSession.writeRef());
-    auto slangTraget {std::to_array<slang::TargetDesc>( { {.format {SLANG_SPIRV}, .profile{globalSlangSession->findProfile("spirv_1_4")}}
+    auto slangTraget {std::to_array<slang::TargetDesc>( { {.format {SLANG_SPIRV}, .profile{compiler.globalSession->findProfile("spirv_1_4")}}
     } )};
     auto slangOptions {std::to_array<slang::CompilerOptionEntry>( {
         {
             slang::CompilerOptionName::EmitSpirvDirectly,
             {slang::CompilerOptionValueKind::Int, 1}
+        },
+        {
+            // all entry points go into one SPIR-V module, keep their names apart
+            slang::CompilerOptionName::VulkanUseEntryPointName,
+            {slang::CompilerOptionValueKind::Int, 1}
         }})};
 
     slang::SessionDesc slangSessionDesc {
@@ -219,230 +988,629 @@ VkShaderModule loadShader(AppContext &appCtx, const std::string &path) {
         .compilerOptionEntryCount {uint32_t(slangOptions.size())}
     };
 
-    Slang::ComPtr<slang::ISession> slangSession;
-    globalSlangSession->createSession( slangSessionDesc, slangSession.writeRef());
+    SlangModule slangModule{};
+    compiler.globalSession->createSession( slangSessionDesc, slangModule.session.writeRef());
     Slang::ComPtr<slang::IBlob> diagnosticsBlob;
-    Slang::ComPtr<slang::IModule> slangModule {
-        slangSession->loadModuleFromSource("triangle", path.c_str(), nullptr, diagnosticsBlob.writeRef())
-    };
-    if (diagnosticsBlob != nullptr) {
-        std::cout << "Spir-v errors:" << std::endl;
-        std::cout << (const char*)diagnosticsBlob->getBufferPointer() << std::endl;
-        exit(-3);
+    std::string moduleName = std::filesystem::path(path).stem().string();
+    slangModule.module = slangModule.session->loadModuleFromSource(moduleName.c_str(), path.c_str(), nullptr, diagnosticsBlob.writeRef());
+    if (diagnosticsBlob != nullptr || slangModule.module == nullptr) {
+        diagnostics = diagnosticsBlob ? (const char*)diagnosticsBlob->getBufferPointer() : "failed to load " + path;
+        return nullptr;
     }
-    Slang::ComPtr<ISlangBlob> spirvBlob;
-    slangModule->getTargetCode(0, spirvBlob.writeRef());
-
-    VkShaderModuleCreateInfo shaderCI {
-    .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-    .pNext = VK_NULL_HANDLE,
-    .codeSize = spirvBlob->getBufferSize(),
-    .pCode = (uint32_t*)spirvBlob->getBufferPointer()};
-
-    VkShaderModule shader;
-    VK_CHECK(vkCreateShaderModule(appCtx.vkCtx.device, &shaderCI, nullptr, &shader), "Failed to load and/or compile shader");
-    return shader;
+    return &compiler.modules.emplace(path, std::move(slangModule)).first->second;
 }
 
-void initWindow(AppContext &appCtx) {
-    glfwSetErrorCallback([](int code, const char *desc) -> void {
-        std::cerr << std::format("[GLFW] {}: {}", code, desc) << std::endl;
-    });
+VkFormat vertexInputFormat(slang::TypeReflection *type) {
+    if (type->getKind() != slang::TypeReflection::Kind::Scalar && type->getKind() != slang::TypeReflection::Kind::Vector) {
+        return VK_FORMAT_UNDEFINED;
+    }
+    size_t components = type->getKind() == slang::TypeReflection::Kind::Vector ? type->getElementCount() : 1u;
+    if (components < 1u || components > 4u) {
+        return VK_FORMAT_UNDEFINED;
+    }
+    switch (type->getScalarType()) {
+        case slang::TypeReflection::ScalarType::Float32:
+            return std::array{VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT}[components - 1u];
+        case slang::TypeReflection::ScalarType::Int32:
+            return std::array{VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT}[components - 1u];
+        case slang::TypeReflection::ScalarType::UInt32:
+            return std::array{VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT}[components - 1u];
+        default:
+            return VK_FORMAT_UNDEFINED;
+    }
+}
 
-    glfwInit();
+VkDescriptorType descriptorType(slang::BindingType type) {
+    switch (type) {
+        case slang::BindingType::Sampler: return VK_DESCRIPTOR_TYPE_SAMPLER;
+        case slang::BindingType::CombinedTextureSampler: return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        case slang::BindingType::Texture: return VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        case slang::BindingType::MutableTexture: return VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        case slang::BindingType::TypedBuffer: return VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+        case slang::BindingType::MutableTypedBuffer: return VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER;
+        case slang::BindingType::RawBuffer:
+        case slang::BindingType::MutableRawBuffer: return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        case slang::BindingType::ConstantBuffer: return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        case slang::BindingType::InputRenderTarget: return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+        case slang::BindingType::RayTracingAccelerationStructure: return VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+        default: return VK_DESCRIPTOR_TYPE_MAX_ENUM; // push constants, varyings - not a descriptor
+    }
+}
 
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+DescriptorSetDesc &descriptorSet(ShaderReflection &reflection, uint32_t set) {
+    auto it = std::find_if(reflection.descriptorSets.begin(), reflection.descriptorSets.end(),
+                           [set](const DescriptorSetDesc &desc) { return desc.set == set; });
+    if (it != reflection.descriptorSets.end()) {
+        return *it;
+    }
+    return reflection.descriptorSets.emplace_back(DescriptorSetDesc{.set = set});
+}
 
-    appCtx.windowCtx.window = glfwCreateWindow(
-        static_cast<int>(appCtx.windowCtx.width),
-        static_cast<int>(appCtx.windowCtx.height), "vulkan14", nullptr, nullptr);
+// descriptor ranges of a type layout, ParameterBlocks get their own set
+void reflectDescriptorSets(slang::TypeLayoutReflection *typeLayout, uint32_t spaceOffset, ShaderReflection &reflection) {
+    for (SlangInt set = 0; set < typeLayout->getDescriptorSetCount(); ++set) {
+        uint32_t space = spaceOffset + uint32_t(typeLayout->getDescriptorSetSpaceOffset(set));
+        for (SlangInt range = 0; range < typeLayout->getDescriptorSetDescriptorRangeCount(set); ++range) {
+            VkDescriptorType type = descriptorType(typeLayout->getDescriptorSetDescriptorRangeType(set, range));
+            if (type == VK_DESCRIPTOR_TYPE_MAX_ENUM) {
+                continue;
+            }
+            descriptorSet(reflection, space).bindings.push_back({
+                .binding = uint32_t(typeLayout->getDescriptorSetDescriptorRangeIndexOffset(set, range)),
+                .descriptorType = type,
+                .descriptorCount = uint32_t(typeLayout->getDescriptorSetDescriptorRangeDescriptorCount(set, range)),
+                .stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS
+            });
+        }
+    }
+    for (SlangInt subObject = 0; subObject < typeLayout->getSubObjectRangeCount(); ++subObject) {
+        SlangInt bindingRange = typeLayout->getSubObjectRangeBindingRangeIndex(subObject);
+        if (typeLayout->getBindingRangeType(bindingRange) != slang::BindingType::ParameterBlock) {
+            continue;
+        }
+        uint32_t space = spaceOffset + uint32_t(typeLayout->getSubObjectRangeSpaceOffset(subObject));
+        auto *element = typeLayout->getBindingRangeLeafTypeLayout(bindingRange)->getElementTypeLayout();
+        if (element->getSize() > 0u) {
+            // ordinary data of a block goes into an implicit constant buffer at binding 0
+            descriptorSet(reflection, space).bindings.push_back({
+                .binding = 0u,
+                .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                .descriptorCount = 1u,
+                .stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS
+            });
+        }
+        reflectDescriptorSets(element, space, reflection);
+    }
+}
 
-    if (appCtx.windowCtx.window == nullptr) {
-        glfwTerminate();
-        exit(-1);
+// descriptor sets, push constants and the vertex inputs that are actually read
+bool reflectShader(slang::IComponentType *linked, ShaderReflection &reflection, std::string &diagnostics) {
+    auto *layout = linked->getLayout();
+    reflectDescriptorSets(layout->getGlobalParamsTypeLayout(), 0u, reflection);
+    std::sort(reflection.descriptorSets.begin(), reflection.descriptorSets.end(),
+              [](const DescriptorSetDesc &a, const DescriptorSetDesc &b) { return a.set < b.set; });
+
+    for (uint32_t i = 0u; i < layout->getParameterCount(); ++i) {
+        auto *param = layout->getParameterByIndex(i);
+        if (param->getCategory() == slang::ParameterCategory::PushConstantBuffer) {
+            auto size = uint32_t(param->getTypeLayout()->getElementTypeLayout()->getSize());
+            reflection.pushConstantSize = std::max(reflection.pushConstantSize, size);
+        }
     }
 
-    glfwSetWindowUserPointer(appCtx.windowCtx.window, &appCtx.windowCtx);
+    for (SlangUInt i = 0u; i < layout->getEntryPointCount(); ++i) {
+        auto *entryPoint = layout->getEntryPointByIndex(i);
+        if (entryPoint->getStage() != SLANG_STAGE_VERTEX) {
+            continue;
+        }
+        // without metadata every declared input counts as used
+        Slang::ComPtr<slang::IMetadata> metadata;
+        Slang::ComPtr<slang::IBlob> diagnosticsBlob;
+        linked->getEntryPointMetadata(SlangInt(i), 0, metadata.writeRef(), diagnosticsBlob.writeRef());
+
+        std::function<bool(slang::VariableLayoutReflection *, uint32_t)> reflectInput =
+            [&](slang::VariableLayoutReflection *var, uint32_t baseLocation) {
+            uint32_t location = baseLocation + uint32_t(var->getOffset(SLANG_PARAMETER_CATEGORY_VARYING_INPUT));
+            auto *typeLayout = var->getTypeLayout();
+            if (typeLayout->getKind() == slang::TypeReflection::Kind::Struct) {
+                for (uint32_t field = 0u; field < typeLayout->getFieldCount(); ++field) {
+                    if (!reflectInput(typeLayout->getFieldByIndex(field), location)) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+            auto semantic = std::string_view(var->getSemanticName() ? var->getSemanticName() : "");
+            if (semantic.starts_with("SV_") || typeLayout->getSize(SLANG_PARAMETER_CATEGORY_VARYING_INPUT) == 0u) {
+                return true; // system values are not fed from vertex buffers
+            }
+            bool used = true;
+            if (metadata != nullptr) {
+                metadata->isParameterLocationUsed(SLANG_PARAMETER_CATEGORY_VARYING_INPUT, 0u, location, used);
+            }
+            if (!used) {
+                return true;
+            }
+            VkFormat format = vertexInputFormat(typeLayout->getType());
+            if (format == VK_FORMAT_UNDEFINED) {
+                diagnostics = std::format("vertex input {} at location {} has no vertex format", var->getName(), location);
+                return false;
+            }
+            reflection.vertexInputs.push_back({location, format});
+            return true;
+        };
+        for (uint32_t param = 0u; param < entryPoint->getParameterCount(); ++param) {
+            if (!reflectInput(entryPoint->getParameterByIndex(param), 0u)) {
+                return false;
+            }
+        }
+    }
+    std::sort(reflection.vertexInputs.begin(), reflection.vertexInputs.end(),
+              [](const VertexInput &a, const VertexInput &b) { return a.location < b.location; });
+    return true;
 }
 
-void initVulkan(AppContext &appCtx) {
-    VkApplicationInfo appInfo = {
-        .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
-        .pNext = VK_NULL_HANDLE,
-        .pApplicationName = "vulkan14_app",
-        .applicationVersion = VK_MAKE_VERSION(0, 0, 1),
-        .pEngineName = "vulkan14_engine",
-        .engineVersion = VK_MAKE_VERSION(0, 0, 1),
-        .apiVersion = VK_API_VERSION_1_4
-    };
-
-    uint32_t reqCount = 0u;
-    const char **glfwReq = glfwGetRequiredInstanceExtensions(&reqCount);
-    std::vector<const char *> extensions(glfwReq, glfwReq + reqCount);
+// links module, all of its entry points and link-time constants of the variant into one program
+bool compileShaderVariant(ShaderCompiler &compiler, const ShaderVariantKey &key, const std::string &variantName,
+                          CompiledShader &compiled, std::string &diagnostics) {
+    SlangModule *slangModule = loadSlangModule(compiler, key.modulePath, diagnostics);
+    if (slangModule == nullptr) {
+        return false;
+    }
 
-    VkInstanceCreateInfo instInfo = {
-        .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
-        .pNext = VK_NULL_HANDLE,
-        .flags = 0u,
-        .pApplicationInfo = &appInfo,
-        .enabledLayerCount = 0u,
-        .ppEnabledLayerNames = VK_NULL_HANDLE,
-        .enabledExtensionCount = static_cast<uint32_t>(extensions.size()),
-        .ppEnabledExtensionNames = extensions.data()
+    Slang::ComPtr<slang::IBlob> diagnosticsBlob;
+    auto failed = [&](SlangResult result, const char *step) {
+        if (SLANG_SUCCEEDED(result)) {
+            return false;
+        }
+        diagnostics = std::format("{} failed", step);
+        if (diagnosticsBlob != nullptr) {
+            diagnostics += std::format(":\n{}", (const char*)diagnosticsBlob->getBufferPointer());
+        }
+        return true;
     };
 
-    VK_CHECK(vkCreateInstance(&instInfo, nullptr, &appCtx.vkCtx.instance),
-             "Failed to create instance");
+    std::vector<slang::IComponentType *> components{slangModule->module.get()};
+    std::vector<Slang::ComPtr<slang::IEntryPoint>> entryPoints(slangModule->module->getDefinedEntryPointCount());
+    for (SlangInt32 i = 0; i < SlangInt32(entryPoints.size()); ++i) {
+        slangModule->module->getDefinedEntryPoint(i, entryPoints[i].writeRef());
+        components.push_back(entryPoints[i].get());
+    }
 
-    VK_CHECK(glfwCreateWindowSurface(appCtx.vkCtx.instance,
-                 appCtx.windowCtx.window, nullptr,
-                 &appCtx.vkCtx.surface),
-             "Failed to create Surface");
+    Slang::ComPtr<slang::IModule> constantsModule;
+    if (!key.linkTimeConstants.empty()) {
+        std::string source;
+        for (auto &constant : key.linkTimeConstants) {
+            source += std::format("export static const {} {} = {};\n", constant.type, constant.name, constant.value);
+        }
+        std::string moduleName = std::format("variant_{:016x}", std::hash<std::string>{}(variantName));
+        constantsModule = slangModule->session->loadModuleFromSourceString(
+            moduleName.c_str(), (moduleName + ".slang").c_str(), source.c_str(), diagnosticsBlob.writeRef());
+        if (constantsModule == nullptr) {
+            failed(SLANG_FAIL, "link-time constants");
+            return false;
+        }
+        components.push_back(constantsModule.get());
+    }
 
-    uint32_t deviceCount = 0u;
-    vkEnumeratePhysicalDevices(appCtx.vkCtx.instance, &deviceCount, nullptr);
-    if (deviceCount == 0)
-        RT_THROW("Failed to find Vulkan supported GPU");
+    Slang::ComPtr<slang::IComponentType> program;
+    if (failed(slangModule->session->createCompositeComponentType(components.data(), SlangInt(components.size()),
+                                                                  program.writeRef(), diagnosticsBlob.writeRef()),
+               "compose")) {
+        return false;
+    }
 
-    std::vector<VkPhysicalDevice> devices(deviceCount);
-    vkEnumeratePhysicalDevices(appCtx.vkCtx.instance, &deviceCount,
-                               devices.data());
+    if (!key.genericArgs.empty()) {
+        std::vector<slang::SpecializationArg> args{};
+        for (auto &typeName : key.genericArgs) {
+            auto *type = slangModule->module->getLayout()->findTypeByName(typeName.c_str());
+            if (type == nullptr) {
+                diagnostics = std::format("unknown generic argument {}", typeName);
+                return false;
+            }
+            args.push_back(slang::SpecializationArg::fromType(type));
+        }
+        Slang::ComPtr<slang::IComponentType> specialized;
+        if (failed(program->specialize(args.data(), SlangInt(args.size()), specialized.writeRef(), diagnosticsBlob.writeRef()),
+                   "specialize")) {
+            return false;
+        }
+        program = specialized;
+    }
 
-    for (auto &dev: devices) {
-        VkPhysicalDeviceProperties properties;
-        vkGetPhysicalDeviceProperties(dev, &properties);
-        std::cout << std::format("Device {}", properties.deviceName) << "\n";
+    Slang::ComPtr<slang::IComponentType> linked;
+    if (failed(program->link(linked.writeRef(), diagnosticsBlob.writeRef()), "link")) {
+        return false;
+    }
+    Slang::ComPtr<slang::IBlob> spirvBlob;
+    if (failed(linked->getTargetCode(0, spirvBlob.writeRef(), diagnosticsBlob.writeRef()), "code generation")) {
+        return false;
     }
 
-    for (auto &dev: devices) {
-        VkPhysicalDeviceProperties properties;
-        vkGetPhysicalDeviceProperties(dev, &properties);
-        if (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
-            appCtx.vkCtx.physicalDevice = dev;
-            appCtx.vkCtx.properties = properties;
-            break;
+    auto code = (const uint32_t*)spirvBlob->getBufferPointer();
+    compiled.spirv.assign(code, code + spirvBlob->getBufferSize() / sizeof(uint32_t));
+
+    auto *layout = linked->getLayout();
+    for (SlangUInt i = 0u; i < layout->getEntryPointCount(); ++i) {
+        auto *entryPoint = layout->getEntryPointByIndex(i);
+        if (entryPoint->getStage() == SLANG_STAGE_VERTEX) {
+            compiled.vertexEntry = entryPoint->getName();
+        } else if (entryPoint->getStage() == SLANG_STAGE_FRAGMENT) {
+            compiled.fragmentEntry = entryPoint->getName();
         }
     }
 
-    if (appCtx.vkCtx.physicalDevice == VK_NULL_HANDLE)
-        RT_THROW("Failed to select Vulkan supported GPU");
+    if (!reflectShader(linked, compiled.reflection, diagnostics)) {
+        return false;
+    }
 
-    std::cout << std::format("Selected {} GPU",
-                             appCtx.vkCtx.properties.deviceName)
-            << "\n";
+    for (auto &[id, value] : key.specializationConstants) {
+        compiled.specializationEntries.push_back({id, uint32_t(compiled.specializationData.size() * sizeof(uint32_t)), sizeof(uint32_t)});
+        compiled.specializationData.push_back(specializationBits(value));
+    }
+    return true;
+}
 
-    uint32_t queueFamilyCount = 0u;
-    vkGetPhysicalDeviceQueueFamilyProperties(appCtx.vkCtx.physicalDevice,
-                                             &queueFamilyCount, nullptr);
-    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-    vkGetPhysicalDeviceQueueFamilyProperties(
-        appCtx.vkCtx.physicalDevice, &queueFamilyCount, queueFamilies.data());
+VkShaderModule createShaderModule(const VulkanContext &vkCtx, const std::vector<uint32_t> &spirv) {
+    VkShaderModuleCreateInfo shaderCI {
+    .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+    .pNext = VK_NULL_HANDLE,
+    .codeSize = spirv.size() * sizeof(uint32_t),
+    .pCode = spirv.data()};
+
+    VkShaderModule shader;
+    VK_CHECK(vkCreateShaderModule(vkCtx.device, &shaderCI, nullptr, &shader), "Failed to load and/or compile shader");
+    return shader;
+}
 
-    uint32_t i = 0;
+// linked vertex + fragment shader objects, fixed-function state is all set dynamically
+std::array<VkShaderEXT, 2> createShaderObjects(const VulkanContext &vkCtx, const CompiledShader &compiled,
+                                               std::span<const VkDescriptorSetLayout> setLayouts) {
+    VkSpecializationInfo specializationInfo {
+        static_cast<uint32_t>(compiled.specializationEntries.size()), compiled.specializationEntries.data(),
+        compiled.specializationData.size() * sizeof(uint32_t), compiled.specializationData.data()
+    };
+    VkPushConstantRange pushConstants {VK_SHADER_STAGE_ALL_GRAPHICS, 0u, compiled.reflection.pushConstantSize};
+    std::array<VkShaderCreateInfoEXT, 2> shaderCIs{};
+    for (auto &shaderCI : shaderCIs) {
+        shaderCI.sType = VK_STRUCTURE_TYPE_SHADER_CREATE_INFO_EXT;
+        shaderCI.flags = VK_SHADER_CREATE_LINK_STAGE_BIT_EXT;
+        shaderCI.codeType = VK_SHADER_CODE_TYPE_SPIRV_EXT;
+        shaderCI.codeSize = compiled.spirv.size() * sizeof(uint32_t);
+        shaderCI.pCode = compiled.spirv.data();
+        shaderCI.pSpecializationInfo = &specializationInfo;
+        shaderCI.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+        shaderCI.pSetLayouts = setLayouts.data();
+        shaderCI.pushConstantRangeCount = pushConstants.size > 0u ? 1u : 0u;
+        shaderCI.pPushConstantRanges = &pushConstants;
+    }
+    shaderCIs[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderCIs[0].nextStage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shaderCIs[0].pName = compiled.vertexEntry.c_str();
+    shaderCIs[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shaderCIs[1].pName = compiled.fragmentEntry.c_str();
+
+    std::array<VkShaderEXT, 2> shaders{};
+    VK_CHECK(vkCtx.ext.vkCreateShadersEXT(vkCtx.device, static_cast<uint32_t>(shaderCIs.size()), shaderCIs.data(),
+                                          nullptr, shaders.data()),
+             "Failed to create shader objects");
+    return shaders;
+}
 
-    for (const auto &queueFam: queueFamilies) {
-        if (queueFam.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-            appCtx.vkCtx.graphicsQueue.idx = i;
-        }
+uint32_t vertexFormatSize(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R32_SFLOAT: case VK_FORMAT_R32_SINT: case VK_FORMAT_R32_UINT: return 4u;
+        case VK_FORMAT_R32G32_SFLOAT: case VK_FORMAT_R32G32_SINT: case VK_FORMAT_R32G32_UINT: return 8u;
+        case VK_FORMAT_R32G32B32_SFLOAT: case VK_FORMAT_R32G32B32_SINT: case VK_FORMAT_R32G32B32_UINT: return 12u;
+        case VK_FORMAT_R32G32B32A32_SFLOAT: case VK_FORMAT_R32G32B32A32_SINT: case VK_FORMAT_R32G32B32A32_UINT: return 16u;
+        default: RT_THROW(std::format("Unsupported vertex format {}", int(format)));
+    }
+}
 
-        if (queueFam.queueFlags & VK_QUEUE_COMPUTE_BIT) {
-            appCtx.vkCtx.computeQueue.idx = i;
+// matches shader inputs to Vertex attributes by location, attributes nobody reads are left out of the stream
+VertexLayout makeVertexLayout(std::span<const VertexInput> inputs) {
+    auto source = Vertex::attributeDescriptions();
+    if (inputs.size() > PipelineStateKey::MAX_VERTEX_ATTRIBUTES) {
+        RT_THROW("Too many vertex inputs");
+    }
+    VertexLayout layout{};
+    for (auto &input : inputs) {
+        auto it = std::find_if(source.begin(), source.end(), [&](auto &attrib) { return attrib.location == input.location; });
+        if (it == source.end() || it->format != input.format) {
+            RT_THROW(std::format("Shader input at location {} has no matching Vertex attribute", input.location));
         }
+        layout.attributes.push_back({input.location, input.format, layout.stride});
+        layout.sourceOffsets.push_back(it->offset);
+        layout.stride += vertexFormatSize(input.format);
+    }
+    return layout;
+}
+
+void packVertex(const Vertex &vertex, const VertexLayout &layout, std::byte *dst) {
+    auto *src = reinterpret_cast<const std::byte*>(&vertex);
+    for (size_t a = 0u; a < layout.attributes.size(); ++a) {
+        memcpy(dst + layout.attributes[a].offset, src + layout.sourceOffsets[a], vertexFormatSize(layout.attributes[a].format));
+    }
+}
+
+// set layouts are created for every set index up to the highest one, unused indices get an empty layout
+VkPipelineLayout createPipelineLayout(const VulkanContext &vkCtx, const ShaderReflection &reflection,
+                                      std::vector<VkDescriptorSetLayout> &setLayouts) {
+    uint32_t setCount = reflection.descriptorSets.empty() ? 0u : reflection.descriptorSets.back().set + 1u;
+    setLayouts.assign(setCount, VK_NULL_HANDLE);
+    for (uint32_t set = 0u; set < setCount; ++set) {
+        auto it = std::find_if(reflection.descriptorSets.begin(), reflection.descriptorSets.end(),
+                               [set](const DescriptorSetDesc &desc) { return desc.set == set; });
+        VkDescriptorSetLayoutCreateInfo setLayoutCI {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .bindingCount = it != reflection.descriptorSets.end() ? static_cast<uint32_t>(it->bindings.size()) : 0u,
+            .pBindings = it != reflection.descriptorSets.end() ? it->bindings.data() : VK_NULL_HANDLE
+        };
+        VK_CHECK(vkCreateDescriptorSetLayout(vkCtx.device, &setLayoutCI, nullptr, &setLayouts[set]),
+                 "Failed to create descriptorSetLayout");
+    }
 
-        VkBool32 presentSupported = VK_FALSE;
-        vkGetPhysicalDeviceSurfaceSupportKHR(appCtx.vkCtx.physicalDevice, i,
-                                             appCtx.vkCtx.surface,
-                                             &presentSupported);
+    VkPushConstantRange pushConstants {VK_SHADER_STAGE_ALL_GRAPHICS, 0u, reflection.pushConstantSize};
+    VkPipelineLayoutCreateInfo pipLayoutCI = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .pNext = VK_NULL_HANDLE,
+        .flags = 0u,
+        .setLayoutCount = setCount,
+        .pSetLayouts = setLayouts.data(),
+        .pushConstantRangeCount = pushConstants.size > 0u ? 1u : 0u,
+        .pPushConstantRanges = &pushConstants
+    };
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    VK_CHECK(vkCreatePipelineLayout(vkCtx.device, &pipLayoutCI, nullptr, &layout),
+             "Failed to create pipeline layout");
+    return layout;
+}
 
-        if (presentSupported) {
-            appCtx.vkCtx.presentQueue.idx = i;
+// null handles are skipped, so partly created variants can go through here too
+void destroyShaderVariant(const VulkanContext &vkCtx, ShaderVariant &shaderVariant) {
+    for (VkShaderEXT shader : shaderVariant.shaderObjects) {
+        if (shader != VK_NULL_HANDLE) {
+            vkCtx.ext.vkDestroyShaderEXT(vkCtx.device, shader, nullptr);
         }
+    }
+    vkDestroyPipelineLayout(vkCtx.device, shaderVariant.layout, nullptr);
+    for (VkDescriptorSetLayout setLayout : shaderVariant.setLayouts) {
+        vkDestroyDescriptorSetLayout(vkCtx.device, setLayout, nullptr);
+    }
+    vkDestroyShaderModule(vkCtx.device, shaderVariant.module, nullptr);
+    shaderVariant = {};
+}
 
-        if (appCtx.vkCtx.presentQueue.idx.has_value() &&
-            appCtx.vkCtx.graphicsQueue.idx.has_value()) {
-            break;
+// returns shader variant id used in PipelineStateKey, module lives as long as the cache
+uint64_t registerShader(AppContext &appCtx, const CompiledShader &compiled) {
+    uint64_t variant = compiled.spirv.size();
+    for (uint32_t word : compiled.spirv) {
+        variant = hashCombine(variant, word);
+    }
+    for (size_t i = 0u; i < compiled.specializationEntries.size(); ++i) {
+        variant = hashCombine(variant, compiled.specializationEntries[i].constantID);
+        variant = hashCombine(variant, compiled.specializationData[i]);
+    }
+    variant = hashCombine(variant, std::hash<std::string>{}(compiled.vertexEntry + "|" + compiled.fragmentEntry));
+    variant = std::max(variant, uint64_t(1u)); // 0 is reserved for "no shader"
+
+    auto &cache = appCtx.modelCtx.pipelineStates;
+    std::lock_guard lock(cache.shaderMutex);
+    if (!cache.shaders.contains(variant)) {
+        // the vertex layout throws on inputs Vertex can't feed, check it before any Vulkan object exists
+        ShaderVariant shaderVariant{
+            .vertexEntry = compiled.vertexEntry,
+            .fragmentEntry = compiled.fragmentEntry,
+            .specializationEntries = compiled.specializationEntries,
+            .specializationData = compiled.specializationData,
+            .vertexLayout = makeVertexLayout(compiled.reflection.vertexInputs),
+            .pushConstantSize = compiled.reflection.pushConstantSize
+        };
+        try {
+            shaderVariant.module = createShaderModule(appCtx.vkCtx, compiled.spirv);
+            shaderVariant.layout = createPipelineLayout(appCtx.vkCtx, compiled.reflection, shaderVariant.setLayouts);
+            if (appCtx.options.shaderObjects) {
+                shaderVariant.shaderObjects = createShaderObjects(appCtx.vkCtx, compiled, shaderVariant.setLayouts);
+            }
+        } catch (...) {
+            // hot-reload keeps running after a failed variant, nothing of it may stay behind
+            destroyShaderVariant(appCtx.vkCtx, shaderVariant);
+            throw;
         }
-        ++i;
+        shaderVariant.compiled = std::make_shared<const CompiledShader>(compiled);
+        cache.shaders[variant] = shaderVariant;
     }
+    return variant;
+}
 
-    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = {
-        appCtx.vkCtx.graphicsQueue.idx.value(),
-        appCtx.vkCtx.presentQueue.idx.value()
+// compiles variant on first request and returns the cached id afterwards, 0 on compile errors
+uint64_t getShaderVariant(AppContext &appCtx, const ShaderVariantKey &key, std::string &diagnostics) {
+    auto &compiler = appCtx.shaderCompiler;
+    std::string name = shaderVariantName(key);
 
-    };
+    std::lock_guard lock(compiler.mutex);
+    if (auto it = compiler.variants.find(name); it != compiler.variants.end()) {
+        return it->second;
+    }
+    auto start = std::chrono::steady_clock::now();
+    CompiledShader compiled{};
+    if (!compileShaderVariant(compiler, key, name, compiled, diagnostics)) {
+        return 0u;
+    }
+    uint64_t variant = registerShader(appCtx, compiled);
+    compiler.variants[name] = variant;
 
-    float prio = 1.0f;
-    for (uint32_t qFam: uniqueQueueFamilies) {
-        VkDeviceQueueCreateInfo queueInfo = {
-            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-            .pNext = VK_NULL_HANDLE,
-            .flags = 0u,
-            .queueFamilyIndex = qFam,
-            .queueCount = 1u,
-            .pQueuePriorities = &prio
-        };
-        queueCreateInfos.push_back(queueInfo);
+    auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << std::format("[ShaderVariant] {} -> {:016x} in {:.1f} ms", name, variant, ms) << std::endl;
+    return variant;
+}
+
+// sources changed on disk, next request reloads modules and recompiles variants
+void invalidateShaderModules(AppContext &appCtx) {
+    std::lock_guard lock(appCtx.shaderCompiler.mutex);
+    appCtx.shaderCompiler.modules.clear();
+    appCtx.shaderCompiler.variants.clear();
+}
+
+uint64_t loadShader(AppContext &appCtx, const ShaderVariantKey &key) {
+    std::string diagnostics;
+    uint64_t variant = getShaderVariant(appCtx, key, diagnostics);
+    if (variant == 0u) {
+        std::cout << "Spir-v errors:" << std::endl;
+        std::cout << diagnostics << std::endl;
+        exit(-3);
     }
-    const std::vector<const char *> deviceExtensions = {
-        VK_KHR_SWAPCHAIN_EXTENSION_NAME
-    };
-    // prepare Vulkan1.4 features
-    appCtx.vkCtx.vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
-    appCtx.vkCtx.vulkan12Features.descriptorIndexing = VK_TRUE;
-    appCtx.vkCtx.vulkan12Features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
-    appCtx.vkCtx.vulkan12Features.descriptorBindingVariableDescriptorCount = VK_TRUE;
-    appCtx.vkCtx.vulkan12Features.runtimeDescriptorArray = VK_TRUE;
-    appCtx.vkCtx.vulkan12Features.bufferDeviceAddress = VK_TRUE;
+    return variant;
+}
 
-    appCtx.vkCtx.vulkan13Features.sType =
-            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
-    appCtx.vkCtx.vulkan13Features.pNext = &appCtx.vkCtx.vulkan12Features;
-    appCtx.vkCtx.vulkan13Features.dynamicRendering = VK_TRUE;
-    appCtx.vkCtx.vulkan13Features.synchronization2 = VK_TRUE;
+AppOptions parseOptions(int argc, char **argv) {
+    AppOptions options{};
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--shader-objects") {
+            options.shaderObjects = true;
+        } else if (arg == "--bench-state-changes" && i + 1 < argc) {
+            options.benchStateChanges = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--stream-budget" && i + 1 < argc) {
+            options.streamBudgetMiB = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+        } else if (arg == "--model" && i + 1 < argc) {
+            options.modelPath = argv[++i];
+        } else if (arg == "--memory-log" && i + 1 < argc) {
+            options.memoryLogSeconds = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--defrag-budget" && i + 1 < argc) {
+            options.defragBudgetMiB = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--capture" && i + 1 < argc) {
+            options.capturePath = argv[++i];
+        } else if (arg == "--capture-frames" && i + 1 < argc) {
+            options.captureFrames = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+        } else if (arg == "--job-workers" && i + 1 < argc) {
+            options.jobWorkers = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--pin-job-workers") {
+            options.pinJobWorkers = true;
+        } else if (arg == "--queue-priorities" && i + 1 < argc) {
+            std::stringstream list{std::string(argv[++i])};
+            for (float &priority : options.queuePriorities) {
+                if (std::string value; std::getline(list, value, ',')) {
+                    priority = std::clamp(std::stof(value), 0.0f, 1.0f);
+                }
+            }
+        } else if (arg == "--no-occlusion-culling") {
+            options.occlusionCulling = false;
+        } else if (arg == "--depth-prepass") {
+            options.depthPrepass = true;
+        } else if (arg == "--dynamic-resolution" && i + 1 < argc) {
+            options.gpuBudgetMs = std::max(0.0f, std::stof(argv[++i]));
+        } else if (arg == "--render-scale" && i + 1 < argc) {
+            std::stringstream list{std::string(argv[++i])};
+            for (float &scale : options.renderScale) {
+                if (std::string value; std::getline(list, value, ',')) {
+                    scale = std::clamp(std::stof(value), 0.25f, 1.0f);
+                }
+            }
+            options.renderScale[1] = std::max(options.renderScale[0], options.renderScale[1]);
+        } else if (arg == "--msaa" && i + 1 < argc) {
+            options.msaaSamples = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+        } else if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--resolution" && i + 1 < argc) {
+            std::string_view resolution = argv[++i];
+            size_t x = resolution.find('x');
+            if (x == std::string_view::npos) {
+                RT_THROW(std::format("--resolution expects <width>x<height>, got {}", resolution));
+            }
+            options.width = std::max(1u, static_cast<uint32_t>(std::stoul(std::string(resolution.substr(0u, x)))));
+            options.height = std::max(1u, static_cast<uint32_t>(std::stoul(std::string(resolution.substr(x + 1u)))));
+        } else if (arg == "--frames-in-flight" && i + 1 < argc) {
+            options.framesInFlight = std::clamp(static_cast<uint32_t>(std::stoul(argv[++i])), 1u,
+                                                uint32_t(SwapChain::MAX_SWAPCHAIN_FRAMES));
+        } else if (arg == "--present-mode" && i + 1 < argc) {
+            std::string_view mode = argv[++i];
+            if (mode == "fifo") {
+                options.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+            } else if (mode == "mailbox") {
+                options.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+            } else if (mode == "immediate") {
+                options.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            } else {
+                RT_THROW(std::format("Unknown present mode {}, expected fifo, mailbox or immediate", mode));
+            }
+        } else if (arg == "--instances" && i + 1 < argc) {
+            options.instanceCount = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+        } else if (arg == "--bench-frames" && i + 1 < argc) {
+            options.benchFrames = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--bench-warmup" && i + 1 < argc) {
+            options.benchWarmup = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--bench-output" && i + 1 < argc) {
+            options.benchOutput = argv[++i];
+        } else {
+            RT_THROW(std::format("Unknown argument {}\nusage: {} [--shader-objects] [--bench-state-changes <draws>] "
+                                 "[--stream-budget <MiB>] [--model <file.obj|file.glb>] [--memory-log <seconds>] "
+                                 "[--defrag-budget <MiB copied per frame>] [--capture <file>] [--capture-frames <n>] [--job-workers <n>] [--pin-job-workers] "
+                                 "[--queue-priorities <g>,<c>,<t>] [--no-occlusion-culling] [--depth-prepass] "
+                                 "[--dynamic-resolution <ms>] [--render-scale <min>,<max>] [--msaa <samples>] [--headless] "
+                                 "[--resolution <w>x<h>] [--frames-in-flight <n>] [--present-mode fifo|mailbox|immediate] "
+                                 "[--instances <n>] [--bench-frames <n>] [--bench-warmup <n>] [--bench-output <file.json>]",
+                                 arg, BENCH_BUILD ? "vulkan14_bench" : "vulkan14"));
+        }
+    }
+    if (options.headless && options.benchFrames == 0u && options.capturePath.empty()) {
+        RT_THROW("--headless has no window to close, use it with --bench-frames or --capture");
+    }
+    return options;
+}
 
-    appCtx.vkCtx.vulkan14Features.sType =
-            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_4_FEATURES;
-    appCtx.vkCtx.vulkan14Features.pNext = &appCtx.vkCtx.vulkan13Features;
+void initWindow(AppContext &appCtx) {
+    if (appCtx.options.headless) {
+        return;
+    }
+    glfwSetErrorCallback([](int code, const char *desc) -> void {
+        std::cerr << std::format("[GLFW] {}: {}", code, desc) << std::endl;
+    });
 
-    VkPhysicalDeviceFeatures enabledFeatures{.samplerAnisotropy = VK_TRUE};
+    glfwInit();
 
-    VkPhysicalDeviceFeatures2 reqDeviceFeatures{};
-    reqDeviceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
-    reqDeviceFeatures.features = enabledFeatures;
-    reqDeviceFeatures.pNext = &appCtx.vkCtx.vulkan14Features;
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 
-    VkDeviceCreateInfo devInfo = {
-        .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-        .pNext = &reqDeviceFeatures,
-        .flags = 0u,
-        .queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size()),
-        .pQueueCreateInfos = queueCreateInfos.data(),
-        .enabledLayerCount = 0u,
-        .ppEnabledLayerNames = VK_NULL_HANDLE,
-        .enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size()),
-        .ppEnabledExtensionNames = deviceExtensions.data(),
-        .pEnabledFeatures = VK_NULL_HANDLE
+    appCtx.windowCtx.window = glfwCreateWindow(
+        static_cast<int>(appCtx.windowCtx.width),
+        static_cast<int>(appCtx.windowCtx.height), "vulkan14", nullptr, nullptr);
 
-    };
+    if (appCtx.windowCtx.window == nullptr) {
+        glfwTerminate();
+        exit(-1);
+    }
 
-    VK_CHECK(vkCreateDevice(appCtx.vkCtx.physicalDevice, &devInfo, nullptr,
-                 &appCtx.vkCtx.device),
-             "Failed to create logical device");
+    glfwSetWindowUserPointer(appCtx.windowCtx.window, &appCtx.windowCtx);
+    glfwSetKeyCallback(appCtx.windowCtx.window, [](GLFWwindow *window, int key, int, int action, int) {
+        auto *windowCtx = static_cast<WindowContext*>(glfwGetWindowUserPointer(window));
+        // a full queue means the render thread is stalled, dropping input beats blocking the event loop
+        spscPush(windowCtx->events, WindowEvent{.type = WindowEvent::Type::Key, .key = key, .action = action});
+    });
+}
 
-    // VMA init
-    VmaVulkanFunctions vmaVkFUnctions {.vkGetInstanceProcAddr = ::vkGetInstanceProcAddr, .vkGetDeviceProcAddr = ::vkGetDeviceProcAddr, .vkCreateImage = ::vkCreateImage};
-    VmaAllocatorCreateInfo vmaAllocInfo {.flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT, .physicalDevice = appCtx.vkCtx.physicalDevice, .device = appCtx.vkCtx.device, .pVulkanFunctions = &vmaVkFUnctions, .instance = appCtx.vkCtx.instance};
-    VK_CHECK(vmaCreateAllocator(&vmaAllocInfo, &appCtx.vkCtx.allocator), "Failed to create VMA allocator");
+bool windowShouldClose(const WindowContext &windowCtx) {
+    return windowCtx.closeRequested.load(std::memory_order_acquire);
+}
+
+// callable from any thread, wakes the main thread so it can join the render thread
+void requestClose(WindowContext &windowCtx) {
+    windowCtx.closeRequested.store(true, std::memory_order_release);
+    if (windowCtx.window != nullptr) {
+        glfwPostEmptyEvent();
+    }
+}
 
-    vkGetDeviceQueue(appCtx.vkCtx.device, appCtx.vkCtx.graphicsQueue.idx.value(),
-                     0u, &appCtx.vkCtx.graphicsQueue.queueHandle);
-    vkGetDeviceQueue(appCtx.vkCtx.device, appCtx.vkCtx.presentQueue.idx.value(),
-                     0u, &appCtx.vkCtx.presentQueue.queueHandle);
-    vkGetDeviceQueue(appCtx.vkCtx.device, appCtx.vkCtx.computeQueue.idx.value(),
-                     0u, &appCtx.vkCtx.computeQueue.queueHandle);
+// render thread, applies the input queued since the last frame
+void processWindowEvents(AppContext &appCtx) {
+    WindowEvent event{};
+    while (spscPop(appCtx.windowCtx.events, event)) {
+        if (event.type == WindowEvent::Type::Key && event.key == GLFW_KEY_F12 && event.action == GLFW_PRESS) {
+            appCtx.windowCtx.memoryStatsRequested = true;
+        }
+    }
+}
 
-    // Create Swapchain
+void createSwapchain(AppContext &appCtx) {
     // pick formats for swapchain
 
     uint32_t formatCount = 0u;
@@ -505,12 +1673,10 @@ void initVulkan(AppContext &appCtx) {
         appCtx.vkCtx.physicalDevice, appCtx.vkCtx.surface, &presentModeCount,
         presentModes.data());
 
-    // find preferred mailbox format
-    appCtx.vkCtx.swapchain.presentMode =
-            *std::find_if(presentModes.begin(), presentModes.end(),
-                          [](const VkPresentModeKHR &mode) {
-                              return mode == VK_PRESENT_MODE_MAILBOX_KHR;
-                          });
+    // FIFO is the only mode every surface supports
+    bool presentModeSupported = std::find(presentModes.begin(), presentModes.end(),
+                                          appCtx.options.presentMode) != presentModes.end();
+    appCtx.vkCtx.swapchain.presentMode = presentModeSupported ? appCtx.options.presentMode : VK_PRESENT_MODE_FIFO_KHR;
 
     uint32_t numberSwapchainImages = surfaceCapabilities.minImageCount + 1u;
     if ((surfaceCapabilities.maxImageCount > 0) &&
@@ -543,6 +1709,9 @@ void initVulkan(AppContext &appCtx) {
         }
     }
 
+    appCtx.vkCtx.swapchain.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                                        (surfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+
     VkSwapchainCreateInfoKHR swapchainCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
         .pNext = VK_NULL_HANDLE,
@@ -553,7 +1722,7 @@ void initVulkan(AppContext &appCtx) {
         .imageColorSpace = appCtx.vkCtx.swapchain.colorSpace,
         .imageExtent = appCtx.vkCtx.swapchain.extent,
         .imageArrayLayers = 1u,
-        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+        .imageUsage = appCtx.vkCtx.swapchain.imageUsage,
         .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
         .queueFamilyIndexCount = 0u,
         .pQueueFamilyIndices = VK_NULL_HANDLE,
@@ -604,165 +1773,2789 @@ void initVulkan(AppContext &appCtx) {
                      &appCtx.vkCtx.swapchain.imageViews[i]),
                  "Failed to create image view - swapchain");
     }
+}
 
-    // create depth buffer
+// headless stand-in for the swapchain, one color image per frame in flight that is rendered to and never presented
+void createOffscreenTargets(AppContext &appCtx) {
+    auto &swapchain = appCtx.vkCtx.swapchain;
+    swapchain.colorFormat = VK_FORMAT_B8G8R8A8_UNORM;
+    swapchain.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+    swapchain.extent = {appCtx.windowCtx.width, appCtx.windowCtx.height};
+    swapchain.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    for (uint32_t i = 0u; i < swapchain.framesInFlight; ++i) {
+        VkImageCreateInfo imageCI {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = swapchain.colorFormat,
+            .extent = {swapchain.extent.width, swapchain.extent.height, 1u},
+            .mipLevels = 1u,
+            .arrayLayers = 1u,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = swapchain.imageUsage,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+        };
+        VmaAllocationCreateInfo imageAllocCI = imageAllocationInfo(appCtx.vkCtx, imageCI);
+        VkImage image = VK_NULL_HANDLE;
+        VmaAllocation allocation = VK_NULL_HANDLE;
+        VK_CHECK(vmaCreateImage(appCtx.vkCtx.allocator, &imageCI, &imageAllocCI, &image, &allocation, nullptr),
+                 "Failed to create offscreen target");
+        VkImageViewCreateInfo viewCI {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = image,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = swapchain.colorFormat,
+            .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = 1u, .layerCount = 1u}
+        };
+        VkImageView view = VK_NULL_HANDLE;
+        VK_CHECK(vkCreateImageView(appCtx.vkCtx.device, &viewCI, nullptr, &view), "Failed to create offscreen target view");
+        swapchain.images.push_back(image);
+        swapchain.imageViews.push_back(view);
+        swapchain.imageAllocations.push_back(allocation);
+    }
+}
 
-    std::vector<VkFormat> depthFormatList = {VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT};
-    VkFormat depthFormat {VK_FORMAT_UNDEFINED};
-    for (VkFormat &f : depthFormatList) {
-        VkFormatProperties2 formatProps2{.sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2};
-        vkGetPhysicalDeviceFormatProperties2(appCtx.vkCtx.physicalDevice, f, &formatProps2);
-        if (formatProps2.formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
-            depthFormat = f;
-            break;
+std::string queueFlagNames(VkQueueFlags flags) {
+    std::string names{};
+    for (auto [bit, name] : {std::pair{VK_QUEUE_GRAPHICS_BIT, "graphics"}, std::pair{VK_QUEUE_COMPUTE_BIT, "compute"},
+                             std::pair{VK_QUEUE_TRANSFER_BIT, "transfer"}, std::pair{VK_QUEUE_SPARSE_BINDING_BIT, "sparse"},
+                             std::pair{VK_QUEUE_VIDEO_DECODE_BIT_KHR, "decode"}, std::pair{VK_QUEUE_VIDEO_ENCODE_BIT_KHR, "encode"}}) {
+        if (flags & bit) {
+            names += names.empty() ? name : std::format("|{}", name);
         }
     }
+    return names;
+}
 
-    VkImageCreateInfo depthImageCI {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-        .pNext = VK_NULL_HANDLE,
-        .imageType = VK_IMAGE_TYPE_2D,
-        .format = depthFormat,
-        .extent = {.width = appCtx.vkCtx.swapchain.extent.width, .height = appCtx.vkCtx.swapchain.extent.height, .depth = 1},
-        .mipLevels = 1u,
-        .arrayLayers =  1u,
-        .samples =  VK_SAMPLE_COUNT_1_BIT,
-        .tiling = VK_IMAGE_TILING_OPTIMAL,
-        .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+// picks a family per role, preferring async compute and dedicated transfer families, and a queue of its own per role
+// while the family has queues left; later roles share the family's last queue. priorities receives the queue
+// priorities of every family and has to outlive vkCreateDevice
+std::vector<VkDeviceQueueCreateInfo> assignQueues(AppContext &appCtx, const std::vector<VkQueueFamilyProperties> &families,
+                                                  std::vector<std::vector<float>> &priorities) {
+    auto &vkCtx = appCtx.vkCtx;
+    auto presents = [&vkCtx, &families](uint32_t family) {
+        // headless frames are never presented, the graphics queue stands in
+        VkBool32 supported = (families[family].queueFlags & VK_QUEUE_GRAPHICS_BIT) ? VK_TRUE : VK_FALSE;
+        if (vkCtx.surface != VK_NULL_HANDLE) {
+            vkGetPhysicalDeviceSurfaceSupportKHR(vkCtx.physicalDevice, family, vkCtx.surface, &supported);
+        }
+        return supported == VK_TRUE;
     };
+    // first family with all of required and none of excluded
+    auto findFamily = [&](VkQueueFlags required, VkQueueFlags excluded, bool present) -> std::optional<uint32_t> {
+        for (uint32_t family = 0u; family < families.size(); ++family) {
+            VkQueueFlags flags = families[family].queueFlags;
+            if ((flags & required) == required && (flags & excluded) == 0u && families[family].queueCount > 0u &&
+                (!present || presents(family))) {
+                return family;
+            }
+        }
+        return std::nullopt;
+    };
+    for (uint32_t family = 0u; family < families.size(); ++family) {
+        std::cout << std::format("[Queues] family {}: {} x{}{}", family, queueFlagNames(families[family].queueFlags),
+                                 families[family].queueCount, presents(family) ? ", present" : "") << std::endl;
+    }
 
-    VmaAllocationCreateInfo allocDepth{.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT, .usage = VMA_MEMORY_USAGE_AUTO};
-    VK_CHECK(vmaCreateImage(appCtx.vkCtx.allocator, &depthImageCI, &allocDepth, &appCtx.vkCtx.swapchain.depthBuffer.image, &appCtx.vkCtx.swapchain.depthBuffer.depthAlloc, nullptr), "Failed to create depth buffer");
-
-    VkImageViewCreateInfo depthImageViewCI {.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-        .image = appCtx.vkCtx.swapchain.depthBuffer.image,
-        .viewType = VK_IMAGE_VIEW_TYPE_2D,
-        .format = depthFormat,
-        .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT, .levelCount =  1u, .layerCount =  1u}
+    // graphics and present on one queue when possible, no semaphore hand-off between families for every frame
+    vkCtx.graphicsQueue.idx = findFamily(VK_QUEUE_GRAPHICS_BIT, 0u, true);
+    if (!vkCtx.graphicsQueue.idx.has_value()) {
+        vkCtx.graphicsQueue.idx = findFamily(VK_QUEUE_GRAPHICS_BIT, 0u, false);
+    }
+    if (!vkCtx.graphicsQueue.idx.has_value()) {
+        RT_THROW("Failed to find a graphics queue family");
+    }
+    uint32_t graphicsFamily = vkCtx.graphicsQueue.idx.value();
+    vkCtx.presentQueue.idx = presents(graphicsFamily) ? graphicsFamily : findFamily(0u, 0u, true);
+    if (!vkCtx.presentQueue.idx.has_value()) {
+        RT_THROW("Failed to find a queue family presenting to the window surface");
+    }
+    vkCtx.computeQueue.idx = findFamily(VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT, false).value_or(graphicsFamily);
+    // graphics and compute families support transfers without reporting it
+    vkCtx.transferQueue.idx = findFamily(VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT, false);
+    if (!vkCtx.transferQueue.idx.has_value()) {
+        vkCtx.transferQueue.idx = findFamily(VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT, false).value_or(graphicsFamily);
+    }
 
+    auto takeQueue = [&families, &priorities](Queue &queue, float priority) {
+        auto &familyPriorities = priorities[queue.idx.value()];
+        if (familyPriorities.size() < families[queue.idx.value()].queueCount) {
+            familyPriorities.push_back(priority);
+        }
+        queue.queueIndex = uint32_t(familyPriorities.size()) - 1u;
+        queue.priority = familyPriorities[queue.queueIndex];
     };
-    VK_CHECK(vkCreateImageView(appCtx.vkCtx.device, &depthImageViewCI, nullptr, &appCtx.vkCtx.swapchain.depthBuffer.imageView), "Failed to create depth image view");
-
+    auto &queuePriorities = appCtx.options.queuePriorities;
+    takeQueue(vkCtx.graphicsQueue, queuePriorities[0]);
+    if (vkCtx.presentQueue.idx == vkCtx.graphicsQueue.idx) {
+        vkCtx.presentQueue.queueIndex = vkCtx.graphicsQueue.queueIndex;
+        vkCtx.presentQueue.priority = vkCtx.graphicsQueue.priority;
+    } else {
+        takeQueue(vkCtx.presentQueue, queuePriorities[0]);
+    }
+    takeQueue(vkCtx.computeQueue, queuePriorities[1]);
+    takeQueue(vkCtx.transferQueue, queuePriorities[2]);
+    vkCtx.uploadFamilies = {graphicsFamily, vkCtx.transferQueue.idx.value()};
+
+    auto describe = [](const Queue &queue) { return std::format("{}.{} ({:.2f})", queue.idx.value(), queue.queueIndex, queue.priority); };
+    std::cout << std::format("[Queues] graphics {}, present {}, compute {}{}, transfer {}{}", describe(vkCtx.graphicsQueue),
+                             describe(vkCtx.presentQueue), describe(vkCtx.computeQueue),
+                             vkCtx.computeQueue.idx != vkCtx.graphicsQueue.idx ? " async" : "", describe(vkCtx.transferQueue),
+                             families[vkCtx.transferQueue.idx.value()].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)
+                                 ? "" : " dedicated") << std::endl;
+
+    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos{};
+    for (uint32_t family = 0u; family < families.size(); ++family) {
+        if (!priorities[family].empty()) {
+            queueCreateInfos.push_back({
+                .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                .queueFamilyIndex = family,
+                .queueCount = uint32_t(priorities[family].size()),
+                .pQueuePriorities = priorities[family].data()
+            });
+        }
+    }
+    return queueCreateInfos;
+}
 
-    // create sync objects
-    appCtx.vkCtx.waitFences.resize(appCtx.vkCtx.swapchain.MAX_SWAPCHAIN_FRAMES);
-    appCtx.vkCtx.presentSemaphores.resize(
-        appCtx.vkCtx.swapchain.MAX_SWAPCHAIN_FRAMES);
-    appCtx.vkCtx.renderCompleteSemaphores.resize(
-        appCtx.vkCtx.swapchain.images.size());
+// false when the transfer role fell back to the graphics queue, uploads are then recorded into the frame itself
+bool separateTransferQueue(const VulkanContext &vkCtx) {
+    return vkCtx.transferQueue.idx != vkCtx.graphicsQueue.idx || vkCtx.transferQueue.queueIndex != vkCtx.graphicsQueue.queueIndex;
+}
 
-    for (size_t i = 0; i < appCtx.vkCtx.swapchain.MAX_SWAPCHAIN_FRAMES; ++i) {
-        VkFenceCreateInfo fenceCI = {
-            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-            .pNext = VK_NULL_HANDLE,
-            .flags = VK_FENCE_CREATE_SIGNALED_BIT
-        };
+// model and arena buffers are written on the transfer queue and read by graphics, concurrent sharing spares the
+// queue family ownership transfers
+void shareWithTransferQueue(const VulkanContext &vkCtx, VkBufferCreateInfo &buffCI) {
+    if (vkCtx.uploadFamilies[0] != vkCtx.uploadFamilies[1]) {
+        buffCI.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        buffCI.queueFamilyIndexCount = uint32_t(vkCtx.uploadFamilies.size());
+        buffCI.pQueueFamilyIndices = vkCtx.uploadFamilies.data();
+    }
+}
 
-        VK_CHECK(vkCreateFence(appCtx.vkCtx.device, &fenceCI, nullptr,
-                     &appCtx.vkCtx.waitFences[i]),
-                 "Failed to create wait fence");
+// why dev can't run the renderer, empty when it can: Vulkan 1.4, the features initVulkan enables unconditionally, a
+// graphics queue and, with a window, a queue that presents to the surface, which assignQueues may find in another family
+std::string deviceUnsuitable(const AppContext &appCtx, VkPhysicalDevice dev) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(dev, &properties);
+    if (properties.apiVersion < VK_API_VERSION_1_4) {
+        return std::format("Vulkan {}.{} only", VK_API_VERSION_MAJOR(properties.apiVersion), VK_API_VERSION_MINOR(properties.apiVersion));
     }
 
-    for (size_t i = 0; i < appCtx.vkCtx.swapchain.MAX_SWAPCHAIN_FRAMES; ++i) {
-        VkSemaphoreCreateInfo semaphoreCI = {
-            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
-            .pNext = VK_NULL_HANDLE,
-            .flags = 0u
+    VkPhysicalDeviceVulkan12Features vulkan12{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+    VkPhysicalDeviceVulkan13Features vulkan13{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES, .pNext = &vulkan12};
+    VkPhysicalDeviceFeatures2 features{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &vulkan13};
+    vkGetPhysicalDeviceFeatures2(dev, &features);
+    if (!features.features.samplerAnisotropy || !vulkan12.descriptorIndexing || !vulkan12.shaderSampledImageArrayNonUniformIndexing ||
+        !vulkan12.descriptorBindingVariableDescriptorCount || !vulkan12.runtimeDescriptorArray || !vulkan12.bufferDeviceAddress ||
+        !vulkan13.dynamicRendering || !vulkan13.synchronization2) {
+        return "missing required features";
+    }
 
-        };
-        VK_CHECK(vkCreateSemaphore(appCtx.vkCtx.device, &semaphoreCI, nullptr,
-                     &appCtx.vkCtx.presentSemaphores[i]),
-                 "Failed to create present semaphore");
+    uint32_t extensionCount = 0u;
+    vkEnumerateDeviceExtensionProperties(dev, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(dev, nullptr, &extensionCount, extensions.data());
+    if (appCtx.vkCtx.surface != VK_NULL_HANDLE &&
+        std::none_of(extensions.begin(), extensions.end(), [](const VkExtensionProperties &ext) {
+            return strcmp(ext.extensionName, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0;
+        })) {
+        return "no swapchain support";
     }
 
-    for (size_t i = 0; i < appCtx.vkCtx.swapchain.images.size(); ++i) {
-        VkSemaphoreCreateInfo semaphoreCI = {
-            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
-            .pNext = VK_NULL_HANDLE,
-            .flags = 0u
-        };
-        VK_CHECK(vkCreateSemaphore(appCtx.vkCtx.device, &semaphoreCI, nullptr,
-                     &appCtx.vkCtx.renderCompleteSemaphores[i]),
-                 "Failed to create render semaphore");
+    uint32_t familyCount = 0u;
+    vkGetPhysicalDeviceQueueFamilyProperties(dev, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(dev, &familyCount, families.data());
+    bool graphics = false;
+    bool present = appCtx.vkCtx.surface == VK_NULL_HANDLE;
+    for (uint32_t family = 0u; family < familyCount; ++family) {
+        graphics = graphics || (families[family].queueFlags & VK_QUEUE_GRAPHICS_BIT);
+        if (!present) {
+            VkBool32 supported = VK_FALSE;
+            vkGetPhysicalDeviceSurfaceSupportKHR(dev, family, appCtx.vkCtx.surface, &supported);
+            present = supported == VK_TRUE;
+        }
     }
+    if (!graphics) {
+        return "no graphics queue";
+    }
+    return present ? std::string{} : "no queue presenting to the window";
+}
 
-    // create command buffers
-    VkCommandPoolCreateInfo cmdPoolInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+void initVulkan(AppContext &appCtx) {
+    VkApplicationInfo appInfo = {
+        .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
         .pNext = VK_NULL_HANDLE,
-        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-        .queueFamilyIndex = appCtx.vkCtx.graphicsQueue.idx.value()
+        .pApplicationName = "vulkan14_app",
+        .applicationVersion = VK_MAKE_VERSION(0, 0, 1),
+        .pEngineName = "vulkan14_engine",
+        .engineVersion = VK_MAKE_VERSION(0, 0, 1),
+        .apiVersion = VK_API_VERSION_1_4
     };
 
-    VK_CHECK(vkCreateCommandPool(appCtx.vkCtx.device, &cmdPoolInfo, nullptr,
-                 &appCtx.vkCtx.commandPool),
-             "Failed to create command pool");
+    std::vector<const char *> extensions{};
+    if (!appCtx.options.headless) {
+        uint32_t reqCount = 0u;
+        const char **glfwReq = glfwGetRequiredInstanceExtensions(&reqCount);
+        extensions.assign(glfwReq, glfwReq + reqCount);
+    }
 
-    VkCommandBufferAllocateInfo cmdBufAllocInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+    VkInstanceCreateInfo instInfo = {
+        .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
         .pNext = VK_NULL_HANDLE,
-        .commandPool = appCtx.vkCtx.commandPool,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount =
-        static_cast<uint32_t>(appCtx.vkCtx.commandBuffers.size())
-
+        .flags = 0u,
+        .pApplicationInfo = &appInfo,
+        .enabledLayerCount = 0u,
+        .ppEnabledLayerNames = VK_NULL_HANDLE,
+        .enabledExtensionCount = static_cast<uint32_t>(extensions.size()),
+        .ppEnabledExtensionNames = extensions.data()
     };
 
-    VK_CHECK(vkAllocateCommandBuffers(appCtx.vkCtx.device, &cmdBufAllocInfo,
-                 appCtx.vkCtx.commandBuffers.data()),
-             "Failed to allocate command buffers");
-}
+    VK_CHECK(vkCreateInstance(&instInfo, nullptr, &appCtx.vkCtx.instance),
+             "Failed to create instance");
 
-void initResouces(AppContext &appCtx) {
-    // prepare geometry
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    tinyobj::LoadObj(&attrib, &shapes, &materials, nullptr, nullptr, "assets/monkey.obj");
-    appCtx.modelCtx.gpuBuffer.indexCount = shapes[0].mesh.indices.size();
-    std::vector<Vertex> vertices{};
-    std::vector<uint32_t> indices{};
-
-    for (auto &idx : shapes[0].mesh.indices) {
-        Vertex v {
-        .position = glm::vec3(
-            attrib.vertices[idx.vertex_index * 3 + 0],
-            -attrib.vertices[idx.vertex_index * 3 + 1],
-            attrib.vertices[idx.vertex_index * 3 + 2]
-        )
+    if (!appCtx.options.headless) {
+        VK_CHECK(glfwCreateWindowSurface(appCtx.vkCtx.instance,
+                     appCtx.windowCtx.window, nullptr,
+                     &appCtx.vkCtx.surface),
+                 "Failed to create Surface");
+    }
+
+    uint32_t deviceCount = 0u;
+    vkEnumeratePhysicalDevices(appCtx.vkCtx.instance, &deviceCount, nullptr);
+    if (deviceCount == 0)
+        RT_THROW("Failed to find Vulkan supported GPU");
+
+    std::vector<VkPhysicalDevice> devices(deviceCount);
+    vkEnumeratePhysicalDevices(appCtx.vkCtx.instance, &deviceCount,
+                               devices.data());
+
+    // only devices that can run the renderer are candidates
+    std::vector<VkPhysicalDevice> suitable{};
+    for (auto &dev: devices) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(dev, &properties);
+        std::string unsuitable = deviceUnsuitable(appCtx, dev);
+        std::cout << std::format("Device {}{}", properties.deviceName, unsuitable.empty() ? "" : ", unsuitable: " + unsuitable) << "\n";
+        if (unsuitable.empty()) {
+            suitable.push_back(dev);
+        }
+    }
+    if (suitable.empty()) {
+        RT_THROW("No Vulkan device supports Vulkan 1.4 with the required features");
+    }
+
+    for (auto &dev: suitable) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(dev, &properties);
+        if (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
+            appCtx.vkCtx.physicalDevice = dev;
+            appCtx.vkCtx.properties = properties;
+            break;
+        }
+    }
+
+    // CPU drivers such as lavapipe, so benchmarks run on machines without a GPU
+    if (appCtx.vkCtx.physicalDevice == VK_NULL_HANDLE) {
+        appCtx.vkCtx.physicalDevice = suitable[0];
+        vkGetPhysicalDeviceProperties(suitable[0], &appCtx.vkCtx.properties);
+    }
+
+    std::cout << std::format("Selected {} GPU",
+                             appCtx.vkCtx.properties.deviceName)
+            << "\n";
+
+    uint32_t queueFamilyCount = 0u;
+    vkGetPhysicalDeviceQueueFamilyProperties(appCtx.vkCtx.physicalDevice,
+                                             &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(
+        appCtx.vkCtx.physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+    std::vector<std::vector<float>> queuePriorities(queueFamilyCount);
+    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos = assignQueues(appCtx, queueFamilies, queuePriorities);
+    std::vector<const char *> deviceExtensions{};
+    if (!appCtx.options.headless) {
+        deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+
+    uint32_t availableExtensionCount = 0u;
+    vkEnumerateDeviceExtensionProperties(appCtx.vkCtx.physicalDevice, nullptr, &availableExtensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(availableExtensionCount);
+    vkEnumerateDeviceExtensionProperties(appCtx.vkCtx.physicalDevice, nullptr, &availableExtensionCount,
+                                         availableExtensions.data());
+    auto hasExtension = [&availableExtensions](const char *name) {
+        return std::any_of(availableExtensions.begin(), availableExtensions.end(),
+                           [name](const VkExtensionProperties &ext) { return strcmp(ext.extensionName, name) == 0; });
+    };
+
+    // query optional features before enabling them
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT gplSupport{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT};
+    VkPhysicalDeviceShaderObjectFeaturesEXT shaderObjectSupport{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT};
+    VkPhysicalDeviceFeatures2 supportedFeatures{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+    if (hasExtension(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME)) {
+        gplSupport.pNext = supportedFeatures.pNext;
+        supportedFeatures.pNext = &gplSupport;
+    }
+    if (hasExtension(VK_EXT_SHADER_OBJECT_EXTENSION_NAME)) {
+        shaderObjectSupport.pNext = supportedFeatures.pNext;
+        supportedFeatures.pNext = &shaderObjectSupport;
+    }
+    vkGetPhysicalDeviceFeatures2(appCtx.vkCtx.physicalDevice, &supportedFeatures);
+    // prepare Vulkan1.4 features
+    appCtx.vkCtx.vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    appCtx.vkCtx.vulkan12Features.descriptorIndexing = VK_TRUE;
+    appCtx.vkCtx.vulkan12Features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    appCtx.vkCtx.vulkan12Features.descriptorBindingVariableDescriptorCount = VK_TRUE;
+    appCtx.vkCtx.vulkan12Features.runtimeDescriptorArray = VK_TRUE;
+    appCtx.vkCtx.vulkan12Features.bufferDeviceAddress = VK_TRUE;
+
+    appCtx.vkCtx.vulkan13Features.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    appCtx.vkCtx.vulkan13Features.pNext = &appCtx.vkCtx.vulkan12Features;
+    appCtx.vkCtx.vulkan13Features.dynamicRendering = VK_TRUE;
+    appCtx.vkCtx.vulkan13Features.synchronization2 = VK_TRUE;
+
+    appCtx.vkCtx.vulkan14Features.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_4_FEATURES;
+    appCtx.vkCtx.vulkan14Features.pNext = &appCtx.vkCtx.vulkan13Features;
+
+    // optional features are pushed to the front of the chain
+    void *featureChain = &appCtx.vkCtx.vulkan14Features;
+
+    if (gplSupport.graphicsPipelineLibrary && hasExtension(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME)) {
+        deviceExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+        deviceExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+        appCtx.vkCtx.graphicsPipelineLibraryFeatures.sType =
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+        appCtx.vkCtx.graphicsPipelineLibraryFeatures.pNext = featureChain;
+        appCtx.vkCtx.graphicsPipelineLibraryFeatures.graphicsPipelineLibrary = VK_TRUE;
+        featureChain = &appCtx.vkCtx.graphicsPipelineLibraryFeatures;
+        appCtx.vkCtx.graphicsPipelineLibrary = true;
+    }
+    std::cout << std::format("Graphics pipeline library: {}", appCtx.vkCtx.graphicsPipelineLibrary ? "enabled" : "not supported") << "\n";
+
+    if (shaderObjectSupport.shaderObject) {
+        deviceExtensions.push_back(VK_EXT_SHADER_OBJECT_EXTENSION_NAME);
+        appCtx.vkCtx.shaderObjectFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT;
+        appCtx.vkCtx.shaderObjectFeatures.pNext = featureChain;
+        appCtx.vkCtx.shaderObjectFeatures.shaderObject = VK_TRUE;
+        featureChain = &appCtx.vkCtx.shaderObjectFeatures;
+        appCtx.vkCtx.shaderObject = true;
+    } else if (appCtx.options.shaderObjects) {
+        std::cerr << "VK_EXT_shader_object not supported, falling back to pipelines" << std::endl;
+        appCtx.options.shaderObjects = false;
+    }
+
+    if (hasExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+        deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        appCtx.vkCtx.memoryBudget = true;
+    }
+    std::cout << std::format("Memory budget: {}", appCtx.vkCtx.memoryBudget ? "enabled" : "not supported, estimated") << "\n";
+    std::cout << std::format("Shader objects: {}", appCtx.options.shaderObjects ? "used" :
+                             appCtx.vkCtx.shaderObject ? "available" : "not supported") << "\n";
+
+    VkPhysicalDeviceFeatures enabledFeatures{.samplerAnisotropy = VK_TRUE};
+    // occlusion culling draws compacted instance ranges indirectly and writes a two channel float storage image
+    enabledFeatures.drawIndirectFirstInstance = supportedFeatures.features.drawIndirectFirstInstance;
+    enabledFeatures.shaderStorageImageExtendedFormats = supportedFeatures.features.shaderStorageImageExtendedFormats;
+    appCtx.vkCtx.features = enabledFeatures;
+
+    VkPhysicalDeviceFeatures2 reqDeviceFeatures{};
+    reqDeviceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    reqDeviceFeatures.features = enabledFeatures;
+    reqDeviceFeatures.pNext = featureChain;
+
+    VkDeviceCreateInfo devInfo = {
+        .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        .pNext = &reqDeviceFeatures,
+        .flags = 0u,
+        .queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size()),
+        .pQueueCreateInfos = queueCreateInfos.data(),
+        .enabledLayerCount = 0u,
+        .ppEnabledLayerNames = VK_NULL_HANDLE,
+        .enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size()),
+        .ppEnabledExtensionNames = deviceExtensions.data(),
+        .pEnabledFeatures = VK_NULL_HANDLE
+
+    };
+
+    VK_CHECK(vkCreateDevice(appCtx.vkCtx.physicalDevice, &devInfo, nullptr,
+                 &appCtx.vkCtx.device),
+             "Failed to create logical device");
+
+    if (appCtx.vkCtx.shaderObject) {
+        LOAD_DEVICE_PROC(appCtx.vkCtx, vkCreateShadersEXT);
+        LOAD_DEVICE_PROC(appCtx.vkCtx, vkDestroyShaderEXT);
+        LOAD_DEVICE_PROC(appCtx.vkCtx, vkCmdBindShadersEXT);
+        LOAD_DEVICE_PROC(appCtx.vkCtx, vkCmdSetVertexInputEXT);
+        LOAD_DEVICE_PROC(appCtx.vkCtx, vkCmdSetPolygonModeEXT);
+        LOAD_DEVICE_PROC(appCtx.vkCtx, vkCmdSetRasterizationSamplesEXT);
+        LOAD_DEVICE_PROC(appCtx.vkCtx, vkCmdSetSampleMaskEXT);
+        LOAD_DEVICE_PROC(appCtx.vkCtx, vkCmdSetAlphaToCoverageEnableEXT);
+        LOAD_DEVICE_PROC(appCtx.vkCtx, vkCmdSetColorBlendEnableEXT);
+        LOAD_DEVICE_PROC(appCtx.vkCtx, vkCmdSetColorBlendEquationEXT);
+        LOAD_DEVICE_PROC(appCtx.vkCtx, vkCmdSetColorWriteMaskEXT);
+    }
+
+    // VMA init
+    VmaVulkanFunctions vmaVkFUnctions {.vkGetInstanceProcAddr = ::vkGetInstanceProcAddr, .vkGetDeviceProcAddr = ::vkGetDeviceProcAddr, .vkCreateImage = ::vkCreateImage};
+    VmaAllocatorCreateInfo vmaAllocInfo {.flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT, .physicalDevice = appCtx.vkCtx.physicalDevice, .device = appCtx.vkCtx.device, .pVulkanFunctions = &vmaVkFUnctions, .instance = appCtx.vkCtx.instance, .vulkanApiVersion = VK_API_VERSION_1_3};
+    if (appCtx.vkCtx.memoryBudget) {
+        vmaAllocInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+    }
+    VmaDeviceMemoryCallbacks memoryCallbacks {
+        .pfnAllocate = [](VmaAllocator, uint32_t, VkDeviceMemory, VkDeviceSize size, void *pools) {
+            ++static_cast<MemoryPools*>(pools)->deviceAllocations;
+            static_cast<MemoryPools*>(pools)->deviceBytes += size;
+        },
+        .pfnFree = [](VmaAllocator, uint32_t, VkDeviceMemory, VkDeviceSize size, void *pools) {
+            ++static_cast<MemoryPools*>(pools)->deviceFrees;
+            static_cast<MemoryPools*>(pools)->deviceBytes -= size;
+        },
+        .pUserData = &appCtx.vkCtx.pools
+    };
+    vmaAllocInfo.pDeviceMemoryCallbacks = &memoryCallbacks;
+    VK_CHECK(vmaCreateAllocator(&vmaAllocInfo, &appCtx.vkCtx.allocator), "Failed to create VMA allocator");
+    createMemoryPools(appCtx.vkCtx);
+
+    for (Queue *queue : {&appCtx.vkCtx.graphicsQueue, &appCtx.vkCtx.presentQueue, &appCtx.vkCtx.computeQueue,
+                         &appCtx.vkCtx.transferQueue}) {
+        vkGetDeviceQueue(appCtx.vkCtx.device, queue->idx.value(), queue->queueIndex, &queue->queueHandle);
+    }
+
+    appCtx.vkCtx.swapchain.framesInFlight = appCtx.options.framesInFlight;
+    if (appCtx.options.headless) {
+        createOffscreenTargets(appCtx);
+    } else {
+        createSwapchain(appCtx);
+    }
+
+    // create depth buffer, reversed-Z only pays off with float depth. Nothing uses stencil, so a combined format is
+    // only the fallback
+
+    std::vector<VkFormat> depthFormatList = {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT};
+    VkFormat depthFormat {VK_FORMAT_UNDEFINED};
+    for (VkFormat &f : depthFormatList) {
+        VkFormatProperties2 formatProps2{.sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2};
+        vkGetPhysicalDeviceFormatProperties2(appCtx.vkCtx.physicalDevice, f, &formatProps2);
+        if (formatProps2.formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+            depthFormat = f;
+            appCtx.vkCtx.swapchain.depthBuffer.format = f;
+            appCtx.vkCtx.swapchain.depthBuffer.sampled = (formatProps2.formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0u;
+            break;
+        }
+    }
+
+    VkImageCreateInfo depthImageCI {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .pNext = VK_NULL_HANDLE,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = depthFormat,
+        .extent = {.width = appCtx.vkCtx.swapchain.extent.width, .height = appCtx.vkCtx.swapchain.extent.height, .depth = 1},
+        .mipLevels = 1u,
+        .arrayLayers =  1u,
+        .samples =  VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VkImageUsageFlags(VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                                   (appCtx.vkCtx.swapchain.depthBuffer.sampled ? VK_IMAGE_USAGE_SAMPLED_BIT : 0u)),
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+    };
+
+    VmaAllocationCreateInfo allocDepth = imageAllocationInfo(appCtx.vkCtx, depthImageCI);
+    VK_CHECK(vmaCreateImage(appCtx.vkCtx.allocator, &depthImageCI, &allocDepth, &appCtx.vkCtx.swapchain.depthBuffer.image, &appCtx.vkCtx.swapchain.depthBuffer.depthAlloc, nullptr), "Failed to create depth buffer");
+
+    VkImageViewCreateInfo depthImageViewCI {.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = appCtx.vkCtx.swapchain.depthBuffer.image,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = depthFormat,
+        .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT, .levelCount =  1u, .layerCount =  1u}
+
+    };
+    VK_CHECK(vkCreateImageView(appCtx.vkCtx.device, &depthImageViewCI, nullptr, &appCtx.vkCtx.swapchain.depthBuffer.imageView), "Failed to create depth image view");
+
+    // MSAA sample count, the highest up to --msaa that color and depth attachments both support. Pipelines are created
+    // with it, the targets once culling and dynamic resolution are known, see createMultisampleTargets
+    VkSampleCountFlags sampleCounts = appCtx.vkCtx.properties.limits.framebufferColorSampleCounts &
+                                      appCtx.vkCtx.properties.limits.framebufferDepthSampleCounts;
+    for (uint32_t samples = std::bit_floor(std::min(appCtx.options.msaaSamples, 64u)); samples > 1u; samples /= 2u) {
+        if (sampleCounts & samples) {
+            appCtx.msaa.samples = VkSampleCountFlagBits(samples);
+            break;
+        }
+    }
+    if (appCtx.options.msaaSamples > 1u && appCtx.msaa.samples != appCtx.options.msaaSamples) {
+        std::cerr << std::format("[MSAA] {} samples requested, the device supports {}", appCtx.options.msaaSamples,
+                                 uint32_t(appCtx.msaa.samples)) << std::endl;
+    }
+
+
+    // create sync objects
+    appCtx.vkCtx.waitFences.resize(appCtx.vkCtx.swapchain.MAX_SWAPCHAIN_FRAMES);
+    appCtx.vkCtx.presentSemaphores.resize(
+        appCtx.vkCtx.swapchain.MAX_SWAPCHAIN_FRAMES);
+    appCtx.vkCtx.renderCompleteSemaphores.resize(
+        appCtx.vkCtx.swapchain.images.size());
+
+    for (size_t i = 0; i < appCtx.vkCtx.swapchain.MAX_SWAPCHAIN_FRAMES; ++i) {
+        VkFenceCreateInfo fenceCI = {
+            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+            .pNext = VK_NULL_HANDLE,
+            .flags = VK_FENCE_CREATE_SIGNALED_BIT
+        };
+
+        VK_CHECK(vkCreateFence(appCtx.vkCtx.device, &fenceCI, nullptr,
+                     &appCtx.vkCtx.waitFences[i]),
+                 "Failed to create wait fence");
+    }
+
+    for (size_t i = 0; i < appCtx.vkCtx.swapchain.MAX_SWAPCHAIN_FRAMES; ++i) {
+        VkSemaphoreCreateInfo semaphoreCI = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = VK_NULL_HANDLE,
+            .flags = 0u
+
+        };
+        VK_CHECK(vkCreateSemaphore(appCtx.vkCtx.device, &semaphoreCI, nullptr,
+                     &appCtx.vkCtx.presentSemaphores[i]),
+                 "Failed to create present semaphore");
+    }
+
+    for (size_t i = 0; i < appCtx.vkCtx.swapchain.images.size(); ++i) {
+        VkSemaphoreCreateInfo semaphoreCI = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = VK_NULL_HANDLE,
+            .flags = 0u
+        };
+        VK_CHECK(vkCreateSemaphore(appCtx.vkCtx.device, &semaphoreCI, nullptr,
+                     &appCtx.vkCtx.renderCompleteSemaphores[i]),
+                 "Failed to create render semaphore");
+    }
+
+    // create command buffers
+    VkCommandPoolCreateInfo cmdPoolInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .pNext = VK_NULL_HANDLE,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = appCtx.vkCtx.graphicsQueue.idx.value()
+    };
+
+    VK_CHECK(vkCreateCommandPool(appCtx.vkCtx.device, &cmdPoolInfo, nullptr,
+                 &appCtx.vkCtx.commandPool),
+             "Failed to create command pool");
+
+    VkCommandBufferAllocateInfo cmdBufAllocInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = VK_NULL_HANDLE,
+        .commandPool = appCtx.vkCtx.commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount =
+        static_cast<uint32_t>(appCtx.vkCtx.commandBuffers.size())
+
+    };
+
+    VK_CHECK(vkAllocateCommandBuffers(appCtx.vkCtx.device, &cmdBufAllocInfo,
+                 appCtx.vkCtx.commandBuffers.data()),
+             "Failed to allocate command buffers");
+
+    if (separateTransferQueue(appCtx.vkCtx)) {
+        VkCommandPoolCreateInfo transferPoolInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+            .queueFamilyIndex = appCtx.vkCtx.transferQueue.idx.value()
+        };
+        VK_CHECK(vkCreateCommandPool(appCtx.vkCtx.device, &transferPoolInfo, nullptr, &appCtx.vkCtx.transferCommandPool),
+                 "Failed to create transfer command pool");
+        VkCommandBufferAllocateInfo transferAllocInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = appCtx.vkCtx.transferCommandPool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = static_cast<uint32_t>(appCtx.vkCtx.transferCommandBuffers.size())
+        };
+        VK_CHECK(vkAllocateCommandBuffers(appCtx.vkCtx.device, &transferAllocInfo, appCtx.vkCtx.transferCommandBuffers.data()),
+                 "Failed to allocate transfer command buffers");
+        appCtx.vkCtx.uploadSemaphores.resize(SwapChain::MAX_SWAPCHAIN_FRAMES);
+        for (auto &semaphore : appCtx.vkCtx.uploadSemaphores) {
+            VkSemaphoreCreateInfo semaphoreCI = {.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+            VK_CHECK(vkCreateSemaphore(appCtx.vkCtx.device, &semaphoreCI, nullptr, &semaphore), "Failed to create upload semaphore");
+        }
+    }
+}
+
+// safe to call from any thread, pipeline cache is internally synchronized
+// key.libraryParts != 0 creates only those graphics pipeline library parts, shader may be null for shader-less parts
+VkPipeline createGraphicsPipeline(const AppContext &appCtx, const ShaderVariant *shader, const PipelineStateKey &key) {
+    std::vector<VkDynamicState> dynamicStates = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR
+
+    };
+    VkPipelineDynamicStateCreateInfo dynamicStateCI = {VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO};
+    dynamicStateCI.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+    dynamicStateCI.pDynamicStates = dynamicStates.data();
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCI{
+        VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO
+    };
+    inputAssemblyStateCI.topology = key.topology;
+
+    // Rasterization state
+    VkPipelineRasterizationStateCreateInfo rasterizationStateCI{
+        VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO
+    };
+    rasterizationStateCI.polygonMode = key.polygonMode;
+    rasterizationStateCI.cullMode = key.cullMode;
+    rasterizationStateCI.frontFace = key.frontFace;
+    rasterizationStateCI.depthClampEnable = VK_FALSE;
+    rasterizationStateCI.rasterizerDiscardEnable = VK_FALSE;
+    rasterizationStateCI.depthBiasEnable = VK_FALSE;
+    rasterizationStateCI.lineWidth = 1.0f;
+
+    // Color blend state describes how blend factors are calculated (if used)
+    // We need one blend attachment state per color attachment (even if blending is not used)
+    VkPipelineColorBlendAttachmentState blendAttachmentState{};
+    blendAttachmentState.colorWriteMask = key.colorWriteMask;
+    blendAttachmentState.blendEnable = key.blendEnable;
+    blendAttachmentState.srcColorBlendFactor = key.srcColorBlendFactor;
+    blendAttachmentState.dstColorBlendFactor = key.dstColorBlendFactor;
+    blendAttachmentState.colorBlendOp = key.colorBlendOp;
+    blendAttachmentState.srcAlphaBlendFactor = key.srcAlphaBlendFactor;
+    blendAttachmentState.dstAlphaBlendFactor = key.dstAlphaBlendFactor;
+    blendAttachmentState.alphaBlendOp = key.alphaBlendOp;
+    std::array<VkPipelineColorBlendAttachmentState, PipelineStateKey::MAX_COLOR_ATTACHMENTS> blendAttachmentStates{};
+    blendAttachmentStates.fill(blendAttachmentState);
+    VkPipelineColorBlendStateCreateInfo colorBlendStateCI{VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO};
+    colorBlendStateCI.attachmentCount = key.colorAttachmentCount;
+    colorBlendStateCI.pAttachments = blendAttachmentStates.data();
+
+    // Viewport state sets the number of viewports and scissor used in this pipeline
+    // Note: This is actually overridden by the dynamic states (see below)
+    VkPipelineViewportStateCreateInfo viewportStateCI{VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO};
+    viewportStateCI.viewportCount = 1;
+    viewportStateCI.scissorCount = 1;
+
+    VkVertexInputBindingDescription vBindingins {
+        .binding = 0u,
+        .stride = key.vertexStride,
+        .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+    };
+    std::vector<VkVertexInputAttributeDescription> vAttribs{};
+    for (uint32_t i = 0u; i < key.vertexAttributeCount; ++i) {
+        vAttribs.push_back({.location = key.vertexAttributes[i].location, .binding = 0u,
+                            .format = key.vertexAttributes[i].format, .offset = key.vertexAttributes[i].offset});
+    }
+    VkPipelineVertexInputStateCreateInfo pipVertInputCI = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .pNext = VK_NULL_HANDLE,
+        .flags = 0u,
+        .vertexBindingDescriptionCount = key.vertexStride > 0u ? 1u : 0u,
+        .pVertexBindingDescriptions = &vBindingins,
+        .vertexAttributeDescriptionCount = static_cast<uint32_t>(vAttribs.size()),
+        .pVertexAttributeDescriptions = vAttribs.data()
+    };
+    ShaderVariant noShader{};
+    const ShaderVariant &variant = shader != nullptr ? *shader : noShader;
+    VkSpecializationInfo specializationInfo = variant.specializationInfo();
+
+    std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages{};
+    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[0].pNext = VK_NULL_HANDLE;
+    shaderStages[0].flags = 0u;
+    shaderStages[0].pName = variant.vertexEntry.c_str();
+    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderStages[0].pSpecializationInfo = &specializationInfo;
+    shaderStages[0].module = variant.module;
+
+    shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[1].pNext = VK_NULL_HANDLE;
+    shaderStages[1].flags = 0u;
+    shaderStages[1].pName = variant.fragmentEntry.c_str();
+    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shaderStages[1].pSpecializationInfo = &specializationInfo;
+    shaderStages[1].module = variant.module;
+
+    VkPipelineRenderingCreateInfo pipRenderingCI = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+        .pNext = VK_NULL_HANDLE,
+        .colorAttachmentCount = key.colorAttachmentCount,
+        .pColorAttachmentFormats = key.colorFormats.data(),
+        .depthAttachmentFormat = key.depthFormat,
+        .stencilAttachmentFormat = key.stencilFormat
+    };
+
+    VkPipelineMultisampleStateCreateInfo mulisampleCI = {VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO};
+    mulisampleCI.rasterizationSamples = key.samples;
+    VkPipelineDepthStencilStateCreateInfo depthStencilStateCI {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+        .depthTestEnable = key.depthTestEnable,
+        .depthWriteEnable = key.depthWriteEnable,
+        .depthCompareOp = key.depthCompareOp
+    };
+
+    VkGraphicsPipelineCreateInfo pipelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext = &pipRenderingCI,
+        .flags = 0u,
+        .stageCount = key.depthOnly ? 1u : static_cast<uint32_t>(shaderStages.size()),
+        .pStages = shaderStages.data(),
+        .pVertexInputState = &pipVertInputCI,
+        .pInputAssemblyState = &inputAssemblyStateCI,
+        .pTessellationState = VK_NULL_HANDLE,
+        .pViewportState = &viewportStateCI,
+        .pRasterizationState = &rasterizationStateCI,
+        .pMultisampleState = &mulisampleCI,
+        .pDepthStencilState = &depthStencilStateCI,
+        .pColorBlendState = &colorBlendStateCI,
+        .pDynamicState = &dynamicStateCI,
+        .layout = variant.layout,
+        .renderPass = VK_NULL_HANDLE,
+        .subpass = 0u,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = 0u
+    };
+
+    VkGraphicsPipelineLibraryCreateInfoEXT libraryCI = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT,
+        .pNext = &pipRenderingCI,
+        .flags = key.libraryParts
+    };
+    std::vector<VkPipelineShaderStageCreateInfo> libraryStages{};
+    if (key.libraryParts != 0u) {
+        // state of parts not being created is ignored, only stages have to be filtered
+        if (key.libraryParts & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT) {
+            libraryStages.push_back(shaderStages[0]);
+        }
+        if ((key.libraryParts & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT) && !key.depthOnly) {
+            libraryStages.push_back(shaderStages[1]);
+        }
+        pipelineInfo.pNext = &libraryCI;
+        pipelineInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+        pipelineInfo.stageCount = static_cast<uint32_t>(libraryStages.size());
+        pipelineInfo.pStages = libraryStages.data();
+    }
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateGraphicsPipelines(appCtx.vkCtx.device, appCtx.modelCtx.pipelineCache, 1u, &pipelineInfo, nullptr, &pipeline), "Failed to create pipeline");
+    return pipeline;
+}
+
+// links complete pipeline from graphics pipeline library parts, without optimize this is the fast link path
+VkPipeline linkGraphicsPipeline(const AppContext &appCtx, std::span<const VkPipeline> libraries, VkPipelineLayout layout,
+                                bool optimize) {
+    VkPipelineLibraryCreateInfoKHR libraryCI = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR,
+        .pNext = VK_NULL_HANDLE,
+        .libraryCount = static_cast<uint32_t>(libraries.size()),
+        .pLibraries = libraries.data()
+    };
+    VkGraphicsPipelineCreateInfo pipelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext = &libraryCI,
+        .flags = optimize ? VkPipelineCreateFlags(VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT) : 0u,
+        .layout = layout
+    };
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateGraphicsPipelines(appCtx.vkCtx.device, appCtx.modelCtx.pipelineCache, 1u, &pipelineInfo, nullptr, &pipeline),
+             "Failed to link pipeline libraries");
+    return pipeline;
+}
+
+thread_local bool onPipelineCompilerThread = false;
+
+void pipelineCompilerWorker(PipelineCompiler &compiler) {
+    onPipelineCompilerThread = true;
+    while (true) {
+        std::packaged_task<VkPipeline()> job;
+        {
+            std::unique_lock lock(compiler.mutex);
+            compiler.jobAvailable.wait(lock, [&compiler] { return compiler.stopping || !compiler.jobs.empty(); });
+            if (compiler.jobs.empty()) {
+                return;
+            }
+            job = std::move(compiler.jobs.front());
+            compiler.jobs.pop_front();
+        }
+        job(); // exceptions end up in the job's future
+    }
+}
+
+void startPipelineCompiler(AppContext &appCtx) {
+    uint32_t threadCount = std::max(std::thread::hardware_concurrency(), 2u) - 1u;
+    for (uint32_t i = 0u; i < threadCount; ++i) {
+        appCtx.pipelineCompiler.workers.emplace_back(pipelineCompilerWorker, std::ref(appCtx.pipelineCompiler));
+    }
+    std::cout << std::format("Pipeline compiler threads: {}", threadCount) << "\n";
+}
+
+// finished optimized links, a failed one only costs performance, the fast-linked pipeline stays in the cache
+void collectBackgroundLinks(AppContext &appCtx) {
+    std::lock_guard lock(appCtx.pipelineCompiler.mutex);
+    std::erase_if(appCtx.pipelineCompiler.backgroundLinks, [](std::future<VkPipeline> &link) {
+        if (link.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return false;
+        }
+        try {
+            link.get();
+        } catch (std::exception &e) {
+            std::cerr << std::format("[PipelineCache] optimized link failed, keeping the fast-linked pipeline: {}", e.what()) << std::endl;
+        }
+        return true;
+    });
+}
+
+// finishes queued jobs before returning
+void stopPipelineCompiler(AppContext &appCtx) {
+    {
+        std::lock_guard lock(appCtx.pipelineCompiler.mutex);
+        appCtx.pipelineCompiler.stopping = true;
+    }
+    appCtx.pipelineCompiler.jobAvailable.notify_all();
+    for (auto &worker : appCtx.pipelineCompiler.workers) {
+        worker.join();
+    }
+    appCtx.pipelineCompiler.workers.clear();
+    collectBackgroundLinks(appCtx);
+}
+
+std::future<VkPipeline> compilePipelineAsync(AppContext &appCtx, std::function<VkPipeline()> build) {
+    std::packaged_task<VkPipeline()> job(std::move(build));
+    auto result = job.get_future();
+    {
+        std::lock_guard lock(appCtx.pipelineCompiler.mutex);
+        appCtx.pipelineCompiler.jobs.push_back(std::move(job));
+    }
+    appCtx.pipelineCompiler.jobAvailable.notify_one();
+    return result;
+}
+
+// can be called from any thread
+void retirePipeline(AppContext &appCtx, VkPipeline pipeline) {
+    if (pipeline != VK_NULL_HANDLE) {
+        std::lock_guard lock(appCtx.modelCtx.retireMutex);
+        appCtx.modelCtx.retiredPipelines.push_back({pipeline, appCtx.vkCtx.frameCounter});
+    }
+}
+
+// can be called from any thread, a variant that is in use again by the time it would go is kept
+void retireShaderVariant(AppContext &appCtx, uint64_t shaderVariant) {
+    if (shaderVariant != 0u) {
+        std::lock_guard lock(appCtx.modelCtx.retireMutex);
+        appCtx.modelCtx.retiredShaderVariants.push_back({shaderVariant, appCtx.vkCtx.frameCounter});
+    }
+}
+
+// pipelines of a variant, library parts included. Deferred while any of them or an optimized link is still compiling,
+// a link in flight reads the parts and puts its result into the cache
+bool destroyShaderVariantPipelines(AppContext &appCtx, uint64_t shaderVariant) {
+    auto &cache = appCtx.modelCtx.pipelineStates;
+    {
+        std::lock_guard lock(appCtx.pipelineCompiler.mutex);
+        if (!appCtx.pipelineCompiler.backgroundLinks.empty()) {
+            return false;
+        }
+    }
+    for (auto &shard : cache.shards) {
+        std::shared_lock lock(shard.mutex);
+        for (auto &[key, pipeline] : shard.pipelines) {
+            if (key.shaderVariant == shaderVariant && pipeline.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                return false;
+            }
+        }
+    }
+    for (auto &shard : cache.shards) {
+        std::unique_lock lock(shard.mutex);
+        std::erase_if(shard.pipelines, [&appCtx, shaderVariant](auto &entry) {
+            if (entry.first.shaderVariant != shaderVariant) {
+                return false;
+            }
+            try {
+                vkDestroyPipeline(appCtx.vkCtx.device, entry.second.get(), nullptr);
+            } catch (...) {
+                // failed creations hold no pipeline
+            }
+            return true;
+        });
+    }
+    return true;
+}
+
+// render thread, after the frame fence wait
+void collectRetiredShaderVariants(AppContext &appCtx) {
+    auto &model = appCtx.modelCtx;
+    std::vector<RetiredShaderVariant> retired{};
+    {
+        std::lock_guard lock(model.retireMutex);
+        retired.swap(model.retiredShaderVariants);
+    }
+    std::vector<RetiredShaderVariant> deferred{};
+    for (auto &variant : retired) {
+        uint64_t id = variant.shaderVariant;
+        if (id == model.pipelineState.shaderVariant || id == model.waitingShaderVariant || id == model.pendingShaderVariant) {
+            continue; // switched back to it, retired again once it is replaced
+        }
+        if (appCtx.vkCtx.frameCounter < variant.retireFrame + SwapChain::MAX_SWAPCHAIN_FRAMES ||
+            !destroyShaderVariantPipelines(appCtx, id)) {
+            deferred.push_back(variant);
+            continue;
+        }
+        // a later compile of the same source registers the variant anew
+        std::lock_guard compilerLock(appCtx.shaderCompiler.mutex);
+        std::erase_if(appCtx.shaderCompiler.variants, [id](auto &entry) { return entry.second == id; });
+        std::lock_guard shaderLock(model.pipelineStates.shaderMutex);
+        if (auto it = model.pipelineStates.shaders.find(id); it != model.pipelineStates.shaders.end()) {
+            destroyShaderVariant(appCtx.vkCtx, it->second);
+            model.pipelineStates.shaders.erase(it);
+        }
+    }
+    std::lock_guard lock(model.retireMutex);
+    model.retiredShaderVariants.insert(model.retiredShaderVariants.end(), deferred.begin(), deferred.end());
+}
+
+void collectRetiredPipelines(AppContext &appCtx) {
+    // called after the frame fence wait, so every frame older than MAX_SWAPCHAIN_FRAMES is done on the GPU
+    std::lock_guard lock(appCtx.modelCtx.retireMutex);
+    std::erase_if(appCtx.modelCtx.retiredPipelines, [&appCtx](const RetiredPipeline &retired) {
+        if (appCtx.vkCtx.frameCounter < retired.retireFrame + SwapChain::MAX_SWAPCHAIN_FRAMES) {
+            return false;
+        }
+        vkDestroyPipeline(appCtx.vkCtx.device, retired.pipeline, nullptr);
+        return true;
+    });
+}
+
+VertexLayout shaderVertexLayout(AppContext &appCtx, uint64_t shaderVariant) {
+    auto &cache = appCtx.modelCtx.pipelineStates;
+    std::lock_guard lock(cache.shaderMutex);
+    return cache.shaders.at(shaderVariant).vertexLayout;
+}
+
+// everything but the shader handles, those are resolved through the caches
+ShaderVariant findShaderVariant(AppContext &appCtx, uint64_t shaderVariant) {
+    auto &cache = appCtx.modelCtx.pipelineStates;
+    std::lock_guard lock(cache.shaderMutex);
+    return cache.shaders.at(shaderVariant);
+}
+
+// pipeline state of the main scene pass, vertex input follows what the shader reads
+PipelineStateKey makePipelineState(AppContext &appCtx, uint64_t shaderVariant) {
+    PipelineStateKey key{.shaderVariant = shaderVariant, .depthFormat = appCtx.vkCtx.swapchain.depthBuffer.format};
+    if (shaderVariant != 0u) {
+        VertexLayout layout = shaderVertexLayout(appCtx, shaderVariant);
+        key.vertexStride = layout.stride;
+        for (auto &attrib : layout.attributes) {
+            key.vertexAttributes[key.vertexAttributeCount++] = attrib;
+        }
+    }
+    key.colorAttachmentCount = 1u;
+    key.colorFormats[0] = appCtx.vkCtx.swapchain.colorFormat;
+    key.samples = appCtx.msaa.samples;
+    return key;
+}
+
+// scene state for opaque draws, blended twin at index 1 when a material is transparent. With the depth pre-pass
+// opaque draws only shade the fragments that won it. Safe on any thread, the drawn model is only seen through
+// drawnHasBlended
+std::vector<PipelineStateKey> makeDrawStates(const AppContext &appCtx, const PipelineStateKey &base) {
+    std::vector<PipelineStateKey> states{base};
+    if (appCtx.options.depthPrepass) {
+        states[0].depthWriteEnable = VK_FALSE;
+        states[0].depthCompareOp = VK_COMPARE_OP_EQUAL;
+    }
+    if (appCtx.modelCtx.drawnHasBlended) {
+        PipelineStateKey blended = base;
+        blended.blendEnable = VK_TRUE;
+        blended.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+        blended.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        blended.depthWriteEnable = VK_FALSE;
+        states.push_back(blended);
+    }
+    return states;
+}
+
+// opaque draws without color output or fragment shader. Same vertex shader and inputs as the main pass, so the
+// depth it writes is what the EQUAL test there compares against
+PipelineStateKey makePrepassState(const PipelineStateKey &base) {
+    PipelineStateKey key = base;
+    key.depthOnly = VK_TRUE;
+    key.colorWriteMask = 0u;
+    return key;
+}
+
+// resets state that has no effect so equivalent keys compare and hash equal
+PipelineStateKey canonicalizePipelineState(PipelineStateKey key) {
+    if (key.vertexStride == 0u) {
+        key.vertexAttributeCount = 0u;
+    }
+    std::sort(key.vertexAttributes.begin(), key.vertexAttributes.begin() + key.vertexAttributeCount,
+              [](const VertexAttributeKey &a, const VertexAttributeKey &b) { return a.location < b.location; });
+    std::fill(key.vertexAttributes.begin() + key.vertexAttributeCount, key.vertexAttributes.end(), VertexAttributeKey{});
+    std::fill(key.colorFormats.begin() + key.colorAttachmentCount, key.colorFormats.end(), VK_FORMAT_UNDEFINED);
+
+    if (key.cullMode == VK_CULL_MODE_NONE) {
+        key.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    }
+    if (key.depthFormat == VK_FORMAT_UNDEFINED) {
+        key.depthTestEnable = VK_FALSE; // no depth attachment, depth test never runs
+    }
+    if (!key.depthTestEnable) {
+        key.depthWriteEnable = VK_FALSE;
+        key.depthCompareOp = VK_COMPARE_OP_ALWAYS;
+    }
+    if (key.depthOnly) {
+        key.blendEnable = VK_FALSE; // nothing reaches the color attachments
+        key.colorWriteMask = 0u;
+    }
+    if (!key.blendEnable || key.colorAttachmentCount == 0u) {
+        PipelineStateKey defaults{};
+        key.blendEnable = VK_FALSE;
+        key.srcColorBlendFactor = defaults.srcColorBlendFactor;
+        key.dstColorBlendFactor = defaults.dstColorBlendFactor;
+        key.colorBlendOp = defaults.colorBlendOp;
+        key.srcAlphaBlendFactor = defaults.srcAlphaBlendFactor;
+        key.dstAlphaBlendFactor = defaults.dstAlphaBlendFactor;
+        key.alphaBlendOp = defaults.alphaBlendOp;
+    }
+    return key;
+}
+
+// keeps only the state a graphics pipeline library part depends on, so parts are shared between permutations
+PipelineStateKey pipelineLibraryKey(const PipelineStateKey &key, VkGraphicsPipelineLibraryFlagsEXT part) {
+    PipelineStateKey partKey{.libraryParts = part};
+    switch (part) {
+        case VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT:
+            partKey.vertexStride = key.vertexStride;
+            partKey.vertexAttributeCount = key.vertexAttributeCount;
+            partKey.vertexAttributes = key.vertexAttributes;
+            partKey.topology = key.topology;
+            break;
+        case VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT:
+            partKey.shaderVariant = key.shaderVariant;
+            partKey.polygonMode = key.polygonMode;
+            partKey.cullMode = key.cullMode;
+            partKey.frontFace = key.frontFace;
+            break;
+        case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT:
+            partKey.shaderVariant = key.shaderVariant;
+            partKey.depthFormat = key.depthFormat;
+            partKey.stencilFormat = key.stencilFormat;
+            partKey.samples = key.samples;
+            partKey.depthTestEnable = key.depthTestEnable;
+            partKey.depthWriteEnable = key.depthWriteEnable;
+            partKey.depthCompareOp = key.depthCompareOp;
+            partKey.depthOnly = key.depthOnly;
+            break;
+        case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT:
+            partKey = key;
+            partKey.libraryParts = part;
+            partKey.shaderVariant = 0u;
+            partKey.vertexStride = 0u;
+            partKey.topology = PipelineStateKey{}.topology;
+            partKey.polygonMode = PipelineStateKey{}.polygonMode;
+            partKey.cullMode = PipelineStateKey{}.cullMode;
+            partKey.depthTestEnable = VK_FALSE;
+            partKey.depthOnly = VK_FALSE;
+            break;
+        default:
+            RT_THROW("Unknown graphics pipeline library part");
+    }
+    return canonicalizePipelineState(partKey);
+}
+
+VkPipeline getOrCreatePipeline(AppContext &appCtx, const PipelineStateKey &state);
+
+// swaps cached pipeline for an equivalent one, previous handle is retired once no frame uses it
+void replaceCachedPipeline(AppContext &appCtx, const PipelineStateKey &key, VkPipeline pipeline) {
+    auto &shard = appCtx.modelCtx.pipelineStates.shards[hashPipelineState(key) % PipelineStateCache::SHARD_COUNT];
+    std::promise<VkPipeline> ready;
+    ready.set_value(pipeline);
+
+    std::shared_future<VkPipeline> previous;
+    {
+        std::unique_lock lock(shard.mutex);
+        auto &entry = shard.pipelines[key];
+        previous = entry;
+        entry = ready.get_future().share();
+    }
+    ++appCtx.modelCtx.pipelineStates.replacements;
+    if (previous.valid()) {
+        retirePipeline(appCtx, previous.get());
+    }
+}
+
+// With graphics pipeline library the pipeline is fast-linked from cached parts and a link-time
+// optimized one replaces it in the cache once the background compile is done.
+VkPipeline createPipelineForState(AppContext &appCtx, const PipelineStateKey &key) {
+    auto &cache = appCtx.modelCtx.pipelineStates;
+    ShaderVariant shader{};
+    if (key.shaderVariant != 0u) {
+        std::lock_guard lock(cache.shaderMutex);
+        shader = cache.shaders.at(key.shaderVariant);
+    }
+    if (key.libraryParts != 0u || !appCtx.vkCtx.graphicsPipelineLibrary) {
+        return createGraphicsPipeline(appCtx, key.shaderVariant != 0u ? &shader : nullptr, key);
+    }
+
+    // shader parts compile in parallel, unless this already is a compiler worker - waiting there could starve the pool
+    std::future<VkPipeline> fragment;
+    if (!onPipelineCompilerThread) {
+        fragment = compilePipelineAsync(appCtx, [&appCtx, key] {
+            return getOrCreatePipeline(appCtx, pipelineLibraryKey(key, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT));
+        });
+    }
+    // parts are owned by the cache, a failed one leaves the others there for the next permutation. The fragment part
+    // is joined before an error propagates, so its job never outlives this call unobserved
+    std::array<VkPipeline, 4> libraries{};
+    try {
+        libraries[0] = getOrCreatePipeline(appCtx, pipelineLibraryKey(key, VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT));
+        libraries[1] = getOrCreatePipeline(appCtx, pipelineLibraryKey(key, VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT));
+        libraries[3] = getOrCreatePipeline(appCtx, pipelineLibraryKey(key, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT));
+    } catch (...) {
+        if (fragment.valid()) {
+            fragment.wait();
+        }
+        throw;
+    }
+    libraries[2] = fragment.valid() ? fragment.get()
+                                    : getOrCreatePipeline(appCtx, pipelineLibraryKey(key, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT));
+    VkPipeline fastLinked = linkGraphicsPipeline(appCtx, libraries, shader.layout, false);
+
+    auto optimizedLink = compilePipelineAsync(appCtx, [&appCtx, key, libraries, layout = shader.layout] {
+        VkPipeline optimized = linkGraphicsPipeline(appCtx, libraries, layout, true);
+        replaceCachedPipeline(appCtx, key, optimized);
+        return optimized;
+    });
+    {
+        std::lock_guard lock(appCtx.pipelineCompiler.mutex);
+        appCtx.pipelineCompiler.backgroundLinks.push_back(std::move(optimizedLink));
+    }
+    return fastLinked;
+}
+
+// returns cached pipeline or creates it on first use, waits if another thread is already creating the same state
+VkPipeline getOrCreatePipeline(AppContext &appCtx, const PipelineStateKey &state) {
+    auto &cache = appCtx.modelCtx.pipelineStates;
+    PipelineStateKey key = canonicalizePipelineState(state);
+    uint64_t hash = hashPipelineState(key);
+    auto &shard = cache.shards[hash % PipelineStateCache::SHARD_COUNT];
+
+    std::shared_future<VkPipeline> cached;
+    {
+        std::shared_lock lock(shard.mutex);
+        if (auto it = shard.pipelines.find(key); it != shard.pipelines.end()) {
+            cached = it->second;
+        }
+    }
+    std::promise<VkPipeline> created;
+    if (!cached.valid()) {
+        std::unique_lock lock(shard.mutex);
+        auto [it, inserted] = shard.pipelines.try_emplace(key, created.get_future().share());
+        if (!inserted) {
+            cached = it->second;
+        }
+    }
+    if (cached.valid()) {
+        ++cache.hits;
+        return cached.get();
+    }
+
+    ++cache.misses;
+    auto start = std::chrono::steady_clock::now();
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    try {
+        pipeline = createPipelineForState(appCtx, key);
+    } catch (...) {
+        created.set_exception(std::current_exception());
+        std::unique_lock lock(shard.mutex);
+        shard.pipelines.erase(key); // next lookup tries again
+        throw;
+    }
+    created.set_value(pipeline);
+
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    cache.compileTimeNs += ns;
+    uint64_t maxNs = cache.maxCompileTimeNs;
+    while (ns > maxNs && !cache.maxCompileTimeNs.compare_exchange_weak(maxNs, ns)) {
+    }
+    std::cout << std::format("[PipelineCache] miss {:016x} (library parts {:#x}) created in {:.2f} ms",
+                             hash, key.libraryParts, ns / 1e6) << std::endl;
+    return pipeline;
+}
+
+void printPipelineCacheStats(const AppContext &appCtx) {
+    auto &cache = appCtx.modelCtx.pipelineStates;
+    std::cout << std::format("[PipelineCache] hits {} misses {} compile total {:.2f} ms max {:.2f} ms",
+                             cache.hits.load(), cache.misses.load(),
+                             cache.compileTimeNs / 1e6, cache.maxCompileTimeNs / 1e6) << std::endl;
+}
+
+std::array<VkShaderEXT, 2> findShaderObjects(AppContext &appCtx, uint64_t shaderVariant) {
+    auto &cache = appCtx.modelCtx.pipelineStates;
+    std::lock_guard lock(cache.shaderMutex);
+    return cache.shaders.at(shaderVariant).shaderObjects;
+}
+
+// shader object path - every piece of state a pipeline would bake is set with dynamic state commands
+void setShaderObjectState(const AppContext &appCtx, VkCommandBuffer cmd, const PipelineStateKey &state, VkExtent2D extent) {
+    auto &ext = appCtx.vkCtx.ext;
+    PipelineStateKey key = canonicalizePipelineState(state);
+
+    VkViewport viewport{0.0f, 0.0f, (float) extent.width, (float) extent.height, 0.0f, 1.0f};
+    VkRect2D scissor{0, 0, extent.width, extent.height};
+    vkCmdSetViewportWithCount(cmd, 1u, &viewport);
+    vkCmdSetScissorWithCount(cmd, 1u, &scissor);
+
+    VkVertexInputBindingDescription2EXT binding{
+        .sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_BINDING_DESCRIPTION_2_EXT,
+        .binding = 0u,
+        .stride = key.vertexStride,
+        .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+        .divisor = 1u
+    };
+    std::array<VkVertexInputAttributeDescription2EXT, PipelineStateKey::MAX_VERTEX_ATTRIBUTES> attributes{};
+    for (uint32_t i = 0u; i < key.vertexAttributeCount; ++i) {
+        attributes[i] = {.sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_ATTRIBUTE_DESCRIPTION_2_EXT,
+                         .location = key.vertexAttributes[i].location, .binding = 0u,
+                         .format = key.vertexAttributes[i].format, .offset = key.vertexAttributes[i].offset};
+    }
+    ext.vkCmdSetVertexInputEXT(cmd, key.vertexStride > 0u ? 1u : 0u, &binding, key.vertexAttributeCount, attributes.data());
+    vkCmdSetPrimitiveTopology(cmd, key.topology);
+    vkCmdSetPrimitiveRestartEnable(cmd, VK_FALSE);
+
+    vkCmdSetRasterizerDiscardEnable(cmd, VK_FALSE);
+    ext.vkCmdSetPolygonModeEXT(cmd, key.polygonMode);
+    vkCmdSetCullMode(cmd, key.cullMode);
+    vkCmdSetFrontFace(cmd, key.frontFace);
+    vkCmdSetDepthBiasEnable(cmd, VK_FALSE);
+
+    VkSampleMask sampleMask = ~0u;
+    ext.vkCmdSetRasterizationSamplesEXT(cmd, key.samples);
+    ext.vkCmdSetSampleMaskEXT(cmd, key.samples, &sampleMask);
+    ext.vkCmdSetAlphaToCoverageEnableEXT(cmd, VK_FALSE);
+
+    vkCmdSetDepthTestEnable(cmd, key.depthTestEnable);
+    vkCmdSetDepthWriteEnable(cmd, key.depthWriteEnable);
+    vkCmdSetDepthCompareOp(cmd, key.depthCompareOp);
+    vkCmdSetDepthBoundsTestEnable(cmd, VK_FALSE);
+    vkCmdSetStencilTestEnable(cmd, VK_FALSE);
+
+    if (key.colorAttachmentCount > 0u) {
+        std::array<VkBool32, PipelineStateKey::MAX_COLOR_ATTACHMENTS> blendEnables{};
+        std::array<VkColorBlendEquationEXT, PipelineStateKey::MAX_COLOR_ATTACHMENTS> blendEquations{};
+        std::array<VkColorComponentFlags, PipelineStateKey::MAX_COLOR_ATTACHMENTS> writeMasks{};
+        blendEnables.fill(key.blendEnable);
+        blendEquations.fill({key.srcColorBlendFactor, key.dstColorBlendFactor, key.colorBlendOp,
+                             key.srcAlphaBlendFactor, key.dstAlphaBlendFactor, key.alphaBlendOp});
+        writeMasks.fill(key.colorWriteMask);
+        ext.vkCmdSetColorBlendEnableEXT(cmd, 0u, key.colorAttachmentCount, blendEnables.data());
+        ext.vkCmdSetColorBlendEquationEXT(cmd, 0u, key.colorAttachmentCount, blendEquations.data());
+        ext.vkCmdSetColorWriteMaskEXT(cmd, 0u, key.colorAttachmentCount, writeMasks.data());
+    }
+}
+
+void bindShaderObjects(const AppContext &appCtx, VkCommandBuffer cmd, const std::array<VkShaderEXT, 2> &shaders) {
+    std::array<VkShaderStageFlagBits, 2> stages = {VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT};
+    appCtx.vkCtx.ext.vkCmdBindShadersEXT(cmd, static_cast<uint32_t>(stages.size()), stages.data(), shaders.data());
+}
+
+VkDescriptorSet createModelDescriptorSet(AppContext &appCtx, const ModelData &data, VkBuffer buffer, VkBuffer instances = VK_NULL_HANDLE);
+
+// switches the scene to a shader variant, pipelines are resolved by resolveScenePipelines
+void useShaderVariant(AppContext &appCtx, uint64_t shaderVariant) {
+    auto &model = appCtx.modelCtx;
+    ShaderVariant shader = findShaderVariant(appCtx, shaderVariant);
+    uint64_t previous = model.pipelineState.shaderVariant;
+    if (previous != shaderVariant) {
+        retireShaderVariant(appCtx, previous);
+    }
+    model.pipelineState = makePipelineState(appCtx, shaderVariant);
+    model.drawStates = makeDrawStates(appCtx, model.pipelineState);
+    model.prepassState = makePrepassState(model.pipelineState);
+    model.piplineLayout = shader.layout;
+    model.pushConstantSize = shader.pushConstantSize;
+    model.pipelinesDirty = true;
+
+    // the drawn model's descriptor set was allocated with the previous variant's set layout
+    if (previous != shaderVariant && model.gpuBuffer.buffer != VK_NULL_HANDLE) {
+        if (model.descriptorSet != VK_NULL_HANDLE) {
+            model.retiredModels.push_back({{}, {}, model.descriptorSet, appCtx.vkCtx.frameCounter});
+        }
+        model.descriptorSet = createModelDescriptorSet(appCtx, model.drawn, model.gpuBuffer.buffer);
+        ++model.drawnRevision; // culling allocates its set anew too
+    }
+}
+
+// only when the scene states changed or an optimized pipeline replaced a cached one, lookups stay off the frame
+void resolveScenePipelines(AppContext &appCtx) {
+    auto &model = appCtx.modelCtx;
+    uint64_t replacements = model.pipelineStates.replacements;
+    if (!model.pipelinesDirty && replacements == model.resolvedReplacements) {
+        return;
+    }
+    model.pipelinesDirty = false;
+    model.resolvedReplacements = replacements;
+    if (appCtx.options.shaderObjects) {
+        model.shaderObjects = findShaderObjects(appCtx, model.pipelineState.shaderVariant);
+        return;
+    }
+    model.drawPipelines.resize(model.drawStates.size());
+    for (size_t i = 0u; i < model.drawStates.size(); ++i) {
+        model.drawPipelines[i] = getOrCreatePipeline(appCtx, model.drawStates[i]);
+    }
+    if (appCtx.options.depthPrepass) {
+        model.prepassPipeline = getOrCreatePipeline(appCtx, model.prepassState);
+    }
+}
+
+constexpr VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1u) / alignment * alignment;
+}
+
+// materials of the scene, last entry is the default material for submeshes without one
+std::vector<GPUMaterial> sceneMaterials(const ObjScene &scene) {
+    std::vector<GPUMaterial> materials{};
+    for (auto &material : scene.materials) {
+        materials.push_back({
+            .diffuse = {material.diffuse[0], material.diffuse[1], material.diffuse[2], material.opacity},
+            .specular = {material.specular[0], material.specular[1], material.specular[2], material.shininess},
+            .emission = {material.emission[0], material.emission[1], material.emission[2], 0.0f}
+        });
+    }
+    materials.push_back(GPUMaterial{});
+    return materials;
+}
+
+// sorted by state and material, neighbouring ranges of the same material and instances become one draw
+std::vector<SceneDraw> mergeSceneDraws(std::vector<SceneDraw> draws) {
+    std::sort(draws.begin(), draws.end(), [](const SceneDraw &a, const SceneDraw &b) {
+        return std::tie(a.state, a.material, a.firstInstance, a.firstIndex) < std::tie(b.state, b.material, b.firstInstance, b.firstIndex);
+    });
+    std::vector<SceneDraw> merged{};
+    for (auto &draw : draws) {
+        if (!merged.empty() && merged.back().state == draw.state && merged.back().material == draw.material &&
+            merged.back().vertexOffset == draw.vertexOffset && merged.back().firstInstance == draw.firstInstance &&
+            merged.back().instanceCount == draw.instanceCount && merged.back().firstIndex + merged.back().indexCount == draw.firstIndex) {
+            merged.back().indexCount += draw.indexCount;
+        } else {
+            merged.push_back(draw);
+        }
+    }
+    return merged;
+}
+
+std::vector<SceneDraw> sceneDraws(const ObjScene &scene, std::span<const GPUMaterial> materials) {
+    std::vector<SceneDraw> draws{};
+    for (auto &submesh : scene.submeshes) {
+        uint32_t material = submesh.material >= 0 ? uint32_t(submesh.material) : uint32_t(scene.materials.size());
+        draws.push_back({
+            .state = materials[material].diffuse.a < 1.0f ? 1u : 0u,
+            .material = material,
+            .firstIndex = uint32_t(submesh.firstTriangle * 3u),
+            .indexCount = uint32_t(submesh.triangleCount * 3u)
+        });
+    }
+    return mergeSceneDraws(std::move(draws));
+}
+
+// sizes the blob and writes materials and instances, vertices and indices are filled in by the caller
+void allocateModelData(ModelData &model, uint64_t vertexCount, uint64_t indexCount, std::span<const GPUMaterial> materials,
+                       std::span<const GPUInstance> instances) {
+    if (vertexCount > std::numeric_limits<uint32_t>::max() || indexCount > std::numeric_limits<uint32_t>::max()) {
+        RT_THROW(std::format("{}: {} vertices, {} indices exceed 32 bit indexing", model.path, vertexCount, indexCount));
+    }
+    model.indexOffset = alignUp(vertexCount * model.vertexLayout.stride, sizeof(uint32_t));
+    model.materialOffset = alignUp(model.indexOffset + indexCount * sizeof(uint32_t), 256u); // max minStorageBufferOffsetAlignment
+    model.instanceOffset = alignUp(model.materialOffset + materials.size_bytes(), 256u);
+    model.indexCount = uint32_t(indexCount);
+    model.data.resize(model.instanceOffset + instances.size_bytes());
+    memcpy(model.data.data() + model.materialOffset, materials.data(), materials.size_bytes());
+    memcpy(model.data.data() + model.instanceOffset, instances.data(), instances.size_bytes());
+}
+
+uint32_t *modelIndices(ModelData &model) {
+    return reinterpret_cast<uint32_t*>(model.data.data() + model.indexOffset);
+}
+
+// runs on a streaming worker and never touches Vulkan, faces are packed into the upload layout while the loader streams them
+ModelData decodeObjModel(const std::string &path, const VertexLayout &layout) {
+    ModelData model{.path = path, .vertexLayout = layout};
+    const ObjAttributes *objAttributes = nullptr;
+    ObjSink objSink {
+        .begin = [&](const ObjAttributes &attributes, const ObjScene &scene) {
+            objAttributes = &attributes;
+            std::vector<GPUMaterial> materials = sceneMaterials(scene);
+            model.draws = sceneDraws(scene, materials);
+            uint64_t indexCount = scene.triangleCount * 3u;
+            allocateModelData(model, indexCount, indexCount, materials, std::array{GPUInstance{}});
+            std::iota(modelIndices(model), modelIndices(model) + indexCount, 0u);
+        },
+        .faces = [&](const ObjFaceBatch &batch) {
+            auto &positions = objAttributes->positions;
+            std::byte *dst = model.data.data() + batch.firstTriangle * 3u * layout.stride;
+            for (auto &corner : batch.corners) {
+                Vertex vertex{};
+                vertex.position = glm::vec3(
+                    positions[corner.position * 3 + 0],
+                    -positions[corner.position * 3 + 1],
+                    positions[corner.position * 3 + 2]
+                );
+                packVertex(vertex, layout, dst);
+                dst += layout.stride;
+            }
+        }
+    };
+    auto loadStart = std::chrono::steady_clock::now();
+    ObjScene scene = streamObj(path, objSink);
+    auto loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+    std::cout << std::format("[ObjLoader] {}: {} triangles, {} submeshes, {} materials, {} draws in {:.1f} ms", path,
+                             scene.triangleCount, scene.submeshes.size(), scene.materials.size(), model.draws.size(),
+                             loadMs) << std::endl;
+    return model;
+}
+
+// copies an accessor into the interleaved vertex stream, converted only when its layout differs from the target format
+uint64_t copyGlbAttribute(const GlbFile &glb, const GlbAccessor &accessor, VkFormat format, std::byte *dst, uint32_t dstStride) {
+    auto src = glb.data(accessor);
+    uint32_t size = vertexFormatSize(format);
+    bool sameFormat = accessor.componentType == GLB_FLOAT && !accessor.normalized && accessor.components * sizeof(float) == size;
+    if (sameFormat && accessor.byteStride == size && dstStride == size) {
+        memcpy(dst, src.data(), src.size());
+        return src.size();
+    }
+    if (sameFormat) {
+        for (uint64_t i = 0u; i < accessor.count; ++i) {
+            memcpy(dst + i * dstStride, src.data() + i * accessor.byteStride, size);
+        }
+        return accessor.count * size;
+    }
+    readGlbFloats(glb, accessor, size / sizeof(float), dst, dstStride);
+    return 0u;
+}
+
+// runs on a streaming worker, buffer views are copied straight from the mapped file into the upload layout,
+// every node using a mesh becomes an instance of its primitives' draws
+ModelData decodeGlbModel(const std::string &path, const VertexLayout &layout) {
+    static constexpr std::array<std::string_view, 2> semantics{"POSITION", "COLOR_0"}; // by Vertex attribute location
+    auto loadStart = std::chrono::steady_clock::now();
+    GlbFile glb = openGlb(path);
+
+    std::vector<GPUMaterial> materials{};
+    for (auto &material : glb.materials) {
+        materials.push_back({
+            .diffuse = {material.baseColor[0], material.baseColor[1], material.baseColor[2], material.baseColor[3]},
+            .specular = {0.0f, 0.0f, 0.0f, 0.0f},
+            .emission = {material.emissive[0], material.emissive[1], material.emissive[2], 0.0f}
+        });
+    }
+    materials.push_back(GPUMaterial{});
+
+    // instances grouped by mesh so each primitive is a single instanced draw, y is flipped like the OBJ path does
+    std::vector<GlbInstance> nodes = glb.instances;
+    std::stable_sort(nodes.begin(), nodes.end(), [](const GlbInstance &a, const GlbInstance &b) { return a.mesh < b.mesh; });
+    std::vector<GPUInstance> instances{};
+    std::vector<std::pair<uint32_t, uint32_t>> meshInstances(glb.meshes.size(), {0u, 0u}); // first, count
+    for (auto &node : nodes) {
+        auto &[first, count] = meshInstances[node.mesh];
+        first = count == 0u ? uint32_t(instances.size()) : first;
+        ++count;
+        auto &m = node.transform;
+        instances.push_back({{glm::vec4{m[0], m[4], m[8], m[12]}, -glm::vec4{m[1], m[5], m[9], m[13]}, glm::vec4{m[2], m[6], m[10], m[14]}}});
+    }
+    if (instances.empty()) { // nothing to draw, and the instance range of the descriptors would be empty
+        RT_THROW(std::format("{}: the scene has no nodes with a mesh", path));
+    }
+
+    uint64_t vertexCount = 0u;
+    uint64_t indexCount = 0u;
+    for (size_t mesh = 0u; mesh < glb.meshes.size(); ++mesh) {
+        if (meshInstances[mesh].second == 0u) {
+            continue;
+        }
+        for (auto &primitive : glb.meshes[mesh].primitives) {
+            uint64_t vertices = glb.accessors[glbAttribute(primitive, "POSITION")].count;
+            vertexCount += vertices;
+            indexCount += primitive.indices >= 0 ? glb.accessors[primitive.indices].count : vertices;
+        }
+    }
+    ModelData model{.path = path, .vertexLayout = layout};
+    allocateModelData(model, vertexCount, indexCount, materials, instances);
+
+    Vertex defaults{};
+    uint64_t directBytes = 0u;
+    uint32_t vertexBase = 0u;
+    uint32_t indexBase = 0u;
+    std::vector<SceneDraw> draws{};
+    for (size_t mesh = 0u; mesh < glb.meshes.size(); ++mesh) {
+        auto [firstInstance, instanceCount] = meshInstances[mesh];
+        if (instanceCount == 0u) {
+            continue;
+        }
+        for (auto &primitive : glb.meshes[mesh].primitives) {
+            auto vertices = uint32_t(glb.accessors[glbAttribute(primitive, "POSITION")].count);
+            std::byte *vertexData = model.data.data() + VkDeviceSize(vertexBase) * layout.stride;
+            for (size_t a = 0u; a < layout.attributes.size(); ++a) {
+                auto &attribute = layout.attributes[a];
+                int32_t accessor = attribute.location < semantics.size() ? glbAttribute(primitive, semantics[attribute.location]) : -1;
+                if (accessor >= 0 && glb.accessors[accessor].count == vertices) {
+                    directBytes += copyGlbAttribute(glb, glb.accessors[accessor], attribute.format, vertexData + attribute.offset, layout.stride);
+                    continue;
+                }
+                // attribute the file doesn't have, same default as a Vertex
+                auto *value = reinterpret_cast<const std::byte*>(&defaults) + layout.sourceOffsets[a];
+                for (uint32_t v = 0u; v < vertices; ++v) {
+                    memcpy(vertexData + v * layout.stride + attribute.offset, value, vertexFormatSize(attribute.format));
+                }
+            }
+
+            uint32_t *indices = modelIndices(model) + indexBase;
+            uint32_t primitiveIndices = vertices;
+            if (primitive.indices >= 0) {
+                auto &accessor = glb.accessors[primitive.indices];
+                primitiveIndices = uint32_t(accessor.count);
+                directBytes += readGlbIndices(glb, accessor, vertices, indices);
+            } else {
+                std::iota(indices, indices + primitiveIndices, 0u);
+            }
+
+            uint32_t material = primitive.material >= 0 ? uint32_t(primitive.material) : uint32_t(glb.materials.size());
+            draws.push_back({
+                .state = primitive.material >= 0 && glb.materials[primitive.material].blend ? 1u : 0u,
+                .material = material,
+                .firstIndex = indexBase,
+                .indexCount = primitiveIndices,
+                .vertexOffset = int32_t(vertexBase),
+                .firstInstance = firstInstance,
+                .instanceCount = instanceCount
+            });
+            vertexBase += vertices;
+            indexBase += primitiveIndices;
+        }
+    }
+    model.draws = mergeSceneDraws(std::move(draws));
+
+    auto loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+    uint64_t geometryBytes = model.indexOffset + indexCount * sizeof(uint32_t);
+    std::cout << std::format("[GlbLoader] {}: {} meshes, {} instances, {} triangles, {} draws, {:.1f} of {:.1f} MiB copied "
+                             "without conversion in {:.1f} ms", path, glb.meshes.size(), instances.size(), indexCount / 3u,
+                             model.draws.size(), directBytes / 1048576.0, geometryBytes / 1048576.0, loadMs) << std::endl;
+    return model;
+}
+
+ModelData decodeModel(const std::string &path, const VertexLayout &layout) {
+    if (std::filesystem::path(path).extension() == ".glb") {
+        return decodeGlbModel(path, layout);
+    }
+    return decodeObjModel(path, layout);
+}
+
+// unit cube with the default material, drawn until the streamed model is resident
+ModelData makePlaceholderModel(const VertexLayout &layout) {
+    // corner i has x, y, z = bit 0, 1, 2 of i, faces wind counter-clockwise seen from outside
+    static constexpr std::array<uint32_t, 24> quads {
+        0u, 4u, 6u, 2u,  1u, 3u, 7u, 5u,  0u, 1u, 5u, 4u,  2u, 6u, 7u, 3u,  0u, 2u, 3u, 1u,  4u, 5u, 7u, 6u
+    };
+    ModelData model{.path = "placeholder", .vertexLayout = layout};
+    allocateModelData(model, 8u, 36u, std::array{GPUMaterial{}}, std::array{GPUInstance{}});
+    for (uint32_t i = 0u; i < 8u; ++i) {
+        Vertex vertex{};
+        vertex.position = glm::vec3(i & 1u ? 0.5f : -0.5f, i & 2u ? 0.5f : -0.5f, i & 4u ? 0.5f : -0.5f);
+        packVertex(vertex, layout, model.data.data() + i * layout.stride);
+    }
+    uint32_t *indices = modelIndices(model);
+    for (size_t q = 0u; q < quads.size(); q += 4u) {
+        for (uint32_t corner : {0u, 1u, 2u, 0u, 2u, 3u}) {
+            *indices++ = quads[q + corner];
+        }
+    }
+    model.draws.push_back({.indexCount = 36u, .bounds = {0.0f, 0.0f, 0.0f, std::sqrt(0.75f)}});
+    return model;
+}
+
+GPUBuffer createGeometryBuffer(AppContext &appCtx, VkDeviceSize size, VkBufferUsageFlags usage) {
+    GPUBuffer buffer {.size = size};
+    VkBufferCreateInfo buffCI {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = size,
+                               .usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT};
+    shareWithTransferQueue(appCtx.vkCtx, buffCI);
+    VmaAllocationCreateInfo buffAllocCI = bufferAllocationInfo(appCtx.vkCtx, size);
+    VK_CHECK(vmaCreateBuffer(appCtx.vkCtx.allocator, &buffCI, &buffAllocCI, &buffer.buffer, &buffer.bufferAllocation, nullptr),
+             "Failed to create geometry buffer");
+    return buffer;
+}
+
+void createGeometryArena(AppContext &appCtx) {
+    auto &arena = appCtx.modelCtx.arena;
+    arena.vertices = createGeometryBuffer(appCtx, GeometryArena::VERTEX_BYTES, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    arena.indices = createGeometryBuffer(appCtx, VkDeviceSize(GeometryArena::INDEX_COUNT) * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+    arena.vertexAllocator = createOffsetAllocator(GeometryArena::VERTEX_BYTES);
+    arena.indexAllocator = createOffsetAllocator(GeometryArena::INDEX_COUNT);
+}
+
+bool geometryAllocated(const ModelGeometry &geometry) {
+    return geometry.vertices.metadata != OFFSET_ALLOCATOR_NO_SPACE || geometry.dedicatedVertices.buffer != VK_NULL_HANDLE;
+}
+
+VkBuffer geometryVertexBuffer(const GeometryArena &arena, const ModelGeometry &geometry) {
+    return geometry.dedicatedVertices.buffer != VK_NULL_HANDLE ? geometry.dedicatedVertices.buffer : arena.vertices.buffer;
+}
+
+VkBuffer geometryIndexBuffer(const GeometryArena &arena, const ModelGeometry &geometry) {
+    return geometry.dedicatedIndices.buffer != VK_NULL_HANDLE ? geometry.dedicatedIndices.buffer : arena.indices.buffer;
+}
+
+void freeModelGeometry(AppContext &appCtx, const ModelGeometry &geometry) {
+    auto &arena = appCtx.modelCtx.arena;
+    offsetFree(arena.vertexAllocator, geometry.vertices);
+    offsetFree(arena.indexAllocator, geometry.indices);
+    for (const GPUBuffer &buffer : {geometry.dedicatedVertices, geometry.dedicatedIndices}) {
+        if (buffer.buffer != VK_NULL_HANDLE) {
+            vmaDestroyBuffer(appCtx.vkCtx.allocator, buffer.buffer, buffer.bufferAllocation);
+        }
+    }
+}
+
+// reserves the model's arena ranges and rebases its draws onto them, false when either arena has no room. Models the
+// arenas could never hold, or any with dedicated, get buffers of their own and keep their draws as they are
+bool allocateModelGeometry(AppContext &appCtx, ModelData &model, ModelGeometry &geometry, bool dedicated = false) {
+    auto &arena = appCtx.modelCtx.arena;
+    // vertexOffset counts vertices of the bound stride, the slack lets the range start on a multiple of it
+    uint32_t stride = model.vertexLayout.stride;
+    VkDeviceSize vertexBytes = model.indexOffset + stride;
+    if (dedicated || vertexBytes > GeometryArena::VERTEX_BYTES || model.indexCount > GeometryArena::INDEX_COUNT) {
+        geometry = {
+            .dedicatedVertices = createGeometryBuffer(appCtx, std::max<VkDeviceSize>(model.indexOffset, stride), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT),
+            .dedicatedIndices = createGeometryBuffer(appCtx, std::max(model.indexCount, 1u) * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT)
+        };
+        return true;
+    }
+    geometry.vertices = offsetAllocate(arena.vertexAllocator, uint32_t(vertexBytes));
+    geometry.indices = offsetAllocate(arena.indexAllocator, model.indexCount);
+    if (geometry.vertices.offset == OFFSET_ALLOCATOR_NO_SPACE || geometry.indices.offset == OFFSET_ALLOCATOR_NO_SPACE) {
+        freeModelGeometry(appCtx, geometry);
+        geometry = {};
+        return false;
+    }
+    geometry.vertexByteOffset = alignUp(geometry.vertices.offset, stride);
+    geometry.vertexOffset = int32_t(geometry.vertexByteOffset / stride);
+    geometry.firstIndex = geometry.indices.offset;
+    for (auto &draw : model.draws) {
+        draw.firstIndex += geometry.firstIndex;
+        draw.vertexOffset += geometry.vertexOffset;
+    }
+    return true;
+}
+
+// copies blob bytes [begin, end), staged at srcOffset, to where they live on the GPU: vertices and indices into the
+// arenas, materials and instances into the model's storage buffer. Padding between the parts is skipped
+void recordModelCopies(const AppContext &appCtx, VkCommandBuffer cmd, const ModelData &model, const ModelGeometry &geometry,
+                       VkBuffer storage, VkBuffer staging, VkDeviceSize srcOffset, VkDeviceSize begin, VkDeviceSize end) {
+    struct Part {
+        VkDeviceSize begin;
+        VkDeviceSize end;
+        VkBuffer buffer;
+        VkDeviceSize offset;
+    };
+    auto &arena = appCtx.modelCtx.arena;
+    std::array<Part, 3> parts {
+        Part{0u, model.indexOffset, geometryVertexBuffer(arena, geometry), geometry.vertexByteOffset},
+        Part{model.indexOffset, model.indexOffset + VkDeviceSize(model.indexCount) * sizeof(uint32_t), geometryIndexBuffer(arena, geometry),
+             VkDeviceSize(geometry.firstIndex) * sizeof(uint32_t)},
+        Part{model.materialOffset, model.data.size(), storage, 0u}
+    };
+    for (auto &part : parts) {
+        VkDeviceSize first = std::max(begin, part.begin);
+        VkDeviceSize last = std::min(end, part.end);
+        if (first < last) {
+            VkBufferCopy region {.srcOffset = srcOffset + first - begin, .dstOffset = part.offset + first - part.begin, .size = last - first};
+            vkCmdCopyBuffer(cmd, staging, part.buffer, 1u, &region);
+        }
+    }
+}
+
+VkDeviceSize modelBufferSize(const ModelData &model) {
+    return model.data.size() - model.materialOffset;
+}
+
+// memory heap createModelBuffer places a buffer of size in
+uint32_t modelBufferHeap(const AppContext &appCtx, VkDeviceSize size) {
+    VkBufferCreateInfo buffCI {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = size, .usage = MODEL_BUFFER_USAGE};
+    shareWithTransferQueue(appCtx.vkCtx, buffCI);
+    VmaAllocationCreateInfo buffAllocCI = bufferAllocationInfo(appCtx.vkCtx, size);
+    uint32_t memoryType = 0u;
+    VK_CHECK(vmaFindMemoryTypeIndexForBufferInfo(appCtx.vkCtx.allocator, &buffCI, &buffAllocCI, &memoryType),
+             "Failed to find model buffer memory type");
+    const VkPhysicalDeviceMemoryProperties *memProps = nullptr;
+    vmaGetMemoryProperties(appCtx.vkCtx.allocator, &memProps);
+    return memProps->memoryTypes[memoryType].heapIndex;
+}
+
+// model buffers of a heap that are retired but still in use by a frame, their memory returns without evicting anything
+VkDeviceSize retiringModelBytes(const AppContext &appCtx, uint32_t heap) {
+    const VkPhysicalDeviceMemoryProperties *memProps = nullptr;
+    vmaGetMemoryProperties(appCtx.vkCtx.allocator, &memProps);
+    VkDeviceSize bytes = 0u;
+    for (auto &retired : appCtx.modelCtx.retiredModels) {
+        for (const GPUBuffer &buffer : {retired.buffer, retired.geometry.dedicatedVertices, retired.geometry.dedicatedIndices}) {
+            if (buffer.buffer != VK_NULL_HANDLE) {
+                VmaAllocationInfo allocInfo{};
+                vmaGetAllocationInfo(appCtx.vkCtx.allocator, buffer.bufferAllocation, &allocInfo);
+                bytes += memProps->memoryTypes[allocInfo.memoryType].heapIndex == heap ? allocInfo.size : 0u;
+            }
+        }
+    }
+    return bytes;
+}
+
+// arena ranges of retired models, free again once their last frame is done
+bool retiringArenaGeometry(const AppContext &appCtx) {
+    return std::any_of(appCtx.modelCtx.retiredModels.begin(), appCtx.modelCtx.retiredModels.end(), [](const RetiredModel &retired) {
+        return retired.geometry.vertices.metadata != OFFSET_ALLOCATOR_NO_SPACE;
+    });
+}
+
+// material and instance storage of one model, filled through transient staging buffers together with its geometry
+// with withinBudget the buffer handle stays null instead of spilling into system memory when the heap is full
+GPUBuffer createModelBuffer(AppContext &appCtx, const ModelData &model, bool withinBudget = false) {
+    GPUBuffer buffer {.size = modelBufferSize(model)};
+    VkBufferCreateInfo buffCI {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = buffer.size, .usage = MODEL_BUFFER_USAGE};
+    shareWithTransferQueue(appCtx.vkCtx, buffCI);
+    VmaAllocationCreateInfo buffAllocCI = bufferAllocationInfo(appCtx.vkCtx, buffer.size);
+    if (withinBudget) {
+        buffAllocCI.flags |= VMA_ALLOCATION_CREATE_WITHIN_BUDGET_BIT;
+    }
+    VmaAllocationInfo allocInfo{};
+    VkResult result = vmaCreateBuffer(appCtx.vkCtx.allocator, &buffCI, &buffAllocCI, &buffer.buffer, &buffer.bufferAllocation, &allocInfo);
+    if (withinBudget && result == VK_ERROR_OUT_OF_DEVICE_MEMORY) {
+        return {};
+    }
+    VK_CHECK(result, "Failed to create model buffer");
+    buffer.mapped = allocInfo.pMappedData;
+    return buffer;
+}
+
+// materials and instances of a model for the current shader variant, null when the variant has no descriptors.
+// instances replaces the model's own instance range, e.g. with the ones that survived culling
+VkDescriptorSet createModelDescriptorSet(AppContext &appCtx, const ModelData &data, VkBuffer buffer, VkBuffer instances) {
+    auto &model = appCtx.modelCtx;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    ShaderVariant shader = findShaderVariant(appCtx, model.pipelineState.shaderVariant);
+    if (!shader.setLayouts.empty()) {
+        VkDescriptorSetAllocateInfo allocInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .pNext = VK_NULL_HANDLE,
+            .descriptorPool = model.descriptorPool,
+            .descriptorSetCount = 1u,
+            .pSetLayouts = &shader.setLayouts[0]
+        };
+        VK_CHECK(vkAllocateDescriptorSets(appCtx.vkCtx.device, &allocInfo, &descriptorSet), "Failed to allocate descriptors");
+
+        // binding 0 materials, binding 1 instance transforms
+        std::array<VkDescriptorBufferInfo, 2> bufferInfos {
+            VkDescriptorBufferInfo{buffer, 0u, data.instanceOffset - data.materialOffset},
+            instances != VK_NULL_HANDLE ? VkDescriptorBufferInfo{instances, 0u, VK_WHOLE_SIZE}
+                                        : VkDescriptorBufferInfo{buffer, data.instanceOffset - data.materialOffset, VK_WHOLE_SIZE}
+        };
+        std::array<VkWriteDescriptorSet, 2> writes{};
+        for (uint32_t binding = 0u; binding < writes.size(); ++binding) {
+            writes[binding] = {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = descriptorSet,
+                .dstBinding = binding,
+                .descriptorCount = 1u,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pBufferInfo = &bufferInfos[binding]
+            };
+        }
+        vkUpdateDescriptorSets(appCtx.vkCtx.device, uint32_t(writes.size()), writes.data(), 0u, nullptr);
+    }
+    return descriptorSet;
+}
+
+// swaps the model the scene draws, the old buffer and descriptor set are released once no frame uses them
+void publishModel(AppContext &appCtx, ModelData &data, const GPUBuffer &buffer, const ModelGeometry &geometry) {
+    auto &model = appCtx.modelCtx;
+    VkDescriptorSet descriptorSet = createModelDescriptorSet(appCtx, data, buffer.buffer);
+
+    // streamed models stay resident until the budget needs their memory, the placeholder is released right away
+    if (model.gpuBuffer.buffer != VK_NULL_HANDLE && model.drawn.path != "placeholder") {
+        model.retiredModels.push_back({{}, {}, model.descriptorSet, appCtx.vkCtx.frameCounter});
+        model.residentModels.push_back({std::move(model.drawn), model.gpuBuffer, model.geometry, appCtx.vkCtx.frameCounter});
+    } else if (model.gpuBuffer.buffer != VK_NULL_HANDLE) {
+        model.retiredModels.push_back({model.gpuBuffer, model.geometry, model.descriptorSet, appCtx.vkCtx.frameCounter});
+    }
+    model.gpuBuffer = buffer;
+    model.geometry = geometry;
+    model.descriptorSet = descriptorSet;
+    ++model.drawnRevision;
+    model.drawn = std::move(data);
+    model.drawn.data = {};
+    model.drawnHasBlended = std::any_of(model.drawn.draws.begin(), model.drawn.draws.end(),
+                                        [](const SceneDraw &draw) { return draw.state == 1u; });
+    model.drawStates = makeDrawStates(appCtx, model.pipelineState);
+    model.pipelinesDirty = true;
+
+    std::cout << std::format("[VertexLayout] {} attributes, stride {} of {} bytes, {} KiB vertex stream", model.drawn.vertexLayout.attributes.size(),
+                             model.drawn.vertexLayout.stride, sizeof(Vertex), model.drawn.indexOffset / 1024u) << std::endl;
+}
+
+void collectRetiredModels(AppContext &appCtx) {
+    std::erase_if(appCtx.modelCtx.retiredModels, [&appCtx](const RetiredModel &retired) {
+        if (appCtx.vkCtx.frameCounter < retired.retireFrame + SwapChain::MAX_SWAPCHAIN_FRAMES) {
+            return false;
+        }
+        if (retired.descriptorSet != VK_NULL_HANDLE) {
+            vkFreeDescriptorSets(appCtx.vkCtx.device, appCtx.modelCtx.descriptorPool, 1u, &retired.descriptorSet);
+        }
+        if (retired.buffer.buffer != VK_NULL_HANDLE) {
+            vmaDestroyBuffer(appCtx.vkCtx.allocator, retired.buffer.buffer, retired.buffer.bufferAllocation);
+        }
+        freeModelGeometry(appCtx, retired.geometry);
+        return true;
+    });
+}
+
+// switches to a model still resident from earlier and packed for the variant's layout, nothing is streamed
+bool publishResidentModel(AppContext &appCtx, const std::string &path, uint64_t shaderVariant) {
+    auto &resident = appCtx.modelCtx.residentModels;
+    VertexLayout layout = shaderVertexLayout(appCtx, shaderVariant);
+    auto it = std::find_if(resident.begin(), resident.end(), [&](const ResidentModel &entry) {
+        return entry.model.path == path && entry.model.vertexLayout == layout;
+    });
+    if (it == resident.end()) {
+        return false;
+    }
+    ResidentModel entry = std::move(*it);
+    resident.erase(it);
+    std::cout << std::format("[Residency] {} still resident, no streaming needed", path) << std::endl;
+    useShaderVariant(appCtx, shaderVariant);
+    publishModel(appCtx, entry.model, entry.buffer, entry.geometry);
+    return true;
+}
+
+// releases least recently used resident models until at least bytes are freed, returns what was freed
+VkDeviceSize evictResidentModels(AppContext &appCtx, VkDeviceSize bytes) {
+    auto &model = appCtx.modelCtx;
+    VkDeviceSize freed = 0u;
+    while (freed < bytes && !model.residentModels.empty()) {
+        auto lru = std::min_element(model.residentModels.begin(), model.residentModels.end(),
+                                    [](const ResidentModel &a, const ResidentModel &b) { return a.lastUsedFrame < b.lastUsedFrame; });
+        std::cout << std::format("[Residency] evicting {} ({:.1f} MiB), unused for {} frames", lru->model.path,
+                                 lru->buffer.size / 1048576.0, appCtx.vkCtx.frameCounter - lru->lastUsedFrame) << std::endl;
+        freed += lru->buffer.size + lru->geometry.dedicatedVertices.size + lru->geometry.dedicatedIndices.size;
+        model.retiredModels.push_back({lru->buffer, lru->geometry, VK_NULL_HANDLE, appCtx.vkCtx.frameCounter});
+        model.residentModels.erase(lru);
+        ++appCtx.residency.evictions;
+    }
+    appCtx.residency.evictedBytes += freed;
+    return freed;
+}
+
+void dumpMemoryStats(AppContext &appCtx) {
+    char *stats = nullptr;
+    vmaBuildStatsString(appCtx.vkCtx.allocator, &stats, VK_TRUE);
+    std::string path = std::format("vma_stats_{}.json", appCtx.vkCtx.frameCounter.load());
+    std::ofstream(path) << stats;
+    vmaFreeStatsString(appCtx.vkCtx.allocator, stats);
+    std::cout << std::format("[Memory] VMA statistics written to {}", path) << std::endl;
+}
+
+// frame boundary: evicts before a device local heap reaches its budget, reports usage periodically
+void updateMemoryBudget(AppContext &appCtx) {
+    auto &residency = appCtx.residency;
+    vmaSetCurrentFrameIndex(appCtx.vkCtx.allocator, uint32_t(appCtx.vkCtx.frameCounter));
+    const VkPhysicalDeviceMemoryProperties *memProps = nullptr;
+    vmaGetMemoryProperties(appCtx.vkCtx.allocator, &memProps);
+    std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets{};
+    vmaGetHeapBudgets(appCtx.vkCtx.allocator, budgets.data());
+
+    // buffers already retired still count until their last frame is done, don't evict for them again
+    for (uint32_t heap = 0u; heap < memProps->memoryHeapCount; ++heap) {
+        if (!(memProps->memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) {
+            continue;
+        }
+        auto limit = VkDeviceSize(budgets[heap].budget * ResidencyManager::EVICTION_THRESHOLD);
+        VkDeviceSize retiring = retiringModelBytes(appCtx, heap);
+        if (budgets[heap].usage > limit + retiring) {
+            evictResidentModels(appCtx, budgets[heap].usage - limit - retiring);
+        }
+    }
+
+    // the first frame only takes the baseline, the rate would otherwise count every allocation made during startup
+    auto now = std::chrono::steady_clock::now();
+    auto &pools = appCtx.vkCtx.pools;
+    if (residency.lastLog == std::chrono::steady_clock::time_point{}) {
+        residency.lastLog = now;
+        pools.lastLoggedAllocations = pools.deviceAllocations;
+    }
+    if (appCtx.options.memoryLogSeconds > 0u && now - residency.lastLog >= std::chrono::seconds(appCtx.options.memoryLogSeconds)) {
+        double seconds = std::chrono::duration<double>(now - std::exchange(residency.lastLog, now)).count();
+        for (uint32_t heap = 0u; heap < memProps->memoryHeapCount; ++heap) {
+            auto &budget = budgets[heap];
+            std::cout << std::format("[Memory] heap {}{}: {:.1f} / {:.1f} MiB budget, {:.1f} MiB in {} allocations", heap,
+                                     memProps->memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT ? " (device local)" : "",
+                                     budget.usage / 1048576.0, budget.budget / 1048576.0,
+                                     budget.statistics.allocationBytes / 1048576.0, budget.statistics.allocationCount) << std::endl;
+        }
+        std::cout << std::format("[Memory] {} resident models, {} evictions, {:.1f} MiB evicted in total",
+                                 appCtx.modelCtx.residentModels.size(), residency.evictions, residency.evictedBytes / 1048576.0) << std::endl;
+        uint64_t allocations = pools.deviceAllocations;
+        std::cout << std::format("[Memory] vkAllocateMemory {:.2f}/s, {} live device memory blocks, {:.1f} MiB",
+                                 double(allocations - std::exchange(pools.lastLoggedAllocations, allocations)) / seconds,
+                                 allocations - pools.deviceFrees, pools.deviceBytes / 1048576.0) << std::endl;
+        auto &arena = appCtx.modelCtx.arena;
+        OffsetAllocatorReport vertexReport = offsetAllocatorReport(arena.vertexAllocator);
+        OffsetAllocatorReport indexReport = offsetAllocatorReport(arena.indexAllocator);
+        std::cout << std::format("[Memory] geometry arena: vertices {:.1f} / {:.1f} MiB, indices {:.1f} / {:.1f} MiB, "
+                                 "largest free ranges {:.1f} MiB and {:.1f} MiB",
+                                 (GeometryArena::VERTEX_BYTES - vertexReport.totalFreeSpace) / 1048576.0, GeometryArena::VERTEX_BYTES / 1048576.0,
+                                 (GeometryArena::INDEX_COUNT - indexReport.totalFreeSpace) * 4.0 / 1048576.0, GeometryArena::INDEX_COUNT * 4.0 / 1048576.0,
+                                 vertexReport.largestFreeRegion / 1048576.0, indexReport.largestFreeRegion * 4.0 / 1048576.0) << std::endl;
+        auto &defrag = appCtx.defragmenter;
+        std::cout << std::format("[Defrag] {} runs, {} buffers moved, {:.1f} MiB copied in total", defrag.runs, defrag.moves,
+                                 defrag.bytesMoved / 1048576.0) << std::endl;
+    }
+    if (std::exchange(appCtx.windowCtx.memoryStatsRequested, false)) {
+        dumpMemoryStats(appCtx);
+    }
+}
+
+bool poolFragmented(const VmaStatistics &stats) {
+    VkDeviceSize unused = stats.blockBytes - stats.allocationBytes;
+    return unused >= Defragmenter::MIN_FREE_BYTES && double(unused) > double(stats.blockBytes) * Defragmenter::FREE_RATIO_THRESHOLD;
+}
+
+// frame boundary: ends the pass once its copies are done, starts a run when a pool has too much unused block memory
+void updateDefragmentation(AppContext &appCtx) {
+    auto &defrag = appCtx.defragmenter;
+    auto allocator = appCtx.vkCtx.allocator;
+    if (defrag.passOpen) {
+        if (appCtx.vkCtx.frameCounter < defrag.passFrame + SwapChain::MAX_SWAPCHAIN_FRAMES) {
+            return;
+        }
+        // moved allocations now refer to the new memory, the old one is freed here
+        VkResult result = vmaEndDefragmentationPass(allocator, defrag.context, &defrag.pass);
+        for (VkBuffer buffer : defrag.movedBuffers) {
+            vkDestroyBuffer(appCtx.vkCtx.device, buffer, nullptr);
+        }
+        defrag.movedBuffers.clear();
+        defrag.passOpen = false;
+        if (result == VK_SUCCESS) {
+            VmaDefragmentationStats stats{};
+            vmaEndDefragmentation(allocator, std::exchange(defrag.context, VK_NULL_HANDLE), &stats);
+            std::cout << std::format("[Defrag] {} pool: {} allocations moved ({:.1f} MiB), {:.1f} MiB and {} blocks freed",
+                                     defrag.pool != VK_NULL_HANDLE ? "small buffer" : "default", stats.allocationsMoved,
+                                     stats.bytesMoved / 1048576.0, stats.bytesFreed / 1048576.0, stats.deviceMemoryBlocksFreed) << std::endl;
+        }
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (defrag.context != VK_NULL_HANDLE || appCtx.options.defragBudgetMiB == 0u || now - defrag.lastCheck < Defragmenter::CHECK_INTERVAL) {
+        return;
+    }
+    defrag.lastCheck = now;
+
+    // the transient pool is a ring and never defragmented, the default pools are what remains of the totals
+    auto &pools = appCtx.vkCtx.pools;
+    VmaDetailedStatistics smallStats{};
+    VmaDetailedStatistics transientStats{};
+    VmaTotalStatistics totalStats{};
+    vmaCalculatePoolStatistics(allocator, pools.small, &smallStats);
+    vmaCalculatePoolStatistics(allocator, pools.transient, &transientStats);
+    vmaCalculateStatistics(allocator, &totalStats);
+    VmaStatistics defaultStats = totalStats.total.statistics;
+    for (const VmaStatistics &pool : {smallStats.statistics, transientStats.statistics}) {
+        defaultStats.blockBytes -= pool.blockBytes;
+        defaultStats.allocationBytes -= pool.allocationBytes;
+    }
+    defrag.checkSmallPool = !defrag.checkSmallPool;
+    bool smallFragmented = poolFragmented(smallStats.statistics);
+    bool defaultFragmented = poolFragmented(defaultStats);
+    if (!smallFragmented && !defaultFragmented) {
+        return;
+    }
+    defrag.pool = (smallFragmented && (defrag.checkSmallPool || !defaultFragmented)) ? pools.small : VK_NULL_HANDLE;
+    VmaDefragmentationInfo defragInfo {
+        .flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT,
+        .pool = defrag.pool,
+        .maxBytesPerPass = VkDeviceSize(appCtx.options.defragBudgetMiB) << 20,
+        .maxAllocationsPerPass = Defragmenter::MAX_MOVES_PER_PASS
+    };
+    VK_CHECK(vmaBeginDefragmentation(allocator, &defragInfo, &defrag.context), "Failed to begin defragmentation");
+    ++defrag.runs;
+}
+
+// copies the allocations of the next pass, at most the budget per frame so compaction never stalls one. Only drawn
+// and resident model buffers move, their handles and the drawn descriptor set switch to the new location right away
+void recordDefragmentationMoves(AppContext &appCtx, VkCommandBuffer cmd) {
+    auto &defrag = appCtx.defragmenter;
+    auto &model = appCtx.modelCtx;
+    if (defrag.context == VK_NULL_HANDLE || defrag.passOpen) {
+        return;
+    }
+    if (vmaBeginDefragmentationPass(appCtx.vkCtx.allocator, defrag.context, &defrag.pass) == VK_SUCCESS) {
+        VmaDefragmentationStats stats{};
+        vmaEndDefragmentation(appCtx.vkCtx.allocator, std::exchange(defrag.context, VK_NULL_HANDLE), &stats);
+        return;
+    }
+    defrag.passOpen = true;
+    defrag.passFrame = appCtx.vkCtx.frameCounter;
+
+    auto findOwner = [&model](VmaAllocation allocation) -> GPUBuffer* {
+        if (model.gpuBuffer.bufferAllocation == allocation) {
+            return &model.gpuBuffer;
+        }
+        for (auto &resident : model.residentModels) {
+            if (resident.buffer.bufferAllocation == allocation) {
+                return &resident.buffer;
+            }
+        }
+        return nullptr;
+    };
+    VkDeviceSize passBytes = 0u;
+    for (uint32_t i = 0u; i < defrag.pass.moveCount; ++i) {
+        auto &move = defrag.pass.pMoves[i];
+        GPUBuffer *owner = findOwner(move.srcAllocation);
+        if (owner == nullptr || owner->mapped != nullptr) {
+            // streaming targets, retired buffers, images and the host visible placeholder stay where they are
+            move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+            continue;
+        }
+        VkBufferCreateInfo buffCI {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = owner->size, .usage = MODEL_BUFFER_USAGE};
+        shareWithTransferQueue(appCtx.vkCtx, buffCI);
+        VkBuffer moved = VK_NULL_HANDLE;
+        VK_CHECK(vkCreateBuffer(appCtx.vkCtx.device, &buffCI, nullptr, &moved), "Failed to create buffer for defragmentation");
+        VK_CHECK(vmaBindBufferMemory(appCtx.vkCtx.allocator, move.dstTmpAllocation, moved), "Failed to bind moved buffer");
+        VkBufferCopy region {.srcOffset = 0u, .dstOffset = 0u, .size = owner->size};
+        vkCmdCopyBuffer(cmd, owner->buffer, moved, 1u, &region);
+        defrag.movedBuffers.push_back(std::exchange(owner->buffer, moved));
+        passBytes += owner->size;
+
+        if (owner == &model.gpuBuffer) {
+            ++model.drawnRevision;
+        }
+        if (owner == &model.gpuBuffer && model.descriptorSet != VK_NULL_HANDLE) {
+            model.retiredModels.push_back({{}, {}, model.descriptorSet, appCtx.vkCtx.frameCounter});
+            model.descriptorSet = createModelDescriptorSet(appCtx, model.drawn, moved);
+        }
+    }
+    if (passBytes > 0u) {
+        defrag.moves += defrag.movedBuffers.size();
+        defrag.bytesMoved += passBytes;
+        VkMemoryBarrier2 moveBarrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+            .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT |
+                            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            .dstAccessMask = VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_2_INDEX_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT
+        };
+        VkDependencyInfo moveDepsInfo {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .memoryBarrierCount = 1u, .pMemoryBarriers = &moveBarrier};
+        vkCmdPipelineBarrier2(cmd, &moveDepsInfo);
+    }
+}
+
+// --instances: every instance of the model is repeated count times on a square grid in the xz plane
+void replicateInstances(JobSystem &jobs, ModelData &model, uint32_t count) {
+    if (count <= 1u) {
+        return;
+    }
+    constexpr float GRID_SPACING = {2.5f};
+    constexpr uint64_t BATCH = {16384u};
+    size_t instanceCount = (model.data.size() - model.instanceOffset) / sizeof(GPUInstance);
+    std::vector<GPUInstance> instances(instanceCount);
+    memcpy(instances.data(), model.data.data() + model.instanceOffset, instanceCount * sizeof(GPUInstance));
+    model.data.resize(model.instanceOffset + instanceCount * count * sizeof(GPUInstance));
+
+    // copies of instance i are at i * count + copy, so a draw's instance range stays contiguous
+    auto columns = uint32_t(std::ceil(std::sqrt(double(count))));
+    auto *dst = reinterpret_cast<GPUInstance*>(model.data.data() + model.instanceOffset);
+    parallelFor(jobs, instanceCount * count, BATCH, [&](uint64_t begin, uint64_t end) {
+        for (uint64_t index = begin; index < end; ++index) {
+            auto copy = uint32_t(index % count);
+            GPUInstance instance = instances[index / count];
+            instance.rows[0].w += (float(copy % columns) - float(columns - 1u) * 0.5f) * GRID_SPACING;
+            instance.rows[2].w += (float(copy / columns) - float(columns - 1u) * 0.5f) * GRID_SPACING;
+            dst[index] = instance;
+        }
+    });
+    for (auto &draw : model.draws) {
+        draw.firstInstance *= count;
+        draw.instanceCount *= count;
+    }
+}
+
+// bounding sphere of every draw in mesh space, around the center of the box of the vertices its indices reach. Draws of
+// a shader that doesn't read positions keep infinite bounds and are never culled
+void computeDrawBounds(JobSystem &jobs, ModelData &model) {
+    auto &attributes = model.vertexLayout.attributes;
+    auto position = std::find_if(attributes.begin(), attributes.end(), [](const VertexAttributeKey &attrib) { return attrib.location == 0u; });
+    if (position == attributes.end()) {
+        return;
+    }
+    const uint32_t *indices = modelIndices(model);
+    parallelFor(jobs, model.draws.size(), 1u, [&](uint64_t begin, uint64_t end) {
+        for (uint64_t d = begin; d < end; ++d) {
+            auto &draw = model.draws[d];
+            if (draw.indexCount == 0u) {
+                continue;
+            }
+            auto vertexPosition = [&](uint32_t index) {
+                glm::vec3 pos{};
+                memcpy(&pos, model.data.data() + (int64_t(draw.vertexOffset) + index) * model.vertexLayout.stride + position->offset, sizeof(pos));
+                return pos;
+            };
+            glm::vec3 boxMin{std::numeric_limits<float>::max()};
+            glm::vec3 boxMax{std::numeric_limits<float>::lowest()};
+            for (uint32_t i = draw.firstIndex; i < draw.firstIndex + draw.indexCount; ++i) {
+                glm::vec3 pos = vertexPosition(indices[i]);
+                boxMin = glm::min(boxMin, pos);
+                boxMax = glm::max(boxMax, pos);
+            }
+            glm::vec3 center = (boxMin + boxMax) * 0.5f;
+            float radiusSquared = 0.0f;
+            for (uint32_t i = draw.firstIndex; i < draw.firstIndex + draw.indexCount; ++i) {
+                glm::vec3 offset = vertexPosition(indices[i]) - center;
+                radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+            }
+            draw.bounds = glm::vec4(center, std::sqrt(radiusSquared));
+        }
+    });
+}
+
+// blended draws back to front, so each blends over what is behind it. The view is fixed, instance transforms map
+// straight to clip space with depth growing away from the near plane at z = 0, so the order is computed once. A draw
+// goes by the mean depth of its bounds center over its instances, instances of one draw keep their order
+void sortBlendedDraws(ModelData &model) {
+    auto blended = std::find_if(model.draws.begin(), model.draws.end(), [](const SceneDraw &draw) { return draw.state == 1u; });
+    if (blended == model.draws.end()) {
+        return;
+    }
+    auto *instances = reinterpret_cast<const GPUInstance*>(model.data.data() + model.instanceOffset);
+    auto viewDepth = [instances](const SceneDraw &draw) {
+        glm::vec4 center(glm::vec3(draw.bounds), 1.0f);
+        float depth = 0.0f;
+        for (uint32_t i = draw.firstInstance; i < draw.firstInstance + draw.instanceCount; ++i) {
+            depth += glm::dot(instances[i].rows[2], center);
+        }
+        return depth / float(std::max(draw.instanceCount, 1u));
+    };
+    std::vector<std::pair<float, SceneDraw>> sorted{};
+    for (auto it = blended; it != model.draws.end(); ++it) {
+        sorted.emplace_back(viewDepth(*it), *it);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](auto &a, auto &b) { return a.first > b.first; });
+    for (auto &[depth, draw] : sorted) {
+        *blended++ = draw;
+    }
+}
+
+// job, decodes the highest priority request queued so far; there is one job per request
+void decodeStreamRequest(AppContext &appCtx) {
+    auto &streamer = appCtx.assetStreamer;
+    StreamRequest request{};
+    {
+        std::lock_guard lock(streamer.mutex);
+        // a replaced request leaves its job nothing to do
+        if (streamer.stopping || streamer.requests.empty()) {
+            return;
+        }
+        auto next = std::min_element(streamer.requests.begin(), streamer.requests.end(),
+                                     [](const StreamRequest &a, const StreamRequest &b) { return a.priority < b.priority; });
+        request = std::move(*next);
+        streamer.requests.erase(next);
+    }
+    try {
+        ModelData model = decodeModel(request.path, request.vertexLayout);
+        computeDrawBounds(appCtx.jobs, model);
+        replicateInstances(appCtx.jobs, model, appCtx.options.instanceCount);
+        sortBlendedDraws(model);
+        // std::function needs a copyable callable, the decoded model is moved exactly once
+        auto upload = std::make_shared<StreamUpload>(StreamUpload {
+            .model = std::move(model),
+            .priority = request.priority,
+            .requested = request.requested
+        });
+        runMainThreadJob(appCtx.jobs, [&streamer, upload] { streamer.uploads.push_back(std::move(*upload)); });
+    } catch (std::exception &e) {
+        std::cerr << std::format("[Streaming] {} failed, keeping current model: {}", request.path, e.what()) << std::endl;
+    }
+}
+
+// can be called from any thread, a queued request for the same asset is replaced
+void requestModel(AppContext &appCtx, StreamRequest request) {
+    auto &streamer = appCtx.assetStreamer;
+    request.requested = std::chrono::steady_clock::now();
+    {
+        std::lock_guard lock(streamer.mutex);
+        std::erase_if(streamer.requests, [&request](const StreamRequest &queued) { return queued.path == request.path; });
+        streamer.requests.push_back(std::move(request));
+    }
+    runJob(appCtx.jobs, [&appCtx] { decodeStreamRequest(appCtx); }, &streamer.decodes);
+}
+
+void startJobs(AppContext &appCtx) {
+    startJobSystem(appCtx.jobs, {.workers = appCtx.options.jobWorkers, .pinWorkers = appCtx.options.pinJobWorkers});
+    std::cout << std::format("[Jobs] {} workers{}", appCtx.jobs.workers.size(), appCtx.options.pinJobWorkers ? ", pinned" : "")
+              << std::endl;
+}
+
+// queued requests are dropped, running decodes finish first
+void stopAssetStreamer(AppContext &appCtx) {
+    {
+        std::lock_guard lock(appCtx.assetStreamer.mutex);
+        appCtx.assetStreamer.stopping = true;
+        appCtx.assetStreamer.requests.clear();
+    }
+    waitJobs(appCtx.jobs, appCtx.assetStreamer.decodes);
+}
+
+// copies the highest priority uploads through one transient staging buffer, never more than the frame budget so a large
+// asset can't stall a frame. cmd is the frame's graphics command buffer or a transfer queue one, returns whether
+// anything was copied
+bool recordStreamingUploads(AppContext &appCtx, VkCommandBuffer cmd) {
+    auto &streamer = appCtx.assetStreamer;
+    uint64_t frame = appCtx.vkCtx.frameCounter;
+    if (streamer.uploads.empty()) {
+        return false;
+    }
+    std::stable_sort(streamer.uploads.begin(), streamer.uploads.end(),
+                     [](const StreamUpload &a, const StreamUpload &b) { return a.priority < b.priority; });
+
+    VkDeviceSize pending = 0u;
+    for (auto &upload : streamer.uploads) {
+        pending += upload.model.data.size() - upload.uploaded;
+    }
+    VkDeviceSize budget = std::min({VkDeviceSize(appCtx.options.streamBudgetMiB) << 20,
+                                    MemoryPools::TRANSIENT_POOL_SIZE / (SwapChain::MAX_SWAPCHAIN_FRAMES + 1u), pending});
+    TransientBuffer *staging = allocateTransientBuffer(appCtx.vkCtx, budget, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    if (staging == nullptr) {
+        return false; // ring is full until older frames are done
+    }
+    VkDeviceSize frameBytes = 0u;
+    for (auto &upload : streamer.uploads) {
+        if (frameBytes == budget) {
+            break;
+        }
+        if (!geometryAllocated(upload.geometry) && !allocateModelGeometry(appCtx, upload.model, upload.geometry)) {
+            // the arenas are full, evicted ranges return once their frames are done. While some are on their way back
+            // wait for them, evicting again every frame until they land would empty the resident set
+            if (retiringArenaGeometry(appCtx) || evictResidentModels(appCtx, 1u) > 0u) {
+                break;
+            }
+            std::cerr << std::format("[Residency] {} doesn't fit the geometry arena with nothing left to evict, using buffers of its own",
+                                     upload.model.path) << std::endl;
+            allocateModelGeometry(appCtx, upload.model, upload.geometry, true);
+        }
+        if (upload.target.buffer == VK_NULL_HANDLE) {
+            upload.target = createModelBuffer(appCtx, upload.model, true);
+        }
+        if (upload.target.buffer == VK_NULL_HANDLE) {
+            // over budget, make room and try again once the evicted models are released. Memory already on its way back
+            // counts, evicting for it again every frame until it lands would empty the resident set
+            VkDeviceSize size = modelBufferSize(upload.model);
+            VkDeviceSize retiring = retiringModelBytes(appCtx, modelBufferHeap(appCtx, size));
+            VkDeviceSize evicted = retiring < size ? evictResidentModels(appCtx, size - retiring) : 0u;
+            if (retiring + evicted > 0u) {
+                break;
+            }
+            std::cerr << std::format("[Residency] {} exceeds the memory budget with nothing left to evict, allocating anyway",
+                                     upload.model.path) << std::endl;
+            upload.target = createModelBuffer(appCtx, upload.model);
+        }
+        if (upload.uploaded < upload.model.data.size()) {
+            VkDeviceSize size = std::min(upload.model.data.size() - upload.uploaded, budget - frameBytes);
+            memcpy(staging->mapped + frameBytes, upload.model.data.data() + upload.uploaded, size);
+            recordModelCopies(appCtx, cmd, upload.model, upload.geometry, upload.target.buffer, staging->buffer, frameBytes,
+                              upload.uploaded, upload.uploaded + size);
+            upload.uploaded += size;
+            frameBytes += size;
+        }
+        if (upload.uploaded == upload.model.data.size()) {
+            upload.lastCopyFrame = frame;
+        }
+    }
+    auto done = std::stable_partition(streamer.uploads.begin(), streamer.uploads.end(),
+                                      [](const StreamUpload &upload) { return upload.uploaded < upload.model.data.size(); });
+    std::move(done, streamer.uploads.end(), std::back_inserter(streamer.completed));
+    streamer.uploads.erase(done, streamer.uploads.end());
+
+    if (frameBytes > 0u) {
+        VK_CHECK(vmaFlushAllocation(appCtx.vkCtx.allocator, staging->allocation, 0u, frameBytes), "Failed to flush staging buffer");
+        streamer.bytesUploaded += frameBytes;
+    }
+    // on the transfer queue the upload semaphore makes the copies visible to the graphics submit
+    if (frameBytes > 0u && !separateTransferQueue(appCtx.vkCtx)) {
+        VkMemoryBarrier2 uploadBarrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+            .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+            .dstAccessMask = VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_2_INDEX_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT
+        };
+        VkDependencyInfo uploadDepsInfo {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .memoryBarrierCount = 1u, .pMemoryBarriers = &uploadBarrier};
+        vkCmdPipelineBarrier2(cmd, &uploadDepsInfo);
+    }
+    return frameBytes > 0u;
+}
+
+// the frame's uploads as their own transfer queue submit, so they start right away instead of queueing behind graphics
+// work; returns whether the graphics submit has to wait for the frame's upload semaphore
+bool submitStreamingUploads(AppContext &appCtx, uint32_t frame) {
+    VkCommandBuffer transferCmd = appCtx.vkCtx.transferCommandBuffers[frame];
+    vkResetCommandBuffer(transferCmd, 0u);
+    VkCommandBufferBeginInfo beginInfo {.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
+    vkBeginCommandBuffer(transferCmd, &beginInfo);
+    bool recorded = recordStreamingUploads(appCtx, transferCmd);
+    vkEndCommandBuffer(transferCmd);
+    if (!recorded) {
+        return false;
+    }
+    VkCommandBufferSubmitInfo cmdInfo {.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO, .commandBuffer = transferCmd};
+    VkSemaphoreSubmitInfo signalInfo {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+        .semaphore = appCtx.vkCtx.uploadSemaphores[frame],
+        .stageMask = VK_PIPELINE_STAGE_2_COPY_BIT
+    };
+    VkSubmitInfo2 submitInfo {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+        .commandBufferInfoCount = 1u,
+        .pCommandBufferInfos = &cmdInfo,
+        .signalSemaphoreInfoCount = 1u,
+        .pSignalSemaphoreInfos = &signalInfo
+    };
+    VK_CHECK(vkQueueSubmit2(appCtx.vkCtx.transferQueue.queueHandle, 1u, &submitInfo, VK_NULL_HANDLE), "Failed to submit uploads");
+    return true;
+}
+
+// frame boundary: models whose last copy is done on the GPU replace the drawn one
+void publishStreamedModels(AppContext &appCtx) {
+    auto &model = appCtx.modelCtx;
+    std::erase_if(appCtx.assetStreamer.completed, [&appCtx, &model](StreamUpload &upload) {
+        if (appCtx.vkCtx.frameCounter < upload.lastCopyFrame + SwapChain::MAX_SWAPCHAIN_FRAMES) {
+            return false;
+        }
+        if (model.waitingShaderVariant != 0u && upload.model.vertexLayout == shaderVertexLayout(appCtx, model.waitingShaderVariant)) {
+            useShaderVariant(appCtx, std::exchange(model.waitingShaderVariant, 0u));
+        }
+        if (!(upload.model.vertexLayout == shaderVertexLayout(appCtx, model.pipelineState.shaderVariant))) {
+            // packed for a shader that is gone, no frame ever read it
+            vmaDestroyBuffer(appCtx.vkCtx.allocator, upload.target.buffer, upload.target.bufferAllocation);
+            freeModelGeometry(appCtx, upload.geometry);
+            return true;
+        }
+        auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - upload.requested).count();
+        std::cout << std::format("[Streaming] {} resident after {:.1f} ms, {:.1f} MiB, {:.1f} MiB streamed in total", upload.model.path,
+                                 ms, upload.model.data.size() / 1048576.0, appCtx.assetStreamer.bytesUploaded / 1048576.0) << std::endl;
+        publishModel(appCtx, upload.model, upload.target, upload.geometry);
+        return true;
+    });
+}
+
+// compiled apart from the shader variant cache, the set layout and push constant size come from reflection
+ComputeKernel createComputeKernel(AppContext &appCtx, const std::string &modulePath, const char *entryPoint) {
+    CompiledShader compiled{};
+    std::string diagnostics;
+    bool success = false;
+    {
+        std::lock_guard lock(appCtx.shaderCompiler.mutex);
+        success = compileShaderVariant(appCtx.shaderCompiler, {.modulePath = modulePath}, modulePath, compiled, diagnostics);
+    }
+    if (!success) {
+        RT_THROW(std::format("{}: {}", modulePath, diagnostics));
+    }
+
+    auto &vkCtx = appCtx.vkCtx;
+    ComputeKernel kernel {.pushConstantSize = compiled.reflection.pushConstantSize};
+    std::vector<VkDescriptorSetLayoutBinding> bindings{};
+    if (!compiled.reflection.descriptorSets.empty()) {
+        bindings = compiled.reflection.descriptorSets.front().bindings;
+    }
+    for (auto &binding : bindings) {
+        binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    VkDescriptorSetLayoutCreateInfo setLayoutCI {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT,
+        .bindingCount = uint32_t(bindings.size()),
+        .pBindings = bindings.data()
+    };
+    VK_CHECK(vkCreateDescriptorSetLayout(vkCtx.device, &setLayoutCI, nullptr, &kernel.setLayout), "Failed to create compute descriptorSetLayout");
+
+    VkPushConstantRange pushConstants {VK_SHADER_STAGE_COMPUTE_BIT, 0u, kernel.pushConstantSize};
+    VkPipelineLayoutCreateInfo pipLayoutCI {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1u,
+        .pSetLayouts = &kernel.setLayout,
+        .pushConstantRangeCount = pushConstants.size > 0u ? 1u : 0u,
+        .pPushConstantRanges = &pushConstants
+    };
+    VK_CHECK(vkCreatePipelineLayout(vkCtx.device, &pipLayoutCI, nullptr, &kernel.layout), "Failed to create compute pipeline layout");
+
+    VkShaderModule module = createShaderModule(vkCtx, compiled.spirv);
+    VkComputePipelineCreateInfo pipelineCI {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = module,
+            .pName = entryPoint
+        },
+        .layout = kernel.layout
+    };
+    VK_CHECK(vkCreateComputePipelines(vkCtx.device, appCtx.modelCtx.pipelineCache, 1u, &pipelineCI, nullptr, &kernel.pipeline),
+             std::format("Failed to create compute pipeline {}", entryPoint));
+    vkDestroyShaderModule(vkCtx.device, module, nullptr);
+    return kernel;
+}
+
+// depth pyramid and both compute kernels, culling stays off when the device can't run them
+void createOcclusionCulling(AppContext &appCtx) {
+    auto &culling = appCtx.culling;
+    auto &vkCtx = appCtx.vkCtx;
+    if (!appCtx.options.occlusionCulling) {
+        return;
+    }
+    if (!vkCtx.features.drawIndirectFirstInstance || !vkCtx.features.shaderStorageImageExtendedFormats || !vkCtx.swapchain.depthBuffer.sampled) {
+        std::cerr << "[Culling] needs drawIndirectFirstInstance, shaderStorageImageExtendedFormats and a sampled depth format, "
+                     "drawing without occlusion culling" << std::endl;
+        return;
+    }
+    culling.pyramidKernel = createComputeKernel(appCtx, "shader/depth_pyramid.slang", "buildDepthPyramid");
+    culling.cullKernel = createComputeKernel(appCtx, "shader/cull.slang", "cullInstances");
+
+    // rounded down so every level halves exactly
+    VkExtent2D extent = vkCtx.swapchain.extent;
+    culling.pyramidExtent = {std::bit_floor(extent.width), std::bit_floor(extent.height)};
+    auto levels = uint32_t(std::bit_width(std::max(culling.pyramidExtent.width, culling.pyramidExtent.height)));
+    VkImageCreateInfo pyramidCI {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = VK_FORMAT_R32G32_SFLOAT,
+        .extent = {culling.pyramidExtent.width, culling.pyramidExtent.height, 1u},
+        .mipLevels = levels,
+        .arrayLayers = 1u,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+    };
+    VmaAllocationCreateInfo pyramidAllocCI = imageAllocationInfo(vkCtx, pyramidCI);
+    VK_CHECK(vmaCreateImage(vkCtx.allocator, &pyramidCI, &pyramidAllocCI, &culling.pyramid, &culling.pyramidAlloc, nullptr),
+             "Failed to create depth pyramid");
+
+    VkImageViewCreateInfo viewCI {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = culling.pyramid,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = pyramidCI.format,
+        .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = levels, .layerCount = 1u}
+    };
+    VK_CHECK(vkCreateImageView(vkCtx.device, &viewCI, nullptr, &culling.pyramidView), "Failed to create depth pyramid view");
+    culling.levelViews.resize(levels);
+    for (uint32_t level = 0u; level < levels; ++level) {
+        viewCI.subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .baseMipLevel = level, .levelCount = 1u, .layerCount = 1u};
+        VK_CHECK(vkCreateImageView(vkCtx.device, &viewCI, nullptr, &culling.levelViews[level]), "Failed to create depth pyramid level view");
+    }
+
+    // phase 0 binds the pyramid before the first one is built, it must not be undefined then
+    VkImageMemoryBarrier2 initBarrier {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+        .srcStageMask = VK_PIPELINE_STAGE_2_NONE,
+        .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+        .image = culling.pyramid,
+        .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0u, levels, 0u, 1u}
+    };
+    VkDependencyInfo initDepsInfo {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .imageMemoryBarrierCount = 1u, .pImageMemoryBarriers = &initBarrier};
+    VkCommandBuffer cmd = beginSingleTimeCommands(vkCtx);
+    vkCmdPipelineBarrier2(cmd, &initDepsInfo);
+    endSingleTimeCommands(vkCtx, cmd);
+
+    culling.enabled = true;
+    std::cout << std::format("[Culling] {}x{} depth pyramid, {} levels", culling.pyramidExtent.width, culling.pyramidExtent.height, levels)
+              << std::endl;
+}
+
+// host written buffers are mapped and only change with the model, the others stay in device memory
+GPUBuffer createCullingBuffer(AppContext &appCtx, VkDeviceSize size, VkBufferUsageFlags usage, bool hostWritten) {
+    GPUBuffer buffer {.size = std::max<VkDeviceSize>(size, 16u)};
+    VkBufferCreateInfo buffCI {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = buffer.size, .usage = usage};
+    VmaAllocationCreateInfo buffAllocCI {.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE};
+    if (hostWritten) {
+        buffAllocCI = {.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                       .usage = VMA_MEMORY_USAGE_AUTO};
+    }
+    VmaAllocationInfo allocInfo{};
+    VK_CHECK(vmaCreateBuffer(appCtx.vkCtx.allocator, &buffCI, &buffAllocCI, &buffer.buffer, &buffer.bufferAllocation, &allocInfo),
+             "Failed to create culling buffer");
+    buffer.mapped = allocInfo.pMappedData;
+    return buffer;
+}
+
+void retireCullingBuffers(AppContext &appCtx) {
+    auto &culling = appCtx.culling;
+    auto &retired = appCtx.modelCtx.retiredModels;
+    for (GPUBuffer *buffer : {&culling.drawBounds, &culling.records, &culling.commandTemplate, &culling.commands, &culling.visibility,
+                              &culling.culledInstances}) {
+        if (buffer->buffer != VK_NULL_HANDLE) {
+            retired.push_back({std::exchange(*buffer, {}), {}, VK_NULL_HANDLE, appCtx.vkCtx.frameCounter});
+        }
+    }
+    if (culling.culledDescriptorSet != VK_NULL_HANDLE) {
+        retired.push_back({{}, {}, std::exchange(culling.culledDescriptorSet, VK_NULL_HANDLE), appCtx.vkCtx.frameCounter});
+    }
+}
+
+// frame boundary after defragmentation moves were recorded, false when this frame draws without culling. Captures
+// replay plain indexed draws and are recorded without it
+bool prepareOcclusionCulling(AppContext &appCtx) {
+    auto &culling = appCtx.culling;
+    auto &model = appCtx.modelCtx;
+    if (!culling.enabled || appCtx.capture.active || model.descriptorSet == VK_NULL_HANDLE) {
+        return false;
+    }
+    if (culling.modelRevision == model.drawnRevision) {
+        return culling.recordCount > 0u;
+    }
+    retireCullingBuffers(appCtx);
+    culling.modelRevision = model.drawnRevision;
+
+    auto &draws = model.drawn.draws;
+    std::vector<glm::vec4> bounds{};
+    std::vector<glm::uvec2> records{};
+    for (uint32_t d = 0u; d < draws.size(); ++d) {
+        bounds.push_back(draws[d].bounds);
+        for (uint32_t i = 0u; i < draws[d].instanceCount; ++i) {
+            records.emplace_back(d, draws[d].firstInstance + i);
+        }
+    }
+    // phase 0 compacts into the first half of culledInstances, phase 1 into the second
+    std::vector<VkDrawIndexedIndirectCommand> commands(draws.size() * 2u);
+    uint32_t firstRecord = 0u;
+    for (uint32_t d = 0u; d < draws.size(); ++d) {
+        auto &draw = draws[d];
+        commands[d] = {draw.indexCount, 0u, draw.firstIndex, draw.vertexOffset, firstRecord};
+        commands[draws.size() + d] = {draw.indexCount, 0u, draw.firstIndex, draw.vertexOffset, uint32_t(records.size()) + firstRecord};
+        firstRecord += draw.instanceCount;
+    }
+
+    auto upload = [&appCtx](std::span<const std::byte> bytes, VkBufferUsageFlags usage) {
+        GPUBuffer buffer = createCullingBuffer(appCtx, bytes.size(), usage, true);
+        memcpy(buffer.mapped, bytes.data(), bytes.size());
+        VK_CHECK(vmaFlushAllocation(appCtx.vkCtx.allocator, buffer.bufferAllocation, 0u, VK_WHOLE_SIZE), "Failed to flush culling buffer");
+        return buffer;
+    };
+    culling.drawBounds = upload(std::as_bytes(std::span(bounds)), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    culling.records = upload(std::as_bytes(std::span(records)), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    culling.commandTemplate = upload(std::as_bytes(std::span(commands)), VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    culling.commands = createCullingBuffer(appCtx, culling.commandTemplate.size, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                           VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, false);
+    culling.visibility = createCullingBuffer(appCtx, records.size() * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                             VK_BUFFER_USAGE_TRANSFER_DST_BIT, false);
+    culling.culledInstances = createCullingBuffer(appCtx, records.size() * 2u * sizeof(GPUInstance), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false);
+    culling.culledDescriptorSet = createModelDescriptorSet(appCtx, model.drawn, model.gpuBuffer.buffer, culling.culledInstances.buffer);
+    culling.drawCount = uint32_t(draws.size());
+    culling.recordCount = uint32_t(records.size());
+    culling.resetVisibility = true;
+    std::cout << std::format("[Culling] {} draws, {} instances tested per phase", culling.drawCount, culling.recordCount) << std::endl;
+    return culling.recordCount > 0u;
+}
+
+// visible instances of the phase are counted into its indirect commands and compacted into culledInstances, phase 0
+// starts from the command template
+void recordCullPass(AppContext &appCtx, VkCommandBuffer cmd, uint32_t phase) {
+    auto &culling = appCtx.culling;
+    auto &model = appCtx.modelCtx;
+    if (phase == 0u) {
+        // the last frame's draws and cull passes are done with what is overwritten here, visibility it wrote is read
+        VkMemoryBarrier2 reuseBarrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            .srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            .dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
+        };
+        VkDependencyInfo reuseDepsInfo {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .memoryBarrierCount = 1u, .pMemoryBarriers = &reuseBarrier};
+        vkCmdPipelineBarrier2(cmd, &reuseDepsInfo);
+        VkBufferCopy region {.srcOffset = 0u, .dstOffset = 0u, .size = culling.commandTemplate.size};
+        vkCmdCopyBuffer(cmd, culling.commandTemplate.buffer, culling.commands.buffer, 1u, &region);
+        if (std::exchange(culling.resetVisibility, false)) {
+            vkCmdFillBuffer(cmd, culling.visibility.buffer, 0u, VK_WHOLE_SIZE, 1u);
+        }
+        VkMemoryBarrier2 resetBarrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+            .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            .dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
         };
-        vertices.push_back(v);
-        indices.push_back(indices.size());
+        VkDependencyInfo resetDepsInfo {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .memoryBarrierCount = 1u, .pMemoryBarriers = &resetBarrier};
+        vkCmdPipelineBarrier2(cmd, &resetDepsInfo);
     }
 
+    // binding 0 depth pyramid, 1 draw bounds, 2 records, 3 model instances, 4 visibility, 5 commands, 6 culled instances
+    VkDescriptorImageInfo pyramidInfo {VK_NULL_HANDLE, culling.pyramidView, VK_IMAGE_LAYOUT_GENERAL};
+    std::array<VkDescriptorBufferInfo, 6> bufferInfos {
+        VkDescriptorBufferInfo{culling.drawBounds.buffer, 0u, VK_WHOLE_SIZE},
+        VkDescriptorBufferInfo{culling.records.buffer, 0u, VK_WHOLE_SIZE},
+        VkDescriptorBufferInfo{model.gpuBuffer.buffer, model.drawn.instanceOffset - model.drawn.materialOffset, VK_WHOLE_SIZE},
+        VkDescriptorBufferInfo{culling.visibility.buffer, 0u, VK_WHOLE_SIZE},
+        VkDescriptorBufferInfo{culling.commands.buffer, 0u, VK_WHOLE_SIZE},
+        VkDescriptorBufferInfo{culling.culledInstances.buffer, 0u, VK_WHOLE_SIZE}
+    };
+    std::array<VkWriteDescriptorSet, 7> writes{};
+    writes[0] = {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstBinding = 0u,
+        .descriptorCount = 1u,
+        .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+        .pImageInfo = &pyramidInfo
+    };
+    for (uint32_t binding = 1u; binding < writes.size(); ++binding) {
+        writes[binding] = {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstBinding = binding,
+            .descriptorCount = 1u,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo = &bufferInfos[binding - 1u]
+        };
+    }
+    CullConstants constants {
+        .recordCount = culling.recordCount,
+        .drawCount = culling.drawCount,
+        .phase = phase,
+        .pyramidLevels = uint32_t(culling.levelViews.size()),
+        .pyramidSize = {float(culling.pyramidExtent.width), float(culling.pyramidExtent.height)}
+    };
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, culling.cullKernel.pipeline);
+    vkCmdPushDescriptorSet(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, culling.cullKernel.layout, 0u, uint32_t(writes.size()), writes.data());
+    vkCmdPushConstants(cmd, culling.cullKernel.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0u, sizeof(constants), &constants);
+    // 64 threads per group, rows of at most 65535 groups, see cullInstances
+    uint32_t groups = (culling.recordCount + 63u) / 64u;
+    vkCmdDispatch(cmd, std::min(groups, 65535u), (groups + 65534u) / 65535u, 1u);
+
+    VkMemoryBarrier2 drawBarrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+        .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+        .srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+        .dstStageMask = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,
+        .dstAccessMask = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT
+    };
+    VkDependencyInfo drawDepsInfo {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .memoryBarrierCount = 1u, .pMemoryBarriers = &drawBarrier};
+    vkCmdPipelineBarrier2(cmd, &drawDepsInfo);
+}
 
-    auto vbuffSize = static_cast<VkDeviceSize>(sizeof(Vertex) * vertices.size());
-    auto ibuffSize = static_cast<VkDeviceSize>(sizeof(uint32_t) * indices.size());
-    appCtx.modelCtx.gpuBuffer.vertexBufferSize = vbuffSize;
-    appCtx.modelCtx.gpuBuffer.indexBufferSize = ibuffSize;
-    appCtx.modelCtx.gpuBuffer.size = vbuffSize + ibuffSize;
-    VkBufferCreateInfo buffCI {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = appCtx.modelCtx.gpuBuffer.size, .usage =  VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |  VK_BUFFER_USAGE_INDEX_BUFFER_BIT};
-    VmaAllocationCreateInfo buffAllocCI {.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT, .usage = VMA_MEMORY_USAGE_AUTO};
-    VK_CHECK(vmaCreateBuffer(appCtx.vkCtx.allocator, &buffCI, &buffAllocCI, &appCtx.modelCtx.gpuBuffer.buffer, &appCtx.modelCtx.gpuBuffer.bufferAllocation, nullptr), "Failed to create tris buffer");
+// min and max depth of what phase 0 drew into every pyramid level, the depth buffer is an attachment again afterwards
+void recordDepthPyramid(AppContext &appCtx, VkCommandBuffer cmd) {
+    auto &culling = appCtx.culling;
+    auto &depthBuffer = appCtx.vkCtx.swapchain.depthBuffer;
+    auto levels = uint32_t(culling.levelViews.size());
+    // with MSAA the depth buffer is written by the depth resolve, which happens in the color attachment output stage
+    bool resolved = appCtx.msaa.samples != VK_SAMPLE_COUNT_1_BIT;
+    VkPipelineStageFlags2 depthStages = resolved ? VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT
+                                                 : VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+    VkAccessFlags2 depthWrite = resolved ? VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT : VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    std::array<VkImageMemoryBarrier2, 2> readBarriers {
+        VkImageMemoryBarrier2{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = depthStages,
+            .srcAccessMask = depthWrite,
+            .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            .dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
+            .newLayout = VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL,
+            .image = depthBuffer.image,
+            .subresourceRange = {depthAspects(depthBuffer.format), 0u, 1u, 0u, 1u}},
+        // the last frame's phase 1 is done reading the pyramid, its contents are discarded
+        VkImageMemoryBarrier2{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            .srcAccessMask = 0u,
+            .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            .dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+            .image = culling.pyramid,
+            .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0u, levels, 0u, 1u}}
+    };
+    VkDependencyInfo readDepsInfo {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .imageMemoryBarrierCount = uint32_t(readBarriers.size()),
+                                   .pImageMemoryBarriers = readBarriers.data()};
+    vkCmdPipelineBarrier2(cmd, &readDepsInfo);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, culling.pyramidKernel.pipeline);
+    VkExtent2D sourceSize = appCtx.resolution.extent; // the corner the scene was drawn into
+    for (uint32_t level = 0u; level < levels; ++level) {
+        VkExtent2D targetSize {std::max(culling.pyramidExtent.width >> level, 1u), std::max(culling.pyramidExtent.height >> level, 1u)};
+        std::array<VkDescriptorImageInfo, 2> imageInfos {
+            level == 0u ? VkDescriptorImageInfo{VK_NULL_HANDLE, depthBuffer.imageView, VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL}
+                        : VkDescriptorImageInfo{VK_NULL_HANDLE, culling.levelViews[level - 1u], VK_IMAGE_LAYOUT_GENERAL},
+            VkDescriptorImageInfo{VK_NULL_HANDLE, culling.levelViews[level], VK_IMAGE_LAYOUT_GENERAL}
+        };
+        std::array<VkWriteDescriptorSet, 2> writes {
+            VkWriteDescriptorSet{
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstBinding = 0u,
+                .descriptorCount = 1u,
+                .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+                .pImageInfo = &imageInfos[0]},
+            VkWriteDescriptorSet{
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstBinding = 1u,
+                .descriptorCount = 1u,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                .pImageInfo = &imageInfos[1]}
+        };
+        PyramidConstants constants {
+            .sourceSize = {sourceSize.width, sourceSize.height},
+            .targetSize = {targetSize.width, targetSize.height},
+            .sourceIsDepth = level == 0u ? 1u : 0u
+        };
+        vkCmdPushDescriptorSet(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, culling.pyramidKernel.layout, 0u, uint32_t(writes.size()), writes.data());
+        vkCmdPushConstants(cmd, culling.pyramidKernel.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0u, sizeof(constants), &constants);
+        vkCmdDispatch(cmd, (targetSize.width + 7u) / 8u, (targetSize.height + 7u) / 8u, 1u);
+
+        // the next level and the phase 1 cull pass read this one
+        VkMemoryBarrier2 levelBarrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            .srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            .dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT
+        };
+        VkDependencyInfo levelDepsInfo {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .memoryBarrierCount = 1u, .pMemoryBarriers = &levelBarrier};
+        vkCmdPipelineBarrier2(cmd, &levelDepsInfo);
+        sourceSize = targetSize;
+    }
 
-    void* pBuffMap = nullptr; // address of GPU memory
-    VK_CHECK(vmaMapMemory(appCtx.vkCtx.allocator, appCtx.modelCtx.gpuBuffer.bufferAllocation, &pBuffMap), "Failed to map buffer memory");
-    memcpy(pBuffMap, vertices.data(), vbuffSize); // copy vertices
-    memcpy(((char*)pBuffMap) + vbuffSize, indices.data(), ibuffSize); // copy indices
-    vmaUnmapMemory(appCtx.vkCtx.allocator, appCtx.modelCtx.gpuBuffer.bufferAllocation);
+    VkImageMemoryBarrier2 attachmentBarrier {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+        .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+        .srcAccessMask = 0u,
+        .dstStageMask = depthStages,
+        .dstAccessMask = resolved ? depthWrite : depthWrite | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL,
+        .newLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
+        .image = depthBuffer.image,
+        .subresourceRange = {depthAspects(depthBuffer.format), 0u, 1u, 0u, 1u}
+    };
+    VkDependencyInfo attachmentDepsInfo {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .imageMemoryBarrierCount = 1u,
+                                         .pImageMemoryBarriers = &attachmentBarrier};
+    vkCmdPipelineBarrier2(cmd, &attachmentDepsInfo);
+}
 
-    // create descriptor pool
+void initResouces(AppContext &appCtx) {
+    // create descriptor pool, sets are reallocated whenever a streamed model replaces the drawn one, twice with culling
     std::array<VkDescriptorPoolSize, 1> poolSizes{};
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount =
-            static_cast<uint32_t>(SwapChain::MAX_SWAPCHAIN_FRAMES);
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[0].descriptorCount = 64u;
 
     VkDescriptorPoolCreateInfo descPoolCI = {
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
         .pNext = VK_NULL_HANDLE,
-        .flags = 0u,
-        .maxSets = static_cast<uint32_t>(SwapChain::MAX_SWAPCHAIN_FRAMES),
+        .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+        .maxSets = 32u,
         .poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
         .pPoolSizes = poolSizes.data()
 
@@ -771,203 +4564,804 @@ void initResouces(AppContext &appCtx) {
     VK_CHECK(vkCreateDescriptorPool(appCtx.vkCtx.device, &descPoolCI, nullptr,
                  &appCtx.modelCtx.descriptorPool),
              "Failed to create descriptorPool");
-    // create descriptor set layout
-    /*
-  VkDescriptorSetLayoutCreateInfo descSetLayoutCI{
-      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-      .pNext = VK_NULL_HANDLE,
-      .flags = 0u,
-      .bindingCount = 0u, // TODO add binding
-      .pBindings = VK_NULL_HANDLE,
-
-  };
-
-  VK_CHECK(vkCreateDescriptorSetLayout(appCtx.vkCtx.device, &descSetLayoutCI,
-                                       nullptr,
-                                       &appCtx.trisCtx.descriptorSetLayout),
-           "Failed to create descriptorSetLayout");
-  // create descriptor set
-
-  std::vector<VkDescriptorSetLayout> layouts{
-      SwapChain::MAX_SWAPCHAIN_FRAMES, appCtx.trisCtx.descriptorSetLayout};
-
-  VkDescriptorSetAllocateInfo allocInfo = {
-      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-      .pNext = VK_NULL_HANDLE,
-      .descriptorPool = appCtx.trisCtx.descriptorPool,
-      .descriptorSetCount = 0u,
-      .pSetLayouts = VK_NULL_HANDLE
-
-  };
-
-  appCtx.trisCtx.descriptorSets.resize(SwapChain::MAX_SWAPCHAIN_FRAMES);
-  VK_CHECK(vkAllocateDescriptorSets(appCtx.vkCtx.device, &allocInfo,
-                                    appCtx.trisCtx.descriptorSets.data()),
-           "Failed to allocate descriptors");
-*/
-    // create pipeline layout
-    VkPipelineLayoutCreateInfo pipLayoutCI = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-        .pNext = VK_NULL_HANDLE,
-        .flags = 0u,
-        .setLayoutCount = 0u,
-        .pSetLayouts = VK_NULL_HANDLE,
-        .pushConstantRangeCount = 0u,
-        .pPushConstantRanges = VK_NULL_HANDLE
+    // descriptor set layouts and pipeline layout come from shader reflection, see registerShader
+
+    VkPipelineCacheCreateInfo pipCacheCI = {VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
+    VK_CHECK(vkCreatePipelineCache(appCtx.vkCtx.device, &pipCacheCI, nullptr, &appCtx.modelCtx.pipelineCache),
+             "Failed to create pipeline cache object");
+
+    // shader independent library part compiles while slang is busy with the shader,
+    // vertex input depends on what the shader reads and has to wait for reflection
+    std::vector<std::future<VkPipeline>> prewarm{};
+    if (appCtx.vkCtx.graphicsPipelineLibrary && !appCtx.options.shaderObjects) {
+        auto state = makePipelineState(appCtx, 0u);
+        prewarm.push_back(compilePipelineAsync(appCtx, [&appCtx, partKey = pipelineLibraryKey(state,
+                                                        VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT)] {
+            return getOrCreatePipeline(appCtx, partKey);
+        }));
+    }
+
+    appCtx.modelCtx.shaderKey = {
+        .modulePath = "shader/tris.slang",
+        .linkTimeConstants = {{"bool", "kVertexColor", "false"}},
+        .genericArgs = {"FlatShading"}
     };
-    VK_CHECK(vkCreatePipelineLayout(appCtx.vkCtx.device, &pipLayoutCI, nullptr, &appCtx.modelCtx.piplineLayout),
-             "Failed to create pipeline layout");
+    uint64_t shaderVariant = loadShader(appCtx, appCtx.modelCtx.shaderKey);
+    ShaderVariant shader = findShaderVariant(appCtx, shaderVariant);
+    appCtx.modelCtx.assetPath = appCtx.options.modelPath;
+    requestModel(appCtx, {.path = appCtx.modelCtx.assetPath, .vertexLayout = shader.vertexLayout});
+    useShaderVariant(appCtx, shaderVariant);
+
+    // placeholder is uploaded right away so the first frame has something to draw
+    createGeometryArena(appCtx);
+    ModelData placeholder = makePlaceholderModel(shader.vertexLayout);
+    ModelGeometry placeholderGeometry{};
+    if (!allocateModelGeometry(appCtx, placeholder, placeholderGeometry)) {
+        RT_THROW("Geometry arena can't hold the placeholder");
+    }
+    GPUBuffer placeholderBuffer = createModelBuffer(appCtx, placeholder);
+    TransientBuffer *staging = allocateTransientBuffer(appCtx.vkCtx, placeholder.data.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    memcpy(staging->mapped, placeholder.data.data(), placeholder.data.size());
+    VK_CHECK(vmaFlushAllocation(appCtx.vkCtx.allocator, staging->allocation, 0u, VK_WHOLE_SIZE), "Failed to flush placeholder");
+    VkCommandBuffer cmd = beginSingleTimeCommands(appCtx.vkCtx);
+    recordModelCopies(appCtx, cmd, placeholder, placeholderGeometry, placeholderBuffer.buffer, staging->buffer, 0u, 0u, placeholder.data.size());
+    endSingleTimeCommands(appCtx.vkCtx, cmd);
+    publishModel(appCtx, placeholder, placeholderBuffer, placeholderGeometry);
+
+    resolveScenePipelines(appCtx);
+    createOcclusionCulling(appCtx);
+    for (auto &part : prewarm) {
+        part.get();
+    }
+}
 
-    std::vector<VkDynamicState> dynamicStates = {
-        VK_DYNAMIC_STATE_VIEWPORT,
-        VK_DYNAMIC_STATE_SCISSOR
+// runs on the hot-reload worker thread, never touches state used by draw() except pendingShaderVariant
+void rebuildPipeline(AppContext &appCtx) {
+    auto start = std::chrono::steady_clock::now();
+    auto &shaderKey = appCtx.modelCtx.shaderKey;
+
+    // pipeline goes into the cache here, draw() only switches to the new variant at frame boundary. Nothing may
+    // escape this thread, an exception here would terminate the application
+    try {
+        invalidateShaderModules(appCtx);
+        std::string diagnostics;
+        uint64_t variant = getShaderVariant(appCtx, shaderKey, diagnostics);
+        if (variant == 0u) {
+            std::cerr << std::format("[HotReload] {} failed to compile, keeping current pipeline:\n{}",
+                                     shaderKey.modulePath, diagnostics) << std::endl;
+            return;
+        }
+        if (!appCtx.options.shaderObjects) {
+            PipelineStateKey base = makePipelineState(appCtx, variant);
+            for (auto &state : makeDrawStates(appCtx, base)) {
+                getOrCreatePipeline(appCtx, state);
+            }
+            if (appCtx.options.depthPrepass) {
+                getOrCreatePipeline(appCtx, makePrepassState(base));
+            }
+        }
+        // a variant still pending was never drawn with
+        if (uint64_t stale = appCtx.modelCtx.pendingShaderVariant.exchange(variant); stale != variant) {
+            retireShaderVariant(appCtx, stale);
+        }
+    } catch (std::exception &e) {
+        std::cerr << std::format("[HotReload] {}", e.what()) << std::endl;
+        return;
+    }
+
+    auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << std::format("[HotReload] rebuilt pipeline from {} in {:.1f} ms", shaderKey.modulePath, ms) << std::endl;
+}
+
+void shaderWatchLoop(AppContext &appCtx) {
+    auto &hotReload = appCtx.hotReload;
+    alignas(inotify_event) std::array<char, 4096> eventBuffer{};
+
+    auto readEvents = [&]() -> bool {
+        bool shaderChanged = false;
+        ssize_t len = 0;
+        while ((len = read(hotReload.inotifyFd, eventBuffer.data(), eventBuffer.size())) > 0) {
+            for (char *ptr = eventBuffer.data(); ptr < eventBuffer.data() + len;) {
+                auto *event = reinterpret_cast<const inotify_event *>(ptr);
+                if (event->len > 0 && std::string_view(event->name).ends_with(".slang")) {
+                    shaderChanged = true;
+                }
+                ptr += sizeof(inotify_event) + event->len;
+            }
+        }
+        return shaderChanged;
+    };
+
+    while (hotReload.running) {
+        pollfd pfd {.fd = hotReload.inotifyFd, .events = POLLIN, .revents = 0};
+        if (poll(&pfd, 1u, 100) <= 0 || !readEvents()) {
+            continue;
+        }
+        // editors emit several events per save, let them settle before compiling
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        readEvents();
+        rebuildPipeline(appCtx);
+    }
+}
+
+void startShaderHotReload(AppContext &appCtx) {
+    auto &hotReload = appCtx.hotReload;
+    hotReload.inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (hotReload.inotifyFd < 0) {
+        std::cerr << "[HotReload] inotify not available, shader hot-reload disabled" << std::endl;
+        return;
+    }
+    if (inotify_add_watch(hotReload.inotifyFd, hotReload.shaderDir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        std::cerr << std::format("[HotReload] failed to watch {}, shader hot-reload disabled", hotReload.shaderDir) << std::endl;
+        close(hotReload.inotifyFd);
+        hotReload.inotifyFd = -1;
+        return;
+    }
+
+    hotReload.running = true;
+    hotReload.worker = std::thread(shaderWatchLoop, std::ref(appCtx));
+}
+
+void stopShaderHotReload(AppContext &appCtx) {
+    auto &hotReload = appCtx.hotReload;
+    hotReload.running = false;
+    if (hotReload.worker.joinable()) {
+        hotReload.worker.join();
+    }
+    if (hotReload.inotifyFd >= 0) {
+        close(hotReload.inotifyFd);
+        hotReload.inotifyFd = -1;
+    }
+}
+
+// copies a range of a device local buffer to the host, waits for the queue
+std::vector<std::byte> readBackBuffer(AppContext &appCtx, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size) {
+    GPUBuffer readback {.size = size};
+    VkBufferCreateInfo buffCI {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = size, .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT};
+    VmaAllocationCreateInfo buffAllocCI {.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                                         .usage = VMA_MEMORY_USAGE_AUTO};
+    VmaAllocationInfo allocInfo{};
+    VK_CHECK(vmaCreateBuffer(appCtx.vkCtx.allocator, &buffCI, &buffAllocCI, &readback.buffer, &readback.bufferAllocation, &allocInfo),
+             "Failed to create readback buffer");
+
+    VkCommandBuffer cmd = beginSingleTimeCommands(appCtx.vkCtx);
+    VkMemoryBarrier2 readBarrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+        .srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+        .srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT,
+        .dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+        .dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT
+    };
+    VkDependencyInfo readDepsInfo {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .memoryBarrierCount = 1u, .pMemoryBarriers = &readBarrier};
+    vkCmdPipelineBarrier2(cmd, &readDepsInfo);
+    VkBufferCopy region {.srcOffset = offset, .dstOffset = 0u, .size = size};
+    vkCmdCopyBuffer(cmd, buffer, readback.buffer, 1u, &region);
+    VkMemoryBarrier2 hostBarrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+        .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+        .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        .dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
+        .dstAccessMask = VK_ACCESS_2_HOST_READ_BIT
+    };
+    VkDependencyInfo hostDepsInfo {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .memoryBarrierCount = 1u, .pMemoryBarriers = &hostBarrier};
+    vkCmdPipelineBarrier2(cmd, &hostDepsInfo);
+    endSingleTimeCommands(appCtx.vkCtx, cmd);
+
+    VK_CHECK(vmaInvalidateAllocation(appCtx.vkCtx.allocator, readback.bufferAllocation, 0u, VK_WHOLE_SIZE), "Failed to invalidate readback");
+    auto *mapped = static_cast<const std::byte*>(allocInfo.pMappedData);
+    std::vector<std::byte> data(mapped, mapped + size);
+    vmaDestroyBuffer(appCtx.vkCtx.allocator, readback.buffer, readback.bufferAllocation);
+    return data;
+}
+
+template <typename... Fields>
+void captureRecord(CommandCapture &capture, CaptureOp op, const Fields &...fields) {
+    capturePut(capture.stream, op);
+    (capturePut(capture.stream, fields), ...);
+}
+
+// the buffer with the given ranges of its current contents, size only has to cover the ranges
+uint32_t captureBuffer(AppContext &appCtx, VkBuffer buffer, VkDeviceSize size, VkBufferUsageFlags usage,
+                       std::initializer_list<std::pair<VkDeviceSize, VkDeviceSize>> ranges) {
+    auto &capture = appCtx.capture;
+    uint32_t id = capture.nextId++;
+    capture.buffers[buffer] = id;
+    captureRecord(capture, CaptureOp::CreateBuffer, id, size, usage);
+    for (auto [offset, rangeSize] : ranges) {
+        std::vector<std::byte> data = readBackBuffer(appCtx, buffer, offset, rangeSize);
+        captureRecord(capture, CaptureOp::UploadBuffer, id, offset);
+        capturePutArray(capture.stream, std::span<const std::byte>(data));
+    }
+    return id;
+}
+
+uint32_t captureShader(AppContext &appCtx, uint64_t shaderVariant) {
+    auto &capture = appCtx.capture;
+    if (auto it = capture.shaders.find(shaderVariant); it != capture.shaders.end()) {
+        return it->second;
+    }
+    uint32_t id = capture.nextId++;
+    capture.shaders[shaderVariant] = id;
+    const CompiledShader &compiled = *findShaderVariant(appCtx, shaderVariant).compiled;
+    captureRecord(capture, CaptureOp::CreateShader, id);
+    capturePutArray(capture.stream, std::span<const uint32_t>(compiled.spirv));
+    capturePutString(capture.stream, compiled.vertexEntry);
+    capturePutString(capture.stream, compiled.fragmentEntry);
+    capturePutArray(capture.stream, std::span<const VkSpecializationMapEntry>(compiled.specializationEntries));
+    capturePutArray(capture.stream, std::span<const uint32_t>(compiled.specializationData));
+    capturePut(capture.stream, compiled.reflection.pushConstantSize);
+    capturePut(capture.stream, uint32_t(compiled.reflection.descriptorSets.size()));
+    for (auto &set : compiled.reflection.descriptorSets) {
+        std::vector<CaptureSetLayoutBinding> bindings{};
+        for (auto &binding : set.bindings) {
+            bindings.push_back({binding.binding, binding.descriptorType, binding.descriptorCount, binding.stageFlags});
+        }
+        capturePut(capture.stream, set.set);
+        capturePutArray(capture.stream, std::span<const CaptureSetLayoutBinding>(bindings));
+    }
+    return id;
+}
+
+uint32_t capturePipeline(AppContext &appCtx, const PipelineStateKey &key) {
+    auto &capture = appCtx.capture;
+    if (auto it = capture.pipelines.find(key); it != capture.pipelines.end()) {
+        return it->second;
+    }
+    uint32_t shader = captureShader(appCtx, key.shaderVariant);
+    uint32_t id = capture.nextId++;
+    capture.pipelines[key] = id;
+    CapturePipelineState state {
+        .vertexStride = key.vertexStride,
+        .vertexAttributeCount = key.vertexAttributeCount,
+        .colorAttachmentCount = key.colorAttachmentCount,
+        .colorFormats = key.colorFormats,
+        .depthFormat = key.depthFormat,
+        .stencilFormat = key.stencilFormat,
+        .samples = key.samples,
+        .topology = key.topology,
+        .polygonMode = key.polygonMode,
+        .cullMode = key.cullMode,
+        .frontFace = key.frontFace,
+        .depthTestEnable = key.depthTestEnable,
+        .depthWriteEnable = key.depthWriteEnable,
+        .depthCompareOp = key.depthCompareOp,
+        .depthOnly = key.depthOnly,
+        .blend = {key.blendEnable, key.srcColorBlendFactor, key.dstColorBlendFactor, key.colorBlendOp,
+                  key.srcAlphaBlendFactor, key.dstAlphaBlendFactor, key.alphaBlendOp, key.colorWriteMask}
+    };
+    for (uint32_t i = 0u; i < key.vertexAttributeCount; ++i) {
+        state.vertexAttributes[i] = {key.vertexAttributes[i].location, 0u, key.vertexAttributes[i].format, key.vertexAttributes[i].offset};
+    }
+    captureRecord(capture, CaptureOp::CreatePipeline, id, shader, state);
+    return id;
+}
+
+uint32_t captureDescriptorSet(AppContext &appCtx) {
+    auto &capture = appCtx.capture;
+    auto &model = appCtx.modelCtx;
+    if (auto it = capture.descriptorSets.find(model.descriptorSet); it != capture.descriptorSets.end()) {
+        return it->second;
+    }
+    uint32_t shader = captureShader(appCtx, model.pipelineState.shaderVariant);
+    uint32_t storage = capture.buffers.at(model.gpuBuffer.buffer);
+    uint32_t id = capture.nextId++;
+    capture.descriptorSets[model.descriptorSet] = id;
+    VkDeviceSize instanceOffset = model.drawn.instanceOffset - model.drawn.materialOffset;
+    std::array<CaptureDescriptorWrite, 2> writes {
+        CaptureDescriptorWrite{.binding = 0u, .buffer = storage, .offset = 0u, .range = instanceOffset},
+        CaptureDescriptorWrite{.binding = 1u, .buffer = storage, .offset = instanceOffset, .range = VK_WHOLE_SIZE}
+    };
+    captureRecord(capture, CaptureOp::CreateDescriptorSet, id, shader, uint32_t(0u));
+    capturePutArray(capture.stream, std::span<const CaptureDescriptorWrite>(writes));
+    return id;
+}
+
+// frame boundary: once the streamed model is drawn, snapshots the geometry and storage it reads and starts recording
+void startCommandCapture(AppContext &appCtx) {
+    auto &capture = appCtx.capture;
+    auto &model = appCtx.modelCtx;
+    if (appCtx.options.capturePath.empty() || capture.active || capture.framesCaptured > 0u || model.drawn.path != model.assetPath) {
+        return;
+    }
+    VkDeviceSize vertexEnd = model.geometry.vertexByteOffset + model.drawn.indexOffset;
+    VkDeviceSize indexEnd = (VkDeviceSize(model.geometry.firstIndex) + model.drawn.indexCount) * sizeof(uint32_t);
+    captureBuffer(appCtx, geometryVertexBuffer(model.arena, model.geometry), vertexEnd, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                  {{model.geometry.vertexByteOffset, model.drawn.indexOffset}});
+    captureBuffer(appCtx, geometryIndexBuffer(model.arena, model.geometry), indexEnd, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                  {{VkDeviceSize(model.geometry.firstIndex) * sizeof(uint32_t), VkDeviceSize(model.drawn.indexCount) * sizeof(uint32_t)}});
+    captureBuffer(appCtx, model.gpuBuffer.buffer, model.gpuBuffer.size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, {{0u, model.gpuBuffer.size}});
+    capture.active = true;
+    std::cout << std::format("[Capture] recording {} frames of {}", appCtx.options.captureFrames, model.drawn.path) << std::endl;
+}
 
-    };
-    VkPipelineDynamicStateCreateInfo dynamicStateCI = {VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO};
-    dynamicStateCI.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-    dynamicStateCI.pDynamicStates = dynamicStates.data();
+// after a captured frame was recorded, writes the file and closes the window once all frames are in
+void finishCapturedFrame(AppContext &appCtx) {
+    auto &capture = appCtx.capture;
+    if (++capture.framesCaptured < appCtx.options.captureFrames) {
+        return;
+    }
+    capture.active = false;
+    capturePut(capture.stream, CaptureOp::End);
+    std::vector<std::byte> file{};
+    capturePut(file, CaptureHeader{.frameCount = capture.framesCaptured});
+    std::ofstream out(appCtx.options.capturePath, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(file.data()), std::streamsize(file.size()));
+    out.write(reinterpret_cast<const char*>(capture.stream.data()), std::streamsize(capture.stream.size()));
+    if (!out) {
+        RT_THROW(std::format("Failed to write capture {}", appCtx.options.capturePath));
+    }
+    std::cout << std::format("[Capture] {} frames, {:.1f} KiB written to {}", capture.framesCaptured,
+                             (file.size() + capture.stream.size()) / 1024.0, appCtx.options.capturePath) << std::endl;
+    capture.stream = {};
+    requestClose(appCtx.windowCtx);
+}
 
-    VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCI{
-        VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO
-    };
-    inputAssemblyStateCI.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+// geometry, material buffer and descriptors shared by all draws of the model
+void bindSceneResources(AppContext &appCtx, VkCommandBuffer cmd) {
+    auto &model = appCtx.modelCtx;
+    // draws carry their arena offsets, every model shares these two bindings unless it has buffers of its own
+    VkBuffer vertexBuffer = geometryVertexBuffer(model.arena, model.geometry);
+    VkBuffer indexBuffer = geometryIndexBuffer(model.arena, model.geometry);
+    VkDeviceSize offsets[1]{ 0 };
+    vkCmdBindVertexBuffers(cmd, 0u, 1u, &vertexBuffer, offsets);
+    vkCmdBindIndexBuffer(cmd, indexBuffer, 0u, VK_INDEX_TYPE_UINT32);
+    if (model.descriptorSet != VK_NULL_HANDLE) {
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, model.piplineLayout, 0u, 1u,
+                                &model.descriptorSet, 0u, nullptr);
+    }
+    if (auto &capture = appCtx.capture; capture.active) {
+        captureRecord(capture, CaptureOp::BindVertexBuffer, capture.buffers.at(vertexBuffer), VkDeviceSize(0u));
+        captureRecord(capture, CaptureOp::BindIndexBuffer, capture.buffers.at(indexBuffer), VkDeviceSize(0u));
+        if (model.descriptorSet != VK_NULL_HANDLE) {
+            uint32_t descriptorSet = captureDescriptorSet(appCtx);
+            captureRecord(capture, CaptureOp::BindDescriptorSet, captureShader(appCtx, model.pipelineState.shaderVariant), uint32_t(0u),
+                          descriptorSet);
+        }
+    }
+}
 
-    // Rasterization state
-    VkPipelineRasterizationStateCreateInfo rasterizationStateCI{
-        VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO
-    };
-    rasterizationStateCI.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizationStateCI.cullMode = VK_CULL_MODE_NONE;
-    rasterizationStateCI.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-    rasterizationStateCI.depthClampEnable = VK_FALSE;
-    rasterizationStateCI.rasterizerDiscardEnable = VK_FALSE;
-    rasterizationStateCI.depthBiasEnable = VK_FALSE;
-    rasterizationStateCI.lineWidth = 1.0f;
+void pushMaterial(AppContext &appCtx, VkCommandBuffer cmd, uint32_t material) {
+    if (appCtx.modelCtx.pushConstantSize >= sizeof(material)) {
+        vkCmdPushConstants(cmd, appCtx.modelCtx.piplineLayout, VK_SHADER_STAGE_ALL_GRAPHICS, 0u, sizeof(material), &material);
+        if (auto &capture = appCtx.capture; capture.active) {
+            captureRecord(capture, CaptureOp::PushConstants, captureShader(appCtx, appCtx.modelCtx.pipelineState.shaderVariant));
+            capturePutArray(capture.stream, std::span<const uint32_t>(&material, 1u));
+        }
+    }
+}
 
-    // Color blend state describes how blend factors are calculated (if used)
-    // We need one blend attachment state per color attachment (even if blending is not used)
-    VkPipelineColorBlendAttachmentState blendAttachmentState{};
-    blendAttachmentState.colorWriteMask = 0xf;
-    blendAttachmentState.blendEnable = VK_FALSE;
-    VkPipelineColorBlendStateCreateInfo colorBlendStateCI{VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO};
-    colorBlendStateCI.attachmentCount = 1;
-    colorBlendStateCI.pAttachments = &blendAttachmentState;
+// culled draws take their instance counts from the phase's indirect commands and read the compacted instances.
+// Blended draws wait for phase 1 and draw the instances of both phases there, so they stay behind every opaque draw
+// and in their back to front order. The depth pre-pass draws only the opaque group, with the depth only pipeline and
+// no material
+void renderScene(AppContext &appCtx, bool culled = false, uint32_t phase = 0u, bool prepass = false) {
 
-    // Viewport state sets the number of viewports and scissor used in this pipeline
-    // Note: This is actually overridden by the dynamic states (see below)
-    VkPipelineViewportStateCreateInfo viewportStateCI{VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO};
-    viewportStateCI.viewportCount = 1;
-    viewportStateCI.scissorCount = 1;
+        auto &cmd = appCtx.vkCtx.commandBuffers[appCtx.vkCtx.swapchain.currentFrame];
+        auto &model = appCtx.modelCtx;
+        auto &culling = appCtx.culling;
 
-    auto vBindingins = Vertex::bindingDesc();
-    auto vAttribs = Vertex::attributeDescriptions();
-    VkPipelineVertexInputStateCreateInfo pipVertInputCI = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-        .pNext = VK_NULL_HANDLE,
-        .flags = 0u,
-        .vertexBindingDescriptionCount = 1u,
-        .pVertexBindingDescriptions = &vBindingins,
-        .vertexAttributeDescriptionCount = static_cast<uint32_t>(vAttribs.size()),
-        .pVertexAttributeDescriptions = vAttribs.data()
-    };
-    auto shader = loadShader(appCtx, "shader/tris.slang");
+        bindSceneResources(appCtx, cmd);
+        if (culled) {
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, model.piplineLayout, 0u, 1u,
+                                    &culling.culledDescriptorSet, 0u, nullptr);
+        }
+        if (appCtx.options.shaderObjects) {
+            bindShaderObjects(appCtx, cmd, prepass ? std::array<VkShaderEXT, 2>{model.shaderObjects[0], VK_NULL_HANDLE}
+                                                   : model.shaderObjects);
+        }
 
-    std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages{};
-    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaderStages[0].pNext = VK_NULL_HANDLE;
-    shaderStages[0].flags = 0u;
-    shaderStages[0].pName = "main";
-    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-    shaderStages[0].pSpecializationInfo = VK_NULL_HANDLE;
-    shaderStages[0].module = shader;
+        // draws are sorted, state and material only change between groups
+        uint32_t state = std::numeric_limits<uint32_t>::max();
+        uint32_t material = std::numeric_limits<uint32_t>::max();
+        for (uint32_t d = 0u; d < model.drawn.draws.size(); ++d) {
+            auto &draw = model.drawn.draws[d];
+            if (prepass && draw.state != 0u) {
+                continue; // blended draws neither write depth nor go through the EQUAL test
+            }
+            if (culled && phase == 0u && draw.state != 0u) {
+                continue;
+            }
+            if (draw.state != state) {
+                state = draw.state;
+                const PipelineStateKey &key = prepass ? model.prepassState : model.drawStates[state];
+                if (appCtx.options.shaderObjects) {
+                    setShaderObjectState(appCtx, cmd, key, appCtx.resolution.extent);
+                } else {
+                    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, prepass ? model.prepassPipeline : model.drawPipelines[state]);
+                }
+                if (appCtx.capture.active) {
+                    uint32_t pipeline = capturePipeline(appCtx, key);
+                    captureRecord(appCtx.capture, CaptureOp::BindPipeline, pipeline);
+                }
+            }
+            if (draw.material != material && !prepass) {
+                material = draw.material;
+                pushMaterial(appCtx, cmd, material);
+            }
+            if (culled) {
+                for (uint32_t commandPhase = draw.state != 0u ? 0u : phase; commandPhase <= phase; ++commandPhase) {
+                    VkDeviceSize command = VkDeviceSize(commandPhase) * culling.drawCount + d;
+                    vkCmdDrawIndexedIndirect(cmd, culling.commands.buffer, command * sizeof(VkDrawIndexedIndirectCommand), 1u,
+                                             sizeof(VkDrawIndexedIndirectCommand));
+                }
+                continue;
+            }
+            vkCmdDrawIndexed(cmd, draw.indexCount, draw.instanceCount, draw.firstIndex, draw.vertexOffset, draw.firstInstance);
+            if (appCtx.capture.active) {
+                captureRecord(appCtx.capture, CaptureOp::DrawIndexed,
+                              CaptureDrawIndexed{draw.indexCount, draw.instanceCount, draw.firstIndex, draw.vertexOffset, draw.firstInstance});
+            }
+        }
 
-    shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaderStages[1].pNext = VK_NULL_HANDLE;
-    shaderStages[1].flags = 0u;
-    shaderStages[1].pName = "main";
-    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    shaderStages[1].pSpecializationInfo = VK_NULL_HANDLE;
-    shaderStages[1].module = shader;
+}
 
-    VkPipelineRenderingCreateInfo pipRenderingCI = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
-        .pNext = VK_NULL_HANDLE,
-        .colorAttachmentCount = 1u,
-        .pColorAttachmentFormats = &appCtx.vkCtx.swapchain.colorFormat,
-        .depthAttachmentFormat = VK_FORMAT_UNDEFINED,
-        .stencilAttachmentFormat = VK_FORMAT_UNDEFINED
-    };
+// startup phases are timed back to back, each mark ends the phase that started at the previous one
+void markStartupPhase(AppContext &appCtx, std::string name) {
+    auto &profiler = appCtx.profiler;
+    auto now = std::chrono::steady_clock::now();
+    profiler.startupMs.emplace_back(std::move(name), std::chrono::duration<double, std::milli>(now - profiler.lastMark).count());
+    profiler.lastMark = now;
+}
 
-    VkPipelineMultisampleStateCreateInfo mulisampleCI = {VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO};
-    mulisampleCI.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-    VkPipelineDepthStencilStateCreateInfo depthStencilStateCI {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
-        .depthTestEnable = VK_TRUE,
-        .depthWriteEnable = VK_TRUE,
-        .depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL
+// created by the benchmark and by dynamic resolution, whichever comes first
+void createFrameTimestamps(AppContext &appCtx) {
+    if (appCtx.profiler.queryPool != VK_NULL_HANDLE) {
+        return;
+    }
+    uint32_t familyCount = {0u};
+    vkGetPhysicalDeviceQueueFamilyProperties(appCtx.vkCtx.physicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(appCtx.vkCtx.physicalDevice, &familyCount, families.data());
+    if (families[appCtx.vkCtx.graphicsQueue.idx.value()].timestampValidBits == 0u) {
+        std::cout << "[Bench] graphics queue has no timestamps, GPU frame times are not reported" << std::endl;
+        return;
+    }
+    VkQueryPoolCreateInfo queryPoolCI {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = FrameProfiler::FRAME_QUERIES * SwapChain::MAX_SWAPCHAIN_FRAMES
     };
+    VK_CHECK(vkCreateQueryPool(appCtx.vkCtx.device, &queryPoolCI, nullptr, &appCtx.profiler.queryPool), "Failed to create query pool");
+}
 
-    VkGraphicsPipelineCreateInfo pipelineInfo = {
-        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-        .pNext = &pipRenderingCI,
-        .flags = 0u,
-        .stageCount = static_cast<uint32_t>(shaderStages.size()),
-        .pStages = shaderStages.data(),
-        .pVertexInputState = &pipVertInputCI,
-        .pInputAssemblyState = &inputAssemblyStateCI,
-        .pTessellationState = VK_NULL_HANDLE,
-        .pViewportState = &viewportStateCI,
-        .pRasterizationState = &rasterizationStateCI,
-        .pMultisampleState = &mulisampleCI,
-        .pDepthStencilState = &depthStencilStateCI,
-        .pColorBlendState = &colorBlendStateCI,
-        .pDynamicState = &dynamicStateCI,
-        .layout = appCtx.modelCtx.piplineLayout,
-        .renderPass = VK_NULL_HANDLE,
-        .subpass = 0u,
-        .basePipelineHandle = VK_NULL_HANDLE,
-        .basePipelineIndex = 0u
+// query 0 at the start of a measured frame's commands, 1 at the end. 2 and 3 wait for all work recorded before them,
+// so the span between them holds the scene passes only and none of the uploads or the phase 0 cull ahead of them
+void writeFrameTimestamp(AppContext &appCtx, VkCommandBuffer cmd, uint32_t frame, uint32_t query) {
+    auto &profiler = appCtx.profiler;
+    if (profiler.queryPool == VK_NULL_HANDLE || (!profiler.measuring && !appCtx.resolution.enabled)) {
+        return;
+    }
+    uint32_t first = FrameProfiler::FRAME_QUERIES * frame;
+    if (query == 0u) {
+        vkCmdResetQueryPool(cmd, profiler.queryPool, first, FrameProfiler::FRAME_QUERIES);
+        vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, profiler.queryPool, first);
+        profiler.pending[frame] = true;
+        profiler.measured[frame] = profiler.measuring;
+    } else {
+        VkPipelineStageFlags2 stage = query == 1u ? VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        vkCmdWriteTimestamp2(cmd, stage, profiler.queryPool, first + query);
+    }
+}
+
+// rounded to 8 pixels, so the scene target isn't resized for changes nobody would see
+VkExtent2D scaledExtent(const AppContext &appCtx, float scale) {
+    auto &maxExtent = appCtx.resolution.maxExtent;
+    auto axis = [scale](uint32_t size, uint32_t maxSize) {
+        return std::clamp(uint32_t(std::lround(size * scale / 8.0f)) * 8u, std::min(8u, maxSize), maxSize);
     };
-    VkPipelineCacheCreateInfo pipCacheCI = {VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
-    VK_CHECK(vkCreatePipelineCache(appCtx.vkCtx.device, &pipCacheCI, nullptr, &appCtx.modelCtx.pipelineCache),
-             "Failed to create pipeline cache object");
-    VK_CHECK(vkCreateGraphicsPipelines(appCtx.vkCtx.device, appCtx.modelCtx.pipelineCache, 1u, &pipelineInfo, nullptr, &appCtx.modelCtx.pipline), "Failed to create pipeline");
+    return {axis(appCtx.vkCtx.swapchain.extent.width, maxExtent.width), axis(appCtx.vkCtx.swapchain.extent.height, maxExtent.height)};
 }
 
-void renderScene(AppContext &appCtx) {
+// scene target at the largest scale, the scene is drawn into the swapchain image directly when scaling is off
+void createDynamicResolution(AppContext &appCtx) {
+    auto &resolution = appCtx.resolution;
+    auto &vkCtx = appCtx.vkCtx;
+    auto &swapchain = vkCtx.swapchain;
+    resolution.extent = swapchain.extent;
+    if (appCtx.options.gpuBudgetMs <= 0.0f) {
+        return;
+    }
+    VkFormatProperties2 formatProps2{.sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2};
+    vkGetPhysicalDeviceFormatProperties2(vkCtx.physicalDevice, swapchain.colorFormat, &formatProps2);
+    VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                                        VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    if ((formatProps2.formatProperties.optimalTilingFeatures & blitFeatures) != blitFeatures ||
+        !(swapchain.imageUsage & VK_IMAGE_USAGE_TRANSFER_DST_BIT)) {
+        std::cerr << "[Resolution] the color format can't be blitted with linear filtering, rendering at native resolution" << std::endl;
+        return;
+    }
+    createFrameTimestamps(appCtx);
+    if (appCtx.profiler.queryPool == VK_NULL_HANDLE) {
+        std::cerr << "[Resolution] needs GPU timestamps, rendering at native resolution" << std::endl;
+        return;
+    }
 
-        auto &cmd = appCtx.vkCtx.commandBuffers[appCtx.vkCtx.swapchain.currentFrame];
+    float maxScale = appCtx.options.renderScale[1];
+    resolution.maxExtent = {std::max(1u, uint32_t(std::lround(swapchain.extent.width * maxScale))),
+                            std::max(1u, uint32_t(std::lround(swapchain.extent.height * maxScale)))};
+    VkImageCreateInfo imageCI {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = swapchain.colorFormat,
+        .extent = {resolution.maxExtent.width, resolution.maxExtent.height, 1u},
+        .mipLevels = 1u,
+        .arrayLayers = 1u,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+    };
+    VmaAllocationCreateInfo imageAllocCI = imageAllocationInfo(vkCtx, imageCI);
+    VK_CHECK(vmaCreateImage(vkCtx.allocator, &imageCI, &imageAllocCI, &resolution.image, &resolution.allocation, nullptr),
+             "Failed to create scene target");
+    VkImageViewCreateInfo viewCI {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = resolution.image,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = swapchain.colorFormat,
+        .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = 1u, .layerCount = 1u}
+    };
+    VK_CHECK(vkCreateImageView(vkCtx.device, &viewCI, nullptr, &resolution.view), "Failed to create scene target view");
+
+    resolution.scale = maxScale;
+    resolution.extent = scaledExtent(appCtx, maxScale);
+    resolution.enabled = true;
+    std::cout << std::format("[Resolution] {}x{} scene target, scale {:.2f} to {:.2f}, {:.2f} ms GPU budget", resolution.maxExtent.width,
+                             resolution.maxExtent.height, appCtx.options.renderScale[0], maxScale, appCtx.options.gpuBudgetMs)
+              << std::endl;
+}
 
-       // vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-       //                       appCtx.trisCtx.piplineLayout, 0u, 1u,
-       //                       &appCtx.trisCtx.descriptorSets[0], 0u, nullptr);
+// multisample targets as large as the scene target, the scene is drawn into their corner like with dynamic resolution
+void createMultisampleTargets(AppContext &appCtx) {
+    auto &msaa = appCtx.msaa;
+    auto &vkCtx = appCtx.vkCtx;
+    if (msaa.samples == VK_SAMPLE_COUNT_1_BIT) {
+        return;
+    }
+    VkExtent2D extent = appCtx.resolution.enabled ? appCtx.resolution.maxExtent : vkCtx.swapchain.extent;
+    msaa.transient = !appCtx.culling.enabled;
+    if (appCtx.culling.enabled) {
+        VkPhysicalDeviceDepthStencilResolveProperties resolveProps {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DEPTH_STENCIL_RESOLVE_PROPERTIES};
+        VkPhysicalDeviceProperties2 props2 {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &resolveProps};
+        vkGetPhysicalDeviceProperties2(vkCtx.physicalDevice, &props2);
+        // depth is reversed, the smallest sample is the farthest and keeps the pyramid conservative. Sample zero is
+        // always supported and only wrong along edges
+        msaa.depthResolve = (resolveProps.supportedDepthResolveModes & VK_RESOLVE_MODE_MIN_BIT) ? VK_RESOLVE_MODE_MIN_BIT
+                                                                                                : VK_RESOLVE_MODE_SAMPLE_ZERO_BIT;
+    }
 
-        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, appCtx.modelCtx.pipline);
+    auto createTarget = [&](VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect, VkImage &image,
+                            VmaAllocation &allocation, VkImageView &view) {
+        VkImageCreateInfo imageCI {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = format,
+            .extent = {extent.width, extent.height, 1u},
+            .mipLevels = 1u,
+            .arrayLayers = 1u,
+            .samples = msaa.samples,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = usage | (msaa.transient ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0u),
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+        };
+        VmaAllocationCreateInfo allocCI = imageAllocationInfo(vkCtx, imageCI);
+        if (msaa.transient) {
+            // dedicated, so the commitment of the memory object is the target's own
+            VmaAllocationCreateInfo lazyAllocCI {.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT,
+                                                 .usage = VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED};
+            uint32_t memoryType = {0u};
+            if (vmaFindMemoryTypeIndexForImageInfo(vkCtx.allocator, &imageCI, &lazyAllocCI, &memoryType) == VK_SUCCESS) {
+                allocCI = lazyAllocCI;
+                msaa.lazilyAllocated = true;
+            }
+        }
+        VK_CHECK(vmaCreateImage(vkCtx.allocator, &imageCI, &allocCI, &image, &allocation, nullptr), "Failed to create multisample target");
+        VmaAllocationInfo allocInfo{};
+        vmaGetAllocationInfo(vkCtx.allocator, allocation, &allocInfo);
+        msaa.attachmentBytes += allocInfo.size;
+        VkImageViewCreateInfo viewCI {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = image,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = format,
+            .subresourceRange = {.aspectMask = aspect, .levelCount = 1u, .layerCount = 1u}
+        };
+        VK_CHECK(vkCreateImageView(vkCtx.device, &viewCI, nullptr, &view), "Failed to create multisample target view");
+    };
+    createTarget(vkCtx.swapchain.colorFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT, msaa.color,
+                 msaa.colorAlloc, msaa.colorView);
+    createTarget(vkCtx.swapchain.depthBuffer.format, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT, msaa.depth,
+                 msaa.depthAlloc, msaa.depthView);
+    std::cout << std::format("[MSAA] {}x at {}x{}, {:.2f} MiB of targets{}{}", uint32_t(msaa.samples), extent.width, extent.height,
+                             msaa.attachmentBytes / 1048576.0,
+                             msaa.lazilyAllocated ? ", lazily allocated" : msaa.transient ? ", transient" : "",
+                             msaa.depthResolve == VK_RESOLVE_MODE_MIN_BIT ? ", depth resolved to the farthest sample"
+                             : msaa.depthResolve != VK_RESOLVE_MODE_NONE ? ", depth resolved from sample 0" : "")
+              << std::endl;
+}
 
-        VkDeviceSize offsets[1]{ 0 };
-        vkCmdBindVertexBuffers(cmd, 0u, 1u, &appCtx.modelCtx.gpuBuffer.buffer, offsets);
-        vkCmdBindIndexBuffer(cmd, appCtx.modelCtx.gpuBuffer.buffer, appCtx.modelCtx.gpuBuffer.vertexBufferSize, VK_INDEX_TYPE_UINT32);
+// what the device actually backs the targets with, lazily allocated memory only grows when samples leave the tile
+VkDeviceSize multisampleCommittedBytes(const AppContext &appCtx) {
+    auto &msaa = appCtx.msaa;
+    VkDeviceSize committed = {0u};
+    for (VmaAllocation allocation : {msaa.colorAlloc, msaa.depthAlloc}) {
+        if (allocation == VK_NULL_HANDLE) {
+            continue;
+        }
+        VmaAllocationInfo allocInfo{};
+        vmaGetAllocationInfo(appCtx.vkCtx.allocator, allocation, &allocInfo);
+        VkMemoryPropertyFlags memoryFlags = {0u};
+        vmaGetAllocationMemoryProperties(appCtx.vkCtx.allocator, allocation, &memoryFlags);
+        VkDeviceSize bytes = allocInfo.size;
+        if (memoryFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) {
+            vkGetDeviceMemoryCommitment(appCtx.vkCtx.device, allocInfo.deviceMemory, &bytes);
+        }
+        committed += bytes;
+    }
+    return committed;
+}
 
+// the GPU frame time is smoothed and only acted on outside a band just below the budget, so the scale doesn't flip
+// back and forth around it. Cost follows the pixel count, the scale moves by the square root of the time ratio and
+// drops faster than it recovers. Samples arrive frames in flight late, the ones recorded before a change are skipped
+void updateRenderScale(AppContext &appCtx, double gpuMs) {
+    constexpr double LOWER_BAND = {0.85}; // of the budget, the scale only grows below it
+    constexpr double SMOOTHING = {0.1};
+    auto &resolution = appCtx.resolution;
+    if (!resolution.enabled || appCtx.capture.active) {
+        return; // captured frames keep the extent they started with
+    }
+    if (resolution.settleFrames > 0u) {
+        --resolution.settleFrames;
+        return;
+    }
+    resolution.filteredMs = resolution.filteredMs == 0.0 ? gpuMs : resolution.filteredMs + (gpuMs - resolution.filteredMs) * SMOOTHING;
+    double budget = appCtx.options.gpuBudgetMs;
+    if (resolution.filteredMs <= budget && resolution.filteredMs >= budget * LOWER_BAND) {
+        return;
+    }
+    auto scale = float(resolution.scale * std::sqrt(budget * (1.0 + LOWER_BAND) * 0.5 / resolution.filteredMs));
+    scale = std::clamp(scale, resolution.scale * 0.85f, resolution.scale * 1.05f);
+    scale = std::clamp(scale, appCtx.options.renderScale[0], appCtx.options.renderScale[1]);
+    VkExtent2D extent = scaledExtent(appCtx, scale);
+    if (extent.width == resolution.extent.width && extent.height == resolution.extent.height) {
+        return;
+    }
+    resolution.scale = scale;
+    resolution.extent = extent;
+    resolution.filteredMs = 0.0;
+    resolution.settleFrames = appCtx.vkCtx.swapchain.framesInFlight;
+}
 
-       vkCmdDrawIndexed(cmd, appCtx.modelCtx.gpuBuffer.indexCount, 1u, 0u, 0u, 0u);
+// scene target corner to the whole swapchain image, which is left in TRANSFER_DST_OPTIMAL
+void recordUpscale(AppContext &appCtx, VkCommandBuffer cmd, VkImage target) {
+    auto &resolution = appCtx.resolution;
+    VkExtent2D targetExtent = appCtx.vkCtx.swapchain.extent;
+    std::array<VkImageMemoryBarrier2, 2> barriers {
+        VkImageMemoryBarrier2{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_BLIT_BIT,
+            .dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
+            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            .image = resolution.image,
+            .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u}},
+        // chains to the acquire semaphore wait, which is at the color attachment stage
+        VkImageMemoryBarrier2{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .srcAccessMask = 0u,
+            .dstStageMask = VK_PIPELINE_STAGE_2_BLIT_BIT,
+            .dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            .image = target,
+            .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u}}
+    };
+    VkDependencyInfo depsInfo {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .imageMemoryBarrierCount = uint32_t(barriers.size()),
+                               .pImageMemoryBarriers = barriers.data()};
+    vkCmdPipelineBarrier2(cmd, &depsInfo);
+
+    VkImageBlit2 region {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2,
+        .srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0u, 0u, 1u},
+        .srcOffsets = {VkOffset3D{0, 0, 0}, VkOffset3D{int32_t(resolution.extent.width), int32_t(resolution.extent.height), 1}},
+        .dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0u, 0u, 1u},
+        .dstOffsets = {VkOffset3D{0, 0, 0}, VkOffset3D{int32_t(targetExtent.width), int32_t(targetExtent.height), 1}}
+    };
+    VkBlitImageInfo2 blitInfo {
+        .sType = VK_STRUCTURE_TYPE_BLIT_IMAGE_INFO_2,
+        .srcImage = resolution.image,
+        .srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        .dstImage = target,
+        .dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .regionCount = 1u,
+        .pRegions = &region,
+        .filter = VK_FILTER_LINEAR
+    };
+    vkCmdBlitImage2(cmd, &blitInfo);
+}
 
+// after the frame's fence, so the results are available
+void readFrameTimestamps(AppContext &appCtx, uint32_t frame) {
+    auto &profiler = appCtx.profiler;
+    if (!std::exchange(profiler.pending[frame], false)) {
+        return;
+    }
+    std::array<uint64_t, FrameProfiler::FRAME_QUERIES> timestamps{};
+    VK_CHECK(vkGetQueryPoolResults(appCtx.vkCtx.device, profiler.queryPool, FrameProfiler::FRAME_QUERIES * frame,
+                                   FrameProfiler::FRAME_QUERIES, sizeof(timestamps), timestamps.data(), sizeof(uint64_t),
+                                   VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT),
+             "Failed to read frame timestamps");
+    double period = appCtx.vkCtx.properties.limits.timestampPeriod / 1e6;
+    double gpuMs = double(timestamps[1] - timestamps[0]) * period;
+    if (std::exchange(profiler.measured[frame], false)) {
+        profiler.gpuFrameMs.push_back(gpuMs);
+        profiler.scenePassMs.push_back(double(timestamps[3] - timestamps[2]) * period);
+    }
+    updateRenderScale(appCtx, gpuMs);
 }
 
 void draw(AppContext &appCtx) {
+    processWindowEvents(appCtx);
     auto &currentFrame = appCtx.vkCtx.swapchain.currentFrame;
+    auto fenceWaitStart = std::chrono::steady_clock::now();
     vkWaitForFences(appCtx.vkCtx.device, 1u,
                     &appCtx.vkCtx.waitFences[currentFrame], VK_TRUE,
                     std::numeric_limits<uint64_t>::max());
+    appCtx.profiler.fenceWaitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - fenceWaitStart).count();
+    readFrameTimestamps(appCtx, currentFrame);
 
     VK_CHECK(vkResetFences(appCtx.vkCtx.device, 1u,
                  &appCtx.vkCtx.waitFences[currentFrame]),
              "Failed to reset fence");
 
-    uint32_t imageIdx = {0u};
-    auto res = vkAcquireNextImageKHR(
-        appCtx.vkCtx.device, appCtx.vkCtx.swapchain.swapchainHandle,
-        std::numeric_limits<uint64_t>::max(),
-        appCtx.vkCtx.presentSemaphores[currentFrame], VK_NULL_HANDLE, &imageIdx);
+    // frame boundary - pick up hot-reloaded shader and streamed models, resolve pipelines and release what no frame uses anymore
+    // the scene stays as it is while a capture is recorded
+    bool sceneFrozen = appCtx.capture.active;
+    runMainThreadJobs(appCtx.jobs); // streamed models decoded since the last frame
+    if (uint64_t variant = sceneFrozen ? 0u : appCtx.modelCtx.pendingShaderVariant.exchange(0u); variant != 0u) {
+        auto &model = appCtx.modelCtx;
+        if (model.waitingShaderVariant != variant) {
+            retireShaderVariant(appCtx, model.waitingShaderVariant); // superseded before its model arrived
+        }
+        if (VertexLayout layout = shaderVertexLayout(appCtx, variant); layout == model.drawn.vertexLayout) {
+            useShaderVariant(appCtx, variant);
+            model.waitingShaderVariant = 0u;
+        } else if (publishResidentModel(appCtx, model.assetPath, variant)) {
+            model.waitingShaderVariant = 0u;
+        } else {
+            // the edited shader reads other attributes, keep the current one until the repacked model is resident
+            model.waitingShaderVariant = variant;
+            requestModel(appCtx, {.path = model.assetPath, .vertexLayout = layout});
+        }
+    }
+    if (!sceneFrozen) {
+        publishStreamedModels(appCtx);
+    }
+    releaseTransientBuffers(appCtx.vkCtx);
+    updateMemoryBudget(appCtx);
+    if (!sceneFrozen) {
+        updateDefragmentation(appCtx);
+    }
+    resolveScenePipelines(appCtx);
+    collectBackgroundLinks(appCtx);
+    collectRetiredPipelines(appCtx);
+    collectRetiredShaderVariants(appCtx);
+    collectRetiredModels(appCtx);
+    startCommandCapture(appCtx);
+
+    // headless targets are used round robin, one per frame in flight
+    uint32_t imageIdx = {currentFrame};
+    VkResult res = VK_SUCCESS;
+    if (!appCtx.options.headless) {
+        res = vkAcquireNextImageKHR(
+            appCtx.vkCtx.device, appCtx.vkCtx.swapchain.swapchainHandle,
+            std::numeric_limits<uint64_t>::max(),
+            appCtx.vkCtx.presentSemaphores[currentFrame], VK_NULL_HANDLE, &imageIdx);
+    }
 
     auto &cmd = appCtx.vkCtx.commandBuffers[currentFrame];
     vkResetCommandBuffer(cmd, 0u);
@@ -980,46 +5374,96 @@ void draw(AppContext &appCtx) {
     };
 
     vkBeginCommandBuffer(cmd, &cmdBegInfo);
-    // image barrier
-    std::array<VkImageMemoryBarrier2, 2> imgBarriers {
+    writeFrameTimestamp(appCtx, cmd, currentFrame, 0u);
+    bool waitForUploads = false;
+    if (separateTransferQueue(appCtx.vkCtx)) {
+        waitForUploads = submitStreamingUploads(appCtx, currentFrame);
+    } else {
+        recordStreamingUploads(appCtx, cmd);
+    }
+    if (!appCtx.capture.active) {
+        recordDefragmentationMoves(appCtx, cmd);
+    }
+    // instances visible last frame are drawn first, the others once the depth pyramid of those is built
+    bool culled = prepareOcclusionCulling(appCtx);
+    if (culled) {
+        recordCullPass(appCtx, cmd, 0u);
+    }
+    // with dynamic resolution the scene goes to the scene target and is blitted to the swapchain image at the end
+    auto &resolution = appCtx.resolution;
+    VkImage sceneImage = resolution.enabled ? resolution.image : appCtx.vkCtx.swapchain.images[imageIdx];
+    VkImageView sceneView = resolution.enabled ? resolution.view : appCtx.vkCtx.swapchain.imageViews[imageIdx];
+    VkExtent2D sceneExtent = resolution.extent;
+    // with MSAA the scene is drawn into the multisample targets and resolved into the scene image, the depth buffer is
+    // only written by the depth resolve for the pyramid
+    auto &msaa = appCtx.msaa;
+    bool multisampled = msaa.samples != VK_SAMPLE_COUNT_1_BIT;
+    VkPipelineStageFlags2 depthStages = multisampled ? VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT
+                                                     : VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+    VkAccessFlags2 depthWrite = multisampled ? VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT : VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    writeFrameTimestamp(appCtx, cmd, currentFrame, 2u);
+
+    // image barrier, the scene target was last read by the previous frame's blit
+    std::array<VkImageMemoryBarrier2, 4> imgBarriers {
         VkImageMemoryBarrier2{
             .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
             .pNext = VK_NULL_HANDLE,
-            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
             .srcAccessMask = 0u,
             .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
             .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT,
             .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
             .newLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
-            .image = appCtx.vkCtx.swapchain.images[imageIdx],
+            .image = sceneImage,
             .subresourceRange = VkImageSubresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u}}, // color attachment
         VkImageMemoryBarrier2{
             .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
             .pNext = VK_NULL_HANDLE,
-            .srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
-            .srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-            .dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
-            .dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            .srcStageMask = depthStages,
+            .srcAccessMask = depthWrite,
+            .dstStageMask = depthStages,
+            .dstAccessMask = multisampled ? depthWrite : depthWrite | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
             .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
             .newLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
             .image = appCtx.vkCtx.swapchain.depthBuffer.image,
-            .subresourceRange = VkImageSubresourceRange{VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT, 0u, 1u, 0u, 1u}} // depth attachment
+            .subresourceRange = VkImageSubresourceRange{depthAspects(appCtx.vkCtx.swapchain.depthBuffer.format), 0u, 1u, 0u, 1u}}, // depth attachment
+        VkImageMemoryBarrier2{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
+            .image = msaa.color,
+            .subresourceRange = VkImageSubresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u}}, // multisample color
+        VkImageMemoryBarrier2{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+            .srcAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+            .dstAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
+            .image = msaa.depth,
+            .subresourceRange = VkImageSubresourceRange{depthAspects(appCtx.vkCtx.swapchain.depthBuffer.format), 0u, 1u, 0u, 1u}} // multisample depth
         };
 
-        VkDependencyInfo barrierDepsInfo {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .imageMemoryBarrierCount = imgBarriers.size(), .pImageMemoryBarriers = imgBarriers.data()};
+        VkDependencyInfo barrierDepsInfo {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .imageMemoryBarrierCount = multisampled ? 4u : 2u,
+                                          .pImageMemoryBarriers = imgBarriers.data()};
         vkCmdPipelineBarrier2(cmd, &barrierDepsInfo);
 
     // rendering here
     VkRenderingAttachmentInfo colorAttachInfo = {
         .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
         .pNext = VK_NULL_HANDLE,
-        .imageView = appCtx.vkCtx.swapchain.imageViews[imageIdx],
+        .imageView = multisampled ? msaa.colorView : sceneView,
         .imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
-        .resolveMode = VK_RESOLVE_MODE_NONE,
-        .resolveImageView = VK_NULL_HANDLE,
-        .resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .resolveMode = multisampled && !culled ? VK_RESOLVE_MODE_AVERAGE_BIT : VK_RESOLVE_MODE_NONE, // culled, phase 1 resolves
+        .resolveImageView = multisampled ? sceneView : VK_NULL_HANDLE,
+        .resolveImageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
         .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .storeOp = msaa.transient ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
         .clearValue = {.color = {1.125f, 0.125f, 0.125f, 1.0f}}
 
     };
@@ -1027,14 +5471,14 @@ void draw(AppContext &appCtx) {
     VkRenderingAttachmentInfo depthAttachInfo = {
         .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
         .pNext = VK_NULL_HANDLE,
-        .imageView = appCtx.vkCtx.swapchain.depthBuffer.imageView,
+        .imageView = multisampled ? msaa.depthView : appCtx.vkCtx.swapchain.depthBuffer.imageView,
         .imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
-        .resolveMode = VK_RESOLVE_MODE_NONE,
-        .resolveImageView = VK_NULL_HANDLE,
-        .resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .resolveMode = culled ? msaa.depthResolve : VK_RESOLVE_MODE_NONE, // the pyramid reads phase 0 depth
+        .resolveImageView = multisampled ? appCtx.vkCtx.swapchain.depthBuffer.imageView : VK_NULL_HANDLE,
+        .resolveImageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
         .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-        .clearValue = {.depthStencil = {1.0f, 0}}
+        .storeOp = msaa.transient ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
+        .clearValue = {.depthStencil = {0.0f, 0}} // reversed-Z, far is 0
 
     };
 
@@ -1044,8 +5488,8 @@ void draw(AppContext &appCtx) {
         .flags = 0u,
         .renderArea = {
             0, 0,
-            appCtx.vkCtx.swapchain.extent.width,
-            appCtx.vkCtx.swapchain.extent.height
+            sceneExtent.width,
+            sceneExtent.height
         },
         .layerCount = 1u,
         .viewMask = 0u,
@@ -1057,84 +5501,507 @@ void draw(AppContext &appCtx) {
     };
 
     vkCmdBeginRendering(cmd, &renderingInfo);
+    if (auto &capture = appCtx.capture; capture.active) {
+        captureRecord(capture, CaptureOp::BeginFrame, capture.framesCaptured);
+        CaptureRendering rendering {
+            .extent = sceneExtent,
+            .colorFormat = appCtx.vkCtx.swapchain.colorFormat,
+            .depthFormat = appCtx.modelCtx.pipelineState.depthFormat,
+            .clearColor = std::to_array(colorAttachInfo.clearValue.color.float32),
+            .clearDepth = depthAttachInfo.clearValue.depthStencil.depth,
+            .samples = msaa.samples
+        };
+        captureRecord(capture, CaptureOp::BeginRendering, rendering);
+    }
     VkViewport viewport{
         0.0f,
         0.0f,
-        (float) appCtx.vkCtx.swapchain.extent.width,
-        (float) appCtx.vkCtx.swapchain.extent.height,
+        (float) sceneExtent.width,
+        (float) sceneExtent.height,
         0.0f,
         1.0f
     };
     vkCmdSetViewport(cmd, 0u, 1u, &viewport);
     VkRect2D scissor{
-        0, 0, appCtx.vkCtx.swapchain.extent.width,
-        appCtx.vkCtx.swapchain.extent.height
+        0, 0, sceneExtent.width,
+        sceneExtent.height
     };
     vkCmdSetScissor(cmd, 0u, 1u, &scissor);
-    renderScene(appCtx);
+    if (appCtx.options.depthPrepass) {
+        renderScene(appCtx, culled, 0u, true);
+    }
+    renderScene(appCtx, culled, 0u);
     vkCmdEndRendering(cmd);
+    if (appCtx.capture.active) {
+        captureRecord(appCtx.capture, CaptureOp::EndRendering);
+        captureRecord(appCtx.capture, CaptureOp::EndFrame);
+        finishCapturedFrame(appCtx);
+    }
+    if (culled) {
+        recordDepthPyramid(appCtx, cmd);
+        recordCullPass(appCtx, cmd, 1u);
+        // phase 1 loads the color and depth phase 0 stored, the pyramid pass barriers only cover the single sample
+        // depth buffer and not the color or multisample attachments
+        VkMemoryBarrier2 loadBarrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+            .srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT |
+                            VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+            .dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+                             VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+        };
+        VkDependencyInfo loadDepsInfo {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .memoryBarrierCount = 1u, .pMemoryBarriers = &loadBarrier};
+        vkCmdPipelineBarrier2(cmd, &loadDepsInfo);
+        colorAttachInfo.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        depthAttachInfo.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        colorAttachInfo.resolveMode = multisampled ? VK_RESOLVE_MODE_AVERAGE_BIT : VK_RESOLVE_MODE_NONE;
+        depthAttachInfo.resolveMode = VK_RESOLVE_MODE_NONE;
+        vkCmdBeginRendering(cmd, &renderingInfo);
+        if (appCtx.options.depthPrepass) {
+            renderScene(appCtx, true, 1u, true);
+        }
+        renderScene(appCtx, true, 1u);
+        vkCmdEndRendering(cmd);
+    }
+    writeFrameTimestamp(appCtx, cmd, currentFrame, 3u);
+
+    if (resolution.enabled) {
+        recordUpscale(appCtx, cmd, appCtx.vkCtx.swapchain.images[imageIdx]);
+    }
 
     VkImageMemoryBarrier2 barrierPresent {
         .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
         .pNext = VK_NULL_HANDLE,
-        .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        .srcStageMask = resolution.enabled ? VK_PIPELINE_STAGE_2_BLIT_BIT : VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+        .srcAccessMask = resolution.enabled ? VK_ACCESS_2_TRANSFER_WRITE_BIT : VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
         .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
         .dstAccessMask = 0u,
-        .oldLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
-        .newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        .oldLayout = resolution.enabled ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
+        .newLayout = appCtx.options.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
         .image = appCtx.vkCtx.swapchain.images[imageIdx],
         .subresourceRange = VkImageSubresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u}
     };
     VkDependencyInfo presentDepsInfo {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .imageMemoryBarrierCount =  1u, .pImageMemoryBarriers = &barrierPresent};
     vkCmdPipelineBarrier2(cmd, &presentDepsInfo);
+    writeFrameTimestamp(appCtx, cmd, currentFrame, 1u);
 
     vkEndCommandBuffer(cmd);
-    VkPipelineStageFlags waitStageMask =
-            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    std::array<VkSemaphore, 2> waitSemaphores{};
+    std::array<VkPipelineStageFlags, 2> waitStageMasks{};
+    uint32_t waitCount = 0u;
+    if (!appCtx.options.headless) {
+        waitSemaphores[waitCount] = appCtx.vkCtx.presentSemaphores[currentFrame];
+        waitStageMasks[waitCount++] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    }
+    // everything that may touch model buffers: defragmentation copies and the draws
+    if (waitForUploads) {
+        waitSemaphores[waitCount] = appCtx.vkCtx.uploadSemaphores[currentFrame];
+        waitStageMasks[waitCount++] = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+                                      VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    }
 
     VkSubmitInfo submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO};
-    submitInfo.pWaitDstStageMask = &waitStageMask;
+    submitInfo.pWaitDstStageMask = waitStageMasks.data();
     submitInfo.pCommandBuffers = &cmd;
     submitInfo.commandBufferCount = 1u;
 
-    submitInfo.pWaitSemaphores = &appCtx.vkCtx.presentSemaphores[currentFrame];
-    submitInfo.waitSemaphoreCount = 1u;
+    uint32_t semaphoreCount = appCtx.options.headless ? 0u : 1u;
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+    submitInfo.waitSemaphoreCount = waitCount;
 
     submitInfo.pSignalSemaphores =
             &appCtx.vkCtx.renderCompleteSemaphores[imageIdx];
-    submitInfo.signalSemaphoreCount = 1u;
+    submitInfo.signalSemaphoreCount = semaphoreCount;
 
     vkQueueSubmit(appCtx.vkCtx.graphicsQueue.queueHandle, 1u, &submitInfo,
                   appCtx.vkCtx.waitFences[currentFrame]);
 
-    VkPresentInfoKHR presentInfo{VK_STRUCTURE_TYPE_PRESENT_INFO_KHR};
-    presentInfo.waitSemaphoreCount = 1u;
-    presentInfo.pWaitSemaphores =
-            &appCtx.vkCtx.renderCompleteSemaphores[imageIdx];
-    presentInfo.swapchainCount = 1u;
-    presentInfo.pSwapchains = &appCtx.vkCtx.swapchain.swapchainHandle;
-    presentInfo.pImageIndices = &imageIdx;
-    res = vkQueuePresentKHR(appCtx.vkCtx.presentQueue.queueHandle, &presentInfo);
+    if (!appCtx.options.headless) {
+        VkPresentInfoKHR presentInfo{VK_STRUCTURE_TYPE_PRESENT_INFO_KHR};
+        presentInfo.waitSemaphoreCount = 1u;
+        presentInfo.pWaitSemaphores =
+                &appCtx.vkCtx.renderCompleteSemaphores[imageIdx];
+        presentInfo.swapchainCount = 1u;
+        presentInfo.pSwapchains = &appCtx.vkCtx.swapchain.swapchainHandle;
+        presentInfo.pImageIndices = &imageIdx;
+        res = vkQueuePresentKHR(appCtx.vkCtx.presentQueue.queueHandle, &presentInfo);
+    }
 
-    currentFrame = (currentFrame + 1) % SwapChain::MAX_SWAPCHAIN_FRAMES;
+    currentFrame = (currentFrame + 1) % appCtx.vkCtx.swapchain.framesInFlight;
+    ++appCtx.vkCtx.frameCounter;
 }
 
-void loop(AppContext &appCtx) {
-    while (!glfwWindowShouldClose(appCtx.windowCtx.window)) {
-        glfwPollEvents(); // input
+struct StateChangeTiming {
+    double recordMs = {0.0};
+    double gpuMs = {0.0};
+};
+
+// Records drawCount small draws, switching to a different fixed-function state before each one, once with
+// pipelines and once with shader objects + dynamic state. Reports CPU recording and GPU execution time.
+void benchmarkStateChanges(AppContext &appCtx, uint32_t drawCount) {
+    std::vector<PipelineStateKey> states{};
+    for (auto topology : {VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP}) {
+        for (auto cullMode : {VK_CULL_MODE_NONE, VK_CULL_MODE_BACK_BIT, VK_CULL_MODE_FRONT_BIT}) {
+            for (auto frontFace : {VK_FRONT_FACE_COUNTER_CLOCKWISE, VK_FRONT_FACE_CLOCKWISE}) {
+                for (VkBool32 blendEnable : {VK_FALSE, VK_TRUE}) {
+                    PipelineStateKey key = appCtx.modelCtx.pipelineState;
+                    key.depthFormat = VK_FORMAT_UNDEFINED; // the benchmark target has no depth attachment
+                    key.samples = VK_SAMPLE_COUNT_1_BIT;   // and is single sampled
+                    key.topology = topology;
+                    key.cullMode = cullMode;
+                    key.frontFace = frontFace;
+                    key.blendEnable = blendEnable;
+                    key.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+                    key.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+                    states.push_back(canonicalizePipelineState(key));
+                }
+            }
+        }
+    }
+
+    // permutations are compiled up front, this is the stall the shader object path does not have
+    auto compileStart = std::chrono::steady_clock::now();
+    std::vector<VkPipeline> pipelines{};
+    for (auto &state : states) {
+        pipelines.push_back(getOrCreatePipeline(appCtx, state));
+    }
+    double compileMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - compileStart).count();
+
+    VkExtent2D extent{256u, 256u};
+    VkImageCreateInfo targetCI {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = appCtx.modelCtx.pipelineState.colorFormats[0],
+        .extent = {extent.width, extent.height, 1u},
+        .mipLevels = 1u,
+        .arrayLayers = 1u,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+    };
+    VmaAllocationCreateInfo targetAllocCI{.usage = VMA_MEMORY_USAGE_AUTO};
+    VkImage target = VK_NULL_HANDLE;
+    VmaAllocation targetAlloc = VK_NULL_HANDLE;
+    VK_CHECK(vmaCreateImage(appCtx.vkCtx.allocator, &targetCI, &targetAllocCI, &target, &targetAlloc, nullptr),
+             "Failed to create benchmark target");
+    VkImageViewCreateInfo targetViewCI {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = target,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = targetCI.format,
+        .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = 1u, .layerCount = 1u}
+    };
+    VkImageView targetView = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateImageView(appCtx.vkCtx.device, &targetViewCI, nullptr, &targetView),
+             "Failed to create benchmark target view");
+
+    VkQueryPoolCreateInfo queryPoolCI {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = 2u
+    };
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateQueryPool(appCtx.vkCtx.device, &queryPoolCI, nullptr, &queryPool), "Failed to create query pool");
+
+    auto run = [&](bool shaderObjects) -> StateChangeTiming {
+        VkCommandBuffer cmd = beginSingleTimeCommands(appCtx.vkCtx);
+        VkImageMemoryBarrier2 barrier {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
+            .image = target,
+            .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u}
+        };
+        VkDependencyInfo depsInfo {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .imageMemoryBarrierCount = 1u, .pImageMemoryBarriers = &barrier};
+        vkCmdPipelineBarrier2(cmd, &depsInfo);
+        vkCmdResetQueryPool(cmd, queryPool, 0u, 2u);
+        vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, queryPool, 0u);
+
+        VkRenderingAttachmentInfo colorAttachInfo {
+            .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+            .imageView = targetView,
+            .imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
+            .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+            .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE
+        };
+        VkRenderingInfo renderingInfo {
+            .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+            .renderArea = {0, 0, extent.width, extent.height},
+            .layerCount = 1u,
+            .colorAttachmentCount = 1u,
+            .pColorAttachments = &colorAttachInfo
+        };
+        vkCmdBeginRendering(cmd, &renderingInfo);
+        VkViewport viewport{0.0f, 0.0f, (float) extent.width, (float) extent.height, 0.0f, 1.0f};
+        VkRect2D scissor{0, 0, extent.width, extent.height};
+        bindSceneResources(appCtx, cmd);
+        pushMaterial(appCtx, cmd, 0u);
+        if (shaderObjects) {
+            bindShaderObjects(appCtx, cmd, findShaderObjects(appCtx, appCtx.modelCtx.pipelineState.shaderVariant));
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0u; i < drawCount; ++i) {
+            if (shaderObjects) {
+                setShaderObjectState(appCtx, cmd, states[i % states.size()], extent);
+            } else {
+                vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[i % pipelines.size()]);
+                vkCmdSetViewport(cmd, 0u, 1u, &viewport);
+                vkCmdSetScissor(cmd, 0u, 1u, &scissor);
+            }
+            vkCmdDrawIndexed(cmd, 3u, 1u, 0u, 0, 0u);
+        }
+        double recordMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        vkCmdEndRendering(cmd);
+        vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, queryPool, 1u);
+        endSingleTimeCommands(appCtx.vkCtx, cmd);
+
+        std::array<uint64_t, 2> timestamps{};
+        vkGetQueryPoolResults(appCtx.vkCtx.device, queryPool, 0u, 2u, sizeof(timestamps), timestamps.data(),
+                              sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+        double gpuMs = double(timestamps[1] - timestamps[0]) * appCtx.vkCtx.properties.limits.timestampPeriod / 1e6;
+        return {recordMs, gpuMs};
+    };
+
+    std::cout << std::format("[StateBench] {} draws over {} states, pipeline compile {:.2f} ms", drawCount, states.size(), compileMs) << "\n";
+    auto report = [drawCount](const char *path, const StateChangeTiming &timing) {
+        std::cout << std::format("[StateBench] {:<14} record {:8.3f} ms ({:6.1f} ns/change) gpu {:8.3f} ms",
+                                 path, timing.recordMs, timing.recordMs * 1e6 / drawCount, timing.gpuMs) << "\n";
+    };
+    run(false); // warm up driver
+    report("pipelines", run(false));
+    if (appCtx.options.shaderObjects) {
+        run(true);
+        report("shader objects", run(true));
+    } else {
+        std::cout << "[StateBench] shader objects skipped, run with --shader-objects" << std::endl;
+    }
+
+    vkDestroyQueryPool(appCtx.vkCtx.device, queryPool, nullptr);
+    vkDestroyImageView(appCtx.vkCtx.device, targetView, nullptr);
+    vmaDestroyImage(appCtx.vkCtx.allocator, target, targetAlloc);
+}
+
+std::string jsonString(std::string_view value) {
+    std::string escaped = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20u) {
+            escaped += std::format("\\u{:04x}", c);
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped + '"';
+}
+
+// nearest rank percentiles
+std::string jsonPercentiles(std::vector<double> values) {
+    if (values.empty()) {
+        return "null";
+    }
+    std::sort(values.begin(), values.end());
+    auto at = [&values](double p) { return values[std::min(values.size() - 1u, size_t(std::ceil(p * values.size())) - (p > 0.0 ? 1u : 0u))]; };
+    double mean = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+    return std::format("{{\"min\": {:.4f}, \"p50\": {:.4f}, \"p90\": {:.4f}, \"p95\": {:.4f}, \"p99\": {:.4f}, \"max\": {:.4f}, "
+                       "\"mean\": {:.4f}}}", values.front(), at(0.5), at(0.9), at(0.95), at(0.99), values.back(), mean);
+}
+
+std::string_view presentModeName(VkPresentModeKHR mode) {
+    switch (mode) {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+    default: return "other";
+    }
+}
+
+void writeBenchmarkReport(AppContext &appCtx) {
+    auto &options = appCtx.options;
+    auto &profiler = appCtx.profiler;
+    const VkPhysicalDeviceMemoryProperties *memProps = nullptr;
+    vmaGetMemoryProperties(appCtx.vkCtx.allocator, &memProps);
+    std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets{};
+    vmaGetHeapBudgets(appCtx.vkCtx.allocator, budgets.data());
+    VkDeviceSize deviceLocalUsage = 0u;
+    VkDeviceSize allocationBytes = 0u;
+    for (uint32_t heap = 0u; heap < memProps->memoryHeapCount; ++heap) {
+        if (memProps->memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+            deviceLocalUsage += budgets[heap].usage;
+        }
+        allocationBytes += budgets[heap].statistics.allocationBytes;
+    }
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    auto &pools = appCtx.vkCtx.pools;
+
+    std::string startup{};
+    for (auto &[phase, ms] : profiler.startupMs) {
+        startup += std::format("{}{}: {:.3f}", startup.empty() ? "" : ", ", jsonString(phase), ms);
+    }
+    std::string report = std::format(
+        "{{\n"
+        "  \"device\": {},\n"
+        "  \"scene\": {{\"model\": {}, \"instances\": {}, \"width\": {}, \"height\": {}, \"framesInFlight\": {}, "
+        "\"presentMode\": {}, \"headless\": {}, \"shaderObjects\": {}, \"occlusionCulling\": {}, \"depthPrepass\": {}, "
+        "\"gpuBudgetMs\": {}, \"msaa\": {}}},\n"
+        "  \"warmupFrames\": {},\n"
+        "  \"frames\": {},\n"
+        "  \"cpuFrameMs\": {},\n"
+        "  \"cpuWorkMs\": {},\n"
+        "  \"gpuFrameMs\": {},\n"
+        "  \"scenePassMs\": {},\n"
+        "  \"renderScale\": {},\n"
+        "  \"msaaTargets\": {{\"transient\": {}, \"lazilyAllocated\": {}, \"attachmentMiB\": {:.2f}, \"committedMiB\": {:.2f}}},\n"
+        "  \"memory\": {{\"deviceLocalUsageMiB\": {:.2f}, \"allocationMiB\": {:.2f}, \"deviceMemoryMiB\": {:.2f}, "
+        "\"deviceMemoryBlocks\": {}, \"vkAllocateMemoryCalls\": {}, \"peakRssMiB\": {:.2f}}},\n"
+        "  \"startupMs\": {{{}}}\n"
+        "}}\n",
+        jsonString(appCtx.vkCtx.properties.deviceName), jsonString(options.modelPath), options.instanceCount,
+        appCtx.vkCtx.swapchain.extent.width, appCtx.vkCtx.swapchain.extent.height, appCtx.vkCtx.swapchain.framesInFlight,
+        jsonString(options.headless ? "none" : presentModeName(appCtx.vkCtx.swapchain.presentMode)), options.headless,
+        options.shaderObjects, appCtx.culling.enabled, options.depthPrepass, appCtx.resolution.enabled ? options.gpuBudgetMs : 0.0f,
+        uint32_t(appCtx.msaa.samples), options.benchWarmup, profiler.cpuFrameMs.size(), jsonPercentiles(profiler.cpuFrameMs),
+        jsonPercentiles(profiler.cpuWorkMs), jsonPercentiles(profiler.gpuFrameMs), jsonPercentiles(profiler.scenePassMs),
+        jsonPercentiles(profiler.renderScale), appCtx.msaa.transient, appCtx.msaa.lazilyAllocated,
+        appCtx.msaa.attachmentBytes / 1048576.0, multisampleCommittedBytes(appCtx) / 1048576.0, deviceLocalUsage / 1048576.0,
+        allocationBytes / 1048576.0, pools.deviceBytes / 1048576.0, pools.deviceAllocations - pools.deviceFrees,
+        pools.deviceAllocations.load(), usage.ru_maxrss / 1024.0, startup);
+
+    if (options.benchOutput.empty()) {
+        std::cout << report;
+        return;
+    }
+    std::ofstream(options.benchOutput) << report;
+    std::cout << std::format("[Bench] {} frames, report written to {}", profiler.cpuFrameMs.size(), options.benchOutput) << std::endl;
+}
+
+// --bench-frames: draws until the streamed model is resident, warms up, then measures a fixed number of frames
+void runBenchmark(AppContext &appCtx) {
+    constexpr std::chrono::seconds LOAD_TIMEOUT{300};
+    auto &profiler = appCtx.profiler;
+    auto &model = appCtx.modelCtx;
+    createFrameTimestamps(appCtx);
+
+    auto loadStart = std::chrono::steady_clock::now();
+    while (model.drawn.path != model.assetPath) {
+        if (windowShouldClose(appCtx.windowCtx)) {
+            return;
+        }
+        if (std::chrono::steady_clock::now() - loadStart > LOAD_TIMEOUT) {
+            RT_THROW(std::format("{} was not resident after {} s", model.assetPath, LOAD_TIMEOUT.count()));
+        }
+        draw(appCtx);
+    }
+    markStartupPhase(appCtx, "modelResident");
+
+    for (uint32_t frame = 0u; frame < appCtx.options.benchWarmup; ++frame) {
+        draw(appCtx);
+    }
+    markStartupPhase(appCtx, "warmup");
 
+    profiler.measuring = true;
+    for (uint32_t frame = 0u; frame < appCtx.options.benchFrames && !windowShouldClose(appCtx.windowCtx); ++frame) {
+        auto start = std::chrono::steady_clock::now();
         draw(appCtx);
+        double frameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        profiler.cpuFrameMs.push_back(frameMs);
+        profiler.renderScale.push_back(appCtx.resolution.enabled ? appCtx.resolution.scale : 1.0);
+        profiler.cpuWorkMs.push_back(frameMs - profiler.fenceWaitMs);
+    }
+    profiler.measuring = false;
+    vkDeviceWaitIdle(appCtx.vkCtx.device);
+    for (uint32_t frame = 0u; frame < SwapChain::MAX_SWAPCHAIN_FRAMES; ++frame) {
+        readFrameTimestamps(appCtx, frame);
+    }
+    writeBenchmarkReport(appCtx);
+}
+
+void loop(AppContext &appCtx) {
+    while (!windowShouldClose(appCtx.windowCtx)) {
+        draw(appCtx);
+    }
+}
+
+// frames are produced on a render thread while the main thread only pumps GLFW, so a window system stall
+// (drag, resize, compositor) doesn't stop rendering and a fence wait doesn't delay input
+void runRenderThread(AppContext &appCtx, const std::function<void(AppContext&)> &render) {
+    auto &windowCtx = appCtx.windowCtx;
+    if (windowCtx.window == nullptr) {
+        render(appCtx); // headless, there are no events to pump
+        return;
+    }
+    std::atomic<bool> finished{false};
+    std::exception_ptr error{};
+    std::thread renderThread([&] {
+        bindJobMainThread(appCtx.jobs); // main thread jobs touch render thread state
+        try {
+            render(appCtx);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        finished.store(true, std::memory_order_release);
+        glfwPostEmptyEvent();
+    });
+    while (!finished.load(std::memory_order_acquire)) {
+        glfwWaitEvents();
+        if (glfwWindowShouldClose(windowCtx.window) && !windowShouldClose(windowCtx)) {
+            requestClose(windowCtx);
+        }
+    }
+    renderThread.join();
+    if (error) {
+        std::rethrow_exception(error);
     }
 }
 
-int main() {
+int main(int argc, char **argv) {
     AppContext appCtx{};
     try {
+        appCtx.options = parseOptions(argc, argv);
+        appCtx.windowCtx.width = appCtx.options.width;
+        appCtx.windowCtx.height = appCtx.options.height;
         initWindow(appCtx);
+        markStartupPhase(appCtx, "window");
         initVulkan(appCtx);
+        markStartupPhase(appCtx, "vulkan");
+        startPipelineCompiler(appCtx);
+        startJobs(appCtx);
         initResouces(appCtx);
-        loop(appCtx);
+        createDynamicResolution(appCtx);
+        createMultisampleTargets(appCtx);
+        markStartupPhase(appCtx, "resources");
+        if (appCtx.options.benchStateChanges > 0u) {
+            benchmarkStateChanges(appCtx, appCtx.options.benchStateChanges);
+            stopAssetStreamer(appCtx);
+            stopPipelineCompiler(appCtx);
+            stopJobSystem(appCtx.jobs);
+            printPipelineCacheStats(appCtx);
+            return 0;
+        }
+        // no hot reload while measuring, the scene stays fixed
+        if (appCtx.options.benchFrames > 0u) {
+            runRenderThread(appCtx, runBenchmark);
+            stopAssetStreamer(appCtx);
+            stopPipelineCompiler(appCtx);
+            stopJobSystem(appCtx.jobs);
+            return 0;
+        }
+        startShaderHotReload(appCtx);
+        runRenderThread(appCtx, loop);
+        stopShaderHotReload(appCtx);
+        stopAssetStreamer(appCtx);
+        stopPipelineCompiler(appCtx);
+        stopJobSystem(appCtx.jobs);
+        printPipelineCacheStats(appCtx);
         // TODO: add shutdown - release resources
     } catch (std::exception &e) {
         std::cerr << e.what();
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <format>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// read-only mmap of a whole file, shared by the asset loaders
+struct MappedFile {
+    const char *data = nullptr;
+    size_t size = {0u};
+
+    explicit MappedFile(const std::string &path, int advice = MADV_SEQUENTIAL) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error(std::format("Failed to open {}", path));
+        }
+        struct stat info{};
+        if (fstat(fd, &info) != 0) {
+            close(fd);
+            throw std::runtime_error(std::format("Failed to stat {}", path));
+        }
+        size = static_cast<size_t>(info.st_size);
+        if (size > 0u) {
+            void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error(std::format("Failed to map {}", path));
+            }
+            madvise(mapped, size, advice);
+            data = static_cast<const char*>(mapped);
+        }
+        close(fd);
+    }
+    ~MappedFile() {
+        if (data != nullptr) {
+            munmap(const_cast<char*>(data), size);
+        }
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+};
@@ -0,0 +1,599 @@
+#include "obj_loader.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+struct ChunkCounts {
+    uint64_t positions = {0u};
+    uint64_t texcoords = {0u};
+    uint64_t normals = {0u};
+    uint64_t triangles = {0u};
+
+    ChunkCounts &operator+=(const ChunkCounts &other) {
+        positions += other.positions;
+        texcoords += other.texcoords;
+        normals += other.normals;
+        triangles += other.triangles;
+        return *this;
+    }
+};
+
+enum class LineType { Other, Position, Texcoord, Normal, Face, Object, UseMaterial, MaterialLib };
+
+// object/group, usemtl and mtllib lines of a chunk, resolved into submeshes once all chunks are counted
+struct ChunkEvent {
+    LineType type = {LineType::Other};
+    std::string name{};
+    uint64_t triangle = {0u}; // chunk local
+};
+
+struct ChunkScan {
+    ChunkCounts counts{};
+    std::vector<ChunkEvent> events{};
+};
+
+inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline bool isDigit(char c) {
+    return static_cast<unsigned char>(c - '0') < 10u;
+}
+
+// consumes the keyword, p points behind it afterwards
+inline LineType lineType(const char *&p, const char *end) {
+    while (p < end && isBlank(*p)) {
+        ++p;
+    }
+    if (end - p < 2) {
+        return LineType::Other;
+    }
+    if (p[0] == 'v') {
+        if (isBlank(p[1])) {
+            p += 2;
+            return LineType::Position;
+        }
+        if (end - p >= 3 && isBlank(p[2])) {
+            if (p[1] == 't') {
+                p += 3;
+                return LineType::Texcoord;
+            }
+            if (p[1] == 'n') {
+                p += 3;
+                return LineType::Normal;
+            }
+        }
+        return LineType::Other;
+    }
+    if (p[0] == 'f' && isBlank(p[1])) {
+        p += 2;
+        return LineType::Face;
+    }
+    if ((p[0] == 'o' || p[0] == 'g') && isBlank(p[1])) {
+        p += 2;
+        return LineType::Object;
+    }
+    auto keyword = [&](std::string_view word) {
+        size_t length = word.size();
+        return size_t(end - p) > length && std::string_view(p, length) == word && isBlank(p[length]);
+    };
+    if (keyword("usemtl")) {
+        p += 7;
+        return LineType::UseMaterial;
+    }
+    if (keyword("mtllib")) {
+        p += 7;
+        return LineType::MaterialLib;
+    }
+    return LineType::Other;
+}
+
+// rest of the line without surrounding blanks
+inline std::string_view lineName(const char *p, const char *end) {
+    while (p < end && isBlank(*p)) {
+        ++p;
+    }
+    while (end > p && isBlank(end[-1])) {
+        --end;
+    }
+    return {p, static_cast<size_t>(end - p)};
+}
+
+template<typename LineFn>
+void forEachLine(std::string_view chunk, LineFn &&lineFn) {
+    const char *p = chunk.data();
+    const char *end = p + chunk.size();
+    while (p < end) {
+        auto *newline = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(end - p)));
+        const char *lineEnd = newline != nullptr ? newline : end;
+        lineFn(p, lineEnd);
+        p = lineEnd + 1;
+    }
+}
+
+// chunk borders are moved forward to the next newline so no line is split between workers
+std::vector<std::string_view> splitAtLines(const char *data, size_t size, uint32_t chunkCount) {
+    std::vector<std::string_view> chunks{};
+    const char *begin = data;
+    const char *end = data + size;
+    for (uint32_t i = 1u; i <= chunkCount && begin < end; ++i) {
+        const char *split = i == chunkCount ? end : std::max(begin, data + size / chunkCount * i);
+        if (split < end) {
+            auto *newline = static_cast<const char*>(memchr(split, '\n', static_cast<size_t>(end - split)));
+            split = newline != nullptr ? newline + 1 : end;
+        }
+        chunks.emplace_back(begin, static_cast<size_t>(split - begin));
+        begin = split;
+    }
+    return chunks;
+}
+
+template<typename ChunkFn>
+void parallelChunks(size_t chunkCount, ChunkFn &&chunkFn) {
+    std::vector<std::future<void>> jobs{};
+    for (size_t i = 1u; i < chunkCount; ++i) {
+        jobs.push_back(std::async(std::launch::async, [&chunkFn, i] { chunkFn(i); }));
+    }
+    if (chunkCount > 0u) {
+        chunkFn(0u);
+    }
+    for (auto &job : jobs) {
+        job.get(); // rethrows parse errors of the worker
+    }
+}
+
+// SWAR digit parsing, 8 ASCII digits are checked and converted in a few integer ops
+inline uint64_t load8(const char *p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline bool isEightDigits(uint64_t value) {
+    return ((value & 0xF0F0F0F0F0F0F0F0ull) | (((value + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4u)) ==
+           0x3333333333333333ull;
+}
+
+inline uint32_t parseEightDigits(uint64_t value) {
+    value = ((value & 0x0F0F0F0F0F0F0F0Full) * 2561u) >> 8u;
+    value = ((value & 0x00FF00FF00FF00FFull) * 6553601u) >> 16u;
+    return static_cast<uint32_t>(((value & 0x0000FFFF0000FFFFull) * 42949672960001ull) >> 32u);
+}
+
+constexpr double POW10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+inline const char *parseObjInt(const char *p, const char *end, int64_t &value) {
+    bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) {
+        ++p;
+    }
+    if (p == end || !isDigit(*p)) {
+        return nullptr;
+    }
+    int64_t result = 0;
+    while (p < end && isDigit(*p)) {
+        result = result * 10 + (*p - '0');
+        ++p;
+    }
+    value = negative ? -result : result;
+    return p;
+}
+
+// OBJ indices are 1-based, negative ones count back from the last element seen so far
+inline int32_t resolveIndex(int64_t index, uint64_t seen, uint64_t total) {
+    int64_t resolved = index > 0 ? index - 1 : static_cast<int64_t>(seen) + index;
+    if (index == 0 || resolved < 0 || static_cast<uint64_t>(resolved) >= total) {
+        return -2;
+    }
+    return static_cast<int32_t>(resolved);
+}
+
+// v, v/vt, v//vn or v/vt/vn
+inline const char *parseCorner(const char *p, const char *end, const ChunkCounts &seen, const ChunkCounts &total,
+                               ObjIndex &corner) {
+    int64_t index = 0;
+    corner = {};
+    if ((p = parseObjInt(p, end, index)) == nullptr) {
+        return nullptr;
+    }
+    corner.position = resolveIndex(index, seen.positions, total.positions);
+    if (p < end && *p == '/') {
+        ++p;
+        if (p < end && *p != '/') {
+            if ((p = parseObjInt(p, end, index)) == nullptr) {
+                return nullptr;
+            }
+            corner.texcoord = resolveIndex(index, seen.texcoords, total.texcoords);
+        }
+        if (p < end && *p == '/') {
+            ++p;
+            if ((p = parseObjInt(p, end, index)) == nullptr) {
+                return nullptr;
+            }
+            corner.normal = resolveIndex(index, seen.normals, total.normals);
+        }
+    }
+    if (corner.position == -2 || corner.texcoord == -2 || corner.normal == -2) {
+        return nullptr;
+    }
+    return p;
+}
+
+uint64_t countFaceTriangles(const char *p, const char *end) {
+    uint64_t corners = 0u;
+    while (p < end) {
+        while (p < end && isBlank(*p)) {
+            ++p;
+        }
+        if (p < end && *p != '#') {
+            ++corners;
+        } else {
+            break;
+        }
+        while (p < end && !isBlank(*p)) {
+            ++p;
+        }
+    }
+    return corners > 2u ? corners - 2u : 0u;
+}
+
+ChunkScan countChunk(std::string_view chunk) {
+    ChunkScan scan{};
+    auto &counts = scan.counts;
+    forEachLine(chunk, [&](const char *p, const char *end) {
+        switch (LineType type = lineType(p, end)) {
+            case LineType::Position: ++counts.positions; break;
+            case LineType::Texcoord: ++counts.texcoords; break;
+            case LineType::Normal: ++counts.normals; break;
+            case LineType::Face: counts.triangles += countFaceTriangles(p, end); break;
+            case LineType::Object:
+            case LineType::UseMaterial:
+            case LineType::MaterialLib:
+                scan.events.push_back({type, std::string(lineName(p, end)), counts.triangles});
+                break;
+            default: break;
+        }
+    });
+    return scan;
+}
+
+std::array<float, 3> parseColor(const char *p, const char *end) {
+    std::array<float, 3> color{};
+    for (auto &c : color) {
+        if (p == nullptr || (p = parseObjFloat(p, end, c)) == nullptr) {
+            c = 0.0f;
+        }
+    }
+    return color;
+}
+
+// only what the renderer uses, unknown statements are ignored
+void parseMtl(const std::filesystem::path &path, std::vector<ObjMaterial> &materials) {
+    std::ifstream file(path);
+    for (std::string line; std::getline(file, line);) {
+        const char *p = line.data();
+        const char *end = p + line.size();
+        while (p < end && isBlank(*p)) {
+            ++p;
+        }
+        const char *keyEnd = p;
+        while (keyEnd < end && !isBlank(*keyEnd)) {
+            ++keyEnd;
+        }
+        std::string_view key(p, static_cast<size_t>(keyEnd - p));
+        if (key == "newmtl") {
+            materials.push_back({.name = std::string(lineName(keyEnd, end))});
+            continue;
+        }
+        if (materials.empty()) {
+            continue;
+        }
+        auto &material = materials.back();
+        float value = 0.0f;
+        if (key == "Ka") {
+            material.ambient = parseColor(keyEnd, end);
+        } else if (key == "Kd") {
+            material.diffuse = parseColor(keyEnd, end);
+        } else if (key == "Ks") {
+            material.specular = parseColor(keyEnd, end);
+        } else if (key == "Ke") {
+            material.emission = parseColor(keyEnd, end);
+        } else if (key == "Ns" && parseObjFloat(keyEnd, end, value) != nullptr) {
+            material.shininess = value;
+        } else if (key == "d" && parseObjFloat(keyEnd, end, value) != nullptr) {
+            material.opacity = value;
+        } else if (key == "Tr" && parseObjFloat(keyEnd, end, value) != nullptr) {
+            material.opacity = 1.0f - value;
+        } else if (key == "map_Kd") {
+            material.diffuseTexture = std::string(lineName(keyEnd, end));
+        }
+    }
+}
+
+// object/material state carries over chunk borders, so submeshes are cut only after all chunks are counted
+ObjScene buildScene(const std::string &path, const std::vector<ChunkScan> &scans, const std::vector<ChunkCounts> &offsets,
+                    uint64_t triangleCount) {
+    ObjScene scene{.triangleCount = triangleCount};
+    std::vector<std::string> submeshMaterials{};
+    std::string object{};
+    std::string material{};
+    uint64_t start = 0u;
+    auto cut = [&](uint64_t triangle) {
+        if (triangle == start) {
+            return;
+        }
+        if (!scene.submeshes.empty() && scene.submeshes.back().name == object && submeshMaterials.back() == material) {
+            scene.submeshes.back().triangleCount += triangle - start;
+        } else {
+            scene.submeshes.push_back({.name = object, .firstTriangle = start, .triangleCount = triangle - start});
+            submeshMaterials.push_back(material);
+        }
+        start = triangle;
+    };
+    for (size_t i = 0u; i < scans.size(); ++i) {
+        for (auto &event : scans[i].events) {
+            cut(offsets[i].triangles + event.triangle);
+            if (event.type == LineType::Object) {
+                object = event.name;
+            } else if (event.type == LineType::UseMaterial) {
+                material = event.name;
+            } else if (event.type == LineType::MaterialLib) {
+                auto library = std::filesystem::path(path).parent_path() / event.name;
+                if (std::filesystem::exists(library)) {
+                    parseMtl(library, scene.materials);
+                }
+            }
+        }
+    }
+    cut(triangleCount);
+
+    std::unordered_map<std::string, int32_t> materialIndices{};
+    for (size_t i = 0u; i < scene.materials.size(); ++i) {
+        materialIndices.emplace(scene.materials[i].name, static_cast<int32_t>(i));
+    }
+    for (size_t i = 0u; i < scene.submeshes.size(); ++i) {
+        auto it = materialIndices.find(submeshMaterials[i]);
+        scene.submeshes[i].material = it != materialIndices.end() ? it->second : -1;
+    }
+    return scene;
+}
+
+ObjScene streamObjInto(const std::string &path, const ObjSink &sink, const ObjOptions &options, ObjAttributes &attributes) {
+    MappedFile file(path);
+    auto parseError = [&](const char *what, const char *at) {
+        return std::runtime_error(std::format("{}: malformed {} at byte {}", path, what, at - file.data));
+    };
+
+    // at least 1 MiB per worker, small files are not worth starting threads for
+    uint32_t threads = options.threads != 0u ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<uint32_t>(std::clamp<size_t>(file.size >> 20u, 1u, threads));
+    auto chunks = splitAtLines(file.data, file.size, threads);
+
+    // pass 1 counts, so attributes are written in place and faces know their global triangle offset
+    std::vector<ChunkScan> scans(chunks.size());
+    parallelChunks(chunks.size(), [&](size_t i) { scans[i] = countChunk(chunks[i]); });
+    std::vector<ChunkCounts> offsets(chunks.size());
+    ChunkCounts total{};
+    for (size_t i = 0u; i < scans.size(); ++i) {
+        offsets[i] = total;
+        total += scans[i].counts;
+    }
+    ObjScene scene = buildScene(path, scans, offsets, total.triangles);
+    if (total.triangles * 3u > uint64_t(std::numeric_limits<uint32_t>::max()) ||
+        total.positions > uint64_t(std::numeric_limits<int32_t>::max())) {
+        throw std::runtime_error(std::format("{}: too large for 32 bit indices", path));
+    }
+
+    // pass 2 vertex attributes, faces may reference vertices of any earlier chunk
+    attributes.positions.resize(total.positions * 3u);
+    attributes.texcoords.resize(total.texcoords * 2u);
+    attributes.normals.resize(total.normals * 3u);
+    parallelChunks(chunks.size(), [&](size_t i) {
+        float *position = attributes.positions.data() + offsets[i].positions * 3u;
+        float *texcoord = attributes.texcoords.data() + offsets[i].texcoords * 2u;
+        float *normal = attributes.normals.data() + offsets[i].normals * 3u;
+        forEachLine(chunks[i], [&](const char *p, const char *end) {
+            switch (lineType(p, end)) {
+                case LineType::Position:
+                    for (uint32_t c = 0u; c < 3u; ++c) {
+                        if ((p = parseObjFloat(p, end, *position++)) == nullptr) {
+                            throw parseError("vertex", end);
+                        }
+                    }
+                    break;
+                case LineType::Texcoord:
+                    if ((p = parseObjFloat(p, end, texcoord[0])) == nullptr) {
+                        throw parseError("texture coordinate", end);
+                    }
+                    if (parseObjFloat(p, end, texcoord[1]) == nullptr) {
+                        texcoord[1] = 0.0f; // 1D texture coordinate
+                    }
+                    texcoord += 2;
+                    break;
+                case LineType::Normal:
+                    for (uint32_t c = 0u; c < 3u; ++c) {
+                        if ((p = parseObjFloat(p, end, *normal++)) == nullptr) {
+                            throw parseError("normal", end);
+                        }
+                    }
+                    break;
+                default:
+                    break;
+            }
+        });
+    });
+
+    if (sink.begin) {
+        sink.begin(attributes, scene);
+    }
+
+    // pass 3 faces, each worker only holds one batch
+    parallelChunks(chunks.size(), [&](size_t i) {
+        ChunkCounts seen = offsets[i];
+        std::vector<ObjIndex> batch{};
+        batch.reserve(size_t(options.batchTriangles) * 3u);
+        std::vector<ObjIndex> polygon{};
+        uint64_t firstTriangle = offsets[i].triangles;
+        auto flush = [&] {
+            if (!batch.empty() && sink.faces) {
+                sink.faces({firstTriangle, batch});
+            }
+            firstTriangle += batch.size() / 3u;
+            batch.clear();
+        };
+        forEachLine(chunks[i], [&](const char *p, const char *end) {
+            switch (lineType(p, end)) {
+                case LineType::Position: ++seen.positions; break;
+                case LineType::Texcoord: ++seen.texcoords; break;
+                case LineType::Normal: ++seen.normals; break;
+                case LineType::Face: {
+                    polygon.clear();
+                    while (true) {
+                        while (p < end && isBlank(*p)) {
+                            ++p;
+                        }
+                        if (p == end || *p == '#') {
+                            break;
+                        }
+                        ObjIndex corner{};
+                        const char *next = parseCorner(p, end, seen, total, corner);
+                        if (next == nullptr) {
+                            throw parseError("face", p);
+                        }
+                        polygon.push_back(corner);
+                        p = next;
+                    }
+                    // triangle fan, same as tinyobj's default triangulation
+                    for (size_t c = 2u; c < polygon.size(); ++c) {
+                        batch.push_back(polygon[0]);
+                        batch.push_back(polygon[c - 1u]);
+                        batch.push_back(polygon[c]);
+                    }
+                    if (batch.size() >= size_t(options.batchTriangles) * 3u) {
+                        flush();
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        });
+        flush();
+    });
+    return scene;
+}
+
+} // namespace
+
+const char *parseObjFloat(const char *p, const char *end, float &value) {
+    while (p < end && isBlank(*p)) {
+        ++p;
+    }
+    const char *start = p;
+    bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) {
+        ++p;
+    }
+
+    uint64_t mantissa = 0u;
+    uint32_t digits = 0u;
+    int32_t exponent = 0;
+    bool truncated = false;
+    auto takeDigits = [&](bool fraction) {
+        while (end - p >= 8 && digits <= 11u) { // 8 more digits still fit into 19
+            uint64_t eight = load8(p);
+            if (!isEightDigits(eight)) {
+                break;
+            }
+            mantissa = mantissa * 100000000u + parseEightDigits(eight);
+            digits += 8u;
+            exponent -= fraction ? 8 : 0;
+            p += 8;
+        }
+        while (p < end && isDigit(*p)) {
+            if (digits < 19u) {
+                mantissa = mantissa * 10u + static_cast<uint64_t>(*p - '0');
+                ++digits;
+                exponent -= fraction ? 1 : 0;
+            } else {
+                truncated = true;
+                exponent += fraction ? 0 : 1;
+            }
+            ++p;
+        }
+    };
+
+    const char *integer = p;
+    takeDigits(false);
+    bool hasDigits = p != integer;
+    if (p < end && *p == '.') {
+        ++p;
+        const char *fraction = p;
+        takeDigits(true);
+        hasDigits |= p != fraction;
+    }
+    bool exact = hasDigits && !truncated;
+    if (exact && p < end && (*p == 'e' || *p == 'E')) {
+        int64_t exp10 = 0;
+        const char *next = parseObjInt(p + 1, end, exp10);
+        exact = next != nullptr && exp10 > -1000 && exp10 < 1000;
+        if (exact) {
+            exponent += static_cast<int32_t>(exp10);
+            p = next;
+        }
+    }
+    if (exact && mantissa < (1ull << 53u) && exponent >= -22 && exponent <= 22) {
+        double result = static_cast<double>(mantissa);
+        result = exponent < 0 ? result / POW10[-exponent] : result * POW10[exponent];
+        // result is the correctly rounded double, narrowing rounds a second time. That only goes wrong when the double
+        // sits exactly between two floats, those and results outside the normal float range take the from_chars path
+        uint64_t bits = std::bit_cast<uint64_t>(result);
+        bool midpoint = (bits & ((1ull << 29u) - 1u)) == (1ull << 28u);
+        bool normal = result >= std::numeric_limits<float>::min() && result <= std::numeric_limits<float>::max();
+        if (result == 0.0 || (normal && !midpoint)) {
+            value = static_cast<float>(negative ? -result : result);
+            return p;
+        }
+    }
+
+    // long mantissas, large exponents, inf/nan
+    if (start < end && *start == '+') {
+        ++start;
+    }
+    auto [next, error] = std::from_chars(start, end, value);
+    return error == std::errc() ? next : nullptr;
+}
+
+ObjScene streamObj(const std::string &path, const ObjSink &sink, const ObjOptions &options) {
+    ObjAttributes attributes{};
+    return streamObjInto(path, sink, options, attributes);
+}
+
+ObjMesh loadObj(const std::string &path, const ObjOptions &options) {
+    ObjMesh mesh{};
+    ObjSink sink {
+        .begin = [&mesh](const ObjAttributes &, const ObjScene &scene) {
+            mesh.corners.resize(scene.triangleCount * 3u);
+        },
+        .faces = [&mesh](const ObjFaceBatch &batch) {
+            std::copy(batch.corners.begin(), batch.corners.end(), mesh.corners.begin() + batch.firstTriangle * 3u);
+        }
+    };
+    mesh.scene = streamObjInto(path, sink, options, mesh.attributes);
+    return mesh;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <vector>
+
+// mmap based OBJ front end, the file is split at line boundaries and parsed by worker threads.
+// Faces are streamed to the caller in batches so the corner list never has to exist as a whole. Attributes are
+// still read in full, and so is whatever the sink builds from the batches, e.g. expanded vertices.
+
+struct ObjIndex {
+    int32_t position = {-1}; // 0-based, -1 when missing
+    int32_t texcoord = {-1};
+    int32_t normal = {-1};
+};
+
+struct ObjAttributes {
+    std::vector<float> positions{}; // xyz
+    std::vector<float> texcoords{}; // uv
+    std::vector<float> normals{};   // xyz
+};
+
+struct ObjMaterial {
+    std::string name{};
+    std::array<float, 3> ambient{0.0f, 0.0f, 0.0f};
+    std::array<float, 3> diffuse{0.8f, 0.8f, 0.8f};
+    std::array<float, 3> specular{0.0f, 0.0f, 0.0f};
+    std::array<float, 3> emission{0.0f, 0.0f, 0.0f};
+    float shininess = {0.0f};
+    float opacity = {1.0f};
+    std::string diffuseTexture{}; // relative to the OBJ file
+};
+
+// contiguous triangle range sharing object/group name and material
+struct ObjSubmesh {
+    std::string name{};
+    int32_t material = {-1}; // index into ObjScene::materials, -1 without usemtl or unknown material
+    uint64_t firstTriangle = {0u};
+    uint64_t triangleCount = {0u};
+};
+
+struct ObjScene {
+    std::vector<ObjMaterial> materials{}; // from all mtllib files, missing libraries are skipped
+    std::vector<ObjSubmesh> submeshes{};  // in file order, covering all triangles
+    uint64_t triangleCount = {0u};
+};
+
+// triangulated faces, 3 corners per triangle starting at firstTriangle of the whole file
+struct ObjFaceBatch {
+    uint64_t firstTriangle = {0u};
+    std::span<const ObjIndex> corners{};
+};
+
+// begin runs once before any batch, faces runs concurrently from the workers with disjoint triangle ranges
+struct ObjSink {
+    std::function<void(const ObjAttributes &attributes, const ObjScene &scene)> begin{};
+    std::function<void(const ObjFaceBatch &batch)> faces{};
+};
+
+struct ObjOptions {
+    uint32_t threads = {0u};             // 0 = hardware concurrency
+    uint32_t batchTriangles = {1u << 16}; // bounds the face batch each worker holds while streaming
+};
+
+struct ObjMesh {
+    ObjAttributes attributes{};
+    ObjScene scene{};
+    std::vector<ObjIndex> corners{}; // 3 per triangle
+};
+
+// throws std::runtime_error on I/O or parse errors
+ObjScene streamObj(const std::string &path, const ObjSink &sink, const ObjOptions &options = {});
+
+// whole file in memory, convenience wrapper around streamObj
+ObjMesh loadObj(const std::string &path, const ObjOptions &options = {});
+
+// correctly rounded like std::from_chars, with a fast path for plain decimal floats; exposed for benchmarks
+const char *parseObjFloat(const char *p, const char *end, float &value);
@@ -0,0 +1,196 @@
+#include "offset_allocator.h"
+
+#include <bit>
+
+namespace {
+
+constexpr uint32_t MANTISSA_BITS = {3u};
+constexpr uint32_t MANTISSA_VALUE = {1u << MANTISSA_BITS};
+constexpr uint32_t MANTISSA_MASK = {MANTISSA_VALUE - 1u};
+
+// bin of the smallest size class that holds size, used to find a region large enough
+uint32_t binRoundUp(uint32_t size) {
+    if (size < MANTISSA_VALUE) {
+        return size;
+    }
+    uint32_t mantissaStart = 31u - uint32_t(std::countl_zero(size)) - MANTISSA_BITS;
+    uint32_t mantissa = (size >> mantissaStart) & MANTISSA_MASK;
+    uint32_t bin = ((mantissaStart + 1u) << MANTISSA_BITS) + mantissa;
+    // a carry out of the mantissa moves into the next exponent, which is the next bin
+    return (size & ((1u << mantissaStart) - 1u)) != 0u ? bin + 1u : bin;
+}
+
+// bin of the largest size class not above size, free regions are filed there
+uint32_t binRoundDown(uint32_t size) {
+    if (size < MANTISSA_VALUE) {
+        return size;
+    }
+    uint32_t mantissaStart = 31u - uint32_t(std::countl_zero(size)) - MANTISSA_BITS;
+    return ((mantissaStart + 1u) << MANTISSA_BITS) + ((size >> mantissaStart) & MANTISSA_MASK);
+}
+
+uint32_t binSize(uint32_t bin) {
+    uint32_t exponent = bin >> MANTISSA_BITS;
+    uint32_t mantissa = bin & MANTISSA_MASK;
+    return exponent == 0u ? mantissa : (mantissa | MANTISSA_VALUE) << (exponent - 1u);
+}
+
+uint32_t lowestBitAfter(uint32_t mask, uint32_t start) {
+    if (start >= 32u) {
+        return OFFSET_ALLOCATOR_NO_SPACE;
+    }
+    uint32_t masked = mask & ~((1u << start) - 1u);
+    return masked == 0u ? OFFSET_ALLOCATOR_NO_SPACE : uint32_t(std::countr_zero(masked));
+}
+
+uint32_t insertNode(OffsetAllocator &allocator, uint32_t size, uint32_t offset) {
+    uint32_t bin = binRoundDown(size);
+    uint32_t top = bin / OffsetAllocator::BINS_PER_LEAF;
+    uint32_t leaf = bin % OffsetAllocator::BINS_PER_LEAF;
+    if (allocator.binIndices[bin] == OFFSET_ALLOCATOR_NO_SPACE) {
+        allocator.usedBins[top] |= uint8_t(1u << leaf);
+        allocator.usedBinsTop |= 1u << top;
+    }
+    uint32_t head = allocator.binIndices[bin];
+    uint32_t index = allocator.freeNodes.back();
+    allocator.freeNodes.pop_back();
+    allocator.nodes[index] = {.dataOffset = offset, .dataSize = size, .binListNext = head};
+    if (head != OFFSET_ALLOCATOR_NO_SPACE) {
+        allocator.nodes[head].binListPrev = index;
+    }
+    allocator.binIndices[bin] = index;
+    allocator.freeStorage += size;
+    return index;
+}
+
+void removeNode(OffsetAllocator &allocator, uint32_t index) {
+    auto &node = allocator.nodes[index];
+    if (node.binListPrev != OFFSET_ALLOCATOR_NO_SPACE) {
+        allocator.nodes[node.binListPrev].binListNext = node.binListNext;
+        if (node.binListNext != OFFSET_ALLOCATOR_NO_SPACE) {
+            allocator.nodes[node.binListNext].binListPrev = node.binListPrev;
+        }
+    } else {
+        // head of its bin
+        uint32_t bin = binRoundDown(node.dataSize);
+        allocator.binIndices[bin] = node.binListNext;
+        if (node.binListNext != OFFSET_ALLOCATOR_NO_SPACE) {
+            allocator.nodes[node.binListNext].binListPrev = OFFSET_ALLOCATOR_NO_SPACE;
+        } else {
+            uint32_t top = bin / OffsetAllocator::BINS_PER_LEAF;
+            allocator.usedBins[top] &= uint8_t(~(1u << (bin % OffsetAllocator::BINS_PER_LEAF)));
+            if (allocator.usedBins[top] == 0u) {
+                allocator.usedBinsTop &= ~(1u << top);
+            }
+        }
+    }
+    allocator.freeNodes.push_back(index);
+    allocator.freeStorage -= node.dataSize;
+}
+
+} // namespace
+
+OffsetAllocator createOffsetAllocator(uint32_t size, uint32_t maxAllocations) {
+    OffsetAllocator allocator{.size = size};
+    allocator.binIndices.fill(OFFSET_ALLOCATOR_NO_SPACE);
+    allocator.nodes.resize(maxAllocations);
+    allocator.freeNodes.reserve(maxAllocations);
+    for (uint32_t i = maxAllocations; i > 0u; --i) {
+        allocator.freeNodes.push_back(i - 1u);
+    }
+    insertNode(allocator, size, 0u);
+    return allocator;
+}
+
+OffsetAllocation offsetAllocate(OffsetAllocator &allocator, uint32_t size) {
+    // a split needs a second node
+    if (size == 0u || allocator.freeNodes.size() < 2u) {
+        return {};
+    }
+    uint32_t minBin = binRoundUp(size);
+    uint32_t top = minBin / OffsetAllocator::BINS_PER_LEAF;
+    uint32_t leaf = OFFSET_ALLOCATOR_NO_SPACE;
+    if (allocator.usedBinsTop & (1u << top)) {
+        leaf = lowestBitAfter(allocator.usedBins[top], minBin % OffsetAllocator::BINS_PER_LEAF);
+    }
+    if (leaf == OFFSET_ALLOCATOR_NO_SPACE) {
+        top = lowestBitAfter(allocator.usedBinsTop, top + 1u);
+        if (top == OFFSET_ALLOCATOR_NO_SPACE) {
+            return {};
+        }
+        leaf = uint32_t(std::countr_zero(uint32_t(allocator.usedBins[top])));
+    }
+
+    // every region in the bin is large enough, take the head
+    uint32_t index = allocator.binIndices[top * OffsetAllocator::BINS_PER_LEAF + leaf];
+    uint32_t regionSize = allocator.nodes[index].dataSize;
+    removeNode(allocator, index);
+    allocator.freeNodes.pop_back(); // removeNode released it, it stays in use
+    auto &node = allocator.nodes[index];
+    node.dataSize = size;
+    node.used = true;
+    node.binListPrev = OFFSET_ALLOCATOR_NO_SPACE;
+    node.binListNext = OFFSET_ALLOCATOR_NO_SPACE;
+
+    if (regionSize > size) {
+        uint32_t rest = insertNode(allocator, regionSize - size, node.dataOffset + size);
+        auto &allocated = allocator.nodes[index];
+        if (allocated.neighborNext != OFFSET_ALLOCATOR_NO_SPACE) {
+            allocator.nodes[allocated.neighborNext].neighborPrev = rest;
+        }
+        allocator.nodes[rest].neighborPrev = index;
+        allocator.nodes[rest].neighborNext = allocated.neighborNext;
+        allocated.neighborNext = rest;
+    }
+    return {.offset = allocator.nodes[index].dataOffset, .metadata = index};
+}
+
+void offsetFree(OffsetAllocator &allocator, OffsetAllocation allocation) {
+    if (allocation.metadata == OFFSET_ALLOCATOR_NO_SPACE) {
+        return;
+    }
+    OffsetAllocator::Node node = allocator.nodes[allocation.metadata];
+    uint32_t offset = node.dataOffset;
+    uint32_t size = node.dataSize;
+    if (node.neighborPrev != OFFSET_ALLOCATOR_NO_SPACE && !allocator.nodes[node.neighborPrev].used) {
+        auto &prev = allocator.nodes[node.neighborPrev];
+        offset = prev.dataOffset;
+        size += prev.dataSize;
+        uint32_t prevIndex = node.neighborPrev;
+        node.neighborPrev = prev.neighborPrev;
+        removeNode(allocator, prevIndex);
+    }
+    if (node.neighborNext != OFFSET_ALLOCATOR_NO_SPACE && !allocator.nodes[node.neighborNext].used) {
+        auto &next = allocator.nodes[node.neighborNext];
+        size += next.dataSize;
+        uint32_t nextIndex = node.neighborNext;
+        node.neighborNext = next.neighborNext;
+        removeNode(allocator, nextIndex);
+    }
+    allocator.nodes[allocation.metadata].used = false;
+    allocator.freeNodes.push_back(allocation.metadata);
+
+    uint32_t merged = insertNode(allocator, size, offset);
+    allocator.nodes[merged].neighborPrev = node.neighborPrev;
+    allocator.nodes[merged].neighborNext = node.neighborNext;
+    if (node.neighborPrev != OFFSET_ALLOCATOR_NO_SPACE) {
+        allocator.nodes[node.neighborPrev].neighborNext = merged;
+    }
+    if (node.neighborNext != OFFSET_ALLOCATOR_NO_SPACE) {
+        allocator.nodes[node.neighborNext].neighborPrev = merged;
+    }
+}
+
+uint32_t offsetAllocationSize(const OffsetAllocator &allocator, OffsetAllocation allocation) {
+    return allocation.metadata == OFFSET_ALLOCATOR_NO_SPACE ? 0u : allocator.nodes[allocation.metadata].dataSize;
+}
+
+OffsetAllocatorReport offsetAllocatorReport(const OffsetAllocator &allocator) {
+    OffsetAllocatorReport report{.totalFreeSpace = allocator.freeStorage};
+    if (allocator.usedBinsTop != 0u) {
+        uint32_t top = 31u - uint32_t(std::countl_zero(allocator.usedBinsTop));
+        uint32_t leaf = 31u - uint32_t(std::countl_zero(uint32_t(allocator.usedBins[top])));
+        report.largestFreeRegion = binSize(top * OffsetAllocator::BINS_PER_LEAF + leaf);
+    }
+    return report;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// TLSF style allocator of offsets into an externally owned range, e.g. a GPU buffer. Free regions are kept in 256
+// bins indexed by a small float of their size (5 bit exponent, 3 bit mantissa) with a two level bitmask on top,
+// so allocate and free are O(1) and neighbouring free regions are merged on free.
+
+constexpr uint32_t OFFSET_ALLOCATOR_NO_SPACE = {0xffffffffu};
+
+struct OffsetAllocation {
+    uint32_t offset = {OFFSET_ALLOCATOR_NO_SPACE};
+    uint32_t metadata = {OFFSET_ALLOCATOR_NO_SPACE}; // node index, needed to free
+};
+
+struct OffsetAllocator {
+    static constexpr uint32_t TOP_BINS = {32u};
+    static constexpr uint32_t BINS_PER_LEAF = {8u};
+    static constexpr uint32_t LEAF_BINS = {TOP_BINS * BINS_PER_LEAF};
+
+    struct Node {
+        uint32_t dataOffset = {0u};
+        uint32_t dataSize = {0u};
+        uint32_t binListPrev = {OFFSET_ALLOCATOR_NO_SPACE};
+        uint32_t binListNext = {OFFSET_ALLOCATOR_NO_SPACE};
+        uint32_t neighborPrev = {OFFSET_ALLOCATOR_NO_SPACE};
+        uint32_t neighborNext = {OFFSET_ALLOCATOR_NO_SPACE};
+        bool used = {false};
+    };
+
+    uint32_t size = {0u};
+    uint32_t freeStorage = {0u};
+    uint32_t usedBinsTop = {0u};
+    std::array<uint8_t, TOP_BINS> usedBins{};
+    std::array<uint32_t, LEAF_BINS> binIndices{};
+    std::vector<Node> nodes{};
+    std::vector<uint32_t> freeNodes{}; // stack of unused node indices
+};
+
+struct OffsetAllocatorReport {
+    uint32_t totalFreeSpace = {0u};
+    uint32_t largestFreeRegion = {0u}; // lower bound, exact up to the bin granularity
+};
+
+// size units are up to the caller, maxAllocations bounds allocations plus free regions
+OffsetAllocator createOffsetAllocator(uint32_t size, uint32_t maxAllocations = 128u * 1024u);
+
+// offset is OFFSET_ALLOCATOR_NO_SPACE when no free region is large enough or the nodes ran out
+OffsetAllocation offsetAllocate(OffsetAllocator &allocator, uint32_t size);
+
+void offsetFree(OffsetAllocator &allocator, OffsetAllocation allocation);
+
+uint32_t offsetAllocationSize(const OffsetAllocator &allocator, OffsetAllocation allocation);
+
+OffsetAllocatorReport offsetAllocatorReport(const OffsetAllocator &allocator);
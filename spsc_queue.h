@@ -0,0 +1,41 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Bounded lock-free queue between exactly one producer thread and one consumer thread.
+// head and tail count up freely and wrap through the mask, so a full queue doesn't need a spare slot.
+
+template <typename T, uint32_t Capacity>
+struct SpscQueue {
+    static_assert(Capacity > 0u && (Capacity & (Capacity - 1u)) == 0u, "Capacity must be a power of two");
+
+    std::array<T, Capacity> slots{};
+    alignas(64) std::atomic<uint32_t> head{0u}; // next slot to write, only the producer stores it
+    alignas(64) std::atomic<uint32_t> tail{0u}; // next slot to read, only the consumer stores it
+};
+
+// producer side, false when the queue is full and the value was dropped
+template <typename T, uint32_t Capacity>
+bool spscPush(SpscQueue<T, Capacity> &queue, const T &value) {
+    uint32_t head = queue.head.load(std::memory_order_relaxed);
+    if (head - queue.tail.load(std::memory_order_acquire) == Capacity) {
+        return false;
+    }
+    queue.slots[head & (Capacity - 1u)] = value;
+    queue.head.store(head + 1u, std::memory_order_release);
+    return true;
+}
+
+// consumer side, false when the queue is empty
+template <typename T, uint32_t Capacity>
+bool spscPop(SpscQueue<T, Capacity> &queue, T &value) {
+    uint32_t tail = queue.tail.load(std::memory_order_relaxed);
+    if (tail == queue.head.load(std::memory_order_acquire)) {
+        return false;
+    }
+    value = queue.slots[tail & (Capacity - 1u)];
+    queue.tail.store(tail + 1u, std::memory_order_release);
+    return true;
+}
@@ -0,0 +1,138 @@
+// offset allocator against a brute force model: allocations never overlap, freed neighbours merge back into one
+// region and requests that can't be met report OFFSET_ALLOCATOR_NO_SPACE
+
+#include "offset_allocator.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#define CHECK(condition)                                                                          \
+    do {                                                                                          \
+        if (!(condition)) {                                                                       \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);    \
+            std::exit(1);                                                                         \
+        }                                                                                         \
+    } while (false)
+
+namespace {
+
+constexpr uint32_t SIZE = {1u << 20};
+
+void allocateAndFree() {
+    OffsetAllocator allocator = createOffsetAllocator(SIZE);
+    OffsetAllocation a = offsetAllocate(allocator, 100u);
+    OffsetAllocation b = offsetAllocate(allocator, 200u);
+    CHECK(a.offset == 0u && b.offset == 100u);
+    CHECK(offsetAllocationSize(allocator, a) == 100u && offsetAllocationSize(allocator, b) == 200u);
+    CHECK(offsetAllocatorReport(allocator).totalFreeSpace == SIZE - 300u);
+
+    // a freed region is handed out again
+    offsetFree(allocator, a);
+    OffsetAllocation c = offsetAllocate(allocator, 100u);
+    CHECK(c.offset != OFFSET_ALLOCATOR_NO_SPACE && offsetAllocatorReport(allocator).totalFreeSpace == SIZE - 300u);
+    offsetFree(allocator, b);
+    offsetFree(allocator, c);
+    CHECK(offsetAllocatorReport(allocator).totalFreeSpace == SIZE);
+}
+
+void coalesce() {
+    OffsetAllocator allocator = createOffsetAllocator(SIZE);
+    std::vector<OffsetAllocation> quarters{};
+    for (uint32_t i = 0u; i < 4u; ++i) {
+        quarters.push_back(offsetAllocate(allocator, SIZE / 4u));
+        CHECK(quarters.back().offset == i * (SIZE / 4u));
+    }
+    CHECK(offsetAllocatorReport(allocator).totalFreeSpace == 0u);
+
+    // free the outer ones first, the middle frees merge with both neighbours
+    for (uint32_t i : {0u, 3u, 1u, 2u}) {
+        offsetFree(allocator, quarters[i]);
+    }
+    OffsetAllocatorReport report = offsetAllocatorReport(allocator);
+    CHECK(report.totalFreeSpace == SIZE && report.largestFreeRegion == SIZE);
+    OffsetAllocation whole = offsetAllocate(allocator, SIZE);
+    CHECK(whole.offset == 0u);
+    offsetFree(allocator, whole);
+}
+
+void outOfSpace() {
+    OffsetAllocator allocator = createOffsetAllocator(SIZE);
+    CHECK(offsetAllocate(allocator, SIZE + 1u).offset == OFFSET_ALLOCATOR_NO_SPACE);
+    CHECK(offsetAllocate(allocator, 0u).offset == OFFSET_ALLOCATOR_NO_SPACE);
+
+    OffsetAllocation whole = offsetAllocate(allocator, SIZE);
+    CHECK(whole.offset == 0u);
+    OffsetAllocation none = offsetAllocate(allocator, 1u);
+    CHECK(none.offset == OFFSET_ALLOCATOR_NO_SPACE && none.metadata == OFFSET_ALLOCATOR_NO_SPACE);
+    offsetFree(allocator, none); // no-op
+    offsetFree(allocator, whole);
+    CHECK(offsetAllocate(allocator, 1u).offset == 0u);
+
+    // plenty of space but no nodes left to describe it
+    OffsetAllocator few = createOffsetAllocator(SIZE, 4u);
+    uint32_t allocated = 0u;
+    while (offsetAllocate(few, 16u).offset != OFFSET_ALLOCATOR_NO_SPACE) {
+        ++allocated;
+        CHECK(allocated < 4u);
+    }
+    CHECK(offsetAllocatorReport(few).totalFreeSpace > 16u);
+}
+
+// random sizes, interleaved frees, every live range checked against the others
+void randomized() {
+    struct Live {
+        OffsetAllocation allocation;
+        uint32_t size;
+    };
+    OffsetAllocator allocator = createOffsetAllocator(SIZE);
+    std::mt19937 rng{42u};
+    std::vector<Live> live{};
+    uint32_t liveBytes = 0u;
+    for (uint32_t step = 0u; step < 20000u; ++step) {
+        if (!live.empty() && rng() % 3u == 0u) {
+            size_t i = rng() % live.size();
+            offsetFree(allocator, live[i].allocation);
+            liveBytes -= live[i].size;
+            live[i] = live.back();
+            live.pop_back();
+        } else {
+            uint32_t size = 1u + rng() % (rng() % 8u == 0u ? 65536u : 512u);
+            OffsetAllocation allocation = offsetAllocate(allocator, size);
+            if (allocation.offset == OFFSET_ALLOCATOR_NO_SPACE) {
+                // only fails when no bin that guarantees size has a region, its lower bound is then below size
+                CHECK(offsetAllocatorReport(allocator).largestFreeRegion < size);
+                continue;
+            }
+            CHECK(allocation.offset + size <= SIZE);
+            live.push_back({allocation, size});
+            liveBytes += size;
+        }
+        CHECK(offsetAllocatorReport(allocator).totalFreeSpace == SIZE - liveBytes);
+        if (step % 1000u == 0u) {
+            std::vector<Live> sorted = live;
+            std::sort(sorted.begin(), sorted.end(), [](const Live &a, const Live &b) { return a.allocation.offset < b.allocation.offset; });
+            for (size_t i = 1u; i < sorted.size(); ++i) {
+                CHECK(sorted[i - 1u].allocation.offset + sorted[i - 1u].size <= sorted[i].allocation.offset);
+            }
+        }
+    }
+    for (Live &entry : live) {
+        offsetFree(allocator, entry.allocation);
+    }
+    CHECK(offsetAllocatorReport(allocator).totalFreeSpace == SIZE);
+    CHECK(offsetAllocate(allocator, SIZE).offset == 0u);
+}
+
+}
+
+int main() {
+    allocateAndFree();
+    coalesce();
+    outOfSpace();
+    randomized();
+    std::printf("offset_allocator_test passed\n");
+    return 0;
+}